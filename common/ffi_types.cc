@@ -4,6 +4,9 @@
 
 #include "common/ffi_types.h"
 
+#include <optional>
+#include <utility>
+
 #include "absl/strings/string_view.h"
 
 namespace crubit {
@@ -19,4 +22,25 @@ absl::string_view StringViewFromFfiU8Slice(FfiU8Slice ffi_u8_slice) {
   return absl::string_view(ffi_u8_slice.ptr, ffi_u8_slice.size);
 }
 
+FfiString::FfiString(FfiString&& other) noexcept
+    : string_(std::move(other.string_)),
+      box_(std::exchange(other.box_, std::nullopt)) {}
+
+FfiString& FfiString::operator=(FfiString&& other) noexcept {
+  if (this != &other) {
+    if (box_.has_value()) {
+      FreeFfiU8SliceBox(*box_);
+    }
+    string_ = std::move(other.string_);
+    box_ = std::exchange(other.box_, std::nullopt);
+  }
+  return *this;
+}
+
+FfiString::~FfiString() {
+  if (box_.has_value()) {
+    FreeFfiU8SliceBox(*box_);
+  }
+}
+
 }  // namespace crubit
@@ -6,6 +6,9 @@
 #define CRUBIT_COMMON_FFI_TYPES_H_
 
 #include <cstddef>
+#include <optional>
+#include <string>
+#include <utility>
 
 #include "absl/strings/string_view.h"
 
@@ -39,6 +42,33 @@ extern "C" FfiU8SliceBox AllocFfiU8SliceBox(FfiU8Slice ffi_u8_slice);
 // Implemented in Rust.
 extern "C" void FreeFfiU8SliceBox(FfiU8SliceBox);
 
+// A string that is either a `std::string`, or a Rust-allocated `FfiU8SliceBox`
+// that is freed when the `FfiString` is destroyed. This lets the strings
+// returned by Rust be passed around (and written out) without copying them.
+class FfiString {
+ public:
+  FfiString() = default;
+  explicit FfiString(std::string s) : string_(std::move(s)) {}
+  explicit FfiString(const char* s) : string_(s) {}
+  // Takes ownership of `box`.
+  explicit FfiString(FfiU8SliceBox box) : box_(box) {}
+
+  FfiString(FfiString&& other) noexcept;
+  FfiString& operator=(FfiString&& other) noexcept;
+  FfiString(const FfiString&) = delete;
+  FfiString& operator=(const FfiString&) = delete;
+  ~FfiString();
+
+  absl::string_view view() const {
+    return box_.has_value() ? absl::string_view(box_->ptr, box_->size)
+                            : absl::string_view(string_);
+  }
+
+ private:
+  std::string string_;
+  std::optional<FfiU8SliceBox> box_;
+};
+
 // Whether or not the generated binding will have doc comments indicating their
 // source location.
 enum SourceLocationDocComment {
@@ -46,6 +76,15 @@ enum SourceLocationDocComment {
   Enabled,
 };
 
+// How the generated Rust source code is formatted.
+enum RustFormatting {
+  // Runs the generated code through the `rustfmt` executable.
+  Rustfmt,
+  // Lays out the generated code with a cheap, built-in printer. The output is
+  // readable, but not `rustfmt`-clean.
+  BuiltinLayout,
+};
+
 }  // namespace crubit
 
 #endif  // CRUBIT_COMMON_FFI_TYPES_H_
@@ -100,6 +100,17 @@ pub enum SourceLocationDocComment {
     Enabled,
 }
 
+/// How the generated Rust source code is formatted.
+#[repr(C)]
+#[derive(Debug, Copy, Clone, PartialEq, Eq, Hash, PartialOrd, Ord)]
+pub enum RustFormatting {
+    /// Runs the generated code through the `rustfmt` executable.
+    Rustfmt,
+    /// Lays out the generated code with a cheap, built-in printer. The output
+    /// is readable, but not `rustfmt`-clean.
+    BuiltinLayout,
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
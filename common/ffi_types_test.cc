@@ -0,0 +1,59 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#include "common/ffi_types.h"
+
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "gtest/gtest.h"
+#include "absl/strings/string_view.h"
+
+namespace crubit {
+namespace {
+
+static_assert(std::is_nothrow_move_constructible_v<FfiString>);
+static_assert(std::is_nothrow_move_assignable_v<FfiString>);
+static_assert(!std::is_convertible_v<std::string, FfiString>);
+static_assert(!std::is_convertible_v<const char*, FfiString>);
+
+FfiString BoxedString(absl::string_view s) {
+  return FfiString(AllocFfiU8SliceBox(MakeFfiU8Slice(s)));
+}
+
+TEST(FfiStringTest, Default) { EXPECT_EQ(FfiString().view(), ""); }
+
+TEST(FfiStringTest, FromString) {
+  EXPECT_EQ(FfiString(std::string("string")).view(), "string");
+  EXPECT_EQ(FfiString("chars").view(), "chars");
+}
+
+TEST(FfiStringTest, FromBox) { EXPECT_EQ(BoxedString("box").view(), "box"); }
+
+TEST(FfiStringTest, MoveTakesOwnershipOfTheBox) {
+  FfiString from = BoxedString("box");
+  FfiString to(std::move(from));
+  EXPECT_EQ(to.view(), "box");
+  // The box is only freed once, by `to`.
+  EXPECT_EQ(from.view(), "");  // NOLINT(bugprone-use-after-move)
+}
+
+TEST(FfiStringTest, MoveAssignment) {
+  FfiString to = BoxedString("old box");
+  // Frees the old box.
+  to = BoxedString("new box");
+  EXPECT_EQ(to.view(), "new box");
+  to = FfiString("string");
+  EXPECT_EQ(to.view(), "string");
+  to = BoxedString("box");
+  EXPECT_EQ(to.view(), "box");
+
+  FfiString& self = to;
+  to = std::move(self);
+  EXPECT_EQ(to.view(), "box");
+}
+
+}  // namespace
+}  // namespace crubit
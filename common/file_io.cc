@@ -4,15 +4,19 @@
 
 #include "common/file_io.h"
 
+#include <cstddef>
 #include <memory>
 #include <string>
 #include <system_error>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "llvm/Support/ErrorOr.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Parallel.h"
 #include "llvm/Support/raw_ostream.h"
 
 namespace crubit {
@@ -42,4 +46,17 @@ absl::Status SetFileContents(absl::string_view path,
   return absl::OkStatus();
 }
 
+absl::Status SetFilesContents(absl::Span<const FileContents> files) {
+  std::vector<absl::Status> statuses(files.size());
+  llvm::parallelFor(0, files.size(), [&](size_t i) {
+    statuses[i] = SetFileContents(files[i].path, files[i].contents);
+  });
+  for (absl::Status& status : statuses) {
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  return absl::OkStatus();
+}
+
 }  // namespace crubit
@@ -10,6 +10,7 @@
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 
 namespace crubit {
 
@@ -18,6 +19,16 @@ absl::StatusOr<std::string> GetFileContents(absl::string_view path);
 absl::Status SetFileContents(absl::string_view path,
                              absl::string_view contents);
 
+// A file to be written by `SetFilesContents`.
+struct FileContents {
+  absl::string_view path;
+  absl::string_view contents;
+};
+
+// Writes `files` in parallel. Returns the error of the first file that can't
+// be written, if any.
+absl::Status SetFilesContents(absl::Span<const FileContents> files);
+
 }  // namespace crubit
 
 #endif  // CRUBIT_COMMON_FILE_IO_H_
@@ -0,0 +1,54 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#include "common/file_io.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "common/status_test_matchers.h"
+
+namespace crubit {
+namespace {
+
+TEST(FileIoTest, SetFileContents) {
+  std::string path = absl::StrCat(testing::TempDir(), "/file.txt");
+  ASSERT_OK(SetFileContents(path, "contents"));
+  EXPECT_THAT(GetFileContents(path), IsOkAndHolds("contents"));
+  ASSERT_OK(SetFileContents(path, ""));
+  EXPECT_THAT(GetFileContents(path), IsOkAndHolds(""));
+}
+
+TEST(FileIoTest, GetFileContentsOfMissingFile) {
+  EXPECT_THAT(
+      GetFileContents(absl::StrCat(testing::TempDir(), "/missing/file.txt")),
+      StatusIs(absl::StatusCode::kInternal));
+}
+
+TEST(FileIoTest, SetFilesContents) {
+  std::string a = absl::StrCat(testing::TempDir(), "/a.txt");
+  std::string b = absl::StrCat(testing::TempDir(), "/b.txt");
+  ASSERT_OK(SetFilesContents({{a, "a"}, {b, "b"}}));
+  EXPECT_THAT(GetFileContents(a), IsOkAndHolds("a"));
+  EXPECT_THAT(GetFileContents(b), IsOkAndHolds("b"));
+
+  ASSERT_OK(SetFilesContents({}));
+}
+
+TEST(FileIoTest, SetFilesContentsFails) {
+  std::string a = absl::StrCat(testing::TempDir(), "/first.txt");
+  std::string missing_dir =
+      absl::StrCat(testing::TempDir(), "/missing_dir/file.txt");
+  std::string b = absl::StrCat(testing::TempDir(), "/last.txt");
+  EXPECT_THAT(SetFilesContents({{a, "a"}, {missing_dir, "x"}, {b, "b"}}),
+              StatusIs(absl::StatusCode::kInternal));
+  // The other files are still written.
+  EXPECT_THAT(GetFileContents(a), IsOkAndHolds("a"));
+  EXPECT_THAT(GetFileContents(b), IsOkAndHolds("b"));
+}
+
+}  // namespace
+}  // namespace crubit
@@ -87,6 +87,14 @@ pub fn rs_tokens_to_formatted_string_for_tests(input: TokenStream) -> Result<Str
     rs_tokens_to_formatted_string(input, &RustfmtConfig::for_testing())
 }
 
+/// Like `tokens_to_string`, but also lays out the result with the cheap,
+/// built-in `write_laid_out_tokens` instead of running it through `rustfmt`.
+pub fn rs_tokens_to_laid_out_string(tokens: TokenStream) -> Result<String> {
+    let mut result = String::new();
+    write_laid_out_tokens(&mut result, tokens)?;
+    Ok(result)
+}
+
 /// Like `tokens_to_string` but also runs the result through `clang-format`.
 pub fn cc_tokens_to_formatted_string(
     tokens: TokenStream,
@@ -169,6 +177,177 @@ pub fn write_unformatted_tokens(
     Ok(())
 }
 
+/// Like `write_unformatted_tokens`, but also breaks the lines after `;`, after
+/// attributes and around the contents of `{}` groups, and indents them by
+/// their nesting depth.
+///
+/// This is much cheaper than `rustfmt` (and doesn't spawn a process), but it
+/// doesn't wrap long lines or normalize doc attributes, so it is intended for
+/// Rust code that is compiled but not read by humans.
+pub fn write_laid_out_tokens(result: &mut String, tokens: TokenStream) -> Result<()> {
+    LayoutWriter { result, indent: 0, at_line_start: true, after_implicit_newline: false }
+        .write_tokens(tokens)
+}
+
+struct LayoutWriter<'a> {
+    result: &'a mut String,
+    /// Nesting depth of the `{}` groups that are being written.
+    indent: usize,
+    /// Whether nothing (not even the indentation) was written on the current
+    /// line yet.
+    at_line_start: bool,
+    /// Whether the current line was started by the layout rather than by an
+    /// explicit `__NEWLINE__`.
+    after_implicit_newline: bool,
+}
+
+impl LayoutWriter<'_> {
+    fn write_str(&mut self, s: &str) {
+        if self.at_line_start {
+            for _ in 0..self.indent {
+                self.result.push_str("    ");
+            }
+            self.at_line_start = false;
+        }
+        self.result.push_str(s);
+    }
+
+    fn newline(&mut self) {
+        self.result.truncate(self.result.trim_end_matches(' ').len());
+        self.result.push('\n');
+        self.at_line_start = true;
+        self.after_implicit_newline = false;
+    }
+
+    fn implicit_newline(&mut self) {
+        if !self.at_line_start {
+            self.newline();
+            self.after_implicit_newline = true;
+        }
+    }
+
+    fn write_tokens(&mut self, tokens: TokenStream) -> Result<()> {
+        let mut it = tokens.into_iter().peekable();
+        while let Some(tt) = it.next() {
+            match tt {
+                TokenTree::Ident(ref tt) if tt == "__NEWLINE__" => {
+                    // `__NEWLINE__` usually follows a `;` or a `}`, which already ended the line.
+                    if self.after_implicit_newline {
+                        self.after_implicit_newline = false;
+                    } else {
+                        self.newline();
+                    }
+                }
+                TokenTree::Ident(ref tt) if tt == "__SPACE__" => {
+                    if !self.at_line_start {
+                        self.write_str(" ");
+                    }
+                }
+                TokenTree::Ident(ref tt) if tt == "__HASH_TOKEN__" => self.write_str("#"),
+                TokenTree::Ident(ref tt) if tt == "__COMMENT__" => {
+                    if let Some(TokenTree::Literal(lit)) = it.next() {
+                        self.implicit_newline();
+                        for line in lit.to_string().trim_matches('"').split("\\n") {
+                            self.write_str("// ");
+                            self.write_str(line);
+                            self.newline();
+                        }
+                        self.after_implicit_newline = true;
+                    } else {
+                        bail!("__COMMENT__ must be followed by a literal")
+                    }
+                }
+                TokenTree::Group(ref group) if group.delimiter() == Delimiter::Brace => {
+                    if !self.at_line_start && !self.result.ends_with([' ', '(', '[']) {
+                        self.write_str(" ");
+                    }
+                    self.write_str("{");
+                    if !group.stream().is_empty() {
+                        self.indent += 1;
+                        self.implicit_newline();
+                        self.write_tokens(group.stream())?;
+                        self.implicit_newline();
+                        self.indent -= 1;
+                    }
+                    self.write_str("}");
+                    // Keep `} else {`, `};`, `},`, `}.method()`, etc. on one line.
+                    match it.peek() {
+                        Some(TokenTree::Punct(_)) => {}
+                        Some(TokenTree::Ident(next)) if next == "else" || next == "as" => {
+                            self.write_str(" ")
+                        }
+                        _ => self.implicit_newline(),
+                    }
+                }
+                TokenTree::Group(ref group) => {
+                    let (open_delimiter, closed_delimiter) = match group.delimiter() {
+                        Delimiter::Parenthesis => ("(", ")"),
+                        Delimiter::Bracket => ("[", "]"),
+                        _ => ("", ""),
+                    };
+                    self.write_str(open_delimiter);
+                    self.write_tokens(group.stream())?;
+                    self.write_str(closed_delimiter);
+                    if let Some(tt_next) = it.peek() {
+                        if is_ident_or_literal(tt_next) {
+                            self.write_str(" ");
+                        }
+                    }
+                }
+                TokenTree::Punct(ref punct) if punct.as_char() == ';' => {
+                    self.write_str(";");
+                    self.implicit_newline();
+                }
+                TokenTree::Punct(ref punct) if punct.as_char() == '#' => {
+                    self.write_str("#");
+                    if let Some(TokenTree::Punct(bang)) = it.peek() {
+                        if bang.as_char() == '!' {
+                            self.write_str("!");
+                            it.next();
+                        }
+                    }
+                    // Put each attribute on a line of its own.
+                    if let Some(TokenTree::Group(attribute)) = it.peek() {
+                        if attribute.delimiter() == Delimiter::Bracket {
+                            let attribute = attribute.stream();
+                            it.next();
+                            self.write_str("[");
+                            self.write_tokens(attribute)?;
+                            self.write_str("]");
+                            self.implicit_newline();
+                        }
+                    }
+                }
+                _ => {
+                    self.write_str(&tt.to_string());
+                    // Spaces that are not needed to separate the tokens, but that make the
+                    // output easier to read.
+                    if let TokenTree::Punct(ref punct) = tt {
+                        if punct.as_char() == ',' {
+                            self.write_str(" ");
+                            continue;
+                        }
+                        // `x: i32`, but not `:: core`.
+                        if punct.as_char() == ':'
+                            && punct.spacing() == proc_macro2::Spacing::Alone
+                            && !self.result.ends_with("::")
+                        {
+                            self.write_str(" ");
+                            continue;
+                        }
+                    }
+                    if let Some(tt_next) = it.peek() {
+                        if tokens_require_whitespace(&tt, tt_next) {
+                            self.write_str(" ");
+                        }
+                    }
+                }
+            }
+        }
+        Ok(())
+    }
+}
+
 fn tokens_to_string(tokens: TokenStream) -> Result<String> {
     let mut result = String::new();
     write_unformatted_tokens(&mut result, tokens)?;
@@ -384,6 +563,49 @@ mod tests {
         Ok(())
     }
 
+    #[test]
+    fn test_rs_tokens_to_laid_out_string() -> Result<()> {
+        let input = quote! {
+            #![rustfmt::skip]
+            #[repr(C)]
+            pub struct Foo { pub x: i32, y: ::core::ffi::c_int }
+            __NEWLINE__
+            impl Foo {
+                pub fn f(&self) -> i32 { if self.x > 0 { 1 } else { 2 } }
+                fn g() {}
+            }
+            __COMMENT__ "a\nb"
+            mod detail { extern "C" { pub fn h(x: i32); } }
+        };
+        assert_eq!(
+            rs_tokens_to_laid_out_string(input)?,
+            r#"#![rustfmt::skip]
+#[repr(C)]
+pub struct Foo {
+    pub x: i32, y: ::core::ffi::c_int
+}
+impl Foo {
+    pub fn f(&self)->i32 {
+        if self.x>0 {
+            1
+        } else {
+            2
+        }
+    }
+    fn g() {}
+}
+// a
+// b
+mod detail {
+    extern "C" {
+        pub fn h(x: i32);
+    }
+}
+"#
+        );
+        Ok(())
+    }
+
     #[test]
     fn test_rs_tokens_to_formatted_string_for_tests() {
         let input = quote! {
@@ -0,0 +1,102 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#include "nullability/inference/aggregate.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "nullability/inference/inference.proto.h"
+#include "nullability/inference/merge.h"
+#include "clang/AST/DeclBase.h"
+#include "clang/Basic/SourceLocation.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Index/USRGeneration.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace clang::tidy::nullability {
+
+void EvidenceAggregator::operator()(const Decl &Target, Slot S,
+                                    Evidence::Kind Kind, SourceLocation Loc) {
+  auto [It, Inserted] = SymbolIndex.try_emplace(&Target, -1);
+  if (Inserted) {
+    llvm::SmallString<128> USR;
+    if (!index::generateUSRForDecl(&Target, USR)) {
+      It->second = Symbols.size();
+      Symbols.push_back({std::string(USR.str()), {}});
+    }
+  }
+  if (It->second < 0) return;  // Can't summarize without a USR
+
+  auto &Slots = Symbols[It->second].Slots;
+  unsigned I = S;
+  if (Slots.size() <= I) Slots.resize(I + 1);
+  SlotSummary &Summary = Slots[I];
+  ++Summary.KindCount[Kind];
+  if (Loc = SM.getFileLoc(Loc); Loc.isValid()) addSample(Summary, Kind, Loc);
+}
+
+void EvidenceAggregator::addSample(SlotSummary &Summary, Evidence::Kind Kind,
+                                   SourceLocation Loc) {
+  // Like mergePartials, keep the first few distinct locations of each kind.
+  // Comparing SourceLocations first avoids decoding the same one repeatedly.
+  unsigned Count = 0;
+  for (const Sample &S : Summary.Samples) {
+    if (S.Kind != Kind) continue;
+    if (S.Loc == Loc) return;
+    ++Count;
+  }
+  if (Count >= MaxSampleLocations) return;
+  PresumedLoc Presumed = SM.getPresumedLoc(Loc);
+  if (Presumed.isInvalid()) return;
+  Sample New = {Kind, Loc, Presumed.getFilename(), Presumed.getLine(),
+                Presumed.getColumn()};
+  for (const Sample &S : Summary.Samples)
+    if (S.Kind == Kind && S.Line == New.Line && S.Column == New.Column &&
+        S.File == New.File)
+      return;
+  Summary.Samples.push_back(New);
+}
+
+std::vector<Partial> EvidenceAggregator::partials() const {
+  std::vector<const SymbolSummary *> Sorted;
+  Sorted.reserve(Symbols.size());
+  for (const SymbolSummary &Symbol : Symbols)
+    if (!Symbol.Slots.empty()) Sorted.push_back(&Symbol);
+  llvm::sort(Sorted, [](const SymbolSummary *L, const SymbolSummary *R) {
+    return L->USR < R->USR;
+  });
+
+  std::vector<Partial> Result;
+  Result.reserve(Sorted.size());
+  for (const SymbolSummary *Symbol : Sorted) {
+    Partial &P = Result.emplace_back();
+    P.mutable_symbol()->set_usr(Symbol->USR);
+    llvm::SmallVector<llvm::StringRef, 2> Files;
+    for (const SlotSummary &Summary : Symbol->Slots) {
+      auto &S = *P.add_slot();
+      for (unsigned Kind = 0; Kind < Summary.KindCount.size(); ++Kind)
+        if (Summary.KindCount[Kind])
+          (*S.mutable_kind_count())[Kind] = Summary.KindCount[Kind];
+      for (const Sample &Entry : Summary.Samples) {
+        Location &Loc = *(*S.mutable_kind_samples())[Entry.Kind].add_location();
+        auto *It = llvm::find(Files, Entry.File);
+        if (It == Files.end()) {
+          P.add_file(Entry.File.str());
+          It = Files.insert(Files.end(), Entry.File);
+        }
+        Loc.set_file_index(It - Files.begin());
+        Loc.set_line(Entry.Line);
+        Loc.set_column(Entry.Column);
+      }
+    }
+  }
+  return Result;
+}
+
+}  // namespace clang::tidy::nullability
@@ -0,0 +1,72 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#ifndef CRUBIT_NULLABILITY_INFERENCE_AGGREGATE_H_
+#define CRUBIT_NULLABILITY_INFERENCE_AGGREGATE_H_
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "nullability/inference/inference.proto.h"
+#include "clang/AST/DeclBase.h"
+#include "clang/Basic/SourceLocation.h"
+#include "clang/Basic/SourceManager.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace clang::tidy::nullability {
+
+// Summarizes the evidence about each symbol as it is collected, without
+// building an Evidence proto for each piece of evidence.
+//
+// This is an EvidenceEmitter, for use with the AST of a single translation
+// unit. The USR of each symbol is generated once, when its first evidence
+// arrives. Each piece of evidence then just increments a count, and a bounded
+// number of sample locations are kept (and only those are decoded into a file,
+// line and column). Memory use is therefore proportional to the number of
+// symbols, not to the amount of evidence.
+//
+// The result is equivalent to merging partialFromEvidence() of each piece of
+// evidence in the order in which it was emitted.
+class EvidenceAggregator {
+ public:
+  explicit EvidenceAggregator(const SourceManager &SM) : SM(SM) {}
+
+  void operator()(const Decl &Target, Slot, Evidence::Kind, SourceLocation);
+
+  // Returns a Partial for each symbol that has evidence, sorted by USR.
+  std::vector<Partial> partials() const;
+
+ private:
+  struct Sample {
+    Evidence::Kind Kind;
+    SourceLocation Loc;
+    // The presumed location, as shown in diagnostics. The file name is owned
+    // by the SourceManager.
+    llvm::StringRef File;
+    unsigned Line;
+    unsigned Column;
+  };
+  struct SlotSummary {
+    std::array<unsigned, Evidence::Kind_ARRAYSIZE> KindCount = {};
+    llvm::SmallVector<Sample, 0> Samples;
+  };
+  struct SymbolSummary {
+    std::string USR;
+    llvm::SmallVector<SlotSummary, 0> Slots;
+  };
+
+  void addSample(SlotSummary &, Evidence::Kind, SourceLocation);
+
+  const SourceManager &SM;
+  // Indexes into `Symbols`, or -1 for the symbols that have no USR.
+  llvm::DenseMap<const Decl *, int> SymbolIndex;
+  std::vector<SymbolSummary> Symbols;
+};
+
+}  // namespace clang::tidy::nullability
+
+#endif  // CRUBIT_NULLABILITY_INFERENCE_AGGREGATE_H_
@@ -0,0 +1,104 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#include "nullability/inference/aggregate.h"
+
+#include <cstddef>
+#include <vector>
+
+#include "nullability/inference/collect_evidence.h"
+#include "nullability/inference/inference.proto.h"
+#include "nullability/inference/merge.h"
+#include "clang/AST/Decl.h"
+#include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/ASTMatchers/ASTMatchers.h"
+#include "clang/Basic/SourceLocation.h"
+#include "clang/Testing/TestAST.h"
+#include "llvm/ADT/FunctionExtras.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "third_party/llvm/llvm-project/third-party/unittest/googletest/include/gtest/gtest.h"
+
+namespace clang::tidy::nullability {
+namespace {
+using ast_matchers::functionDecl;
+using ast_matchers::hasName;
+using ast_matchers::match;
+using ast_matchers::selectFirst;
+
+// Collects the partials of the Evidence protos of evidenceEmitter(), merged by
+// symbol in the order in which the evidence is emitted.
+class ReferenceEmitter {
+ public:
+  ReferenceEmitter()
+      : Emitter(evidenceEmitter([this](const Evidence &E) {
+          Partial P = partialFromEvidence(E);
+          for (Partial &Existing : Partials) {
+            if (Existing.symbol().usr() == E.symbol().usr()) {
+              mergePartials(Existing, P);
+              return;
+            }
+          }
+          Partials.push_back(P);
+        })) {}
+
+  void operator()(const Decl &Target, Slot S, Evidence::Kind Kind,
+                  SourceLocation Loc) {
+    Emitter(Target, S, Kind, Loc);
+  }
+
+  std::vector<Partial> Partials;
+
+ private:
+  llvm::unique_function<EvidenceEmitter> Emitter;
+};
+
+TEST(EvidenceAggregatorTest, SameAsMergingEvidence) {
+  TestAST AST(R"cc(
+    int *a(int *p, int *q);
+    void b(int *p);
+    void c(int *p);
+  )cc");
+  auto Function = [&](llvm::StringRef Name) {
+    return selectFirst<FunctionDecl>(
+        "f", match(functionDecl(hasName(Name)).bind("f"), AST.context()));
+  };
+  const FunctionDecl *A = Function("a");
+  const FunctionDecl *B = Function("b");
+  const FunctionDecl *C = Function("c");
+  SourceLocation Loc = A->getLocation();
+  auto At = [&](int Offset) { return Loc.getLocWithOffset(Offset); };
+
+  EvidenceAggregator Aggregator(AST.sourceManager());
+  ReferenceEmitter Reference;
+  auto Emit = [&](const Decl &Target, Slot S, Evidence::Kind Kind,
+                  SourceLocation Loc) {
+    Aggregator(Target, S, Kind, Loc);
+    Reference(Target, S, Kind, Loc);
+  };
+  Emit(*C, paramSlot(0), Evidence::UNCHECKED_DEREFERENCE, At(0));
+  Emit(*A, paramSlot(1), Evidence::NONNULL_ARGUMENT, At(1));
+  Emit(*A, SLOT_RETURN_TYPE, Evidence::NULLABLE_RETURN, SourceLocation());
+  // More samples than are kept, and repeated ones.
+  for (int Offset : {2, 3, 3, 2, 4, 5, 6})
+    Emit(*A, paramSlot(0), Evidence::UNCHECKED_DEREFERENCE, At(Offset));
+  Emit(*A, paramSlot(0), Evidence::NULLABLE_ARGUMENT, At(3));
+  Emit(*B, paramSlot(0), Evidence::ANNOTATED_NONNULL, At(7));
+  Emit(*C, paramSlot(0), Evidence::UNCHECKED_DEREFERENCE, At(8));
+
+  auto Partials = Aggregator.partials();
+  llvm::sort(Reference.Partials, [](const Partial &L, const Partial &R) {
+    return L.symbol().usr() < R.symbol().usr();
+  });
+  ASSERT_EQ(Partials.size(), 3u);
+  ASSERT_EQ(Partials.size(), Reference.Partials.size());
+  for (size_t I = 0; I < Partials.size(); ++I)
+    EXPECT_EQ(Partials[I].DebugString(), Reference.Partials[I].DebugString());
+  const auto &Samples = Partials[0].slot(1).kind_samples();
+  EXPECT_EQ(Samples.at(Evidence::UNCHECKED_DEREFERENCE).location_size(),
+            static_cast<int>(MaxSampleLocations));
+}
+
+}  // namespace
+}  // namespace clang::tidy::nullability
@@ -32,6 +32,8 @@
 #include "clang/Analysis/FlowSensitive/Value.h"
 #include "clang/Analysis/FlowSensitive/WatchedLiteralsSolver.h"
 #include "clang/Basic/LLVM.h"
+#include "clang/Basic/SourceLocation.h"
+#include "clang/Basic/SourceManager.h"
 #include "clang/Basic/Specifiers.h"
 #include "clang/Index/USRGeneration.h"
 #include "llvm/ADT/DenseMap.h"
@@ -71,8 +73,14 @@ llvm::unique_function<EvidenceEmitter> evidenceEmitter(
           Target.getDeclContext()->getParentASTContext().getSourceManager();
       // TODO: are macro locations actually useful enough for debugging?
       //       we could leave them out, and make room for non-macro samples.
-      if (Loc = SM.getFileLoc(Loc); Loc.isValid())
-        E.set_location(Loc.printToString(SM));
+      if (Loc = SM.getFileLoc(Loc); Loc.isValid()) {
+        if (PresumedLoc Presumed = SM.getPresumedLoc(Loc); Presumed.isValid()) {
+          Location &L = *E.mutable_location();
+          L.set_file(Presumed.getFilename());
+          L.set_line(Presumed.getLine());
+          L.set_column(Presumed.getColumn());
+        }
+      }
 
       Emit(E);
     }
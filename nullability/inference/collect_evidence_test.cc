@@ -133,7 +133,9 @@ TEST(InferAnnotationsTest, Location) {
   auto Evidence = collectEvidenceFromTargetFunction(Code);
   ASSERT_THAT(Evidence, ElementsAre(evidence(paramSlot(0),
                                              Evidence::UNCHECKED_DEREFERENCE)));
-  EXPECT_EQ("input.mm:1:23", Evidence.front().location());
+  EXPECT_EQ("input.mm", Evidence.front().location().file());
+  EXPECT_EQ(1, Evidence.front().location().line());
+  EXPECT_EQ(23, Evidence.front().location().column());
 }
 
 TEST(CollectEvidenceFromImplementationTest, DereferenceBeforeAssignment) {
@@ -0,0 +1,227 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#include "nullability/inference/evidence_cache.h"
+
+#include <optional>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "nullability/inference/inference.proto.h"
+#include "nullability/type_nullability.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Decl.h"
+#include "clang/AST/DeclBase.h"
+#include "clang/AST/Expr.h"
+#include "clang/AST/ExprCXX.h"
+#include "clang/AST/PrettyPrinter.h"
+#include "clang/AST/RecursiveASTVisitor.h"
+#include "clang/AST/Type.h"
+#include "clang/Basic/SourceLocation.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Index/USRGeneration.h"
+#include "clang/Lex/Lexer.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA256.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace clang::tidy::nullability {
+namespace {
+
+// Has to be changed whenever the evidence collected from a function body
+// changes (e.g. collect_evidence learns a new pattern), or the format of the
+// entries does.
+constexpr llvm::StringLiteral CacheVersion = "2";
+
+// Feeds length-prefixed strings to a SHA-256 hasher, so that the boundaries
+// between them are part of the digest.
+class KeyHasher {
+ public:
+  void add(llvm::StringRef S) {
+    Hasher.update(llvm::utostr(S.size()) + ":");
+    Hasher.update(S);
+  }
+
+  std::string hexDigest() {
+    return llvm::toHex(Hasher.final(), /*LowerCase=*/true);
+  }
+
+ private:
+  llvm::SHA256 Hasher;
+};
+
+// Collects the declarations that a function body refers to. The function's
+// own local declarations are left out, as they are part of the body.
+class ReferencedDecls : public RecursiveASTVisitor<ReferencedDecls> {
+ public:
+  llvm::SetVector<const Decl *> Decls;
+
+  bool shouldVisitImplicitCode() const { return true; }
+  bool shouldVisitTemplateInstantiations() const { return true; }
+
+  bool VisitDeclRefExpr(const DeclRefExpr *E) {
+    add(E->getDecl());
+    return true;
+  }
+  bool VisitMemberExpr(const MemberExpr *E) {
+    add(E->getMemberDecl());
+    return true;
+  }
+  bool VisitCallExpr(const CallExpr *E) {
+    add(E->getCalleeDecl());
+    return true;
+  }
+  bool VisitCXXConstructExpr(const CXXConstructExpr *E) {
+    add(E->getConstructor());
+    return true;
+  }
+
+ private:
+  void add(const Decl *D) {
+    if (D && !D->getParentFunctionOrMethod()) Decls.insert(D);
+  }
+};
+
+std::string print(const Decl &D, const PrintingPolicy &Policy) {
+  std::string Result;
+  llvm::raw_string_ostream OS(Result);
+  D.print(OS, Policy, /*Indentation=*/0, /*PrintInstantiation=*/true);
+  return Result;
+}
+
+// Returns the file, line and column where `Impl` starts.
+Location startOf(const Decl &Impl) {
+  const SourceManager &SM = Impl.getASTContext().getSourceManager();
+  Location Start;
+  PresumedLoc Presumed = SM.getPresumedLoc(SM.getFileLoc(Impl.getBeginLoc()));
+  if (Presumed.isValid()) {
+    Start.set_file(Presumed.getFilename());
+    Start.set_line(Presumed.getLine());
+    Start.set_column(Presumed.getColumn());
+  }
+  return Start;
+}
+
+}  // namespace
+
+std::string EvidenceCache::key(const Decl &Impl) {
+  ASTContext &Ctx = Impl.getASTContext();
+  const SourceManager &SM = Ctx.getSourceManager();
+  KeyHasher Hasher;
+  Hasher.add(CacheVersion);
+
+  Hasher.add(Lexer::getSourceText(SM.getExpansionRange(Impl.getSourceRange()),
+                                  SM, Ctx.getLangOpts()));
+  PrintingPolicy Policy = Ctx.getPrintingPolicy();
+  Hasher.add(print(Impl, Policy));
+
+  ReferencedDecls Referenced;
+  Referenced.Decls.insert(&Impl);
+  Referenced.TraverseDecl(const_cast<Decl *>(&Impl));
+  Policy.TerseOutput = true;
+  for (const Decl *D : Referenced.Decls) {
+    llvm::SmallString<128> USR;
+    if (index::generateUSRForDecl(D, USR)) USR.clear();
+    Hasher.add(USR);
+    Hasher.add(print(*D, Policy));
+    // The canonical type covers the type aliases that the declaration uses.
+    if (const auto *VD = dyn_cast<ValueDecl>(D)) {
+      QualType T = VD->getType();
+      Hasher.add(
+          printWithNullability(T, getNullabilityAnnotationsFromType(T), Ctx));
+    }
+  }
+  return Hasher.hexDigest();
+}
+
+std::string EvidenceCache::entryPath(llvm::StringRef Key) const {
+  // Spread the entries over subdirectories, so that none gets too large.
+  llvm::SmallString<128> Path(Dir);
+  llvm::sys::path::append(Path, Key.take_front(2), Key);
+  return std::string(Path);
+}
+
+std::optional<std::vector<Partial>> EvidenceCache::lookup(
+    llvm::StringRef Key, const Decl &Impl) const {
+  auto Buffer = llvm::MemoryBuffer::getFile(entryPath(Key));
+  if (!Buffer) return std::nullopt;
+  CachedEvidence Entry;
+  if (!Entry.ParseFromArray((*Buffer)->getBufferStart(),
+                            (*Buffer)->getBufferSize()))
+    return std::nullopt;
+
+  // Move the sample locations in the function's file along with it. The text
+  // of the function is unchanged (it is part of the key), so only the columns
+  // on its first line can have moved.
+  Location Start = startOf(Impl);
+  int LineDelta = static_cast<int>(Start.line()) -
+                  static_cast<int>(Entry.start().line());
+  int ColumnDelta = static_cast<int>(Start.column()) -
+                    static_cast<int>(Entry.start().column());
+  std::vector<Partial> Result;
+  Result.reserve(Entry.partial_size());
+  for (Partial &P : *Entry.mutable_partial()) {
+    for (int I = 0; I < P.file_size(); ++I) {
+      if (P.file(I) != Entry.start().file()) continue;
+      P.set_file(I, Start.file());
+      for (auto &Slot : *P.mutable_slot())
+        for (auto &[Kind, Samples] : *Slot.mutable_kind_samples())
+          for (Location &Loc : *Samples.mutable_location()) {
+            if (Loc.file_index() != static_cast<unsigned>(I)) continue;
+            if (Loc.line() == Entry.start().line())
+              Loc.set_column(Loc.column() + ColumnDelta);
+            Loc.set_line(Loc.line() + LineDelta);
+          }
+    }
+    Result.push_back(std::move(P));
+  }
+  return Result;
+}
+
+llvm::Error EvidenceCache::store(llvm::StringRef Key, const Decl &Impl,
+                                 llvm::ArrayRef<Partial> Partials) const {
+  CachedEvidence Entry;
+  *Entry.mutable_start() = startOf(Impl);
+  for (const Partial &P : Partials) *Entry.add_partial() = P;
+
+  std::string Path = entryPath(Key);
+  if (auto EC = llvm::sys::fs::create_directories(
+          llvm::sys::path::parent_path(Path)))
+    return llvm::createFileError(Path, EC);
+  // Write to a temporary file first, so that readers never see a partially
+  // written entry.
+  int FD;
+  llvm::SmallString<128> TempPath;
+  if (auto EC = llvm::sys::fs::createUniqueFile(Path + ".tmp-%%%%%%%%", FD,
+                                                TempPath))
+    return llvm::createFileError(Path, EC);
+  std::error_code EC;
+  {
+    llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS << Entry.SerializeAsString();
+    OS.close();
+    if (OS.has_error()) {
+      EC = OS.error();
+      OS.clear_error();
+    }
+  }
+  if (!EC) EC = llvm::sys::fs::rename(TempPath, Path);
+  if (EC) {
+    llvm::sys::fs::remove(TempPath);
+    return llvm::createFileError(Path, EC);
+  }
+  return llvm::Error::success();
+}
+
+}  // namespace clang::tidy::nullability
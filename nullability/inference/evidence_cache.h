@@ -0,0 +1,66 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#ifndef CRUBIT_NULLABILITY_INFERENCE_EVIDENCE_CACHE_H_
+#define CRUBIT_NULLABILITY_INFERENCE_EVIDENCE_CACHE_H_
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "nullability/inference/inference.proto.h"
+#include "clang/AST/DeclBase.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+namespace clang::tidy::nullability {
+
+// A persistent cache of the evidence collected from function bodies, so that
+// running inference again after an edit only analyzes the functions that
+// changed.
+//
+// The evidence is stored as the Partials of each symbol, under a key that
+// covers everything that collectEvidenceFromImplementation() depends on:
+//  - the function as written (so that sample locations within it stay
+//    accurate), and as parsed (which covers macros, and the arguments of
+//    template instantiations);
+//  - the declarations that the body refers to, such as its callees: their
+//    declarations as written, and their canonical types with nullability.
+//    Changing the signature, annotations or default arguments of a callee, or
+//    a type alias used in its signature, invalidates the entries of callers.
+// The key doesn't cover where the function is, so the entry of a function
+// that moved (e.g. after an edit above it) is reused, with its sample
+// locations moved along with it.
+//
+// The cache is a directory with a file per entry. Entries are written
+// atomically, so that the cache can be shared by concurrent threads and runs.
+// Entries are never evicted: the directory grows with every version of every
+// function body that was analyzed, until it is cleaned up externally.
+class EvidenceCache {
+ public:
+  explicit EvidenceCache(llvm::StringRef Dir) : Dir(Dir) {}
+
+  // Returns the key of the evidence collected from the implementation `Impl`.
+  static std::string key(const Decl &Impl);
+
+  // Returns the partials stored under `Key`, with their sample locations moved
+  // to where `Impl` is now. Returns nullopt if there are none (or if they can't
+  // be read).
+  std::optional<std::vector<Partial>> lookup(llvm::StringRef Key,
+                                             const Decl &Impl) const;
+
+  // Stores the partials of the evidence collected from `Impl` under `Key`.
+  llvm::Error store(llvm::StringRef Key, const Decl &Impl,
+                    llvm::ArrayRef<Partial>) const;
+
+ private:
+  std::string entryPath(llvm::StringRef Key) const;
+
+  std::string Dir;
+};
+
+}  // namespace clang::tidy::nullability
+
+#endif  // CRUBIT_NULLABILITY_INFERENCE_EVIDENCE_CACHE_H_
@@ -0,0 +1,176 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#include "nullability/inference/evidence_cache.h"
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "nullability/inference/aggregate.h"
+#include "nullability/inference/collect_evidence.h"
+#include "nullability/inference/inference.proto.h"
+#include "clang/AST/Decl.h"
+#include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/ASTMatchers/ASTMatchers.h"
+#include "clang/Testing/TestAST.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "third_party/llvm/llvm-project/third-party/unittest/googletest/include/gtest/gtest.h"
+
+namespace clang::tidy::nullability {
+namespace {
+using ast_matchers::functionDecl;
+using ast_matchers::hasName;
+using ast_matchers::isDefinition;
+using ast_matchers::match;
+using ast_matchers::selectFirst;
+
+TestInputs inputs(llvm::StringRef Code) {
+  TestInputs Inputs = Code;
+  Inputs.ExtraFiles["nullability.h"] = R"cc(
+    template <typename T>
+    using Nullable [[clang::annotate("Nullable")]] = T;
+    template <typename T>
+    using Nonnull [[clang::annotate("Nonnull")]] = T;
+  )cc";
+  Inputs.ExtraArgs.push_back("-include");
+  Inputs.ExtraArgs.push_back("nullability.h");
+  return Inputs;
+}
+
+const FunctionDecl &target(TestAST &AST) {
+  return *selectFirst<FunctionDecl>(
+      "f", match(functionDecl(hasName("target"), isDefinition()).bind("f"),
+                 AST.context()));
+}
+
+std::string keyOf(llvm::StringRef Code) {
+  TestAST AST(inputs(Code));
+  return EvidenceCache::key(target(AST));
+}
+
+std::vector<Partial> collect(const Decl &Impl) {
+  EvidenceAggregator Aggregator(Impl.getASTContext().getSourceManager());
+  EXPECT_FALSE(llvm::errorToBool(
+      collectEvidenceFromImplementation(Impl, Aggregator)));
+  return Aggregator.partials();
+}
+
+std::string debugString(llvm::ArrayRef<Partial> Partials) {
+  std::string Result;
+  for (const Partial &P : Partials) Result += P.DebugString();
+  return Result;
+}
+
+// Returns an empty directory for the cache of a test.
+std::string cacheDir(llvm::StringRef Name) {
+  llvm::SmallString<128> Dir(testing::TempDir());
+  llvm::sys::path::append(Dir, Name);
+  llvm::sys::fs::remove_directories(Dir);
+  return std::string(Dir);
+}
+
+TEST(EvidenceCacheTest, KeyIgnoresUnrelatedCode) {
+  std::string Key = keyOf(R"cc(
+    void callee(int *p);
+    void target(int *p) { callee(p); }
+  )cc");
+  EXPECT_EQ(Key, keyOf(R"cc(
+    void callee(int *p);
+    void unrelated(int *q) { *q; }
+
+    void target(int *p) { callee(p); }
+  )cc"));
+}
+
+TEST(EvidenceCacheTest, KeyDependsOnFunction) {
+  std::string Key = keyOf(R"cc(
+    void target(int *p) { p; }
+  )cc");
+  EXPECT_NE(Key, keyOf(R"cc(
+    void target(int *p) { *p; }
+  )cc"));
+  EXPECT_NE(Key, keyOf(R"cc(
+    void target(Nonnull<int *> p) { p; }
+  )cc"));
+  // Only the layout changes, but that moves the sample locations.
+  EXPECT_NE(Key, keyOf(R"cc(
+    void target(int *p) {
+      p;
+    }
+  )cc"));
+}
+
+TEST(EvidenceCacheTest, KeyDependsOnCallees) {
+  std::string Key = keyOf(R"cc(
+    using Ptr = int *;
+    void callee(Ptr p);
+    void target(int *p) { callee(p); }
+  )cc");
+  EXPECT_NE(Key, keyOf(R"cc(
+    using Ptr = int *;
+    void callee(Nonnull<Ptr> p);
+    void target(int *p) { callee(p); }
+  )cc"));
+  EXPECT_NE(Key, keyOf(R"cc(
+    using Ptr = int *;
+    void callee(Ptr p = nullptr);
+    void target(int *p) { callee(p); }
+  )cc"));
+  // The callee is written the same, but the type of its parameter changed.
+  EXPECT_NE(Key, keyOf(R"cc(
+    using Ptr = Nullable<int *>;
+    void callee(Ptr p);
+    void target(int *p) { callee(p); }
+  )cc"));
+}
+
+TEST(EvidenceCacheTest, StoreAndLookUp) {
+  EvidenceCache Cache(cacheDir("store_and_look_up"));
+  llvm::StringRef Code = "void target(int *p, int *q) { *p; *q; }";
+  TestAST AST(inputs(Code));
+  const FunctionDecl &Impl = target(AST);
+  std::string Key = EvidenceCache::key(Impl);
+  EXPECT_FALSE(Cache.lookup(Key, Impl).has_value());
+
+  std::vector<Partial> Partials = collect(Impl);
+  ASSERT_FALSE(Partials.empty());
+  ASSERT_FALSE(llvm::errorToBool(Cache.store(Key, Impl, Partials)));
+  auto Cached = Cache.lookup(Key, Impl);
+  ASSERT_TRUE(Cached.has_value());
+  EXPECT_EQ(debugString(*Cached), debugString(Partials));
+
+  // The function moved down, so its sample locations did too.
+  TestAST Moved(inputs(("\n\n" + Code).str()));
+  const FunctionDecl &MovedImpl = target(Moved);
+  ASSERT_EQ(EvidenceCache::key(MovedImpl), Key);
+  Cached = Cache.lookup(Key, MovedImpl);
+  ASSERT_TRUE(Cached.has_value());
+  EXPECT_EQ(debugString(*Cached), debugString(collect(MovedImpl)));
+  EXPECT_NE(debugString(*Cached), debugString(Partials));
+
+  // The function moved right, so the sample locations on its first line did
+  // too (but not the ones on the next lines).
+  llvm::StringRef MultilineCode = R"cc(void target(int *p, int *q) { *p;
+    *q; })cc";
+  TestAST Before(inputs(MultilineCode));
+  const FunctionDecl &BeforeImpl = target(Before);
+  Key = EvidenceCache::key(BeforeImpl);
+  ASSERT_FALSE(llvm::errorToBool(
+      Cache.store(Key, BeforeImpl, collect(BeforeImpl))));
+  TestAST Indented(inputs(("    " + MultilineCode).str()));
+  const FunctionDecl &IndentedImpl = target(Indented);
+  ASSERT_EQ(EvidenceCache::key(IndentedImpl), Key);
+  Cached = Cache.lookup(Key, IndentedImpl);
+  ASSERT_TRUE(Cached.has_value());
+  EXPECT_EQ(debugString(*Cached), debugString(collect(IndentedImpl)));
+}
+
+}  // namespace
+}  // namespace clang::tidy::nullability
@@ -0,0 +1,180 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#include "nullability/inference/infer_codebase.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "nullability/inference/evidence_cache.h"
+#include "nullability/inference/infer_tu.h"
+#include "nullability/inference/inference.proto.h"
+#include "nullability/inference/reduce.h"
+#include "clang/AST/ASTConsumer.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendAction.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Tooling/ArgumentsAdjusters.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace clang::tidy::nullability {
+namespace {
+
+// Writes the partials of each translation unit to `Shard`.
+class MapAction : public SyntaxOnlyAction {
+ public:
+  MapAction(llvm::raw_ostream &Shard, const EvidenceCache *Cache)
+      : Shard(Shard), Cache(Cache) {}
+
+ private:
+  std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &,
+                                                 llvm::StringRef) override {
+    class Consumer : public ASTConsumer {
+     public:
+      Consumer(llvm::raw_ostream &Shard, const EvidenceCache *Cache)
+          : Shard(Shard), Cache(Cache) {}
+
+     private:
+      void HandleTranslationUnit(ASTContext &Ctx) override {
+        for (const Partial &P : partialsFromTU(Ctx, Cache))
+          writeRecord(P, Shard);
+      }
+      llvm::raw_ostream &Shard;
+      const EvidenceCache *Cache;
+    };
+    return std::make_unique<Consumer>(Shard, Cache);
+  }
+
+  llvm::raw_ostream &Shard;
+  const EvidenceCache *Cache;
+};
+
+class MapActionFactory : public tooling::FrontendActionFactory {
+ public:
+  MapActionFactory(llvm::raw_ostream &Shard, const EvidenceCache *Cache)
+      : Shard(Shard), Cache(Cache) {}
+
+  std::unique_ptr<FrontendAction> create() override {
+    return std::make_unique<MapAction>(Shard, Cache);
+  }
+
+ private:
+  llvm::raw_ostream &Shard;
+  const EvidenceCache *Cache;
+};
+
+// Runs the map phase over `Files` on `Options.Jobs` threads, writing the
+// partials of the I'th file to the I'th of `ShardPaths`, whichever thread
+// parsed it.
+llvm::Error runMap(const tooling::CompilationDatabase &DB,
+                   llvm::ArrayRef<std::string> Files,
+                   llvm::ArrayRef<std::string> ShardPaths,
+                   const CodebaseOptions &Options) {
+  // Each file (and its error) is handled by a single thread.
+  std::vector<std::error_code> ShardErrors(Files.size());
+
+  std::atomic<size_t> Next = 0;
+  auto Work = [&] {
+    for (size_t I = Next++; I < Files.size(); I = Next++) {
+      // stderr is unbuffered, so each line is written in one call to keep the
+      // lines of the threads from interleaving.
+      std::string Progress =
+          llvm::formatv("[{0}/{1}] {2}\n", I + 1, Files.size(), Files[I]);
+      llvm::errs() << Progress;
+      llvm::raw_fd_ostream Shard(ShardPaths[I], ShardErrors[I]);
+      if (ShardErrors[I]) continue;
+      // The real file system that tools use by default changes the working
+      // directory of the process, so each tool gets its own instead.
+      tooling::ClangTool Tool(
+          DB, {Files[I]}, std::make_shared<PCHContainerOperations>(),
+          llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem>(
+              llvm::vfs::createPhysicalFileSystem()));
+      Tool.appendArgumentsAdjuster(tooling::getInsertArgumentAdjuster(
+          "-w", tooling::ArgumentInsertPosition::BEGIN));
+      MapActionFactory Factory(Shard, Options.Cache);
+      if (Tool.run(&Factory) != 0)
+        llvm::errs() << ("Failed to analyze " + Files[I] + "\n");
+      Shard.close();
+      if (Shard.has_error()) {
+        ShardErrors[I] = Shard.error();
+        Shard.clear_error();
+      }
+    }
+  };
+  unsigned Workers =
+      std::max(1u, std::min<unsigned>(Options.Jobs, Files.size()));
+  std::vector<std::thread> Threads;
+  for (unsigned I = 1; I < Workers; ++I) Threads.emplace_back(Work);
+  Work();
+  for (auto &Thread : Threads) Thread.join();
+
+  for (size_t I = 0; I < Files.size(); ++I)
+    if (ShardErrors[I])
+      return llvm::createFileError(ShardPaths[I], ShardErrors[I]);
+  return llvm::Error::success();
+}
+
+// Runs the reduce and finalize phases over the shards, in order.
+llvm::Error runReduce(llvm::ArrayRef<std::string> ShardPaths,
+                      llvm::StringRef SpillDir, const CodebaseOptions &Options,
+                      llvm::function_ref<void(const Inference &)> Output) {
+  auto Reducer = PartialReducer::create(SpillDir, Options.Buckets);
+  if (!Reducer) return Reducer.takeError();
+  for (const auto &Path : ShardPaths) {
+    if (auto Err = readRecords<Partial>(
+            Path, [&](Partial P) { return Reducer->add(P); }))
+      return Err;
+  }
+  return std::move(*Reducer).finish(Options.Jobs, Output);
+}
+
+}  // namespace
+
+llvm::Error inferCodebase(const tooling::CompilationDatabase &DB,
+                          llvm::ArrayRef<std::string> Files,
+                          const CodebaseOptions &Options,
+                          llvm::function_ref<void(const Inference &)> Output) {
+  std::vector<std::string> ShardPaths;
+  ShardPaths.reserve(Files.size());
+  for (size_t I = 0; I < Files.size(); ++I) {
+    llvm::SmallString<128> Path(Options.WorkDir);
+    llvm::sys::path::append(Path, "map-" + llvm::Twine(I) + ".partials");
+    ShardPaths.push_back(std::string(Path));
+  }
+  llvm::SmallString<128> SpillDir(Options.WorkDir);
+  llvm::sys::path::append(SpillDir, "reduce");
+  // The intermediate files are only needed until the output is written, and
+  // there are as many shards as translation units.
+  auto Cleanup = llvm::make_scope_exit([&] {
+    for (const auto &Path : ShardPaths) llvm::sys::fs::remove(Path);
+    llvm::sys::fs::remove(SpillDir);
+  });
+
+  if (auto Err = runMap(DB, Files, ShardPaths, Options)) return Err;
+  return runReduce(ShardPaths, SpillDir, Options, Output);
+}
+
+}  // namespace clang::tidy::nullability
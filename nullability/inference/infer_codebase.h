@@ -0,0 +1,51 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#ifndef CRUBIT_NULLABILITY_INFERENCE_INFER_CODEBASE_H_
+#define CRUBIT_NULLABILITY_INFERENCE_INFER_CODEBASE_H_
+
+#include <string>
+
+#include "nullability/inference/evidence_cache.h"
+#include "nullability/inference/inference.proto.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/Support/Error.h"
+
+namespace clang::tidy::nullability {
+
+struct CodebaseOptions {
+  // Directory for the intermediate files, which are removed when done.
+  std::string WorkDir;
+  // Number of translation units (or buckets) to process in parallel.
+  unsigned Jobs = 1;
+  // Number of buckets the partials are spilled to when merging. Memory use is
+  // proportional to Jobs / Buckets.
+  unsigned Buckets = 64;
+  // Where the evidence of function bodies is cached, if anywhere.
+  const EvidenceCache *Cache = nullptr;
+};
+
+// Infers nullability across all the translation units `Files` of `DB`, as a
+// local map-reduce:
+//  - map: each translation unit is parsed, and its evidence summarized as a
+//    Partial per symbol (see partialsFromTU). The partials of each translation
+//    unit are written to a shard file in the WorkDir.
+//  - reduce: the shards are streamed, in the order of `Files`, into a
+//    PartialReducer, which spills the partials into buckets by USR, and merges
+//    one bucket at a time.
+//  - finalize: the merged partial of each symbol becomes an Inference.
+//
+// `Output` is called with each inference. As the partials are merged in the
+// same order however many jobs there are, the output (including the samples
+// of evidence that are kept) only depends on `Files` and on the Buckets.
+llvm::Error inferCodebase(const tooling::CompilationDatabase &DB,
+                          llvm::ArrayRef<std::string> Files,
+                          const CodebaseOptions &Options,
+                          llvm::function_ref<void(const Inference &)> Output);
+
+}  // namespace clang::tidy::nullability
+
+#endif  // CRUBIT_NULLABILITY_INFERENCE_INFER_CODEBASE_H_
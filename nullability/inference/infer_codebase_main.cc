@@ -0,0 +1,131 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+// infer_codebase_main infers nullability across all the translation units of
+// a compilation database, as a local map-reduce (see infer_codebase.h). The
+// intermediate files are written to -work_dir.
+//
+// The inferences are written to -output as records (see reduce.h), or printed
+// as text protos if there is no -output.
+//
+// With -cache_dir, the evidence of each function body is cached, so that
+// running again after an edit only analyzes the function bodies that changed
+// (see evidence_cache.h).
+//
+// Usage: infer_codebase_main -compile_commands=compile_commands.json -jobs=N
+
+#include <optional>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include "absl/log/check.h"
+#include "nullability/inference/evidence_cache.h"
+#include "nullability/inference/infer_codebase.h"
+#include "nullability/inference/inference.proto.h"
+#include "nullability/inference/reduce.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "clang/Tooling/JSONCompilationDatabase.h"
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+llvm::cl::OptionCategory Opts("infer_codebase_main options");
+llvm::cl::opt<std::string> CompileCommands{
+    "compile_commands",
+    llvm::cl::desc("The compile_commands.json of the translation units"),
+    llvm::cl::Required,
+    llvm::cl::cat(Opts),
+};
+llvm::cl::opt<std::string> WorkDir{
+    "work_dir",
+    llvm::cl::desc("Directory for the intermediate files (a new directory in "
+                   "the system's temporary directory by default)"),
+    llvm::cl::cat(Opts),
+};
+llvm::cl::opt<std::string> Output{
+    "output",
+    llvm::cl::desc("File to write the Inference records to (printed as text "
+                   "protos by default)"),
+    llvm::cl::cat(Opts),
+};
+llvm::cl::opt<std::string> CacheDir{
+    "cache_dir",
+    llvm::cl::desc("Directory to cache the evidence of function bodies in, "
+                   "so that unchanged ones aren't analyzed again"),
+    llvm::cl::cat(Opts),
+};
+llvm::cl::opt<unsigned> Jobs{
+    "jobs",
+    llvm::cl::desc("Number of translation units (or buckets) to process in "
+                   "parallel"),
+    llvm::cl::init(std::thread::hardware_concurrency()),
+    llvm::cl::cat(Opts),
+};
+llvm::cl::opt<unsigned> Buckets{
+    "buckets",
+    llvm::cl::desc("Number of buckets the partials are spilled to when "
+                   "merging. Memory use is proportional to jobs / buckets"),
+    llvm::cl::init(64),
+    llvm::cl::cat(Opts),
+};
+
+namespace clang::tidy::nullability {
+namespace {
+
+llvm::Error run() {
+  std::string Error;
+  auto DB = tooling::JSONCompilationDatabase::loadFromFile(
+      CompileCommands, Error, tooling::JSONCommandLineSyntax::AutoDetect);
+  if (!DB)
+    return llvm::createStringError(llvm::inconvertibleErrorCode(), Error);
+
+  llvm::SmallString<128> Dir(WorkDir);
+  bool TempDir = Dir.empty();
+  if (TempDir) {
+    llvm::SmallString<128> Prefix;
+    llvm::sys::path::system_temp_directory(/*ErasedOnReboot=*/true, Prefix);
+    llvm::sys::path::append(Prefix, "infer_codebase");
+    if (auto EC = llvm::sys::fs::createUniqueDirectory(Prefix, Dir))
+      return llvm::createFileError(Prefix, EC);
+  } else if (auto EC = llvm::sys::fs::create_directories(Dir)) {
+    return llvm::createFileError(Dir, EC);
+  }
+  auto RemoveTempDir = llvm::make_scope_exit([&] {
+    if (TempDir) llvm::sys::fs::remove_directories(Dir);
+  });
+
+  std::optional<EvidenceCache> Cache;
+  if (!CacheDir.empty()) Cache.emplace(CacheDir);
+
+  std::error_code EC;
+  llvm::raw_fd_ostream OS(Output.empty() ? "-" : Output.getValue(), EC);
+  if (EC) return llvm::createFileError(Output, EC);
+  return inferCodebase(*DB, DB->getAllFiles(),
+                       {.WorkDir = std::string(Dir),
+                        .Jobs = Jobs,
+                        .Buckets = Buckets,
+                        .Cache = Cache ? &*Cache : nullptr},
+                       [&](const Inference &I) {
+                         if (Output.empty())
+                           OS << I.DebugString() << "\n";
+                         else
+                           writeRecord(I, OS);
+                       });
+}
+
+}  // namespace
+}  // namespace clang::tidy::nullability
+
+int main(int argc, const char **argv) {
+  llvm::cl::HideUnrelatedOptions(Opts);
+  llvm::cl::ParseCommandLineOptions(argc, argv);
+  auto Err = clang::tidy::nullability::run();
+  QCHECK(!Err) << toString(std::move(Err));
+}
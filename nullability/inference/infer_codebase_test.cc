@@ -0,0 +1,82 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#include "nullability/inference/infer_codebase.h"
+
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "nullability/inference/inference.proto.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "third_party/llvm/llvm-project/third-party/unittest/googletest/include/gtest/gtest.h"
+
+namespace clang::tidy::nullability {
+namespace {
+
+// Returns an empty directory for a test.
+std::string tempDir(llvm::StringRef Name) {
+  llvm::SmallString<128> Dir(testing::TempDir());
+  llvm::sys::path::append(Dir, Name);
+  llvm::sys::fs::remove_directories(Dir);
+  EXPECT_FALSE(llvm::sys::fs::create_directories(Dir));
+  return std::string(Dir);
+}
+
+std::string writeFile(llvm::StringRef Dir, llvm::StringRef Name,
+                      llvm::StringRef Contents) {
+  llvm::SmallString<128> Path(Dir);
+  llvm::sys::path::append(Path, Name);
+  std::error_code EC;
+  llvm::raw_fd_ostream OS(Path, EC);
+  EXPECT_FALSE(EC);
+  OS << Contents;
+  return std::string(Path);
+}
+
+TEST(InferCodebaseTest, OutputDoesNotDependOnJobs) {
+  std::string SrcDir = tempDir("infer_codebase_src");
+  writeFile(SrcDir, "target.h", "void target(int *p);\n");
+  // Many more samples of the same evidence than are kept, in translation
+  // units that take different times to parse.
+  std::vector<std::string> Files;
+  for (int I = 0; I < 16; ++I) {
+    std::string Code = "#include \"target.h\"\n";
+    for (int J = 0; J < I; ++J)
+      Code += "void filler" + std::to_string(J) + "(int *p) { *p; }\n";
+    Code += "void caller() { target(nullptr); }\n";
+    Files.push_back(writeFile(SrcDir, "tu" + std::to_string(I) + ".cc", Code));
+  }
+  tooling::FixedCompilationDatabase DB(SrcDir, {"-std=c++17"});
+
+  auto Infer = [&](unsigned Jobs) {
+    std::string Result;
+    CodebaseOptions Options;
+    Options.WorkDir = tempDir("infer_codebase_work_" + std::to_string(Jobs));
+    Options.Jobs = Jobs;
+    Options.Buckets = 4;
+    EXPECT_FALSE(llvm::errorToBool(inferCodebase(
+        DB, Files, Options,
+        [&](const Inference &I) { Result += I.DebugString(); })));
+    // The intermediate files are gone.
+    std::error_code EC;
+    EXPECT_EQ(llvm::sys::fs::directory_iterator(Options.WorkDir, EC),
+              llvm::sys::fs::directory_iterator());
+    EXPECT_FALSE(EC);
+    return Result;
+  };
+  std::string Serial = Infer(1);
+  EXPECT_NE(Serial.find("target"), std::string::npos);
+  EXPECT_EQ(Infer(4), Serial);
+  EXPECT_EQ(Infer(8), Serial);
+}
+
+}  // namespace
+}  // namespace clang::tidy::nullability
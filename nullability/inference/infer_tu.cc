@@ -4,50 +4,186 @@
 
 #include "nullability/inference/infer_tu.h"
 
+#include <cstddef>
+#include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
+#include "nullability/inference/aggregate.h"
 #include "nullability/inference/collect_evidence.h"
+#include "nullability/inference/evidence_cache.h"
 #include "nullability/inference/inference.proto.h"
 #include "nullability/inference/merge.h"
 #include "clang/AST/ASTContext.h"
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/raw_ostream.h"
 
 namespace clang::tidy::nullability {
+namespace {
 
-std::vector<Inference> inferTU(ASTContext& Ctx) {
-  std::vector<Evidence> AllEvidence;
+// The evidence collected from one implementation.
+struct ImplementationResult {
+  bool Done = false;
+  std::vector<Partial> Partials;
+  // Why the implementation was skipped, if it was.
+  std::string Error;
+  // Why the evidence couldn't be stored in the cache, if it couldn't.
+  std::string CacheError;
+};
 
-  // Collect all evidence.
+// Analyzes the `I`th implementation (or replays its evidence from `Cache`),
+// and stores the results in `Results[I]`.
+void analyzeImplementation(const EvidenceSites& Sites, size_t I,
+                           const EvidenceCache* Cache,
+                           std::vector<ImplementationResult>& Results) {
+  const Decl& Impl = *Sites.Implementations[I];
+  ImplementationResult& Result = Results[I];
+  Result.Done = true;
+  std::string Key;
+  if (Cache) {
+    Key = EvidenceCache::key(Impl);
+    if (auto Cached = Cache->lookup(Key, Impl)) {
+      Result.Partials = std::move(*Cached);
+      return;
+    }
+  }
+
+  EvidenceAggregator Aggregator(Impl.getASTContext().getSourceManager());
+  if (auto Err = collectEvidenceFromImplementation(Impl, Aggregator)) {
+    llvm::raw_string_ostream OS(Result.Error);
+    OS << toString(std::move(Err)) << "\n";
+    Impl.print(OS);
+  }
+  Result.Partials = Aggregator.partials();
+  // Skipped implementations aren't stored, so that the error is reported again.
+  if (Cache && Result.Error.empty()) {
+    if (auto Err = Cache->store(Key, Impl, Result.Partials))
+      Result.CacheError = toString(std::move(Err));
+  }
+}
+
+// Analyzes every `Stride`th implementation in `Ctx`, starting with the
+// `First`th one.
+void analyzeImplementations(ASTContext& Ctx, size_t First, size_t Stride,
+                            const EvidenceCache* Cache,
+                            std::vector<ImplementationResult>& Results) {
+  auto Sites = EvidenceSites::discover(Ctx);
+  // The implementations of a copy of the AST that doesn't match the original
+  // are analyzed in the original instead.
+  if (Sites.Implementations.size() != Results.size()) return;
+  for (size_t I = First; I < Results.size(); I += Stride)
+    analyzeImplementation(Sites, I, Cache, Results);
+}
+
+// Merges the partials of the declarations and of each implementation by
+// symbol, and returns them sorted by USR. The implementations that haven't
+// been analyzed yet are analyzed first.
+//
+// The partials are merged in the order in which partialsFromTU(Ctx) collects
+// the evidence, so that the same samples are kept.
+std::vector<Partial> mergeResults(std::vector<Partial> DeclarationPartials,
+                                  const EvidenceSites& Sites,
+                                  const EvidenceCache* Cache,
+                                  std::vector<ImplementationResult>& Results) {
+  llvm::StringMap<Partial> PartialByUSR;
+  auto Merge = [&](std::vector<Partial> Partials) {
+    for (Partial& P : Partials) {
+      auto [It, Inserted] = PartialByUSR.try_emplace(P.symbol().usr());
+      if (Inserted)
+        It->second = std::move(P);
+      else
+        mergePartials(It->second, P);
+    }
+  };
+  Merge(std::move(DeclarationPartials));
+  for (size_t I = 0; I < Results.size(); ++I) {
+    if (!Results[I].Done) analyzeImplementation(Sites, I, Cache, Results);
+    if (!Results[I].Error.empty())
+      llvm::errs() << "Skipping function: " << Results[I].Error << "\n";
+    if (!Results[I].CacheError.empty())
+      llvm::errs() << "Failed to cache evidence: " << Results[I].CacheError
+                   << "\n";
+    Merge(std::move(Results[I].Partials));
+  }
+
+  std::vector<llvm::StringRef> USRs;
+  USRs.reserve(PartialByUSR.size());
+  for (const auto& Entry : PartialByUSR) USRs.push_back(Entry.getKey());
+  llvm::sort(USRs);
+  std::vector<Partial> Partials;
+  Partials.reserve(USRs.size());
+  for (llvm::StringRef USR : USRs)
+    Partials.push_back(std::move(PartialByUSR[USR]));
+  return Partials;
+}
+
+// Finalizes each symbol's partial into an inference.
+std::vector<Inference> finalizeAll(llvm::ArrayRef<Partial> Partials) {
+  std::vector<Inference> AllInference;
+  AllInference.reserve(Partials.size());
+  for (const Partial& P : Partials) AllInference.push_back(finalize(P));
+  return AllInference;
+}
+
+}  // namespace
+
+std::vector<Partial> partialsFromTU(ASTContext& Ctx,
+                                    const EvidenceCache* Cache) {
+  // Summarize the evidence by symbol as it is collected.
+  EvidenceAggregator Aggregator(Ctx.getSourceManager());
   auto Sites = EvidenceSites::discover(Ctx);
-  auto Emitter = evidenceEmitter([&](auto& E) { AllEvidence.push_back(E); });
   for (const auto* Decl : Sites.Declarations)
-    collectEvidenceFromTargetDeclaration(*Decl, Emitter);
+    collectEvidenceFromTargetDeclaration(*Decl, Aggregator);
+  if (Cache) {
+    // The evidence of each implementation is cached separately.
+    std::vector<ImplementationResult> Results(Sites.Implementations.size());
+    return mergeResults(Aggregator.partials(), Sites, Cache, Results);
+  }
   for (const auto* Impl : Sites.Implementations) {
-    if (auto Err = collectEvidenceFromImplementation(*Impl, Emitter)) {
+    if (auto Err = collectEvidenceFromImplementation(*Impl, Aggregator)) {
       llvm::errs() << "Skipping function: " << toString(std::move(Err)) << "\n";
       Impl->print(llvm::errs());
     }
   }
-  // Group by symbol.
-  llvm::sort(AllEvidence, [&](const Evidence& L, const Evidence& R) {
-    return L.symbol().usr() < R.symbol().usr();
-  });
-  // For each symbol, combine evidence into an inference.
-  llvm::ArrayRef<Evidence> RemainingEvidence = AllEvidence;
-  std::vector<Inference> AllInference;
-  while (!RemainingEvidence.empty()) {
-    auto Batch = RemainingEvidence.take_while([&](const Evidence& E) {
-      return E.symbol().usr() == RemainingEvidence.front().symbol().usr();
+  return Aggregator.partials();
+}
+
+std::vector<Inference> inferTU(ASTContext& Ctx, const EvidenceCache* Cache) {
+  return finalizeAll(partialsFromTU(Ctx, Cache));
+}
+
+std::vector<Inference> inferTU(ASTContext& Ctx, unsigned Threads,
+                               TUParser ParseTU, const EvidenceCache* Cache) {
+  if (Threads <= 1) return inferTU(Ctx, Cache);
+
+  EvidenceAggregator Aggregator(Ctx.getSourceManager());
+  auto Sites = EvidenceSites::discover(Ctx);
+  for (const auto* Decl : Sites.Declarations)
+    collectEvidenceFromTargetDeclaration(*Decl, Aggregator);
+
+  // Thread I analyzes the implementations I, I + Threads, I + 2 * Threads...
+  // The current thread takes the first share, in the original AST.
+  // Each result is written by a single thread, so they need no locking.
+  std::vector<ImplementationResult> Results(Sites.Implementations.size());
+  std::vector<std::thread> Workers;
+  for (unsigned I = 1; I < Threads && I < Results.size(); ++I) {
+    Workers.emplace_back([&, I] {
+      ParseTU([&](ASTContext& Copy) {
+        analyzeImplementations(Copy, I, Threads, Cache, Results);
+      });
     });
-    RemainingEvidence = RemainingEvidence.drop_front(Batch.size());
-    AllInference.push_back(mergeEvidence(Batch));
   }
+  analyzeImplementations(Ctx, 0, Threads, Cache, Results);
+  for (auto& Worker : Workers) Worker.join();
 
-  return AllInference;
+  return finalizeAll(
+      mergeResults(Aggregator.partials(), Sites, Cache, Results));
 }
 
 }  // namespace clang::tidy::nullability
@@ -7,8 +7,10 @@
 
 #include <vector>
 
+#include "nullability/inference/evidence_cache.h"
 #include "nullability/inference/inference.proto.h"
 #include "clang/AST/ASTContext.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
 
 namespace clang::tidy::nullability {
 
@@ -17,7 +19,36 @@ namespace clang::tidy::nullability {
 // This is not as powerful as running inference over the whole codebase, but is
 // useful in observing the behavior of the inference system.
 // It also lets us write tests for the whole inference system.
-std::vector<Inference> inferTU(ASTContext &);
+//
+// If there is a `Cache`, the evidence of the function bodies that are in it is
+// replayed rather than collected again, and that of the others is stored.
+std::vector<Inference> inferTU(ASTContext &,
+                               const EvidenceCache *Cache = nullptr);
+
+// Collects the evidence in a single translation unit, and combines it into a
+// Partial for each symbol, sorted by USR.
+//
+// This is the "map" phase of inference over a whole codebase: the partials of
+// all translation units are then merged by symbol and finalized.
+std::vector<Partial> partialsFromTU(ASTContext &,
+                                    const EvidenceCache *Cache = nullptr);
+
+// Parses the translation unit again, and calls the callback with the AST.
+using TUParser =
+    llvm::function_ref<void(llvm::function_ref<void(ASTContext &)>)>;
+
+// Like inferTU(Ctx), but analyzes the function bodies on `Threads` threads.
+//
+// A Clang AST can't be used from several threads at once (even analyzing a
+// function allocates in the ASTContext and updates SourceManager caches), so
+// each extra thread analyzes its share of the function bodies in its own copy
+// of the AST, produced by `ParseTU`. `ParseTU` is called concurrently, and must
+// parse the same code as `Ctx`.
+//
+// The results are the same as those of inferTU(Ctx), in the same order.
+std::vector<Inference> inferTU(ASTContext &Ctx, unsigned Threads,
+                               TUParser ParseTU,
+                               const EvidenceCache *Cache = nullptr);
 
 }  // namespace clang::tidy::nullability
 
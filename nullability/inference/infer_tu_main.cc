@@ -6,21 +6,27 @@
 //
 // By default (-diagnostics=1) it shows findings as diagnostics.
 // It can optionally (-protos=1) print the Inference proto.
+// Function bodies can be analyzed on several threads (-threads=N), and their
+// evidence cached between runs (-cache_dir=...).
 //
 // This is not the intended way to fully analyze a real codebase.
 // e.g. it can't jointly inspect all callsites of a function (in different TUs).
 
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
 
 #include "absl/log/check.h"
+#include "nullability/inference/evidence_cache.h"
 #include "nullability/inference/infer_tu.h"
 #include "nullability/inference/inference.proto.h"
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/Decl.h"
 #include "clang/AST/RecursiveASTVisitor.h"
+#include "clang/Basic/Diagnostic.h"
 #include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/CompilerInvocation.h"
 #include "clang/Frontend/FrontendAction.h"
 #include "clang/Frontend/FrontendActions.h"
 #include "clang/Index/USRGeneration.h"
@@ -30,6 +36,7 @@
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/Twine.h"
@@ -53,6 +60,17 @@ llvm::cl::opt<bool> PrintEvidence{
     llvm::cl::desc("Print sample evidence as notes (requires -diagnostics)"),
     llvm::cl::init(true),
 };
+llvm::cl::opt<unsigned> Threads{
+    "threads",
+    llvm::cl::desc("Number of threads analyzing function bodies (each extra "
+                   "thread parses its own copy of the translation unit)"),
+    llvm::cl::init(1),
+};
+llvm::cl::opt<std::string> CacheDir{
+    "cache_dir",
+    llvm::cl::desc("Directory to cache the evidence of function bodies in, "
+                   "so that unchanged ones aren't analyzed again"),
+};
 llvm::cl::opt<bool> IncludeTrivial{
     "trivial",
     llvm::cl::desc("Include trivial inferences (annotated, no conflicts)"),
@@ -77,7 +95,8 @@ class DiagnosticPrinter : public RecursiveASTVisitor<DiagnosticPrinter> {
           << Inference::Nullability_Name(Slot.nullability());
       if (PrintEvidence) {
         for (const auto &Sample : Slot.sample_evidence()) {
-          if (SourceLocation Loc = parseLoc(Sample.location()); Loc.isValid())
+          if (SourceLocation Loc = toSourceLocation(Sample.location());
+              Loc.isValid())
             Diags.Report(Loc, DiagSample) << Evidence::Kind_Name(Sample.kind());
         }
       }
@@ -89,17 +108,12 @@ class DiagnosticPrinter : public RecursiveASTVisitor<DiagnosticPrinter> {
     return ("parameter " + llvm::Twine(S - SLOT_PARAM)).str();
   }
 
-  // Terrible hack: parse "foo.cc:4:2" back into a SourceLocation.
-  SourceLocation parseLoc(llvm::StringRef LocStr) {
+  SourceLocation toSourceLocation(const Location &Loc) {
     auto &SM = Diags.getSourceManager();
-    auto &FM = SM.getFileManager();
-    auto [Rest, ColStr] = llvm::StringRef(LocStr).rsplit(':');
-    auto [Name, LineStr] = Rest.rsplit(':');
-    auto File = FM.getOptionalFileRef(Name);
-    unsigned Line, Col;
-    if (!File || LineStr.getAsInteger(10, Line) || ColStr.getAsInteger(10, Col))
-      return SourceLocation();
-    return SM.translateFileLineCol(&File->getFileEntry(), Line, Col);
+    auto File = SM.getFileManager().getOptionalFileRef(Loc.file());
+    if (!File) return SourceLocation();
+    return SM.translateFileLineCol(&File->getFileEntry(), Loc.line(),
+                                   Loc.column());
   }
 
  public:
@@ -128,13 +142,59 @@ bool isTrivial(const Inference::SlotInference &I) {
   return false;
 }
 
+// Parses the translation unit of `Invocation` again, and calls `Callback` with
+// the AST.
+void reparse(const CompilerInvocation &Invocation,
+             llvm::function_ref<void(ASTContext &)> Callback) {
+  class ReparseAction : public SyntaxOnlyAction {
+   public:
+    explicit ReparseAction(llvm::function_ref<void(ASTContext &)> Callback)
+        : Callback(Callback) {}
+
+   private:
+    std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &,
+                                                   llvm::StringRef) override {
+      class Consumer : public ASTConsumer {
+       public:
+        explicit Consumer(llvm::function_ref<void(ASTContext &)> Callback)
+            : Callback(Callback) {}
+
+       private:
+        void HandleTranslationUnit(ASTContext &Ctx) override { Callback(Ctx); }
+        llvm::function_ref<void(ASTContext &)> Callback;
+      };
+      return std::make_unique<Consumer>(Callback);
+    }
+    llvm::function_ref<void(ASTContext &)> Callback;
+  };
+
+  CompilerInstance Clang;
+  Clang.setInvocation(std::make_shared<CompilerInvocation>(Invocation));
+  // The diagnostics were already reported when parsing the original AST.
+  Clang.createDiagnostics(new IgnoringDiagConsumer());
+  ReparseAction Action(Callback);
+  Clang.ExecuteAction(Action);
+}
+
 class Action : public SyntaxOnlyAction {
-  std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &,
+  std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &CI,
                                                  llvm::StringRef) override {
     class Consumer : public ASTConsumer {
+     public:
+      explicit Consumer(const CompilerInvocation &Invocation)
+          : Invocation(Invocation) {}
+
+     private:
+      const CompilerInvocation &Invocation;
+
       void HandleTranslationUnit(ASTContext &Ctx) override {
         llvm::errs() << "Running inference...";
-        auto Results = inferTU(Ctx);
+        std::optional<EvidenceCache> Cache;
+        if (!CacheDir.empty()) Cache.emplace(CacheDir);
+        auto Results = inferTU(
+            Ctx, Threads,
+            [&](auto Callback) { reparse(Invocation, Callback); },
+            Cache ? &*Cache : nullptr);
         if (!IncludeTrivial)
           llvm::erase_if(Results, [](Inference &I) {
             llvm::erase_if(*I.mutable_slot_inference(), isTrivial);
@@ -146,7 +206,7 @@ class Action : public SyntaxOnlyAction {
           DiagnosticPrinter(Results, Ctx.getDiagnostics()).TraverseAST(Ctx);
       }
     };
-    return std::make_unique<Consumer>();
+    return std::make_unique<Consumer>(CI.getInvocation());
   }
 };
 
@@ -4,10 +4,15 @@
 
 #include "nullability/inference/infer_tu.h"
 
+#include <atomic>
 #include <optional>
+#include <string>
+#include <system_error>
 #include <vector>
 
+#include "nullability/inference/evidence_cache.h"
 #include "nullability/inference/inference.proto.h"
+#include "nullability/inference/merge.h"
 #include "nullability/proto_matchers.h"
 #include "clang/ASTMatchers/ASTMatchFinder.h"
 #include "clang/ASTMatchers/ASTMatchers.h"
@@ -15,12 +20,16 @@
 #include "clang/Testing/TestAST.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
 #include "third_party/llvm/llvm-project/third-party/unittest/googlemock/include/gmock/gmock.h"
 #include "third_party/llvm/llvm-project/third-party/unittest/googletest/include/gtest/gtest.h"
 
 namespace clang::tidy::nullability {
 namespace {
 using ast_matchers::hasName;
+using testing::IsEmpty;
+using testing::Not;
 
 MATCHER_P2(inferredSlot, I, Nullability, "") {
   return arg.slot() == I && arg.nullability() == Nullability;
@@ -34,11 +43,12 @@ MATCHER_P2(inferenceMatcher, USR, SlotsMatcher, "") {
 AST_MATCHER(Decl, isCanonical) { return Node.isCanonicalDecl(); }
 
 class InferTUTest : public ::testing::Test {
+  TestInputs Inputs;
   std::optional<TestAST> AST;
 
  protected:
   void build(llvm::StringRef Code) {
-    TestInputs Inputs = Code;
+    Inputs = Code;
     Inputs.ExtraFiles["nullability.h"] = R"cc(
       template <typename T>
       using Nullable [[clang::annotate("Nullable")]] = T;
@@ -51,6 +61,19 @@ class InferTUTest : public ::testing::Test {
   }
 
   auto infer() { return inferTU(AST->context()); }
+  auto partials() { return partialsFromTU(AST->context()); }
+  auto infer(const EvidenceCache &Cache) {
+    return inferTU(AST->context(), &Cache);
+  }
+
+  // Infers on `Threads` threads, and counts the copies of the AST in `Parses`.
+  auto infer(unsigned Threads, std::atomic<int> &Parses) {
+    return inferTU(AST->context(), Threads, [&](auto Callback) {
+      ++Parses;
+      TestAST Copy(Inputs);
+      Callback(Copy.context());
+    });
+  }
 
   // Returns a matcher for an Inference.
   // The DeclMatcher should uniquely identify the symbol being described.
@@ -101,11 +124,23 @@ TEST_F(InferTUTest, Samples) {
                                     {inferredSlot(1, Inference::NONNULL)})));
   EXPECT_THAT(Results.front().slot_inference(0).sample_evidence(),
               testing::UnorderedElementsAre(
-                  EqualsProto(R"pb(location: "input.mm:2:30"
+                  EqualsProto(R"pb(location {
+                                     file: "input.mm"
+                                     line: 2
+                                     column: 30
+                                   }
                                    kind: NONNULL_ARGUMENT)pb"),
-                  EqualsProto(R"pb(location: "input.mm:1:24"
+                  EqualsProto(R"pb(location {
+                                     file: "input.mm"
+                                     line: 1
+                                     column: 24
+                                   }
                                    kind: UNCHECKED_DEREFERENCE)pb"),
-                  EqualsProto(R"pb(location: "input.mm:1:29"
+                  EqualsProto(R"pb(location {
+                                     file: "input.mm"
+                                     line: 1
+                                     column: 29
+                                   }
                                    kind: UNCHECKED_DEREFERENCE)pb")));
 }
 
@@ -194,5 +229,78 @@ TEST_F(InferTUTest, ReturnTypeNonnullAndNullable) {
                                  {inferredSlot(0, Inference::NULLABLE)})));
 }
 
+TEST_F(InferTUTest, PartialsFromTU) {
+  build(R"cc(
+    void callee(int* p);
+    void target(int* p, Nullable<int*> q) {
+      *p;
+      callee(q);
+    }
+  )cc");
+  auto Partials = partials();
+  auto Expected = infer();
+  ASSERT_EQ(Partials.size(), Expected.size());
+  for (size_t I = 0; I < Partials.size(); ++I)
+    EXPECT_EQ(finalize(Partials[I]).DebugString(), Expected[I].DebugString());
+}
+
+TEST_F(InferTUTest, Threads) {
+  build(R"cc(
+    void deref(int* p) { *p; }
+    int* returnsNull() { return nullptr; }
+    Nonnull<int*> returnsNonnull();
+    void callee(int* p, int* q);
+    void caller(int* p) { callee(returnsNonnull(), returnsNull()); }
+    void derefTwice(int* p, int* q) { *p + *q; }
+    template <typename T>
+    T* identity(T* p) { return p; }
+    int* instantiation() { return identity(returnsNonnull()); }
+  )cc");
+  auto Expected = infer();
+  ASSERT_THAT(Expected, Not(IsEmpty()));
+
+  std::atomic<int> Parses = 0;
+  auto Results = infer(3, Parses);
+  EXPECT_EQ(Parses, 2);
+  ASSERT_EQ(Results.size(), Expected.size());
+  for (size_t I = 0; I < Results.size(); ++I)
+    EXPECT_EQ(Results[I].DebugString(), Expected[I].DebugString());
+
+  // More threads than function bodies.
+  Parses = 0;
+  Results = infer(100, Parses);
+  EXPECT_LT(Parses, 100);
+  ASSERT_EQ(Results.size(), Expected.size());
+  for (size_t I = 0; I < Results.size(); ++I)
+    EXPECT_EQ(Results[I].DebugString(), Expected[I].DebugString());
+}
+
+TEST_F(InferTUTest, Cache) {
+  build(R"cc(
+    void deref(int* p) { *p; }
+    int* returnsNull() { return nullptr; }
+    void callee(int* p, int* q);
+    void caller(int* p) { callee(p, returnsNull()); }
+  )cc");
+  auto Expected = infer();
+  ASSERT_THAT(Expected, Not(IsEmpty()));
+
+  llvm::SmallString<128> Dir(testing::TempDir());
+  llvm::sys::path::append(Dir, "infer_tu_cache");
+  llvm::sys::fs::remove_directories(Dir);
+  EvidenceCache Cache(Dir);
+  // The evidence is stored by the first run, and replayed by the second.
+  for (int Run = 0; Run < 2; ++Run) {
+    auto Results = infer(Cache);
+    ASSERT_EQ(Results.size(), Expected.size());
+    for (size_t I = 0; I < Results.size(); ++I)
+      EXPECT_EQ(Results[I].DebugString(), Expected[I].DebugString());
+  }
+  std::error_code EC;
+  EXPECT_NE(llvm::sys::fs::recursive_directory_iterator(Dir, EC),
+            llvm::sys::fs::recursive_directory_iterator());
+  EXPECT_FALSE(EC);
+}
+
 }  // namespace
 }  // namespace clang::tidy::nullability
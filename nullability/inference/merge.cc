@@ -6,34 +6,63 @@
 
 #include <array>
 #include <optional>
+#include <tuple>
 #include <utility>
 
 #include "absl/log/check.h"
 #include "nullability/inference/inference.proto.h"
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringRef.h"
 
 namespace clang::tidy::nullability {
 namespace {
 
-static void mergeSampleLocations(Partial::SampleLocations &LHS,
+// Returns the path of the file of a sample location of `P`.
+static llvm::StringRef filePath(const Partial &P, const Location &Loc) {
+  if (Loc.file_index() >= static_cast<unsigned>(P.file_size())) return "";
+  return P.file(Loc.file_index());
+}
+
+// Returns the index of `Path` in the file table of `P`, adding it if needed.
+static unsigned fileIndex(Partial &P, llvm::StringRef Path) {
+  // Linear scan is fine because the samples are in few files.
+  for (int I = 0; I < P.file_size(); ++I)
+    if (P.file(I) == Path) return I;
+  P.add_file(Path.str());
+  return P.file_size() - 1;
+}
+
+static void mergeSampleLocations(Partial &LHSPartial,
+                                 Partial::SampleLocations &LHS,
+                                 const Partial &RHSPartial,
                                  const Partial::SampleLocations &RHS) {
-  static constexpr unsigned Limit = 3;
   // We don't care which we pick, but they should be unique.
   // Multiple instantiations of the same template are not interesting.
   for (const auto &Loc : RHS.location()) {
-    if (LHS.location_size() >= Limit) break;
-    // Linear scan is fine because Limit is tiny.
-    if (!llvm::is_contained(LHS.location(), Loc)) LHS.add_location(Loc);
+    if (LHS.location_size() >= MaxSampleLocations) break;
+    llvm::StringRef Path = filePath(RHSPartial, Loc);
+    // Linear scan is fine because MaxSampleLocations is tiny.
+    if (llvm::any_of(LHS.location(), [&](const Location &Existing) {
+          return Existing.line() == Loc.line() &&
+                 Existing.column() == Loc.column() &&
+                 filePath(LHSPartial, Existing) == Path;
+        }))
+      continue;
+    Location &Added = *LHS.add_location();
+    Added = Loc;
+    Added.set_file_index(fileIndex(LHSPartial, Path));
   }
 }
 
-static void mergeSlotPartials(Partial::SlotPartial &LHS,
+static void mergeSlotPartials(Partial &LHSPartial, Partial::SlotPartial &LHS,
+                              const Partial &RHSPartial,
                               const Partial::SlotPartial &RHS) {
   for (auto [Kind, Count] : RHS.kind_count())
     (*LHS.mutable_kind_count())[Kind] += Count;
   for (const auto &[Kind, Samples] : RHS.kind_samples())
-    mergeSampleLocations((*LHS.mutable_kind_samples())[Kind], Samples);
+    mergeSampleLocations(LHSPartial, (*LHS.mutable_kind_samples())[Kind],
+                         RHSPartial, Samples);
 }
 
 }  // namespace
@@ -45,8 +74,12 @@ Partial partialFromEvidence(const Evidence &E) {
   while (P.slot_size() < E.slot()) P.add_slot();
   auto *S = P.add_slot();
   ++(*S->mutable_kind_count())[E.kind()];
-  if (E.has_location())
-    (*S->mutable_kind_samples())[E.kind()].add_location(E.location());
+  if (E.has_location()) {
+    Location &Loc = *(*S->mutable_kind_samples())[E.kind()].add_location();
+    Loc = E.location();
+    Loc.clear_file();
+    Loc.set_file_index(fileIndex(P, E.location().file()));
+  }
   return P;
 }
 
@@ -55,7 +88,7 @@ void mergePartials(Partial &LHS, const Partial &RHS) {
   auto *Slots = LHS.mutable_slot();
   while (RHS.slot_size() > Slots->size()) Slots->Add();
   for (unsigned I = 0; I < RHS.slot_size(); ++I)
-    mergeSlotPartials(*LHS.mutable_slot(I), RHS.slot(I));
+    mergeSlotPartials(LHS, *LHS.mutable_slot(I), RHS, RHS.slot(I));
 }
 
 // Form nullability conclusions from a set of evidence.
@@ -71,13 +104,18 @@ Inference finalize(const Partial &P) {
     for (const auto &[Kind, Samples] : P.slot(I).kind_samples()) {
       for (const auto &Loc : Samples.location()) {
         auto *Sample = Slot.add_sample_evidence();
-        Sample->set_location(Loc);
+        Location &SampleLoc = *Sample->mutable_location();
+        SampleLoc.set_file(filePath(P, Loc).str());
+        SampleLoc.set_line(Loc.line());
+        SampleLoc.set_column(Loc.column());
         Sample->set_kind(static_cast<Evidence::Kind>(Kind));
       }
     }
     llvm::stable_sort(*Slot.mutable_sample_evidence(), [&](auto &L, auto &R) {
-      return std::forward_as_tuple(L.kind(), L.location()) <
-             std::forward_as_tuple(R.kind(), R.location());
+      return std::make_tuple(L.kind(), llvm::StringRef(L.location().file()),
+                             L.location().line(), L.location().column()) <
+             std::make_tuple(R.kind(), llvm::StringRef(R.location().file()),
+                             R.location().line(), R.location().column());
     });
 
     std::array<unsigned, Evidence::Kind_MAX + 1> KindCounts = {};
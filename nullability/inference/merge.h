@@ -20,6 +20,10 @@
 
 namespace clang::tidy::nullability {
 
+// The number of sample locations a Partial keeps for each kind of evidence in a
+// slot.
+inline constexpr unsigned MaxSampleLocations = 3;
+
 // Build a Partial representing a single piece of evidence.
 Partial partialFromEvidence(const Evidence &);
 // Update LHS to include the evidence from RHS.
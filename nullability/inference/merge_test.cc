@@ -29,7 +29,7 @@ TEST(MergeEvidenceTest, PartialFromEvidence) {
                 symbol { usr: "func" }
                 slot: 1
                 kind: UNCHECKED_DEREFERENCE
-                location: "foo.cc:42"
+                location { file: "foo.cc" line: 42 column: 3 }
               )pb")),
               EqualsProto(R"pb(
                 symbol { usr: "func" }
@@ -38,9 +38,10 @@ TEST(MergeEvidenceTest, PartialFromEvidence) {
                   kind_count { key: 3 value: 1 }
                   kind_samples {
                     key: 3
-                    value { location: "foo.cc:42" }
+                    value { location { file_index: 0 line: 42 column: 3 } }
                   }
                 }
+                file: "foo.cc"
               )pb"));
 }
 
@@ -52,10 +53,14 @@ TEST(MergeEvidenceTest, MergePartials) {
       kind_count { key: 0 value: 2 }
       kind_samples {
         key: 0
-        value { location: "a" location: "b" }
+        value {
+          location { file_index: 0 line: 1 }
+          location { file_index: 0 line: 2 }
+        }
       }
     }
     slot { kind_count { key: 0 value: 1 } }
+    file: "a.cc"
   )pb");
 
   auto R = proto<Partial>(R"pb(
@@ -65,11 +70,17 @@ TEST(MergeEvidenceTest, MergePartials) {
       kind_count { key: 0 value: 2 }
       kind_samples {
         key: 0
-        value { location: "c" location: "a" location: "d" }
+        value {
+          location { file_index: 0 line: 1 }
+          location { file_index: 1 line: 1 }
+          location { file_index: 0 line: 5 }
+        }
       }
     }
     slot {}
     slot { kind_count { key: 3 value: 1 } }
+    file: "b.cc"
+    file: "a.cc"
   )pb");
 
   mergePartials(L, R);
@@ -81,11 +92,17 @@ TEST(MergeEvidenceTest, MergePartials) {
                   kind_count { key: 1 value: 1 }
                   kind_samples {
                     key: 0
-                    value { location: "a" location: "b" location: "c" }
+                    value {
+                      location { file_index: 0 line: 1 }
+                      location { file_index: 0 line: 2 }
+                      location { file_index: 1 line: 1 }
+                    }
                   }
                 }
                 slot { kind_count { key: 0 value: 1 } }
                 slot { kind_count { key: 3 value: 1 } }
+                file: "a.cc"
+                file: "b.cc"
               )pb"));
 }
 
@@ -97,11 +114,11 @@ TEST(MergeEvidenceTest, Finalize) {
                   kind_count { key: 2 value: 1 }  # ANNOTATED_NONNULL
                   kind_samples {
                     key: 1
-                    value { location: "decl" }
+                    value { location { file_index: 1 line: 3 } }
                   }
                   kind_samples {
                     key: 2
-                    value { location: "def" }
+                    value { location { file_index: 0 line: 10 } }
                   }
                 }
                 slot {}
@@ -109,6 +126,8 @@ TEST(MergeEvidenceTest, Finalize) {
                   kind_count { key: 3 value: 1 }  # UNCHECKED_DEREFERENCE
                 }
                 slot { kind_count { key: 0 value: 1 } }  # ANNOTATED_UNKNOWN
+                file: "def.cc"
+                file: "decl.h"
               )pb")),
               EqualsProto(R"pb(
                 symbol { usr: "func" }
@@ -116,8 +135,14 @@ TEST(MergeEvidenceTest, Finalize) {
                   slot: 0
                   nullability: UNKNOWN
                   conflict: true
-                  sample_evidence { kind: ANNOTATED_NULLABLE location: "decl" }
-                  sample_evidence { kind: ANNOTATED_NONNULL location: "def" }
+                  sample_evidence {
+                    kind: ANNOTATED_NULLABLE
+                    location { file: "decl.h" line: 3 column: 0 }
+                  }
+                  sample_evidence {
+                    kind: ANNOTATED_NONNULL
+                    location { file: "def.cc" line: 10 column: 0 }
+                  }
                 }
                 slot_inference { slot: 2 nullability: NONNULL }
                 slot_inference { slot: 3 nullability: UNKNOWN }
@@ -0,0 +1,155 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#include "nullability/inference/reduce.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "nullability/inference/inference.proto.h"
+#include "nullability/inference/merge.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/LEB128.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+namespace clang::tidy::nullability {
+namespace {
+
+// Merges the partials of a bucket, and returns the inferences sorted by USR.
+llvm::Expected<std::vector<Inference>> reduceBucket(llvm::StringRef Path) {
+  llvm::StringMap<Partial> PartialByUSR;
+  if (auto Err = readRecords<Partial>(Path, [&](Partial P) {
+        auto [It, Inserted] = PartialByUSR.try_emplace(P.symbol().usr());
+        if (Inserted)
+          It->second = std::move(P);
+        else
+          mergePartials(It->second, P);
+        return llvm::Error::success();
+      }))
+    return std::move(Err);
+
+  std::vector<llvm::StringRef> USRs;
+  USRs.reserve(PartialByUSR.size());
+  for (const auto &Entry : PartialByUSR) USRs.push_back(Entry.getKey());
+  llvm::sort(USRs);
+  std::vector<Inference> Result;
+  Result.reserve(USRs.size());
+  for (llvm::StringRef USR : USRs)
+    Result.push_back(finalize(PartialByUSR[USR]));
+  return Result;
+}
+
+}  // namespace
+
+llvm::Error readRecords(
+    llvm::StringRef Path,
+    llvm::function_ref<llvm::Error(llvm::StringRef)> Callback) {
+  auto Buffer = llvm::MemoryBuffer::getFile(Path);
+  if (!Buffer) return llvm::createFileError(Path, Buffer.getError());
+  const uint8_t *Pos =
+      reinterpret_cast<const uint8_t *>((*Buffer)->getBufferStart());
+  const uint8_t *End =
+      reinterpret_cast<const uint8_t *>((*Buffer)->getBufferEnd());
+  while (Pos != End) {
+    unsigned SizeLength;
+    const char *Error = nullptr;
+    uint64_t Size = llvm::decodeULEB128(Pos, &SizeLength, End, &Error);
+    if (Error || Size > static_cast<uint64_t>(End - Pos - SizeLength))
+      return llvm::createFileError(
+          Path, llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                        "Truncated record"));
+    Pos += SizeLength;
+    if (auto Err = Callback(
+            llvm::StringRef(reinterpret_cast<const char *>(Pos), Size)))
+      return Err;
+    Pos += Size;
+  }
+  return llvm::Error::success();
+}
+
+llvm::Expected<PartialReducer> PartialReducer::create(llvm::StringRef SpillDir,
+                                                      unsigned Buckets) {
+  if (std::error_code EC = llvm::sys::fs::create_directories(SpillDir))
+    return llvm::createFileError(SpillDir, EC);
+  PartialReducer Reducer;
+  for (unsigned I = 0; I < std::max(Buckets, 1u); ++I) {
+    llvm::SmallString<128> Path = SpillDir;
+    llvm::sys::path::append(Path, "bucket-" + llvm::Twine(I) + ".partials");
+    std::error_code EC;
+    auto File = std::make_unique<llvm::raw_fd_ostream>(Path, EC);
+    if (EC) return llvm::createFileError(Path, EC);
+    Reducer.BucketPaths.push_back(std::string(Path));
+    Reducer.BucketFiles.push_back(std::move(File));
+  }
+  return Reducer;
+}
+
+PartialReducer::~PartialReducer() {
+  BucketFiles.clear();
+  for (const auto &Path : BucketPaths) llvm::sys::fs::remove(Path);
+}
+
+llvm::Error PartialReducer::add(const Partial &P) {
+  // xxHash64 is stable, so the buckets don't depend on the run.
+  auto &File = *BucketFiles[llvm::xxHash64(P.symbol().usr()) %
+                            BucketFiles.size()];
+  writeRecord(P, File);
+  if (File.has_error())
+    return llvm::createStringError(File.error(), "Failed to spill a partial");
+  return llvm::Error::success();
+}
+
+llvm::Error PartialReducer::finish(
+    unsigned Threads, llvm::function_ref<void(const Inference &)> Output) && {
+  for (auto &File : BucketFiles) {
+    File->close();
+    if (File->has_error())
+      return llvm::createStringError(File->error(),
+                                     "Failed to spill partials");
+  }
+
+  // Buckets are merged in batches of `Threads`, and output in order.
+  Threads = std::max(Threads, 1u);
+  for (size_t First = 0; First < BucketPaths.size(); First += Threads) {
+    size_t Count = std::min<size_t>(Threads, BucketPaths.size() - First);
+    std::vector<std::optional<llvm::Expected<std::vector<Inference>>>> Results(
+        Count);
+    std::vector<std::thread> Workers;
+    for (size_t I = 1; I < Count; ++I)
+      Workers.emplace_back(
+          [&, I] { Results[I].emplace(reduceBucket(BucketPaths[First + I])); });
+    Results[0].emplace(reduceBucket(BucketPaths[First]));
+    for (auto &Worker : Workers) Worker.join();
+
+    llvm::Error Err = llvm::Error::success();
+    for (auto &Result : Results) {
+      if (!*Result) {
+        Err = llvm::joinErrors(std::move(Err), Result->takeError());
+        continue;
+      }
+      for (const Inference &I : **Result) Output(I);
+    }
+    if (Err) return Err;
+  }
+  return llvm::Error::success();
+}
+
+}  // namespace clang::tidy::nullability
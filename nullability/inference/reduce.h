@@ -0,0 +1,93 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+// Merges the partial evidence of many translation units by symbol.
+//
+// This is the "reduce" phase of inference over a whole codebase: each
+// translation unit is summarized as Partials (see partialsFromTU), and all the
+// Partials for a symbol are merged and finalized into an Inference.
+//
+// Partials and inferences are passed between phases in files of records. Each
+// record is a varint size followed by a serialized proto (the format of
+// protobuf's delimited streams).
+
+#ifndef CRUBIT_NULLABILITY_INFERENCE_REDUCE_H_
+#define CRUBIT_NULLABILITY_INFERENCE_REDUCE_H_
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "nullability/inference/inference.proto.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/LEB128.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace clang::tidy::nullability {
+
+// Appends a record of `Message` to `OS`.
+template <typename Proto>
+void writeRecord(const Proto &Message, llvm::raw_ostream &OS) {
+  std::string Bytes = Message.SerializeAsString();
+  llvm::encodeULEB128(Bytes.size(), OS);
+  OS << Bytes;
+}
+
+// Calls `Callback` with the serialized proto of each record in the file.
+llvm::Error readRecords(llvm::StringRef Path,
+                        llvm::function_ref<llvm::Error(llvm::StringRef)>);
+
+// Calls `Callback` with the proto of each record in the file.
+template <typename Proto>
+llvm::Error readRecords(llvm::StringRef Path,
+                        llvm::function_ref<llvm::Error(Proto)> Callback) {
+  return readRecords(Path, [&](llvm::StringRef Bytes) -> llvm::Error {
+    Proto Message;
+    if (!Message.ParseFromArray(Bytes.data(), Bytes.size()))
+      return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                     "Invalid record in " + Path);
+    return Callback(std::move(Message));
+  });
+}
+
+// Merges partials by symbol, and finalizes them, in bounded memory.
+//
+// As they are added, partials are spilled to one of several bucket files,
+// according to a hash of their USR. Buckets are then merged one at a time, so
+// that memory use is bounded by the size of a bucket rather than by the number
+// of symbols in the codebase.
+class PartialReducer {
+ public:
+  // Creates a reducer with `Buckets` bucket files in the directory `SpillDir`.
+  static llvm::Expected<PartialReducer> create(llvm::StringRef SpillDir,
+                                               unsigned Buckets);
+
+  PartialReducer(PartialReducer &&) = default;
+  PartialReducer &operator=(PartialReducer &&) = default;
+  ~PartialReducer();
+
+  // Adds a partial, for any symbol.
+  llvm::Error add(const Partial &);
+
+  // Merges the partials of each symbol, and calls `Output` with their
+  // inferences, in a deterministic order. Up to `Threads` buckets are merged
+  // concurrently, but `Output` is only called from the current thread.
+  //
+  // The bucket files are deleted.
+  llvm::Error finish(unsigned Threads,
+                     llvm::function_ref<void(const Inference &)> Output) &&;
+
+ private:
+  PartialReducer() = default;
+
+  std::vector<std::string> BucketPaths;
+  std::vector<std::unique_ptr<llvm::raw_fd_ostream>> BucketFiles;
+};
+
+}  // namespace clang::tidy::nullability
+
+#endif  // CRUBIT_NULLABILITY_INFERENCE_REDUCE_H_
@@ -0,0 +1,148 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#include "nullability/inference/reduce.h"
+
+#include <cstddef>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "nullability/inference/inference.proto.h"
+#include "nullability/inference/merge.h"
+#include "nullability/proto_matchers.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "third_party/llvm/llvm-project/third-party/unittest/googlemock/include/gmock/gmock.h"
+#include "third_party/llvm/llvm-project/third-party/unittest/googletest/include/gtest/gtest.h"
+#include "third_party/protobuf/text_format.h"
+
+namespace clang::tidy::nullability {
+namespace {
+using testing::ElementsAre;
+using testing::IsEmpty;
+
+template <typename T>
+T proto(llvm::StringRef Text) {
+  T Result;
+  CHECK(proto2::TextFormat::ParseFromString(Text, &Result));
+  return Result;
+}
+
+std::string tempPath(llvm::StringRef Name) {
+  llvm::SmallString<128> Path(testing::TempDir());
+  llvm::sys::path::append(Path, Name);
+  return std::string(Path);
+}
+
+TEST(ReduceTest, Records) {
+  std::string Path = tempPath("records");
+  {
+    std::error_code EC;
+    llvm::raw_fd_ostream OS(Path, EC);
+    ASSERT_FALSE(EC);
+    writeRecord(proto<Partial>(R"pb(symbol { usr: "a" })pb"), OS);
+    writeRecord(Partial(), OS);
+    writeRecord(proto<Partial>(R"pb(symbol { usr: "b" } slot {})pb"), OS);
+  }
+  std::vector<Partial> Partials;
+  ASSERT_FALSE(llvm::errorToBool(readRecords<Partial>(Path, [&](Partial P) {
+    Partials.push_back(std::move(P));
+    return llvm::Error::success();
+  })));
+  EXPECT_THAT(Partials, ElementsAre(EqualsProto(R"pb(symbol { usr: "a" })pb"),
+                                    EqualsProto(""),
+                                    EqualsProto(R"pb(symbol { usr: "b" }
+                                                     slot {})pb")));
+
+  // Truncate the last record.
+  {
+    std::error_code EC;
+    llvm::raw_fd_ostream OS(Path, EC);
+    ASSERT_FALSE(EC);
+    writeRecord(proto<Partial>(R"pb(symbol { usr: "a" })pb"), OS);
+    OS << "\x10xyz";
+  }
+  Partials.clear();
+  EXPECT_TRUE(llvm::errorToBool(readRecords<Partial>(Path, [&](Partial P) {
+    Partials.push_back(std::move(P));
+    return llvm::Error::success();
+  })));
+  EXPECT_THAT(Partials, ElementsAre(EqualsProto(R"pb(symbol { usr: "a" })pb")));
+}
+
+TEST(ReduceTest, PartialReducer) {
+  auto Make = [](llvm::StringRef USR, unsigned Slot, llvm::StringRef Kind) {
+    return partialFromEvidence(proto<Evidence>(
+        ("symbol { usr: '" + USR + "' } slot: " + llvm::Twine(Slot) +
+         " kind: " + Kind)
+            .str()));
+  };
+  // The partials from three translation units.
+  std::vector<Partial> Partials = {
+      Make("a", 1, "UNCHECKED_DEREFERENCE"),
+      Make("b", 0, "NULLABLE_RETURN"),
+      Make("c", 0, "ANNOTATED_NONNULL"),
+      Make("a", 1, "NULLABLE_ARGUMENT"),
+      Make("c", 0, "NONNULL_RETURN"),
+      Make("d", 2, "NONNULL_ARGUMENT"),
+      Make("b", 0, "NONNULL_RETURN"),
+  };
+
+  auto Reduce = [&](unsigned Buckets, unsigned Threads) {
+    auto Reducer = PartialReducer::create(tempPath("reduce"), Buckets);
+    CHECK(Reducer) << toString(Reducer.takeError());
+    for (const Partial &P : Partials) CHECK(!Reducer->add(P));
+    std::vector<Inference> Result;
+    CHECK(!std::move(*Reducer).finish(
+        Threads, [&](const Inference &I) { Result.push_back(I); }));
+    return Result;
+  };
+
+  auto Results = Reduce(/*Buckets=*/3, /*Threads=*/2);
+  ASSERT_EQ(Results.size(), 4u);
+  // The inferences are merged from all the partials of each symbol.
+  for (const Inference &I : Results) {
+    Partial Expected;
+    for (const Partial &P : Partials) {
+      if (P.symbol().usr() != I.symbol().usr()) continue;
+      if (Expected.has_symbol())
+        mergePartials(Expected, P);
+      else
+        Expected = P;
+    }
+    EXPECT_EQ(I.DebugString(), finalize(Expected).DebugString());
+  }
+
+  // The order of the inferences depends on the buckets, but not on the threads.
+  auto SingleThreaded = Reduce(/*Buckets=*/3, /*Threads=*/1);
+  ASSERT_EQ(SingleThreaded.size(), Results.size());
+  for (size_t I = 0; I < Results.size(); ++I)
+    EXPECT_EQ(SingleThreaded[I].DebugString(), Results[I].DebugString());
+
+  // The bucket files are removed.
+  std::error_code EC;
+  EXPECT_EQ(llvm::sys::fs::directory_iterator(tempPath("reduce"), EC),
+            llvm::sys::fs::directory_iterator());
+  EXPECT_FALSE(EC);
+}
+
+TEST(ReduceTest, NoPartials) {
+  auto Reducer = PartialReducer::create(tempPath("empty"), 4);
+  ASSERT_TRUE(static_cast<bool>(Reducer));
+  std::vector<Inference> Results;
+  ASSERT_FALSE(llvm::errorToBool(std::move(*Reducer).finish(
+      4, [&](const Inference &I) { Results.push_back(I); })));
+  EXPECT_THAT(Results, IsEmpty());
+}
+
+}  // namespace
+}  // namespace clang::tidy::nullability
@@ -64,8 +64,6 @@ def generate_bindings(
         namespaces_output.path,
         "--crubit_support_path",
         "support",
-        "--clang_format_exe_path",
-        ctx.file._clang_format.path,
         "--rustfmt_exe_path",
         ctx.file._rustfmt.path,
         "--rustfmt_config_path",
@@ -119,7 +117,6 @@ def generate_bindings(
         grep_includes = ctx.file._grep_includes,
         additional_inputs = depset(
             direct = [
-                ctx.executable._clang_format,
                 ctx.executable._rustfmt,
                 ctx.executable._generator,
             ] + ctx.files._rustfmt_cfg + extra_rs_srcs,
@@ -136,12 +136,6 @@ bindings_attrs = {
         default = Label("@bazel_tools//tools/cpp:grep-includes"),
         cfg = "exec",
     ),
-    "_clang_format": attr.label(
-        default = "//third_party/crosstool/google3_users:stable_clang-format",
-        executable = True,
-        allow_single_file = True,
-        cfg = "exec",
-    ),
     "_rustfmt": attr.label(
         default = "//nowhere/llvm/rust:genrustfmt_for_crubit_aspects",
         executable = True,
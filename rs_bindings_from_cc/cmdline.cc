@@ -37,11 +37,13 @@ ABSL_FLAG(std::string, crubit_support_path, "",
           "should be used in the #include directives inside the generated .cc "
           "files.");
 ABSL_FLAG(std::string, clang_format_exe_path, "",
-          "Path to a clang-format executable that will be used to format the "
-          ".cc files generated by the tool.");
+          "(optional) path to a clang-format executable that will be used to "
+          "format the .cc files generated by the tool. If not present, the .cc "
+          "files are formatted in-process.");
 ABSL_FLAG(std::string, rustfmt_exe_path, "",
           "Path to a rustfmt executable that will be used to format the "
-          ".rs files generated by the tool.");
+          ".rs files generated by the tool. Not needed with "
+          "--fast_rs_layout.");
 ABSL_FLAG(std::string, rustfmt_config_path, "",
           "(optional) path to a rustfmt.toml file that should replace the "
           "default formatting of the .rs files generated by the tool.");
@@ -80,6 +82,35 @@ ABSL_FLAG(std::string, error_report_out, "",
 ABSL_FLAG(bool, generate_source_location_in_doc_comment, true,
           "add the source code location from which the binding originates in"
           "the doc comment of the binding");
+ABSL_FLAG(std::string, precompiled_header, "",
+          "(optional) path to a precompiled header with (some of) the headers "
+          "included by the public headers, as written by "
+          "--precompiled_header_out for a dependency. Declarations in it are "
+          "loaded from it instead of being parsed again.");
+ABSL_FLAG(std::string, precompiled_header_out, "",
+          "(optional) output path for a precompiled header of the public "
+          "headers, that dependent targets can pass as --precompiled_header. "
+          "The clang arguments of the dependent targets have to match.");
+ABSL_FLAG(int, codegen_threads, 1,
+          "number of threads used to generate the Rust and C++ source code of "
+          "the bindings");
+ABSL_FLAG(std::string, output_cache_dir, "",
+          "(optional) directory of a cache of the outputs of the tool, keyed "
+          "by the preprocessed public headers and the other inputs. On a "
+          "cache hit, the bindings are not generated again. Not used when "
+          "--ir_out is specified.");
+ABSL_FLAG(std::string, time_trace_out, "",
+          "(optional) output path for a Chrome trace (as with clang's "
+          "-ftime-trace) of the phases of the tool, with their wall time, CPU "
+          "time, peak RSS and item counts");
+ABSL_FLAG(bool, fast_rs_layout, false,
+          "lay out the .rs files generated by the tool with a cheap built-in "
+          "printer instead of formatting them with rustfmt (useful when the "
+          "bindings are not read by humans)");
+ABSL_FLAG(bool, lazy_import, false,
+          "import only the declarations of the current target, and the "
+          "declarations of its dependencies that they refer to, instead of "
+          "all the declarations of the translation unit");
 
 namespace crubit {
 
@@ -117,7 +148,14 @@ absl::StatusOr<Cmdline> Cmdline::Create() {
       absl::GetFlag(FLAGS_error_report_out),
       absl::GetFlag(FLAGS_generate_source_location_in_doc_comment)
           ? SourceLocationDocComment::Enabled
-          : SourceLocationDocComment::Disabled);
+          : SourceLocationDocComment::Disabled,
+      absl::GetFlag(FLAGS_precompiled_header),
+      absl::GetFlag(FLAGS_precompiled_header_out),
+      absl::GetFlag(FLAGS_lazy_import), absl::GetFlag(FLAGS_codegen_threads),
+      absl::GetFlag(FLAGS_fast_rs_layout) ? RustFormatting::BuiltinLayout
+                                          : RustFormatting::Rustfmt,
+      absl::GetFlag(FLAGS_output_cache_dir),
+      absl::GetFlag(FLAGS_time_trace_out));
 }
 
 absl::StatusOr<Cmdline> Cmdline::CreateFromArgs(
@@ -129,7 +167,10 @@ absl::StatusOr<Cmdline> Cmdline::CreateFromArgs(
     std::string target_args_str, std::vector<std::string> extra_rs_srcs,
     std::vector<std::string> srcs_to_scan_for_instantiations,
     std::string instantiations_out, std::string error_report_out,
-    SourceLocationDocComment generate_source_location_in_doc_comment) {
+    SourceLocationDocComment generate_source_location_in_doc_comment,
+    std::string precompiled_header, std::string precompiled_header_out,
+    bool lazy_import, int codegen_threads, RustFormatting rust_formatting,
+    std::string output_cache_dir, std::string time_trace_out) {
   Cmdline cmdline;
   if (current_target.empty()) {
     return absl::InvalidArgumentError("please specify --target");
@@ -155,15 +196,13 @@ absl::StatusOr<Cmdline> Cmdline::CreateFromArgs(
   }
   cmdline.crubit_support_path_ = std::move(crubit_support_path);
 
-  if (clang_format_exe_path.empty()) {
-    return absl::InvalidArgumentError("please specify --clang_format_exe_path");
-  }
   cmdline.clang_format_exe_path_ = std::move(clang_format_exe_path);
 
-  if (rustfmt_exe_path.empty()) {
+  if (rustfmt_exe_path.empty() && rust_formatting == RustFormatting::Rustfmt) {
     return absl::InvalidArgumentError("please specify --rustfmt_exe_path");
   }
   cmdline.rustfmt_exe_path_ = std::move(rustfmt_exe_path);
+  cmdline.rust_formatting_ = rust_formatting;
 
   cmdline.rustfmt_config_path_ = std::move(rustfmt_config_path);
   cmdline.do_nothing_ = do_nothing;
@@ -188,6 +227,16 @@ absl::StatusOr<Cmdline> Cmdline::CreateFromArgs(
   cmdline.srcs_to_scan_for_instantiations_ =
       std::move(srcs_to_scan_for_instantiations);
   cmdline.error_report_out_ = std::move(error_report_out);
+  cmdline.precompiled_header_ = std::move(precompiled_header);
+  cmdline.precompiled_header_out_ = std::move(precompiled_header_out);
+  cmdline.lazy_import_ = lazy_import;
+  if (codegen_threads < 1) {
+    return absl::InvalidArgumentError(
+        "please specify a positive number of --codegen_threads");
+  }
+  cmdline.codegen_threads_ = codegen_threads;
+  cmdline.output_cache_dir_ = std::move(output_cache_dir);
+  cmdline.time_trace_out_ = std::move(time_trace_out);
 
   if (target_args_str.empty()) {
     return absl::InvalidArgumentError("please specify --target_args");
@@ -36,7 +36,12 @@ class Cmdline {
       std::string target_args_str, std::vector<std::string> extra_rs_srcs,
       std::vector<std::string> srcs_to_scan_for_instantiations,
       std::string instantiations_out, std::string error_report_out,
-      SourceLocationDocComment generate_source_location_in_doc_comment) {
+      SourceLocationDocComment generate_source_location_in_doc_comment,
+      std::string precompiled_header = "",
+      std::string precompiled_header_out = "", bool lazy_import = false,
+      int codegen_threads = 1,
+      RustFormatting rust_formatting = RustFormatting::Rustfmt,
+      std::string output_cache_dir = "", std::string time_trace_out = "") {
     return CreateFromArgs(
         std::move(current_target), std::move(cc_out), std::move(rs_out),
         std::move(ir_out), std::move(namespaces_out),
@@ -45,7 +50,10 @@ class Cmdline {
         std::move(public_headers), std::move(target_args_str),
         std::move(extra_rs_srcs), std::move(srcs_to_scan_for_instantiations),
         std::move(instantiations_out), std::move(error_report_out),
-        generate_source_location_in_doc_comment);
+        generate_source_location_in_doc_comment, std::move(precompiled_header),
+        std::move(precompiled_header_out), lazy_import, codegen_threads,
+        rust_formatting, std::move(output_cache_dir),
+        std::move(time_trace_out));
   }
 
   Cmdline(const Cmdline&) = delete;
@@ -65,6 +73,15 @@ class Cmdline {
   absl::string_view rustfmt_config_path() const { return rustfmt_config_path_; }
   absl::string_view instantiations_out() const { return instantiations_out_; }
   absl::string_view error_report_out() const { return error_report_out_; }
+  absl::string_view precompiled_header() const { return precompiled_header_; }
+  absl::string_view precompiled_header_out() const {
+    return precompiled_header_out_;
+  }
+  bool lazy_import() const { return lazy_import_; }
+  int codegen_threads() const { return codegen_threads_; }
+  RustFormatting rust_formatting() const { return rust_formatting_; }
+  absl::string_view output_cache_dir() const { return output_cache_dir_; }
+  absl::string_view time_trace_out() const { return time_trace_out_; }
   bool do_nothing() const { return do_nothing_; }
   SourceLocationDocComment generate_source_location_in_doc_comment() const {
     return generate_source_location_in_doc_comment_;
@@ -105,7 +122,10 @@ class Cmdline {
       std::string target_args_str, std::vector<std::string> extra_rs_srcs,
       std::vector<std::string> srcs_to_scan_for_instantiations,
       std::string instantiations_out, std::string error_report_out,
-      SourceLocationDocComment generate_source_location_in_doc_comment);
+      SourceLocationDocComment generate_source_location_in_doc_comment,
+      std::string precompiled_header, std::string precompiled_header_out,
+      bool lazy_import, int codegen_threads, RustFormatting rust_formatting,
+      std::string output_cache_dir, std::string time_trace_out);
 
   absl::StatusOr<BazelLabel> FindHeader(const HeaderName& header) const;
 
@@ -117,6 +137,13 @@ class Cmdline {
   std::string rustfmt_exe_path_;
   std::string rustfmt_config_path_;
   std::string error_report_out_;
+  std::string precompiled_header_;
+  std::string precompiled_header_out_;
+  bool lazy_import_ = false;
+  int codegen_threads_ = 1;
+  RustFormatting rust_formatting_ = RustFormatting::Rustfmt;
+  std::string output_cache_dir_;
+  std::string time_trace_out_;
   bool do_nothing_ = true;
   SourceLocationDocComment generate_source_location_in_doc_comment_ =
       SourceLocationDocComment::Enabled;
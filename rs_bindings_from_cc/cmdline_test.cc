@@ -338,7 +338,9 @@ TEST(CmdlineTest, ClangFormatExePathEmpty) {
   constexpr absl::string_view kTargetsAndHeaders = R"([
     {"t": "//:target1", "h": ["a.h", "b.h"]}
   ])";
-  ASSERT_THAT(
+  // The generated C++ code is then formatted in-process.
+  ASSERT_OK_AND_ASSIGN(
+      Cmdline cmdline,
       Cmdline::CreateForTesting(
           "//:target1", "cc_out", "rs_out", "ir_out", "namespaces_out",
           "crubit_support_path",
@@ -348,9 +350,8 @@ TEST(CmdlineTest, ClangFormatExePathEmpty) {
           /* extra_rs_srcs= */ {},
           /* srcs_to_scan_for_instantiations= */ {},
           /* instantiations_out= */ "", "error_report_out",
-          SourceLocationDocComment::Enabled),
-      StatusIs(absl::StatusCode::kInvalidArgument,
-               HasSubstr("please specify --clang_format_exe_path")));
+          SourceLocationDocComment::Enabled));
+  EXPECT_EQ(cmdline.clang_format_exe_path(), "");
 }
 
 TEST(CmdlineTest, RustfmtExePathEmpty) {
@@ -370,5 +371,129 @@ TEST(CmdlineTest, RustfmtExePathEmpty) {
       StatusIs(absl::StatusCode::kInvalidArgument,
                HasSubstr("please specify --rustfmt_exe_path")));
 }
+
+TEST(CmdlineTest, PrecompiledHeader) {
+  constexpr absl::string_view kTargetsAndHeaders = R"([
+    {"t": "//:target1", "h": ["a.h", "b.h"]}
+  ])";
+  ASSERT_OK_AND_ASSIGN(
+      Cmdline cmdline,
+      Cmdline::CreateForTesting(
+          "//:target1", "cc_out", "rs_out", "ir_out", "namespaces_out",
+          "crubit_support_path", "clang_format_exe_path", "rustfmt_exe_path",
+          "rustfmt_config_path",
+          /* do_nothing= */ false, {"a.h"}, std::string(kTargetsAndHeaders),
+          /* extra_rs_srcs= */ {},
+          /* srcs_to_scan_for_instantiations= */ {},
+          /* instantiations_out= */ "", "error_report_out",
+          SourceLocationDocComment::Enabled, "deps.pch", "target1.pch"));
+  EXPECT_EQ(cmdline.precompiled_header(), "deps.pch");
+  EXPECT_EQ(cmdline.precompiled_header_out(), "target1.pch");
+
+  ASSERT_OK_AND_ASSIGN(cmdline,
+                       TestCmdline({"a.h"}, std::string(kTargetsAndHeaders)));
+  EXPECT_EQ(cmdline.precompiled_header(), "");
+  EXPECT_EQ(cmdline.precompiled_header_out(), "");
+}
+
+TEST(CmdlineTest, CodegenThreads) {
+  constexpr absl::string_view kTargetsAndHeaders = R"([
+    {"t": "//:target1", "h": ["a.h"]}
+  ])";
+  auto create = [&](int codegen_threads) {
+    return Cmdline::CreateForTesting(
+        "//:target1", "cc_out", "rs_out", "ir_out", "namespaces_out",
+        "crubit_support_path", "clang_format_exe_path", "rustfmt_exe_path",
+        "rustfmt_config_path",
+        /* do_nothing= */ false, {"a.h"}, std::string(kTargetsAndHeaders),
+        /* extra_rs_srcs= */ {},
+        /* srcs_to_scan_for_instantiations= */ {},
+        /* instantiations_out= */ "", /* error_report_out= */ "",
+        SourceLocationDocComment::Enabled, /* precompiled_header= */ "",
+        /* precompiled_header_out= */ "", /* lazy_import= */ false,
+        codegen_threads);
+  };
+  ASSERT_OK_AND_ASSIGN(Cmdline cmdline, create(8));
+  EXPECT_EQ(cmdline.codegen_threads(), 8);
+
+  ASSERT_THAT(create(0),
+              StatusIs(absl::StatusCode::kInvalidArgument,
+                       HasSubstr("please specify a positive number of "
+                                 "--codegen_threads")));
+}
+
+TEST(CmdlineTest, FastRsLayout) {
+  constexpr absl::string_view kTargetsAndHeaders = R"([
+    {"t": "//:target1", "h": ["a.h"]}
+  ])";
+  ASSERT_OK_AND_ASSIGN(
+      Cmdline cmdline,
+      Cmdline::CreateForTesting(
+          "//:target1", "cc_out", "rs_out", "ir_out", "namespaces_out",
+          "crubit_support_path", "clang_format_exe_path",
+          /* rustfmt_exe_path= */ "", /* rustfmt_config_path= */ "",
+          /* do_nothing= */ false, {"a.h"}, std::string(kTargetsAndHeaders),
+          /* extra_rs_srcs= */ {},
+          /* srcs_to_scan_for_instantiations= */ {},
+          /* instantiations_out= */ "", /* error_report_out= */ "",
+          SourceLocationDocComment::Enabled, /* precompiled_header= */ "",
+          /* precompiled_header_out= */ "", /* lazy_import= */ false,
+          /* codegen_threads= */ 1, RustFormatting::BuiltinLayout));
+  EXPECT_EQ(cmdline.rust_formatting(), RustFormatting::BuiltinLayout);
+
+  ASSERT_OK_AND_ASSIGN(cmdline,
+                       TestCmdline({"a.h"}, std::string(kTargetsAndHeaders)));
+  EXPECT_EQ(cmdline.rust_formatting(), RustFormatting::Rustfmt);
+}
+
+TEST(CmdlineTest, OutputCacheDir) {
+  constexpr absl::string_view kTargetsAndHeaders = R"([
+    {"t": "//:target1", "h": ["a.h"]}
+  ])";
+  ASSERT_OK_AND_ASSIGN(
+      Cmdline cmdline,
+      Cmdline::CreateForTesting(
+          "//:target1", "cc_out", "rs_out", "ir_out", "namespaces_out",
+          "crubit_support_path", "clang_format_exe_path", "rustfmt_exe_path",
+          "rustfmt_config_path",
+          /* do_nothing= */ false, {"a.h"}, std::string(kTargetsAndHeaders),
+          /* extra_rs_srcs= */ {},
+          /* srcs_to_scan_for_instantiations= */ {},
+          /* instantiations_out= */ "", /* error_report_out= */ "",
+          SourceLocationDocComment::Enabled, /* precompiled_header= */ "",
+          /* precompiled_header_out= */ "", /* lazy_import= */ false,
+          /* codegen_threads= */ 1, RustFormatting::Rustfmt, "cache"));
+  EXPECT_EQ(cmdline.output_cache_dir(), "cache");
+
+  ASSERT_OK_AND_ASSIGN(cmdline,
+                       TestCmdline({"a.h"}, std::string(kTargetsAndHeaders)));
+  EXPECT_EQ(cmdline.output_cache_dir(), "");
+}
+
+TEST(CmdlineTest, TimeTraceOut) {
+  constexpr absl::string_view kTargetsAndHeaders = R"([
+    {"t": "//:target1", "h": ["a.h"]}
+  ])";
+  ASSERT_OK_AND_ASSIGN(
+      Cmdline cmdline,
+      Cmdline::CreateForTesting(
+          "//:target1", "cc_out", "rs_out", "ir_out", "namespaces_out",
+          "crubit_support_path", "clang_format_exe_path", "rustfmt_exe_path",
+          "rustfmt_config_path",
+          /* do_nothing= */ false, {"a.h"}, std::string(kTargetsAndHeaders),
+          /* extra_rs_srcs= */ {},
+          /* srcs_to_scan_for_instantiations= */ {},
+          /* instantiations_out= */ "", /* error_report_out= */ "",
+          SourceLocationDocComment::Enabled, /* precompiled_header= */ "",
+          /* precompiled_header_out= */ "", /* lazy_import= */ false,
+          /* codegen_threads= */ 1, RustFormatting::Rustfmt,
+          /* output_cache_dir= */ "", "trace.json"));
+  EXPECT_EQ(cmdline.time_trace_out(), "trace.json");
+
+  ASSERT_OK_AND_ASSIGN(cmdline,
+                       TestCmdline({"a.h"}, std::string(kTargetsAndHeaders)));
+  EXPECT_EQ(cmdline.time_trace_out(), "");
+}
+
 }  // namespace
 }  // namespace crubit
@@ -4,44 +4,64 @@
 
 #include "rs_bindings_from_cc/collect_instantiations.h"
 
+#include <cstddef>
 #include <string>
-#include <utility>
 #include <vector>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
 #include "absl/types/span.h"
 #include "common/ffi_types.h"
-#include "llvm/Support/Error.h"
-#include "llvm/Support/FormatVariadic.h"
-#include "llvm/Support/JSON.h"
 
 // This function is implemented in Rust.
 extern "C" crubit::FfiU8SliceBox CollectInstantiationsImpl(
-    crubit::FfiU8Slice json);
+    crubit::FfiU8Slice filenames);
 
 namespace crubit {
 
-absl::StatusOr<std::vector<std::string>> CollectInstantiations(
-    absl::Span<const std::string> rust_sources) {
-  llvm::json::Value rust_sources_json = llvm::json::Array(rust_sources);
-  std::string json = llvm::formatv("{0}", rust_sources_json);
-  FfiU8SliceBox result = CollectInstantiationsImpl(MakeFfiU8Slice(json));
-  std::string result_string = std::string(result.ptr, result.size);
-  llvm::Expected<llvm::json::Value> expected_instantiations =
-      llvm::json::parse(result_string);
-  if (auto error = expected_instantiations.takeError()) {
-    return absl::InternalError(llvm::toString(std::move(error)));
+namespace {
+
+// Encodes `strings` the way `CollectInstantiationsImpl` expects them: each
+// string is prefixed by its decimal length and a newline.
+std::string EncodeStringList(absl::Span<const std::string> strings) {
+  std::string result;
+  for (const std::string& s : strings) {
+    absl::StrAppend(&result, s.size(), "\n", s);
   }
+  return result;
+}
 
-  llvm::json::Value instantiations = *expected_instantiations;
-  FreeFfiU8SliceBox(result);
-  std::vector<std::string> instantiations_vector;
-  llvm::json::Path::Root root;
-  if (llvm::json::fromJSON(instantiations, instantiations_vector, root)) {
-    return instantiations_vector;
+// Decodes a list of strings encoded by `EncodeStringList`.
+absl::StatusOr<std::vector<std::string>> DecodeStringList(
+    absl::string_view encoded) {
+  std::vector<std::string> result;
+  while (!encoded.empty()) {
+    size_t newline = encoded.find('\n');
+    size_t size;
+    if (newline == absl::string_view::npos ||
+        !absl::SimpleAtoi(encoded.substr(0, newline), &size) ||
+        encoded.size() - newline - 1 < size) {
+      return absl::InternalError(
+          "Couldn't decode the instantiations returned by "
+          "CollectInstantiationsImpl");
+    }
+    result.emplace_back(encoded.substr(newline + 1, size));
+    encoded.remove_prefix(newline + 1 + size);
   }
-  return absl::InternalError(llvm::toString(root.getError()));
+  return result;
+}
+
+}  // namespace
+
+absl::StatusOr<std::vector<std::string>> CollectInstantiations(
+    absl::Span<const std::string> rust_sources) {
+  std::string filenames = EncodeStringList(rust_sources);
+  FfiString instantiations(
+      CollectInstantiationsImpl(MakeFfiU8Slice(filenames)));
+  return DecodeStringList(instantiations.view());
 }
 
 }  // namespace crubit
@@ -2,61 +2,160 @@
 // Exceptions. See /LICENSE for license information.
 // SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
 
-use arc_anyhow::{Context, Result};
+use arc_anyhow::{ensure, Context, Result};
 use ffi_types::FfiU8Slice;
 use ffi_types::FfiU8SliceBox;
+use once_cell::sync::Lazy;
 use proc_macro2::TokenStream;
 use proc_macro2::TokenTree;
-use std::collections::HashSet;
+use std::collections::{BTreeSet, HashMap, HashSet};
 use std::fs;
 use std::panic::catch_unwind;
-use std::path::PathBuf;
+use std::path::{Path, PathBuf};
 use std::process;
+use std::sync::{Arc, Mutex};
+use std::thread;
 
-/// Parses given files and returns a Json list with all  C++ class
-/// template instantiations requested by calls to the `cc_template!` macro.
+/// Parses given files and returns a list with all C++ class template
+/// instantiations requested by calls to the `cc_template!` macro.
+///
+/// Both the file names and the result are lists of strings encoded by
+/// `encode_string_list`.
 ///
 /// This function panics on error.
 ///
 /// # Safety
 ///
 /// Expectations:
-///    * function expects that param `json` is a FfiU8Slice for a valid array of
-///      bytes with the given size.
-///    * function expects that param `json` doesn't change during the call.
+///    * function expects that param `filenames` is a FfiU8Slice for a valid
+///      array of bytes with the given size.
+///    * function expects that param `filenames` doesn't change during the
+///      call.
 ///
 /// Ownership:
 ///    * function doesn't take ownership of (in other words it borrows) the
-///      param `json`
+///      param `filenames`
 ///    * function passes ownership of the returned value to the caller
 #[no_mangle]
-pub unsafe extern "C" fn CollectInstantiationsImpl(json: FfiU8Slice) -> FfiU8SliceBox {
+pub unsafe extern "C" fn CollectInstantiationsImpl(filenames: FfiU8Slice) -> FfiU8SliceBox {
     catch_unwind(|| {
-        let filenames: Vec<PathBuf> = serde_json::from_reader(json.as_slice())
-            .with_context(|| {
-                let json_str = std::str::from_utf8(json.as_slice()).unwrap();
-                format!("Couldn't deserialize json '{}'", json_str)
-            })
-            .unwrap();
+        let filenames = decode_string_list(filenames.as_slice())
+            .context("Couldn't decode the file names")
+            .unwrap()
+            .into_iter()
+            .map(PathBuf::from)
+            .collect();
         let instantiations = collect_instantiations_impl(filenames).unwrap();
-        let result_json = serde_json::to_string(&instantiations).unwrap();
-        FfiU8SliceBox::from_boxed_slice(result_json.into_bytes().into_boxed_slice())
+        FfiU8SliceBox::from_boxed_slice(encode_string_list(&instantiations).into_boxed_slice())
     })
     .unwrap_or_else(|_| process::abort())
 }
 
+/// Encodes `strings` as the concatenation of the decimal length of each
+/// string, a newline, and the string itself.
+fn encode_string_list(strings: &[String]) -> Vec<u8> {
+    let mut result = vec![];
+    for s in strings {
+        result.extend_from_slice(format!("{}\n", s.len()).as_bytes());
+        result.extend_from_slice(s.as_bytes());
+    }
+    result
+}
+
+/// Decodes a list of strings encoded by `encode_string_list`.
+fn decode_string_list(mut bytes: &[u8]) -> Result<Vec<String>> {
+    let mut result = vec![];
+    while !bytes.is_empty() {
+        let newline = bytes
+            .iter()
+            .position(|&byte| byte == b'\n')
+            .context("Missing the length of a string")?;
+        let len: usize = std::str::from_utf8(&bytes[..newline])?.parse()?;
+        bytes = &bytes[newline + 1..];
+        ensure!(bytes.len() >= len, "Expected {} more bytes, found {}", len, bytes.len());
+        result.push(String::from_utf8(bytes[..len].to_vec())?);
+        bytes = &bytes[len..];
+    }
+    Ok(result)
+}
+
+/// The instantiations requested by each file parsed by this process, keyed by
+/// the contents of the file, so that a long-running process (such as a
+/// persistent worker) only parses the files that changed. Keying by the
+/// contents themselves, rather than by a digest of them, rules out collisions.
+static INSTANTIATIONS_BY_CONTENTS: Lazy<Mutex<HashMap<String, Arc<[String]>>>> =
+    Lazy::new(Default::default);
+
+/// The maximum number of files in `INSTANTIATIONS_BY_CONTENTS`. The cache is
+/// cleared when it is full, so that it doesn't grow with every edit of every
+/// file over the lifetime of the process.
+const MAX_CACHED_FILES: usize = 4096;
+
 fn collect_instantiations_impl(filenames: Vec<PathBuf>) -> Result<Vec<String>> {
-    let mut result = HashSet::<String>::new();
+    let mut files_to_parse = vec![];
     for filename in filenames {
         let content = fs::read_to_string(&filename)
             .with_context(|| format!("Couldn't read '{}'", filename.display()))?;
-        let token_stream = syn::parse_str(&content)
-            .with_context(|| format!("Couldn't parse the file '{}'", filename.display()))?;
-        find_cc_template_calls(token_stream, &mut result);
+        // Searching a file is much cheaper than parsing it, and most files don't
+        // instantiate templates.
+        if content.contains("cc_template") {
+            files_to_parse.push((filename, content));
+        }
+    }
+
+    let threads = thread::available_parallelism().map_or(1, |n| n.get()).min(files_to_parse.len());
+    let results: Vec<Result<Arc<[String]>>> = if threads <= 1 {
+        files_to_parse
+            .iter()
+            .map(|(filename, content)| find_instantiations(filename, content))
+            .collect()
+    } else {
+        thread::scope(|scope| {
+            let handles: Vec<_> = files_to_parse
+                .chunks((files_to_parse.len() + threads - 1) / threads)
+                .map(|chunk| {
+                    scope.spawn(move || {
+                        chunk
+                            .iter()
+                            .map(|(filename, content)| find_instantiations(filename, content))
+                            .collect::<Vec<_>>()
+                    })
+                })
+                .collect();
+            handles
+                .into_iter()
+                .flat_map(|handle| {
+                    handle.join().unwrap_or_else(|panic| std::panic::resume_unwind(panic))
+                })
+                .collect()
+        })
+    };
+
+    let mut result = BTreeSet::new();
+    for instantiations in results {
+        result.extend(instantiations?.iter().cloned());
+    }
+    Ok(result.into_iter().collect())
+}
+
+/// Returns the instantiations requested by `filename`, whose contents are
+/// `content`.
+fn find_instantiations(filename: &Path, content: &str) -> Result<Arc<[String]>> {
+    if let Some(instantiations) = INSTANTIATIONS_BY_CONTENTS.lock().unwrap().get(content) {
+        return Ok(instantiations.clone());
+    }
+
+    let token_stream = syn::parse_str(content)
+        .with_context(|| format!("Couldn't parse the file '{}'", filename.display()))?;
+    let mut instantiations = HashSet::new();
+    find_cc_template_calls(token_stream, &mut instantiations);
+    let instantiations: Arc<[String]> = instantiations.into_iter().collect();
+    let mut cache = INSTANTIATIONS_BY_CONTENTS.lock().unwrap();
+    if cache.len() >= MAX_CACHED_FILES {
+        cache.clear();
     }
-    let mut result_vec = result.into_iter().collect::<Vec<_>>();
-    result_vec.sort();
-    Ok(result_vec)
+    cache.insert(content.to_string(), instantiations.clone());
+    Ok(instantiations)
 }
 
 fn find_cc_template_calls(input: TokenStream, results: &mut HashSet<String>) {
@@ -125,7 +224,7 @@ mod tests {
 
     #[test]
     fn test_file_doesnt_parse() {
-        let input = make_tmp_input_file("does_not_parse", "This is not (Rust>!");
+        let input = make_tmp_input_file("does_not_parse", "cc_template!(This is not (Rust>!");
         let err = collect_instantiations_impl(vec![input.clone()]).unwrap_err();
         assert_eq!(
             format!("{:#}", err),
@@ -133,6 +232,12 @@ mod tests {
         );
     }
 
+    #[test]
+    fn test_file_without_cc_template_is_not_parsed() {
+        let input = make_tmp_input_file("not_parsed", "This is not (Rust>!");
+        assert!(collect_instantiations_impl(vec![input]).unwrap().is_empty());
+    }
+
     #[test]
     fn test_single_template_parens() {
         let result =
@@ -206,22 +311,62 @@ mod tests {
         assert_eq!(result, vec!["std :: vector < Foo >".to_string(),]);
     }
 
-    fn collect_instantiations_from_json(json: &str) -> String {
+    #[test]
+    fn test_instantiations_from_multiple_files() {
+        let first = make_tmp_input_file("first", "cc_template!(std::vector<int>);");
+        let second = make_tmp_input_file(
+            "second",
+            "cc_template!(std::vector<int>); cc_template!(std::vector<bool>);",
+        );
+        let result = collect_instantiations_impl(vec![first, second]).unwrap();
+        assert_eq!(
+            result,
+            vec!["std :: vector < bool >".to_string(), "std :: vector < int >".to_string()]
+        );
+    }
+
+    #[test]
+    fn test_same_contents_are_parsed_once() {
+        let content = "cc_template!(std::vector<CachedContents>);";
+        let first = find_instantiations(Path::new("first.rs"), content).unwrap();
+        let second = find_instantiations(Path::new("second.rs"), content).unwrap();
+        assert!(Arc::ptr_eq(&first, &second));
+        assert_eq!(*second, ["std :: vector < CachedContents >".to_string()]);
+
+        let changed = find_instantiations(
+            Path::new("first.rs"),
+            "cc_template!(std::vector<CachedContents>); cc_template!(std::vector<Changed>);",
+        )
+        .unwrap();
+        assert!(!Arc::ptr_eq(&first, &changed));
+        assert_eq!(changed.len(), 2);
+    }
+
+    #[test]
+    fn test_string_list_round_trip() {
+        let strings = vec!["".to_string(), "a\nb".to_string(), "12\n".to_string()];
+        assert_eq!(decode_string_list(&encode_string_list(&strings)).unwrap(), strings);
+        assert!(decode_string_list(b"3\nab").is_err());
+        assert!(decode_string_list(b"ab").is_err());
+    }
+
+    fn collect_instantiations_from_string_list(filenames: &[String]) -> Vec<String> {
         let u8_slice = unsafe {
-            CollectInstantiationsImpl(FfiU8Slice::from_slice(json.as_bytes())).into_boxed_slice()
+            CollectInstantiationsImpl(FfiU8Slice::from_slice(&encode_string_list(filenames)))
+                .into_boxed_slice()
         };
-        std::str::from_utf8(&u8_slice).unwrap().to_string()
+        decode_string_list(&u8_slice).unwrap()
     }
 
     #[test]
-    fn test_collect_instantiations_json() {
+    fn test_collect_instantiations_string_list() {
         let filename = make_tmp_input_file(
-            "json",
+            "string_list",
             "cc_template!(std::vector<int>); cc_template!(std::vector<bool>);",
         );
         assert_eq!(
-            collect_instantiations_from_json(&format!("[\"{}\"]", filename.display())),
-            "[\"std :: vector < bool >\",\"std :: vector < int >\"]"
+            collect_instantiations_from_string_list(&[filename.display().to_string()]),
+            vec!["std :: vector < bool >".to_string(), "std :: vector < int >".to_string()]
         );
     }
 }
@@ -32,5 +32,17 @@ TEST(CollectInstantiationsTest, ReturnInstantiationsFromRustTest) {
               IsOkAndHolds(ElementsAre(StrEq("std :: vector < bool >"))));
 }
 
+TEST(CollectInstantiationsTest, MultipleFilesTest) {
+  std::string a = WriteFileForCurrentTest("a.rs",
+                                          "cc_template!(std::vector<int>);\n"
+                                          "cc_template!(std::vector<bool>);");
+  std::string b = WriteFileForCurrentTest("b.rs", "fn f() {}");
+  std::string c =
+      WriteFileForCurrentTest("c.rs", "cc_template!(std::vector<int>);");
+  EXPECT_THAT(CollectInstantiations({std::move(a), std::move(b), std::move(c)}),
+              IsOkAndHolds(ElementsAre(StrEq("std :: vector < bool >"),
+                                       StrEq("std :: vector < int >"))));
+}
+
 }  // namespace
 }  // namespace crubit
@@ -139,9 +139,12 @@ class NamespaceTrie {
 
 // Returns the current target's namespace hierarchy in JSON serializable format.
 NamespacesHierarchy CollectNamespaces(const IR& ir) {
-  auto all_namespaces = ir.get_items_if<Namespace>();
+  return CollectNamespaces(ir, IrItemIndex(ir));
+}
+
+NamespacesHierarchy CollectNamespaces(const IR& ir, const IrItemIndex& index) {
   absl::flat_hash_map<ItemId, const Namespace*> id_to_namespace;
-  for (auto ns : all_namespaces) {
+  for (const Namespace* ns : index.items_of_kind<Namespace>()) {
     // We are not interested in namespaces from different targets.
     if (ns->owning_target != ir.current_target) {
       continue;
@@ -48,6 +48,9 @@ inline std::ostream& operator<<(std::ostream& o,
 // Returns the current target's namespace hierarchy in JSON serializable format.
 NamespacesHierarchy CollectNamespaces(const IR& ir);
 
+// Same as above, but uses an already built `index` of `ir`.
+NamespacesHierarchy CollectNamespaces(const IR& ir, const IrItemIndex& index);
+
 inline std::string NamespacesAsJson(const NamespacesHierarchy& topLevel) {
   return llvm::formatv("{0:2}", topLevel.ToJson());
 }
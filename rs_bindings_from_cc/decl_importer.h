@@ -19,10 +19,14 @@
 #include "lifetime_annotations/type_lifetimes.h"
 #include "rs_bindings_from_cc/bazel_types.h"
 #include "rs_bindings_from_cc/ir.h"
+#include "clang/AST/Decl.h"
 #include "clang/AST/DeclBase.h"
 #include "clang/AST/Type.h"
 #include "clang/Basic/SourceLocation.h"
 #include "clang/Sema/Sema.h"
+#include "llvm/Support/Casting.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/TypeName.h"
 
 namespace crubit {
 
@@ -30,9 +34,12 @@ namespace crubit {
 class Invocation {
  public:
   Invocation(BazelLabel target, absl::Span<const HeaderName> public_headers,
-             const absl::flat_hash_map<HeaderName, BazelLabel>& header_targets)
+             const absl::flat_hash_map<HeaderName, BazelLabel>& header_targets,
+             bool lazy_import = false, bool memoize_owning_targets = true)
       : target_(target),
         public_headers_(public_headers),
+        lazy_import_(lazy_import),
+        memoize_owning_targets_(memoize_owning_targets),
         lifetime_context_(std::make_shared<
                           clang::tidy::lifetimes::LifetimeAnnotationContext>()),
         header_targets_(header_targets) {
@@ -59,6 +66,16 @@ class Invocation {
   // `IR::public_headers` and `HeaderName` for more details.
   const absl::Span<const HeaderName> public_headers_;
 
+  // If true, only the decls of the current target are walked, and decls from
+  // other targets are imported on demand, when they are referenced by the
+  // current target (see `ImportContext::EnsureSuccessfullyImported`).
+  // Otherwise, all decls of the translation unit are imported.
+  const bool lazy_import_;
+
+  // If true, the owning target of each file is computed once. Otherwise, it is
+  // computed again for every decl, as a baseline for `importer_benchmark`.
+  const bool memoize_owning_targets_;
+
   const std::shared_ptr<clang::tidy::lifetimes::LifetimeAnnotationContext>
       lifetime_context_;
 
@@ -95,11 +112,14 @@ class ImportContext {
   // Does not use or update the cache.
   virtual std::optional<IR::Item> ImportDecl(clang::Decl* decl) = 0;
 
-  // Returns the Item of a Decl, importing it first if necessary.
-  // Updates the cache.
-  virtual std::optional<IR::Item> GetDeclItem(clang::Decl* decl) = 0;
+  // Returns the Item of a Decl, importing it first if necessary, or nullptr if
+  // the Decl is not imported. Updates the cache.
+  //
+  // The Item is owned by the cache, and stays valid until the importer is done.
+  virtual const IR::Item* GetDeclItem(clang::Decl* decl) = 0;
 
-  virtual std::optional<IR::Item> GetImportedItem(const clang::Decl* decl) = 0;
+  // Returns the Item of a Decl that has already been imported, or nullptr.
+  virtual const IR::Item* GetImportedItem(const clang::Decl* decl) = 0;
 
   // Imports children of `decl`.
   //
@@ -108,6 +128,11 @@ class ImportContext {
   // their source order.
   virtual std::vector<ItemId> GetItemIdsInSourceOrder(clang::Decl* decl) = 0;
 
+  // Returns the ItemId of `decl` (see `GenerateItemId`). The ItemIds are
+  // memoized, as they are needed again and again (e.g. for every use of a
+  // type).
+  virtual ItemId GetItemId(const clang::Decl* decl) const = 0;
+
   // Mangles the name of a named decl.
   virtual std::string GetMangledName(
       const clang::NamedDecl* named_decl) const = 0;
@@ -210,6 +235,14 @@ class DeclImporterBase : public DeclImporter {
   std::optional<IR::Item> ImportDecl(clang::Decl* decl) override {
     auto* typed_decl = clang::dyn_cast<D>(decl);
     if (typed_decl == nullptr) return std::nullopt;
+    // With `--time_trace_out`, the time spent in each kind of importer is
+    // totalled in the trace (see `StartTimeTrace`).
+    llvm::TimeTraceScope scope(llvm::getTypeName<D>(), [&]() -> std::string {
+      if (auto* named_decl = clang::dyn_cast<clang::NamedDecl>(decl)) {
+        return named_decl->getQualifiedNameAsString();
+      }
+      return "";
+    });
     return Import(typed_decl);
   }
   virtual std::optional<IR::Item> Import(D*) = 0;
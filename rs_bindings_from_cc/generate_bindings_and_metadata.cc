@@ -20,23 +20,27 @@
 #include "rs_bindings_from_cc/ir.h"
 #include "rs_bindings_from_cc/ir_from_cc.h"
 #include "rs_bindings_from_cc/src_code_gen.h"
+#include "rs_bindings_from_cc/time_trace.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/Support/VirtualFileSystem.h"
 
 namespace crubit {
 
-std::optional<const Namespace*> FindNamespace(const IR& ir,
+std::optional<const Namespace*> FindNamespace(const IrItemIndex& index,
                                               absl::string_view name) {
-  for (const auto* ns : ir.get_items_if<Namespace>()) {
-    if (ns->name.Ident() == kInstantiationsNamespaceName) {
+  for (const Namespace* ns : index.items_of_kind<Namespace>()) {
+    if (ns->name.Ident() == name) {
       return ns;
     }
   }
   return std::nullopt;
 }
 
-std::vector<const Record*> FindInstantiationsInNamespace(const IR& ir,
-                                                         ItemId namespace_id) {
+std::vector<const Record*> FindInstantiationsInNamespace(
+    const IrItemIndex& index, ItemId namespace_id) {
   absl::flat_hash_set<ItemId> record_ids;
-  for (const auto* type_alias : ir.get_items_if<TypeAlias>()) {
+  std::vector<const Record*> result;
+  for (const TypeAlias* type_alias : index.items_of_kind<TypeAlias>()) {
     if (type_alias->enclosing_namespace_id.has_value() &&
         type_alias->enclosing_namespace_id == namespace_id) {
       const MappedType* mapped_type = &type_alias->underlying_type;
@@ -44,14 +48,13 @@ std::vector<const Record*> FindInstantiationsInNamespace(const IR& ir,
       CHECK(mapped_type->rs_type.decl_id.has_value());
       CHECK(mapped_type->cc_type.decl_id.value() ==
             mapped_type->rs_type.decl_id.value());
-      record_ids.insert(mapped_type->rs_type.decl_id.value());
-    }
-  }
-
-  std::vector<const Record*> result;
-  for (const auto* record : ir.get_items_if<Record>()) {
-    if (record_ids.find(record->id) != record_ids.end()) {
-      result.push_back(record);
+      ItemId record_id = mapped_type->rs_type.decl_id.value();
+      if (!record_ids.insert(record_id).second) {
+        continue;
+      }
+      if (const Record* record = index.FindItemOfKind<Record>(record_id)) {
+        result.push_back(record);
+      }
     }
   }
   return result;
@@ -60,25 +63,41 @@ std::vector<const Record*> FindInstantiationsInNamespace(const IR& ir,
 absl::StatusOr<BindingsAndMetadata> GenerateBindingsAndMetadata(
     Cmdline& cmdline, std::vector<std::string> clang_args,
     absl::flat_hash_map<const HeaderName, const std::string>
-        virtual_headers_contents_for_testing) {
+        virtual_headers_contents_for_testing,
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> file_system) {
   std::vector<absl::string_view> clang_args_view;
   clang_args_view.insert(clang_args_view.end(), clang_args.begin(),
                          clang_args.end());
 
-  CRUBIT_ASSIGN_OR_RETURN(
-      std::vector<std::string> requested_instantiations,
-      CollectInstantiations(cmdline.srcs_to_scan_for_instantiations()));
+  std::vector<std::string> requested_instantiations;
+  {
+    TracePhase phase("CollectInstantiations");
+    CRUBIT_ASSIGN_OR_RETURN(
+        requested_instantiations,
+        CollectInstantiations(cmdline.srcs_to_scan_for_instantiations()));
+    phase.AddCount("srcs", cmdline.srcs_to_scan_for_instantiations().size());
+    phase.AddCount("instantiations", requested_instantiations.size());
+  }
 
-  CRUBIT_ASSIGN_OR_RETURN(
-      IR ir, IrFromCc({.current_target = cmdline.current_target(),
-                       .public_headers = cmdline.public_headers(),
-                       .virtual_headers_contents_for_testing =
-                           std::move(virtual_headers_contents_for_testing),
-                       .headers_to_targets = cmdline.headers_to_targets(),
-                       .extra_rs_srcs = cmdline.extra_rs_srcs(),
-                       .clang_args = clang_args_view,
-                       .extra_instantiations = requested_instantiations,
-                       .crubit_features = cmdline.target_to_features()}));
+  IR ir;
+  {
+    TracePhase phase("IrFromCc");
+    CRUBIT_ASSIGN_OR_RETURN(
+        ir, IrFromCc({.current_target = cmdline.current_target(),
+                      .public_headers = cmdline.public_headers(),
+                      .virtual_headers_contents_for_testing =
+                          std::move(virtual_headers_contents_for_testing),
+                      .headers_to_targets = cmdline.headers_to_targets(),
+                      .extra_rs_srcs = cmdline.extra_rs_srcs(),
+                      .clang_args = clang_args_view,
+                      .extra_instantiations = requested_instantiations,
+                      .crubit_features = cmdline.target_to_features(),
+                      .precompiled_header = cmdline.precompiled_header(),
+                      .lazy_import = cmdline.lazy_import(),
+                      .file_system = std::move(file_system)}));
+    phase.AddCount("headers", cmdline.public_headers().size());
+    phase.AddCount("items", ir.items.size());
+  }
 
   if (!cmdline.instantiations_out().empty()) {
     ir.crate_root_path = "__cc_template_instantiations_rs_api";
@@ -91,28 +110,31 @@ absl::StatusOr<BindingsAndMetadata> GenerateBindingsAndMetadata(
                        cmdline.clang_format_exe_path(),
                        cmdline.rustfmt_exe_path(),
                        cmdline.rustfmt_config_path(), generate_error_report,
-                       cmdline.generate_source_location_in_doc_comment()));
+                       cmdline.generate_source_location_in_doc_comment(),
+                       cmdline.codegen_threads(), cmdline.rust_formatting()));
 
+  TracePhase metadata_phase("CollectMetadata");
+  IrItemIndex index(ir);
   absl::flat_hash_map<std::string, std::string> instantiations;
   std::optional<const Namespace*> ns =
-      FindNamespace(ir, kInstantiationsNamespaceName);
+      FindNamespace(index, kInstantiationsNamespaceName);
   if (ns.has_value()) {
     std::vector<const Record*> records =
-        FindInstantiationsInNamespace(ir, ns.value()->id);
+        FindInstantiationsInNamespace(index, ns.value()->id);
     for (const auto* record : records) {
       instantiations.insert({record->cc_name, record->rs_name});
     }
   }
 
-  auto top_level_namespaces = crubit::CollectNamespaces(ir);
+  auto top_level_namespaces = crubit::CollectNamespaces(ir, index);
 
   return BindingsAndMetadata{
-      .ir = ir,
-      .rs_api = bindings.rs_api,
-      .rs_api_impl = bindings.rs_api_impl,
+      .ir = std::move(ir),
+      .rs_api = std::move(bindings.rs_api),
+      .rs_api_impl = std::move(bindings.rs_api_impl),
       .namespaces = std::move(top_level_namespaces),
       .instantiations = std::move(instantiations),
-      .error_report = bindings.error_report,
+      .error_report = std::move(bindings.error_report),
   };
 }
 
@@ -13,6 +13,8 @@
 #include "rs_bindings_from_cc/cmdline.h"
 #include "rs_bindings_from_cc/collect_namespaces.h"
 #include "rs_bindings_from_cc/ir.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/Support/VirtualFileSystem.h"
 
 namespace crubit {
 // Contains generated bindings and all related metadata, such as the IR.
@@ -21,23 +23,26 @@ struct BindingsAndMetadata {
   // bindings.
   IR ir;
   // Generated Rust source code.
-  std::string rs_api;
+  FfiString rs_api;
   // Generated C++ source code.
-  std::string rs_api_impl;
+  FfiString rs_api_impl;
   // A hierarchy tree for all C++ namespaces used in the target.
   NamespacesHierarchy namespaces;
   // C++ class templates explicitly instantiated in this TU and their Rust
   // struct name.
   absl::flat_hash_map<std::string, std::string> instantiations;
   // A JSON error report, if requested.
-  std::string error_report;
+  FfiString error_report;
 };
 
 // Returns `BindingsAndMetadata` as requested by the user on the command line.
+//
+// Clang reads the headers from `file_system` (see `IrFromCcOptions`).
 absl::StatusOr<BindingsAndMetadata> GenerateBindingsAndMetadata(
     Cmdline& cmdline, std::vector<std::string> clang_args,
     absl::flat_hash_map<const HeaderName, const std::string>
-        virtual_headers_contents_for_testing = {});
+        virtual_headers_contents_for_testing = {},
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> file_system = nullptr);
 
 }  // namespace crubit
 
@@ -59,7 +59,7 @@ TEST(GenerateBindingsAndMetadataTest, GeneratingIR) {
 
   ASSERT_EQ(result.ir.public_headers.size(), 1);
   ASSERT_EQ(result.ir.public_headers.front().IncludePath(), "a.h");
-  ASSERT_EQ(result.error_report, "");
+  ASSERT_EQ(result.error_report.view(), "");
 
   // Check that IR items have the proper owning target set.
   auto item = result.ir.get_items_if<Namespace>().front();
@@ -0,0 +1,309 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+// Measures `GenerateBindingsAndMetadata` (from the import of the headers to the
+// formatting of the generated sources) on a synthetic header, or on a corpus of
+// real headers:
+//
+//   generate_bindings_benchmark --records=1000 --methods_per_record=10
+//   generate_bindings_benchmark --namespace_depth=8 --instantiations=1000
+//   generate_bindings_benchmark --corpus_headers=a/b.h,a/c.h -- -I. -Idir
+//
+// The arguments after `--` are passed to Clang. Reports the throughput (in IR
+// items per second) and the peak RSS over the iterations, which run without
+// tracing. The time spent in each phase of the tool and in each importer (see
+// `TracePhase`) comes from one more, traced, iteration.
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/substitute.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "common/ffi_types.h"
+#include "common/file_io.h"
+#include "common/status_macros.h"
+#include "rs_bindings_from_cc/bazel_types.h"
+#include "rs_bindings_from_cc/cmdline.h"
+#include "rs_bindings_from_cc/generate_bindings_and_metadata.h"
+#include "rs_bindings_from_cc/time_trace.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/JSON.h"
+
+ABSL_FLAG(int, records, 1000, "number of records in the synthetic header");
+ABSL_FLAG(int, methods_per_record, 10,
+          "number of methods of each record (half of them inline)");
+ABSL_FLAG(int, namespace_depth, 4,
+          "depth of the nested namespaces around each group of records");
+ABSL_FLAG(int, records_per_namespace, 50,
+          "number of records in each innermost namespace");
+ABSL_FLAG(int, instantiations, 100,
+          "number of instantiations of a class template (one per record, "
+          "wrapping around)");
+ABSL_FLAG(int, enumerators, 1000, "number of enumerators of a scoped enum");
+ABSL_FLAG(int, doc_comment_lines, 3,
+          "number of lines of the doc comment of each record and method");
+ABSL_FLAG(std::vector<std::string>, corpus_headers, {},
+          "if set, the public headers to generate bindings for, instead of the "
+          "synthetic header");
+ABSL_FLAG(int, iterations, 3,
+          "number of times to generate the bindings (not counting the traced "
+          "iteration)");
+ABSL_FLAG(int, codegen_threads, 1, "passed as --codegen_threads");
+ABSL_FLAG(bool, lazy_import, false, "passed as --lazy_import");
+ABSL_FLAG(std::string, time_trace_out, "",
+          "if set, where to keep the trace of the traced iteration (see "
+          "--time_trace_out of rs_bindings_from_cc)");
+
+namespace crubit {
+namespace {
+
+constexpr absl::string_view kTarget = "//benchmark:synthetic";
+constexpr absl::string_view kSyntheticHeader = "benchmark/synthetic.h";
+
+void AppendDocComment(std::string& header, absl::string_view indent,
+                      absl::string_view name, int lines) {
+  for (int i = 0; i < lines; ++i) {
+    absl::SubstituteAndAppend(
+        &header, "$0/// Line $1 of the documentation of `$2`, which is long "
+                 "enough to wrap in the generated bindings.\n",
+        indent, i, name);
+  }
+}
+
+// Returns the source of the synthetic header, as described by the flags.
+std::string MakeSyntheticHeader() {
+  int records = absl::GetFlag(FLAGS_records);
+  int methods_per_record = absl::GetFlag(FLAGS_methods_per_record);
+  int namespace_depth = absl::GetFlag(FLAGS_namespace_depth);
+  int records_per_namespace =
+      std::max(absl::GetFlag(FLAGS_records_per_namespace), 1);
+  int doc_comment_lines = absl::GetFlag(FLAGS_doc_comment_lines);
+
+  std::string header = "#pragma once\n\n";
+  AppendDocComment(header, "", "Box", doc_comment_lines);
+  header +=
+      "template <typename T>\n"
+      "class Box {\n"
+      " public:\n"
+      "  T Get() const { return value_; }\n"
+      "  void Set(T value) { value_ = value; }\n"
+      "\n"
+      " private:\n"
+      "  T value_;\n"
+      "};\n\n";
+
+  // The fully qualified names of the records.
+  std::vector<std::string> record_names;
+  record_names.reserve(records);
+  for (int group = 0; group * records_per_namespace < records; ++group) {
+    std::string qualifier = "::";
+    for (int depth = 0; depth < namespace_depth; ++depth) {
+      std::string ns = absl::StrCat("ns", group, "_", depth);
+      absl::StrAppend(&header, "namespace ", ns, " {\n");
+      absl::StrAppend(&qualifier, ns, "::");
+    }
+    int end = std::min(records, (group + 1) * records_per_namespace);
+    for (int i = group * records_per_namespace; i < end; ++i) {
+      std::string name = absl::StrCat("Struct", i);
+      header += "\n";
+      AppendDocComment(header, "", name, doc_comment_lines);
+      absl::StrAppend(&header, "struct ", name, " {\n");
+      for (int j = 0; j < methods_per_record; ++j) {
+        std::string method = absl::StrCat("Method", j);
+        AppendDocComment(header, "  ", absl::StrCat(name, "::", method),
+                         doc_comment_lines);
+        if (j % 2 == 0) {
+          absl::SubstituteAndAppend(
+              &header, "  int $0(int x) const { return field$1 + x; }\n",
+              method, j % 4 / 2);
+        } else {
+          absl::SubstituteAndAppend(&header, "  $0* $1(const $0& other);\n",
+                                    name, method);
+        }
+      }
+      header += "  int field0;\n  int field1;\n};\n";
+      record_names.push_back(absl::StrCat(qualifier, name));
+    }
+    for (int depth = namespace_depth - 1; depth >= 0; --depth) {
+      absl::StrAppend(&header, "}  // namespace ns", group, "_", depth, "\n");
+    }
+    header += "\n";
+  }
+
+  for (int i = 0; i < absl::GetFlag(FLAGS_instantiations) && records > 0;
+       ++i) {
+    absl::SubstituteAndAppend(&header, "using BoxOf$0 = Box<$1>;\n", i,
+                              record_names[i % records]);
+  }
+
+  int enumerators = absl::GetFlag(FLAGS_enumerators);
+  if (enumerators > 0) {
+    header += "\n";
+    AppendDocComment(header, "", "LargeEnum", doc_comment_lines);
+    header += "enum class LargeEnum : int {\n";
+    for (int i = 0; i < enumerators; ++i) {
+      absl::SubstituteAndAppend(&header, "  kEnumerator$0 = $0,\n", i);
+    }
+    header += "};\n";
+  }
+  return header;
+}
+
+struct PhaseTotal {
+  int64_t events = 0;
+  double wall_ms = 0;
+  double cpu_ms = 0;
+};
+
+// Prints the time spent in each phase and in each importer, from the trace
+// written by `FinishTimeTrace`.
+absl::Status PrintPhases(absl::string_view trace_path) {
+  CRUBIT_ASSIGN_OR_RETURN(std::string contents, GetFileContents(trace_path));
+  llvm::Expected<llvm::json::Value> trace = llvm::json::parse(contents);
+  if (!trace) {
+    return absl::InternalError(llvm::toString(trace.takeError()));
+  }
+  // Sorted by name, so that the outputs of runs can be compared.
+  std::map<std::string, PhaseTotal> phases;
+  std::map<std::string, PhaseTotal> importers;
+  for (const llvm::json::Value& event :
+       *trace->getAsObject()->getArray("traceEvents")) {
+    const llvm::json::Object* object = event.getAsObject();
+    llvm::StringRef name = object->getString("name").value_or("");
+    const llvm::json::Object* args = object->getObject("args");
+    if (object->getString("cat") == "rs_bindings_from_cc") {
+      PhaseTotal& total = phases[name.str()];
+      ++total.events;
+      total.wall_ms += object->getInteger("dur").value_or(0) / 1000.0;
+      total.cpu_ms += args->getNumber("cpu_ms").value_or(0);
+    } else if (name.consume_front("Total clang::") && args != nullptr) {
+      // The totals of LLVM's profiler, for the `DeclImporterBase`s.
+      PhaseTotal& total = importers[name.str()];
+      total.events = args->getInteger("count").value_or(0);
+      total.wall_ms = object->getInteger("dur").value_or(0) / 1000.0;
+    }
+  }
+
+  std::cout << std::fixed << std::setprecision(1) << "\n"
+            << "phase (per iteration)              wall ms     cpu ms\n";
+  for (const auto& [name, total] : phases) {
+    std::cout << std::left << std::setw(32) << name << std::right
+              << std::setw(11) << total.wall_ms << std::setw(11) << total.cpu_ms
+              << "\n";
+  }
+  std::cout << "\nimporter (per iteration)           wall ms      decls\n";
+  for (const auto& [name, total] : importers) {
+    std::cout << std::left << std::setw(32) << name << std::right
+              << std::setw(11) << total.wall_ms << std::setw(11) << total.events
+              << "\n";
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Main(std::vector<std::string> clang_args) {
+  std::vector<std::string> public_headers =
+      absl::GetFlag(FLAGS_corpus_headers);
+  absl::flat_hash_map<const HeaderName, const std::string> headers_contents;
+  if (public_headers.empty()) {
+    public_headers.push_back(std::string(kSyntheticHeader));
+    headers_contents.insert(
+        {HeaderName(std::string(kSyntheticHeader)), MakeSyntheticHeader()});
+  }
+  std::string target_args = absl::Substitute(
+      R"([{"t": "$0", "h": ["$1"], "f": ["supported"]}])", kTarget,
+      absl::StrJoin(public_headers, R"(", ")"));
+
+  CRUBIT_ASSIGN_OR_RETURN(
+      Cmdline cmdline,
+      Cmdline::CreateForTesting(
+          std::string(kTarget), "cc_out", "rs_out", /* ir_out= */ "",
+          "namespaces_out", "crubit_support_path",
+          /* clang_format_exe_path= */ "", /* rustfmt_exe_path= */ "",
+          /* rustfmt_config_path= */ "",
+          /* do_nothing= */ false, public_headers, target_args,
+          /* extra_rs_srcs= */ {},
+          /* srcs_to_scan_for_instantiations= */ {},
+          /* instantiations_out= */ "", /* error_report_out= */ "",
+          SourceLocationDocComment::Enabled, /* precompiled_header= */ "",
+          /* precompiled_header_out= */ "", absl::GetFlag(FLAGS_lazy_import),
+          absl::GetFlag(FLAGS_codegen_threads),
+          RustFormatting::BuiltinLayout));
+
+  std::string trace_path = absl::GetFlag(FLAGS_time_trace_out);
+  if (trace_path.empty()) {
+    trace_path = (std::filesystem::temp_directory_path() /
+                  "generate_bindings_benchmark_trace.json")
+                     .string();
+  }
+
+  int iterations = std::max(absl::GetFlag(FLAGS_iterations), 1);
+  size_t items = 0;
+  size_t output_bytes = 0;
+  int64_t rss_before_kb = PeakRssKb();
+  // The timed iterations don't trace, as recording the events of each phase
+  // and importer has a cost of its own.
+  absl::Time start = absl::Now();
+  for (int i = 0; i < iterations; ++i) {
+    CRUBIT_ASSIGN_OR_RETURN(
+        BindingsAndMetadata result,
+        GenerateBindingsAndMetadata(cmdline, clang_args, headers_contents));
+    items = result.ir.items.size();
+    output_bytes =
+        result.rs_api.view().size() + result.rs_api_impl.view().size();
+  }
+  absl::Duration elapsed = absl::Now() - start;
+  int64_t peak_rss_kb = PeakRssKb();
+
+  StartTimeTrace();
+  {
+    TracePhase phase("GenerateBindingsAndMetadata");
+    CRUBIT_RETURN_IF_ERROR(
+        GenerateBindingsAndMetadata(cmdline, clang_args, headers_contents)
+            .status());
+  }
+  CRUBIT_RETURN_IF_ERROR(FinishTimeTrace(trace_path));
+
+  std::cout << "items in the IR:      " << items << "\n"
+            << "generated sources:    " << output_bytes << " bytes\n"
+            << "time per iteration:   " << elapsed / iterations << "\n"
+            << "throughput:           "
+            << static_cast<int64_t>(items * iterations /
+                                    absl::ToDoubleSeconds(elapsed))
+            << " items/s\n"
+            << "peak RSS:             " << peak_rss_kb << " KiB ("
+            << peak_rss_kb - rss_before_kb << " KiB more than at the start)\n"
+            << "trace:                " << trace_path << "\n";
+  return PrintPhases(trace_path);
+}
+
+}  // namespace
+}  // namespace crubit
+
+int main(int argc, char* argv[]) {
+  std::vector<char*> args = absl::ParseCommandLine(argc, argv);
+  absl::Status status =
+      crubit::Main(std::vector<std::string>(args.begin() + 1, args.end()));
+  if (!status.ok()) {
+    std::cerr << status << "\n";
+    return 1;
+  }
+  return 0;
+}
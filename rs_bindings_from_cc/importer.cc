@@ -10,7 +10,7 @@
 #include <cassert>
 #include <cstddef>
 #include <iterator>
-#include <map>
+#include <limits>
 #include <memory>
 #include <optional>
 #include <set>
@@ -37,6 +37,7 @@
 #include "rs_bindings_from_cc/ast_util.h"
 #include "rs_bindings_from_cc/bazel_types.h"
 #include "rs_bindings_from_cc/ir.h"
+#include "rs_bindings_from_cc/time_trace.h"
 #include "rs_bindings_from_cc/type_map.h"
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/Decl.h"
@@ -66,11 +67,11 @@ constexpr absl::string_view kTypeStatusPayloadUrl =
 
 // Checks if the return value from `GetDeclItem` indicates that the import was
 // successful.
-absl::Status CheckImportStatus(const std::optional<IR::Item>& item) {
-  if (!item.has_value()) {
+absl::Status CheckImportStatus(const IR::Item* item) {
+  if (item == nullptr) {
     return absl::InvalidArgumentError("The import has been skipped");
   }
-  if (auto* unsupported = std::get_if<UnsupportedItem>(&*item)) {
+  if (auto* unsupported = std::get_if<UnsupportedItem>(item)) {
     return absl::InvalidArgumentError(unsupported->message);
   }
   return absl::OkStatus();
@@ -192,89 +193,225 @@ static int GetDeclOrder(const clang::Decl* decl) {
   return 999;
 }
 
-class Importer::SourceOrderKey {
+// Maps source locations to their positions in the translation unit, i.e. to
+// their offsets in the text that the compiler sees once all the `#include`s
+// are expanded. Comparing the positions of two file locations is equivalent to
+// `SourceManager::isBeforeInTranslationUnit`, but doesn't walk up their include
+// stacks every time.
+//
+// The positions are computed from a table of all the files of the translation
+// unit (including the ones loaded from a precompiled header), which is built
+// on first use.
+class Importer::SourcePositions {
  public:
-  explicit SourceOrderKey(clang::SourceRange source_range, int decl_order = 0,
-                          std::string name = "")
-      : source_range_(source_range), decl_order_(decl_order), name_(name) {}
-
-  SourceOrderKey(const SourceOrderKey&) = default;
-  SourceOrderKey& operator=(const SourceOrderKey&) = default;
-
-  bool isBefore(const SourceOrderKey& other,
-                const clang::SourceManager& sm) const {
-    if (!source_range_.isValid() || !other.source_range_.isValid()) {
-      if (source_range_.isValid() != other.source_range_.isValid())
-        return !source_range_.isValid() && other.source_range_.isValid();
-    } else {
-      if (source_range_.getBegin() != other.source_range_.getBegin()) {
-        return sm.isBeforeInTranslationUnit(source_range_.getBegin(),
-                                            other.source_range_.getBegin());
-      }
-      if (source_range_.getEnd() != other.source_range_.getEnd()) {
-        return sm.isBeforeInTranslationUnit(source_range_.getEnd(),
-                                            other.source_range_.getEnd());
+  explicit SourcePositions(const clang::SourceManager& sm) : sm_(sm) {}
+
+  // Returns the position of the expansion location of `loc`, or 0 if `loc` is
+  // invalid. Valid locations have positions of 1 and above.
+  uint64_t GetPosition(clang::SourceLocation loc) {
+    if (loc.isInvalid()) return 0;
+    return GetFilePosition(sm_.getExpansionLoc(loc));
+  }
+
+  // Returns the position of the spelling location of `loc`, which orders the
+  // locations that come from the same macro expansion.
+  uint64_t GetSpellingPosition(clang::SourceLocation loc) {
+    if (loc.isInvalid()) return 0;
+    return GetFilePosition(sm_.getSpellingLoc(loc));
+  }
+
+ private:
+  // Files are identified by the offset of their SLocEntry.
+  using FileKey = clang::SourceLocation::UIntTy;
+
+  struct File {
+    // The position of the first character of the file.
+    uint64_t position = 0;
+    // The number of positions taken by the file and the files it includes.
+    uint64_t size = 0;
+    // The offsets of the `#include`s of the file and the files they include,
+    // in source order.
+    std::vector<std::pair<unsigned, FileKey>> includes;
+    // `included_sizes[i]` is the total size of the first `i` included files.
+    std::vector<uint64_t> included_sizes;
+  };
+
+  uint64_t GetFilePosition(clang::SourceLocation file_loc) {
+    auto [file_id, offset] = sm_.getDecomposedLoc(file_loc);
+    FileKey key = sm_.getSLocEntry(file_id).getOffset();
+    auto it = files_.find(key);
+    if (it == files_.end()) {
+      // The file was entered after the table was built.
+      Build();
+      it = files_.find(key);
+      CHECK(it != files_.end());
+    }
+    const File& file = it->second;
+    size_t includes_before =
+        llvm::lower_bound(file.includes, offset,
+                          [](const auto& include, unsigned value) {
+                            return include.first < value;
+                          }) -
+        file.includes.begin();
+    return file.position + offset + file.included_sizes[includes_before];
+  }
+
+  void Build() {
+    files_.clear();
+    // The files that aren't included by another file, in the order in which
+    // they are parsed: the ones loaded from a precompiled header, then the
+    // `<built-in>` predefines buffer (which includes the `-include`d headers),
+    // then the main file.
+    std::vector<std::tuple<bool, bool, FileKey>> roots;
+    auto add_file = [&](const clang::SrcMgr::SLocEntry& entry, bool is_local) {
+      if (!entry.isFile()) return;
+      FileKey key = entry.getOffset();
+      clang::FileID file_id =
+          sm_.getFileID(clang::SourceLocation::getFromRawEncoding(key));
+      files_[key].size = sm_.getFileIDSize(file_id) + 1;
+      clang::SourceLocation include_loc = entry.getFile().getIncludeLoc();
+      if (include_loc.isInvalid()) {
+        bool is_builtin = sm_.getBufferName(sm_.getLocForStartOfFile(
+                              file_id)) == "<built-in>";
+        roots.push_back({is_local, !is_builtin, key});
+        return;
       }
+      auto [includer_id, include_offset] =
+          sm_.getDecomposedExpansionLoc(include_loc);
+      files_[sm_.getSLocEntry(includer_id).getOffset()].includes.push_back(
+          {include_offset, key});
+    };
+    for (unsigned i = 0; i < sm_.loaded_sloc_entry_size(); ++i) {
+      bool invalid = false;
+      const clang::SrcMgr::SLocEntry& entry =
+          sm_.getLoadedSLocEntry(i, &invalid);
+      if (!invalid) add_file(entry, /*is_local=*/false);
+    }
+    // The first local entry is a placeholder.
+    for (unsigned i = 1; i < sm_.local_sloc_entry_size(); ++i) {
+      add_file(sm_.getLocalSLocEntry(i), /*is_local=*/true);
     }
 
-    if (decl_order_ < other.decl_order_) {
-      return true;
-    } else if (decl_order_ > other.decl_order_) {
-      return false;
+    llvm::sort(roots);
+    uint64_t position = 1;
+    for (const auto& root : roots) {
+      position += LayOut(std::get<FileKey>(root), position);
+    }
+  }
+
+  // Places the file `key` and the files it includes at `position`, and returns
+  // the number of positions they take.
+  uint64_t LayOut(FileKey key, uint64_t position) {
+    // No files are added to `files_` from here on, so `file` stays valid.
+    File& file = files_.find(key)->second;
+    file.position = position;
+    llvm::sort(file.includes);
+    file.included_sizes.assign(1, 0);
+    for (const auto& [offset, included_key] : file.includes) {
+      uint64_t included_size = LayOut(
+          included_key, position + offset + 1 + file.included_sizes.back());
+      file.included_sizes.push_back(file.included_sizes.back() +
+                                    included_size);
     }
-    return name_ < other.name_;
+    file.size += file.included_sizes.back();
+    return file.size;
   }
 
+  const clang::SourceManager& sm_;
+  absl::flat_hash_map<FileKey, File> files_;
+};
+
+// The position of an item in the source order. Items with the same key are
+// ordered by the names of their decls (see `Importer::SortInSourceOrder`).
+class Importer::SourceOrderKey {
+ public:
+  explicit SourceOrderKey(SourcePositions& positions,
+                          clang::SourceRange source_range, int decl_order = 0,
+                          const clang::Decl* decl = nullptr)
+      : decl_order_(decl_order), decl_(decl) {
+    // Items with an invalid location go first, and are ordered by
+    // `decl_order` only.
+    if (source_range.getBegin().isValid()) {
+      begin_ = positions.GetPosition(source_range.getBegin());
+      begin_spelling_ = positions.GetSpellingPosition(source_range.getBegin());
+      end_ = positions.GetPosition(source_range.getEnd());
+      end_spelling_ = positions.GetSpellingPosition(source_range.getEnd());
+    }
+  }
+
+  bool operator<(const SourceOrderKey& other) const {
+    return std::tie(begin_, begin_spelling_, end_, end_spelling_,
+                    decl_order_) < std::tie(other.begin_,
+                                            other.begin_spelling_, other.end_,
+                                            other.end_spelling_,
+                                            other.decl_order_);
+  }
+
+  // The decl of the item, or nullptr for comments.
+  const clang::Decl* decl() const { return decl_; }
+
  private:
-  clang::SourceRange source_range_;
+  uint64_t begin_ = 0;
+  uint64_t begin_spelling_ = 0;
+  uint64_t end_ = 0;
+  uint64_t end_spelling_ = 0;
   int decl_order_;
-  std::string name_;
+  const clang::Decl* decl_;
 };
 
+Importer::~Importer() = default;
+
+Importer::SourcePositions& Importer::GetSourcePositions() const {
+  if (source_positions_ == nullptr) {
+    source_positions_ =
+        std::make_unique<SourcePositions>(ctx_.getSourceManager());
+  }
+  return *source_positions_;
+}
+
 Importer::SourceOrderKey Importer::GetSourceOrderKey(
     const clang::Decl* decl) const {
-  return SourceOrderKey(decl->getSourceRange(), GetDeclOrder(decl),
-                        GetNameForSourceOrder(decl));
+  return SourceOrderKey(GetSourcePositions(), decl->getSourceRange(),
+                        GetDeclOrder(decl), decl);
 }
 
 Importer::SourceOrderKey Importer::GetSourceOrderKey(
     const clang::RawComment* comment) const {
-  return SourceOrderKey(comment->getSourceRange());
+  return SourceOrderKey(GetSourcePositions(), comment->getSourceRange());
 }
 
-class Importer::SourceLocationComparator {
- public:
-  bool operator()(const clang::SourceLocation& a,
-                  const clang::SourceLocation& b) const {
-    return b.isValid() && a.isValid() && sm_.isBeforeInTranslationUnit(a, b);
-  }
-  bool operator()(const clang::RawComment* a,
-                  const clang::SourceLocation& b) const {
-    return this->operator()(a->getBeginLoc(), b);
-  }
-  bool operator()(const clang::SourceLocation& a,
-                  const clang::RawComment* b) const {
-    return this->operator()(a, b->getBeginLoc());
-  }
-  bool operator()(const clang::RawComment* a,
-                  const clang::RawComment* b) const {
-    return this->operator()(a->getBeginLoc(), b->getBeginLoc());
-  }
-
-  using OrderedItemId = std::pair<SourceOrderKey, ItemId>;
-  using OrderedItem = std::pair<SourceOrderKey, IR::Item>;
-
-  template <typename OrderedItemOrId>
-  bool operator()(const OrderedItemOrId& a, const OrderedItemOrId& b) const {
-    auto a_source_order = a.first;
-    auto b_source_order = b.first;
-    return a_source_order.isBefore(b_source_order, sm_);
+template <typename T>
+void Importer::SortInSourceOrder(
+    std::vector<std::pair<SourceOrderKey, T>>& items) const {
+  llvm::sort(items, llvm::less_first());
+  // Computing the names involves mangling, so they are only computed for the
+  // items that have the same key as another item (e.g. the members of
+  // implicit class template specializations, which all have the same
+  // location).
+  for (auto run_begin = items.begin(); run_begin != items.end();) {
+    auto run_end =
+        std::find_if(run_begin + 1, items.end(), [&](const auto& item) {
+          return run_begin->first < item.first;
+        });
+    if (run_end - run_begin > 1) {
+      std::vector<std::pair<std::string, std::pair<SourceOrderKey, T>>>
+          named_items;
+      named_items.reserve(run_end - run_begin);
+      for (auto it = run_begin; it != run_end; ++it) {
+        const clang::Decl* decl = it->first.decl();
+        named_items.push_back(
+            {decl == nullptr ? "" : GetNameForSourceOrder(decl),
+             std::move(*it)});
+      }
+      llvm::sort(named_items, llvm::less_first());
+      auto it = run_begin;
+      for (auto& [_, item] : named_items) {
+        *it++ = std::move(item);
+      }
+    }
+    run_begin = run_end;
   }
-  explicit SourceLocationComparator(const clang::SourceManager& sm) : sm_(sm) {}
-
- private:
-  const clang::SourceManager& sm_;
-};
+}
 
 static std::vector<clang::Decl*> GetCanonicalChildren(
     const clang::DeclContext* decl_context) {
@@ -310,28 +447,52 @@ static std::vector<clang::Decl*> GetCanonicalChildren(
 std::vector<ItemId> Importer::GetItemIdsInSourceOrder(
     clang::Decl* parent_decl) {
   clang::SourceManager& sm = ctx_.getSourceManager();
-  std::vector<SourceLocationComparator::OrderedItemId> items;
-  auto compare_locations = SourceLocationComparator(sm);
+  SourcePositions& positions = GetSourcePositions();
+  std::vector<std::pair<SourceOrderKey, ItemId>> items;
+
+  // Returns the range of `comments_` within [begin, end) whose positions are
+  // within `source_range`. An invalid begin or end of `source_range` stands
+  // for the beginning or the end of the translation unit.
+  auto find_comments = [&](size_t begin, size_t end,
+                           clang::SourceRange source_range) {
+    uint64_t begin_position = positions.GetPosition(source_range.getBegin());
+    uint64_t end_position = source_range.getEnd().isValid()
+                                ? positions.GetPosition(source_range.getEnd())
+                                : std::numeric_limits<uint64_t>::max();
+    auto first = std::lower_bound(
+        comments_.begin() + begin, comments_.begin() + end, begin_position,
+        [](const auto& comment, uint64_t position) {
+          return comment.first < position;
+        });
+    auto last = std::upper_bound(
+        first, comments_.begin() + end, end_position,
+        [](uint64_t position, const auto& comment) {
+          return position < comment.first;
+        });
+    return std::pair<size_t, size_t>(first - comments_.begin(),
+                                     last - comments_.begin());
+  };
 
   // We are only interested in comments within this decl context.
-  std::vector<const clang::RawComment*> comments_in_range(
-      llvm::lower_bound(comments_, parent_decl->getBeginLoc(),
-                        compare_locations),
-      llvm::upper_bound(comments_, parent_decl->getEndLoc(),
-                        compare_locations));
-
-  std::map<clang::SourceLocation, const clang::RawComment*,
-           SourceLocationComparator>
-      ordered_comments(compare_locations);
-  for (auto& comment : comments_in_range) {
-    ordered_comments.insert({comment->getBeginLoc(), comment});
-  }
+  std::pair<size_t, size_t> comments_in_range =
+      find_comments(0, comments_.size(), parent_decl->getSourceRange());
+  size_t comments_begin = comments_in_range.first;
+  size_t comments_end = comments_in_range.second;
+  // Indexed by the index of the comment minus `comments_begin`.
+  std::vector<bool> is_free_comment(comments_end - comments_begin, true);
+  auto remove_comments = [&](std::pair<size_t, size_t> range) {
+    std::fill(is_free_comment.begin() + (range.first - comments_begin),
+              is_free_comment.begin() + (range.second - comments_begin), false);
+  };
 
   absl::flat_hash_set<ItemId> visited_item_ids;
 
   auto* decl_context = clang::cast<clang::DeclContext>(parent_decl);
   for (auto decl : GetCanonicalChildren(decl_context)) {
-    auto item = GetDeclItem(decl);
+    // In lazy import mode, decls from other targets are only imported when
+    // they are referenced, and are not listed as children.
+    if (decl_context->isFileContext() && !IsImportRoot(decl)) continue;
+    const IR::Item* item = GetDeclItem(decl);
     // We generated IR for top level items coming from different targets,
     // however we shouldn't generate bindings for them, so we don't add them
     // to ir.top_level_item_ids.
@@ -339,8 +500,8 @@ std::vector<ItemId> Importer::GetItemIdsInSourceOrder(
       continue;
     }
     // Only add item ids for decls that can be successfully imported.
-    if (item.has_value()) {
-      auto item_id = GenerateItemId(decl);
+    if (item != nullptr) {
+      auto item_id = GetItemId(decl);
       // TODO(rosica): Drop this check when we start importing also other
       // redecls, not just the canonical
       if (visited_item_ids.find(item_id) == visited_item_ids.end()) {
@@ -352,16 +513,20 @@ std::vector<ItemId> Importer::GetItemIdsInSourceOrder(
     // We remove comments attached to a child decl or that are within a child
     // decl.
     if (auto raw_comment = ctx_.getRawCommentForDeclNoCache(decl)) {
-      ordered_comments.erase(raw_comment->getBeginLoc());
+      clang::SourceLocation loc = raw_comment->getBeginLoc();
+      remove_comments(find_comments(comments_begin, comments_end,
+                                    clang::SourceRange(loc, loc)));
     }
-    ordered_comments.erase(ordered_comments.lower_bound(decl->getBeginLoc()),
-                           ordered_comments.upper_bound(decl->getEndLoc()));
+    remove_comments(
+        find_comments(comments_begin, comments_end, decl->getSourceRange()));
   }
 
-  for (auto& [_, comment] : ordered_comments) {
-    items.push_back({GetSourceOrderKey(comment), GenerateItemId(comment)});
+  for (size_t i = comments_begin; i < comments_end; ++i) {
+    if (!is_free_comment[i - comments_begin]) continue;
+    const clang::RawComment* comment = comments_[i].second;
+    items.push_back({GetSourceOrderKey(comment), GenerateItemId(comment, sm)});
   }
-  llvm::sort(items, compare_locations);
+  SortInSourceOrder(items);
 
   std::vector<ItemId> ordered_item_ids;
   ordered_item_ids.reserve(items.size());
@@ -373,15 +538,12 @@ std::vector<ItemId> Importer::GetItemIdsInSourceOrder(
 
 std::vector<ItemId> Importer::GetOrderedItemIdsOfTemplateInstantiations()
     const {
-  std::vector<SourceLocationComparator::OrderedItemId> items;
+  std::vector<std::pair<SourceOrderKey, ItemId>> items;
   items.reserve(class_template_instantiations_.size());
   for (const auto* decl : class_template_instantiations_) {
-    items.push_back({GetSourceOrderKey(decl), GenerateItemId(decl)});
+    items.push_back({GetSourceOrderKey(decl), GetItemId(decl)});
   }
-
-  clang::SourceManager& sm = ctx_.getSourceManager();
-  auto compare_locations = SourceLocationComparator(sm);
-  llvm::sort(items, compare_locations);
+  SortInSourceOrder(items);
 
   std::vector<ItemId> ordered_item_ids;
   ordered_item_ids.reserve(items.size());
@@ -393,51 +555,69 @@ std::vector<ItemId> Importer::GetOrderedItemIdsOfTemplateInstantiations()
 
 void Importer::ImportFreeComments() {
   clang::SourceManager& sm = ctx_.getSourceManager();
+  SourcePositions& positions = GetSourcePositions();
   for (const auto& header : invocation_.public_headers_) {
     if (auto file = sm.getFileManager().getFile(header.IncludePath())) {
       if (auto comments_in_file = ctx_.Comments.getCommentsInFile(
               sm.getOrCreateFileID(*file, clang::SrcMgr::C_User))) {
         for (const auto& [_, comment] : *comments_in_file) {
-          comments_.push_back(comment);
+          comments_.push_back(
+              {positions.GetPosition(comment->getBeginLoc()), comment});
         }
       }
     }
   }
-  llvm::sort(comments_, SourceLocationComparator(sm));
+  llvm::sort(comments_, llvm::less_first());
 }
 
 void Importer::Import(clang::TranslationUnitDecl* translation_unit_decl) {
+  TracePhase phase("Import");
   ImportFreeComments();
   clang::SourceManager& sm = ctx_.getSourceManager();
-  std::vector<SourceLocationComparator::OrderedItem> ordered_items;
-
+  // The items are gathered into `items` first and then sorted by their index,
+  // so that each of them is moved (rather than copied) exactly once into the
+  // IR, however large it is.
+  std::vector<IR::Item> items;
+  // The keys of the items, with their indexes in `items`.
+  std::vector<std::pair<SourceOrderKey, size_t>> ordered_items;
+
+  items.reserve(comments_.size());
   ordered_items.reserve(comments_.size());
-  for (auto& comment : comments_) {
-    ordered_items.push_back(
-        {GetSourceOrderKey(comment),
-         Comment{.text = comment->getFormattedText(sm, sm.getDiagnostics()),
-                 .id = GenerateItemId(comment)}});
+  for (const auto& [_, comment] : comments_) {
+    ordered_items.push_back({GetSourceOrderKey(comment), items.size()});
+    items.push_back(
+        Comment{.text = comment->getFormattedText(sm, sm.getDiagnostics()),
+                .id = GenerateItemId(comment, sm)});
   }
 
   ImportDeclsFromDeclContext(translation_unit_decl);
-  for (const auto& [decl, item] : import_cache_) {
+  invocation_.ir_.top_level_item_ids =
+      GetItemIdsInSourceOrder(translation_unit_decl);
+
+  // Nothing is imported anymore after this point, so the items can be moved
+  // out of the cache.
+  items.reserve(items.size() + import_cache_.size());
+  ordered_items.reserve(ordered_items.size() + import_cache_.size());
+  for (auto& [decl, item] : import_cache_) {
     if (item.has_value()) {
       if (std::holds_alternative<UnsupportedItem>(*item) &&
           !IsFromCurrentTarget(decl)) {
         continue;
       }
-      ordered_items.push_back({GetSourceOrderKey(decl), *item});
+      ordered_items.push_back({GetSourceOrderKey(decl), items.size()});
+      items.push_back(*std::move(item));
     }
   }
 
-  llvm::sort(ordered_items, SourceLocationComparator(sm));
+  SortInSourceOrder(ordered_items);
 
-  invocation_.ir_.items.reserve(ordered_items.size());
-  for (auto& ordered_item : ordered_items) {
-    invocation_.ir_.items.push_back(ordered_item.second);
+  invocation_.ir_.items.reserve(invocation_.ir_.items.size() +
+                                ordered_items.size());
+  for (const auto& ordered_item : ordered_items) {
+    invocation_.ir_.items.push_back(std::move(items[ordered_item.second]));
   }
-  invocation_.ir_.top_level_item_ids =
-      GetItemIdsInSourceOrder(translation_unit_decl);
+  phase.AddCount("decls", import_cache_.size());
+  phase.AddCount("items", ordered_items.size());
 
   // TODO(b/257302656): Consider placing the generated template instantiations
   // into a separate namespace (maybe `crubit::instantiated_templates` ?).
@@ -448,14 +628,34 @@ void Importer::Import(clang::TranslationUnitDecl* translation_unit_decl) {
 void Importer::ImportDeclsFromDeclContext(
     const clang::DeclContext* decl_context) {
   for (auto decl : GetCanonicalChildren(decl_context)) {
+    if (decl_context->isFileContext() && !IsImportRoot(decl)) continue;
     GetDeclItem(decl);
   }
 }
 
-std::optional<IR::Item> Importer::GetDeclItem(clang::Decl* decl) {
+bool Importer::IsImportRoot(const clang::Decl* decl) const {
+  if (!invocation_.lazy_import_ || IsFromCurrentTarget(decl)) return true;
+  // The main file doesn't belong to any target, but it contains the namespace
+  // with the class template instantiations requested by `cc_template!`.
+  const clang::SourceManager& sm = ctx_.getSourceManager();
+  return sm.isInMainFile(sm.getExpansionLoc(decl->getLocation()));
+}
+
+void Importer::ImportEnclosingNamespace(const clang::Decl* decl) {
+  if (!invocation_.lazy_import_) return;
+  auto* namespace_decl = clang::dyn_cast<clang::NamespaceDecl>(
+      decl->getDeclContext()->getEnclosingNamespaceContext());
+  // Namespaces that are import roots get imported by
+  // `ImportDeclsFromDeclContext` (and importing them from here would recurse
+  // into the import of their children).
+  if (namespace_decl == nullptr || IsImportRoot(namespace_decl)) return;
+  GetDeclItem(namespace_decl);
+}
+
+const IR::Item* Importer::GetDeclItem(clang::Decl* decl) {
   // TODO(jeanpierreda): Move `decl->getCanonicalDecl()` from callers into here.
   if (auto it = import_cache_.find(decl); it != import_cache_.end()) {
-    return it->second;
+    return it->second.has_value() ? &*it->second : nullptr;
   }
   // Here, we need to be careful. Recursive imports break cycles as follows:
   // an item which may, in the process of being imported, then import itself,
@@ -491,9 +691,12 @@ std::optional<IR::Item> Importer::GetDeclItem(clang::Decl* decl) {
   // Note: insert_or_assign, not insert, in case a record, so as to overwrite
   // any null entries introduced by cycles.
 
+  ImportEnclosingNamespace(decl);
   std::optional<IR::Item> result = ImportDecl(decl);
-  auto [it, inserted] = import_cache_.try_emplace(decl, result);
-  if (!inserted) {
+  auto [it, inserted] = import_cache_.try_emplace(decl);
+  if (inserted) {
+    it->second = std::move(result);
+  } else {
     // TODO(jeanpierreda): Fix and promote to CHECK.
     // At least one cycle occurs with Typedef, where a typedef will import
     // itself during its own import. This isn't an infinite loop, because the
@@ -509,8 +712,11 @@ std::optional<IR::Item> Importer::GetDeclItem(clang::Decl* decl) {
         << "\n  trying to import a " << decl->getDeclKindName()
         << "\n  present entry: " << ItemToString(it->second)
         << "\n  was going to be inserted: " << ItemToString(result);
-    it->second = result;
+    it->second = std::move(result);
   }
+  // `import_cache_` is a node map, so the entry stays put even if the imports
+  // below add more entries.
+  const std::optional<IR::Item>& entry = it->second;
   if (auto* record_decl = clang::dyn_cast<clang::CXXRecordDecl>(decl)) {
     // TODO(forster): Should we even visit the nested decl if we couldn't
     // import the parent? For now we have tests that check that we generate
@@ -523,7 +729,7 @@ std::optional<IR::Item> Importer::GetDeclItem(clang::Decl* decl) {
     // IR::top_level_item_ids.
     class_template_instantiations_.insert(specialization_decl);
   }
-  return result;
+  return entry.has_value() ? &*entry : nullptr;
 }
 
 /// Returns true if a decl is inside a private section, or is inside a
@@ -563,12 +769,12 @@ std::optional<IR::Item> Importer::ImportDecl(clang::Decl* decl) {
   return std::nullopt;
 }
 
-std::optional<IR::Item> Importer::GetImportedItem(const clang::Decl* decl) {
+const IR::Item* Importer::GetImportedItem(const clang::Decl* decl) {
   auto it = import_cache_.find(decl);
-  if (it != import_cache_.end()) {
-    return it->second;
+  if (it != import_cache_.end() && it->second.has_value()) {
+    return &*it->second;
   }
-  return std::nullopt;
+  return nullptr;
 }
 
 BazelLabel Importer::GetOwningTarget(const clang::Decl* decl) const {
@@ -580,32 +786,54 @@ BazelLabel Importer::GetOwningTarget(const clang::Decl* decl) const {
 
   clang::SourceManager& source_manager = ctx_.getSourceManager();
   auto source_location = decl->getLocation();
+  if (!source_location.isValid()) {
+    return BazelLabel("//:virtual_clang_resource_dir_target");
+  }
+  if (source_location.isMacroID()) {
+    source_location = source_manager.getExpansionLoc(source_location);
+  }
+  return GetOwningTargetOfFile(source_manager.getFileID(source_location));
+}
 
-  // If the header this decl comes from is not associated with a target we
-  // consider it a textual header. In that case we go up the include stack
-  // until we find a header that has an owning target.
+BazelLabel Importer::GetOwningTargetOfFile(clang::FileID id) const {
+  if (!invocation_.memoize_owning_targets_) {
+    return ComputeOwningTargetOfFile(id);
+  }
+  if (auto it = owning_targets_of_files_.find(id);
+      it != owning_targets_of_files_.end()) {
+    return it->second;
+  }
+  BazelLabel target = ComputeOwningTargetOfFile(id);
+  owning_targets_of_files_.try_emplace(id, target);
+  return target;
+}
 
-  while (source_location.isValid()) {
-    if (source_location.isMacroID()) {
-      source_location = source_manager.getExpansionLoc(source_location);
-    }
-    auto id = source_manager.getFileID(source_location);
-    std::optional<llvm::StringRef> filename =
-        source_manager.getNonBuiltinFilenameForID(id);
-    if (!filename) {
-      return BazelLabel("//:_nothing_should_depend_on_private_builtin_hdrs");
-    }
-    if (filename->startswith("./")) {
-      filename = filename->substr(2);
-    }
+BazelLabel Importer::ComputeOwningTargetOfFile(clang::FileID id) const {
 
-    if (auto target = invocation_.header_target(HeaderName(filename->str()))) {
-      return *target;
-    }
-    source_location = source_manager.getIncludeLoc(id);
+  clang::SourceManager& source_manager = ctx_.getSourceManager();
+  std::optional<llvm::StringRef> filename =
+      source_manager.getNonBuiltinFilenameForID(id);
+  if (!filename) {
+    return BazelLabel("//:_nothing_should_depend_on_private_builtin_hdrs");
+  }
+  if (filename->startswith("./")) {
+    filename = filename->substr(2);
+  }
+  if (auto target = invocation_.header_target(HeaderName(filename->str()))) {
+    return *target;
   }
 
-  return BazelLabel("//:virtual_clang_resource_dir_target");
+  // If the header is not associated with a target we consider it a textual
+  // header. In that case we go up the include stack until we find a header
+  // that has an owning target.
+  auto include_location = source_manager.getIncludeLoc(id);
+  if (!include_location.isValid()) {
+    return BazelLabel("//:virtual_clang_resource_dir_target");
+  }
+  if (include_location.isMacroID()) {
+    include_location = source_manager.getExpansionLoc(include_location);
+  }
+  return GetOwningTargetOfFile(source_manager.getFileID(include_location));
 }
 
 bool Importer::IsFromCurrentTarget(const clang::Decl* decl) const {
@@ -622,7 +850,7 @@ IR::Item Importer::ImportUnsupportedItem(const clang::Decl* decl,
   return UnsupportedItem{.name = name,
                          .message = error,
                          .source_loc = source_loc,
-                         .id = GenerateItemId(decl)};
+                         .id = GetItemId(decl)};
 }
 
 IR::Item Importer::ImportUnsupportedItem(const clang::Decl* decl,
@@ -710,9 +938,8 @@ std::string Importer::ConvertSourceLocation(clang::SourceLocation loc) const {
 
 absl::StatusOr<MappedType> Importer::ConvertTemplateSpecializationType(
     const clang::TemplateSpecializationType* type) {
-  // Qualifiers are handled separately in TypeMapper::ConvertQualType().
-  std::string type_string = clang::QualType(type, 0).getAsString();
-
+  // Qualifiers are handled separately in TypeMapper::ConvertQualType(). The
+  // type is only printed for errors, as most types are converted successfully.
   auto* specialization_decl =
       clang::dyn_cast_or_null<clang::ClassTemplateSpecializationDecl>(
           type->getAsCXXRecordDecl());
@@ -720,7 +947,7 @@ absl::StatusOr<MappedType> Importer::ConvertTemplateSpecializationType(
     return absl::InvalidArgumentError(absl::Substitute(
         "Template specialization '$0' without an associated record decl "
         "is not supported.",
-        type_string));
+        clang::QualType(type, 0).getAsString()));
   }
 
   if (HasBeenAlreadySuccessfullyImported(specialization_decl))
@@ -741,7 +968,7 @@ absl::StatusOr<MappedType> Importer::ConvertTemplateSpecializationType(
   if (!import_status.ok()) {
     return absl::InvalidArgumentError(absl::Substitute(
         "Failed to create bindings for template specialization type $0: $1",
-        type_string, import_status.message()));
+        clang::QualType(type, 0).getAsString(), import_status.message()));
   }
 
   return ConvertTypeDecl(specialization_decl);
@@ -753,7 +980,7 @@ absl::StatusOr<MappedType> Importer::ConvertTypeDecl(clang::NamedDecl* decl) {
         "No generated bindings found for '$0'", decl->getNameAsString()));
   }
 
-  ItemId decl_id = GenerateItemId(decl);
+  ItemId decl_id = GetItemId(decl);
   return MappedType::WithDeclId(decl_id);
 }
 
@@ -777,8 +1004,6 @@ absl::StatusOr<MappedType> Importer::ConvertType(
     const clang::tidy::lifetimes::ValueLifetimes* lifetimes,
     std::optional<clang::RefQualifierKind> ref_qualifier_kind, bool nullable) {
   // Qualifiers are handled separately in ConvertQualType().
-  std::string type_string = clang::QualType(type, 0).getAsString();
-
   assert(!lifetimes || IsSameCanonicalUnqualifiedType(
                            lifetimes->Type(), clang::QualType(type, 0)));
 
@@ -965,10 +1190,18 @@ absl::StatusOr<MappedType> Importer::ConvertQualType(
     const clang::tidy::lifetimes::ValueLifetimes* lifetimes,
     std::optional<clang::RefQualifierKind> ref_qualifier_kind, bool nullable) {
   qual_type = GetUnelaboratedType(std::move(qual_type), ctx_);
-  std::string type_string = qual_type.getAsString();
+  auto key = std::make_tuple(qual_type.getAsOpaquePtr(), ref_qualifier_kind,
+                             nullable);
+  if (lifetimes == nullptr) {
+    if (auto it = converted_types_.find(key); it != converted_types_.end()) {
+      return it->second;
+    }
+  }
+
   absl::StatusOr<MappedType> type = ConvertType(
       qual_type.getTypePtr(), lifetimes, ref_qualifier_kind, nullable);
   if (!type.ok()) {
+    std::string type_string = qual_type.getAsString();
     absl::Status error = absl::UnimplementedError(absl::Substitute(
         "Unsupported type '$0': $1", type_string, type.status().message()));
     error.SetPayload(kTypeStatusPayloadUrl, absl::Cord(type_string));
@@ -978,13 +1211,27 @@ absl::StatusOr<MappedType> Importer::ConvertQualType(
   // Handle cv-qualification.
   type->cc_type.is_const = qual_type.isConstQualified();
   if (qual_type.isVolatileQualified()) {
-    return absl::UnimplementedError(
-        absl::StrCat("Unsupported `volatile` qualifier: ", type_string));
+    return absl::UnimplementedError(absl::StrCat(
+        "Unsupported `volatile` qualifier: ", qual_type.getAsString()));
   }
 
+  if (lifetimes == nullptr) {
+    converted_types_.insert({std::move(key), *type});
+  }
   return type;
 }
 
+ItemId Importer::GetItemId(const clang::Decl* decl) const {
+  if (!clang::isa<clang::NamespaceDecl>(decl)) {
+    decl = decl->getCanonicalDecl();
+  }
+  auto [it, inserted] = item_ids_.try_emplace(decl);
+  if (inserted) {
+    it->second = GenerateItemId(decl);
+  }
+  return it->second;
+}
+
 std::string Importer::GetMangledName(const clang::NamedDecl* named_decl) const {
   if (auto record_decl = clang::dyn_cast<clang::RecordDecl>(named_decl)) {
     // Mangled record names are used to 1) provide valid Rust identifiers for
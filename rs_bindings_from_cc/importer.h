@@ -5,13 +5,17 @@
 #ifndef CRUBIT_RS_BINDINGS_FROM_CC_IMPORTER_H_
 #define CRUBIT_RS_BINDINGS_FROM_CC_IMPORTER_H_
 
+#include <cstdint>
 #include <memory>
 #include <optional>
 #include <set>
 #include <string>
+#include <tuple>
 #include <utility>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/node_hash_map.h"
 #include "absl/log/die_if_null.h"
 #include "common/status_macros.h"
 #include "rs_bindings_from_cc/decl_importer.h"
@@ -27,6 +31,8 @@
 #include "rs_bindings_from_cc/ir.h"
 #include "clang/AST/Mangle.h"
 #include "clang/AST/RawCommentList.h"
+#include "clang/Basic/SourceLocation.h"
+#include "llvm/ADT/DenseMap.h"
 
 namespace crubit {
 
@@ -51,8 +57,12 @@ class Importer final : public ImportContext {
     decl_importers_.push_back(std::make_unique<NamespaceDeclImporter>(*this));
     decl_importers_.push_back(std::make_unique<TypeAliasImporter>(*this));
   }
+  ~Importer() override;
 
   // Import all visible declarations from a translation unit.
+  //
+  // Must be called at most once: the imported items are moved out of the
+  // importer into the IR of the invocation.
   void Import(clang::TranslationUnitDecl* decl);
 
  protected:
@@ -64,8 +74,9 @@ class Importer final : public ImportContext {
   IR::Item ImportUnsupportedItem(const clang::Decl* decl,
                                  std::set<std::string> errors) override;
   std::optional<IR::Item> ImportDecl(clang::Decl* decl) override;
-  std::optional<IR::Item> GetImportedItem(const clang::Decl* decl) override;
+  const IR::Item* GetImportedItem(const clang::Decl* decl) override;
   std::vector<ItemId> GetItemIdsInSourceOrder(clang::Decl* decl) override;
+  ItemId GetItemId(const clang::Decl* decl) const override;
   std::string GetMangledName(const clang::NamedDecl* named_decl) const override;
   BazelLabel GetOwningTarget(const clang::Decl* decl) const override;
   bool IsFromCurrentTarget(const clang::Decl* decl) const override;
@@ -98,8 +109,11 @@ class Importer final : public ImportContext {
   }
 
  private:
+  class SourcePositions;
   class SourceOrderKey;
-  class SourceLocationComparator;
+
+  // Returns the positions of the source locations of the translation unit.
+  SourcePositions& GetSourcePositions() const;
 
   // Returns a SourceOrderKey for the given `decl` that should be used for
   // ordering Items.
@@ -111,12 +125,36 @@ class Importer final : public ImportContext {
   // Returns a name for `decl` that should be used for ordering declarations.
   std::string GetNameForSourceOrder(const clang::Decl* decl) const;
 
+  // Sorts `items` by their keys. Items with the same key are ordered by
+  // `GetNameForSourceOrder`, which is only called for them.
+  template <typename T>
+  void SortInSourceOrder(
+      std::vector<std::pair<SourceOrderKey, T>>& items) const;
+
   // Returns the item ids of template instantiations that have been triggered
   // from the current target.  The returned items are in an arbitrary,
   // deterministic/reproducible order.
   std::vector<ItemId> GetOrderedItemIdsOfTemplateInstantiations() const;
 
-  std::optional<IR::Item> GetDeclItem(clang::Decl* decl) override;
+  const IR::Item* GetDeclItem(clang::Decl* decl) override;
+
+  // Returns true if `decl`, a child of a namespace or of the translation unit,
+  // should be imported even if nothing refers to it. Unless
+  // `Invocation::lazy_import_` is set, this is true for all decls.
+  bool IsImportRoot(const clang::Decl* decl) const;
+  // In lazy import mode, imports the namespace enclosing a `decl` that is
+  // imported on demand, so that its `enclosing_namespace_id` refers to an item
+  // of the IR.
+  void ImportEnclosingNamespace(const clang::Decl* decl);
+
+  // Returns the label of the target that owns the file `id`, i.e. of the
+  // target of the file itself or, for textual headers, of the nearest file up
+  // the include stack that has a target. The results are memoized in
+  // `owning_targets_of_files_` (unless `Invocation::memoize_owning_targets_` is
+  // false).
+  BazelLabel GetOwningTargetOfFile(clang::FileID id) const;
+  BazelLabel ComputeOwningTargetOfFile(clang::FileID id) const;
+
   // Stores the comments of this target in source order.
   void ImportFreeComments();
 
@@ -141,11 +179,36 @@ class Importer final : public ImportContext {
   // to successfully match a decl "wins", and no other importers are tried.
   std::vector<std::unique_ptr<DeclImporter>> decl_importers_;
   std::unique_ptr<clang::MangleContext> mangler_;
-  absl::flat_hash_map<const clang::Decl*, std::optional<IR::Item>>
+  // A node map, so that the items returned by `GetDeclItem` don't move when
+  // more items are imported.
+  absl::node_hash_map<const clang::Decl*, std::optional<IR::Item>>
       import_cache_;
   absl::flat_hash_set<const clang::ClassTemplateSpecializationDecl*>
       class_template_instantiations_;
-  std::vector<const clang::RawComment*> comments_;
+  // The comments of the public headers with their positions (see
+  // `SourcePositions`), in source order.
+  std::vector<std::pair<uint64_t, const clang::RawComment*>> comments_;
+  // Computed on first use by `GetSourcePositions`.
+  mutable std::unique_ptr<SourcePositions> source_positions_;
+  // Memoized results of `GetOwningTargetOfFile`, which is called for every decl
+  // that is imported.
+  mutable llvm::DenseMap<clang::FileID, BazelLabel> owning_targets_of_files_;
+  // Memoized results of `GetItemId`, keyed by the canonical decl (or, for
+  // namespaces, which aren't merged, by the decl itself).
+  mutable llvm::DenseMap<const clang::Decl*, ItemId> item_ids_;
+  // Memoized successful results of `ConvertQualType` without lifetimes, keyed
+  // by the (unelaborated) type, `ref_qualifier_kind` and `nullable`. The same
+  // types appear in many signatures (e.g. `const std::string&`).
+  //
+  // The key is the type as spelled rather than its canonical type, because a
+  // typedef maps to a different item than the type it aliases. Lifetimes are
+  // not uniqued, so the conversions with lifetimes are not memoized. Errors
+  // aren't either: a type whose decl is being imported may be convertible
+  // later on.
+  absl::flat_hash_map<
+      std::tuple<void*, std::optional<clang::RefQualifierKind>, bool>,
+      MappedType>
+      converted_types_;
 
   // Set of decls that have been successfully imported (i.e. that will be
   // present in the IR output / that will not produce dangling ItemIds in the IR
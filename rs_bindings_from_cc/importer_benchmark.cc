@@ -0,0 +1,135 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+// Measures `IrFromCc` on a synthetic translation unit in which most of the
+// decls come from the headers of dependencies, half of them through textual
+// headers (which have no owning target of their own, so that the importer has
+// to walk up the include stack to find their owning target):
+//
+//   importer_benchmark --headers=20 --decls_per_header=1000
+//   importer_benchmark --headers=20 --decls_per_header=1000 --lazy_import
+//
+// With `--nomemoize_owning_targets`, the owning target of each decl is looked
+// up without the memo of the owning target of each file, which gives the
+// baseline for the memo:
+//
+//   importer_benchmark --headers=20 --decls_per_header=1000 \
+//       --nomemoize_owning_targets
+//
+// With `--repeated_params`, the signatures of the functions repeat the same
+// types, as with the `const std::string&` parameters of real-world headers:
+//
+//   importer_benchmark --headers=20 --decls_per_header=1000 --repeated_params=8
+
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/substitute.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "rs_bindings_from_cc/bazel_types.h"
+#include "rs_bindings_from_cc/ir.h"
+#include "rs_bindings_from_cc/ir_from_cc.h"
+
+ABSL_FLAG(int, headers, 20, "number of dependency headers");
+ABSL_FLAG(int, decls_per_header, 1000,
+          "number of structs (and as many functions) per dependency header");
+ABSL_FLAG(int, iterations, 3, "number of times to run IrFromCc");
+ABSL_FLAG(bool, lazy_import, false, "passed as IrFromCcOptions::lazy_import");
+ABSL_FLAG(bool, memoize_owning_targets, true,
+          "passed as IrFromCcOptions::memoize_owning_targets_for_testing");
+ABSL_FLAG(int, repeated_params, 0,
+          "number of extra parameters of each function, all of them of the "
+          "same few types");
+
+namespace crubit {
+namespace {
+
+// Returns the source of `count` structs, each with a field and a function
+// taking it by pointer (and `--repeated_params` more parameters).
+std::string MakeDecls(absl::string_view prefix, int count) {
+  std::string repeated_params;
+  for (int i = 0; i < absl::GetFlag(FLAGS_repeated_params); ++i) {
+    absl::SubstituteAndAppend(
+        &repeated_params,
+        i % 2 == 0 ? ", const $0$1& p$2" : ", const char* p$2", prefix, 0, i);
+  }
+  std::string result = "#pragma once\n";
+  for (int i = 0; i < count; ++i) {
+    absl::SubstituteAndAppend(&result,
+                              "struct $0$1 { int field; };\n"
+                              "void $0Func$1($0$1* s$2);\n",
+                              prefix, i, repeated_params);
+  }
+  return result;
+}
+
+int Main() {
+  int headers = absl::GetFlag(FLAGS_headers);
+  int decls_per_header = absl::GetFlag(FLAGS_decls_per_header);
+
+  absl::flat_hash_map<const HeaderName, const std::string> contents;
+  absl::flat_hash_map<HeaderName, BazelLabel> headers_to_targets;
+  std::string target_source;
+  for (int i = 0; i < headers; ++i) {
+    std::string dependency_header = absl::StrCat("benchmark/dep", i, ".h");
+    std::string textual_header =
+        absl::StrCat("benchmark/dep", i, "_textual.inc");
+    contents.insert(
+        {HeaderName(dependency_header),
+         absl::StrCat("#include \"", textual_header, "\"\n",
+                      MakeDecls(absl::StrCat("Dep", i, "_"),
+                                decls_per_header / 2))});
+    contents.insert({HeaderName(textual_header),
+                     MakeDecls(absl::StrCat("Textual", i, "_"),
+                               decls_per_header - decls_per_header / 2)});
+    headers_to_targets.insert({HeaderName(dependency_header),
+                               BazelLabel(absl::StrCat("//benchmark:dep", i))});
+    absl::SubstituteAndAppend(&target_source,
+                              "#include \"$0\"\n"
+                              "void UseDep$1(Dep$1_0* a, Textual$1_0* b);\n",
+                              dependency_header, i);
+  }
+
+  int iterations = absl::GetFlag(FLAGS_iterations);
+  size_t items = 0;
+  absl::Time start = absl::Now();
+  for (int i = 0; i < iterations; ++i) {
+    absl::StatusOr<IR> ir =
+        IrFromCc({.extra_source_code_for_testing = target_source,
+                  .current_target = BazelLabel("//benchmark:target"),
+                  .virtual_headers_contents_for_testing = contents,
+                  .headers_to_targets = headers_to_targets,
+                  .lazy_import = absl::GetFlag(FLAGS_lazy_import),
+                  .memoize_owning_targets_for_testing =
+                      absl::GetFlag(FLAGS_memoize_owning_targets)});
+    if (!ir.ok()) {
+      std::cerr << ir.status() << "\n";
+      return 1;
+    }
+    items = ir->items.size();
+  }
+  absl::Duration elapsed = absl::Now() - start;
+
+  std::cout << "decls in the TU:      " << 2 * headers * decls_per_header
+            << "\n"
+            << "items in the IR:      " << items << "\n"
+            << "time per iteration:   " << elapsed / iterations << "\n";
+  return 0;
+}
+
+}  // namespace
+}  // namespace crubit
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+  return crubit::Main();
+}
@@ -2,6 +2,7 @@
 // Exceptions. See /LICENSE for license information.
 // SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
 
+#include <cstddef>
 #include <optional>
 #include <string>
 #include <variant>
@@ -9,11 +10,15 @@
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
 #include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "common/status_test_matchers.h"
 #include "rs_bindings_from_cc/bazel_types.h"
 #include "rs_bindings_from_cc/ir.h"
+#include "rs_bindings_from_cc/ir_binary.h"
 #include "rs_bindings_from_cc/ir_from_cc.h"
 
 namespace crubit {
@@ -24,6 +29,7 @@ using ::testing::AnyOf;
 using ::testing::Contains;
 using ::testing::Each;
 using ::testing::ElementsAre;
+using ::testing::ElementsAreArray;
 using ::testing::IsEmpty;
 using ::testing::Not;
 using ::testing::Pointee;
@@ -350,6 +356,173 @@ TEST(ImporterTest, TwoFuncsFromTwoHeaders) {
                                    VariantWith<Func>(IdentifierIs("Bar"))));
 }
 
+TEST(ImporterTest, PrecompiledHeader) {
+  const HeaderName dependency_header("test/dependency_header.h");
+  const std::string dependency_header_content =
+      "#pragma once\n"
+      "struct Dependency {};";
+  const std::string pch_path = testing::TempDir() + "dependency_header.pch";
+  ASSERT_OK(PrecompileHeaders(
+      {.public_headers = {dependency_header},
+       .virtual_headers_contents_for_testing = {{dependency_header,
+                                                 dependency_header_content}}},
+      pch_path));
+
+  ASSERT_OK_AND_ASSIGN(
+      IR ir,
+      IrFromCc({.extra_source_code_for_testing =
+                    "#include \"test/dependency_header.h\"\n"
+                    "void Foo(Dependency* dependency);",
+                .virtual_headers_contents_for_testing =
+                    {{dependency_header, dependency_header_content}},
+                .headers_to_targets = {{dependency_header,
+                                        BazelLabel{"//test:dependency"}}},
+                .precompiled_header = pch_path}));
+  EXPECT_THAT(ItemsWithoutBuiltins(ir),
+              Contains(VariantWith<Func>(IdentifierIs("Foo"))));
+}
+
+TEST(ImporterTest, LazyImport) {
+  const HeaderName dependency_header("test/dependency_header.h");
+  const std::string dependency_header_content =
+      "#pragma once\n"
+      "namespace dependency {\n"
+      "struct Used {};\n"
+      "struct Unused {};\n"
+      "}  // namespace dependency";
+
+  ASSERT_OK_AND_ASSIGN(
+      IR ir,
+      IrFromCc({.extra_source_code_for_testing =
+                    "#include \"test/dependency_header.h\"\n"
+                    "void Foo(dependency::Used* used);",
+                .virtual_headers_contents_for_testing =
+                    {{dependency_header, dependency_header_content}},
+                .headers_to_targets = {{dependency_header,
+                                        BazelLabel{"//test:dependency"}}},
+                .lazy_import = true}));
+  std::optional<ItemId> used_id = DeclIdForRecord(ir, "Used");
+  ASSERT_TRUE(used_id.has_value());
+  auto is_ptr_to_used = CcTypeIs(CcPointsTo(DeclIdIs(*used_id)));
+
+  // `Used` and its namespace are imported because `Foo` refers to `Used`.
+  EXPECT_THAT(ItemsWithoutBuiltins(ir),
+              Contains(VariantWith<Func>(AllOf(
+                  IdentifierIs("Foo"), ParamsAre(ParamType(is_ptr_to_used))))));
+  EXPECT_THAT(ItemsWithoutBuiltins(ir),
+              Contains(VariantWith<Namespace>(IdentifierIs("dependency"))));
+  EXPECT_THAT(ItemsWithoutBuiltins(ir),
+              Not(Contains(VariantWith<Record>(RsNameIs("Unused")))));
+}
+
+TEST(ImporterTest, ReproducibleIr) {
+  constexpr absl::string_view kSource = R"cc(
+    // Free comment.
+    namespace ns {
+    struct S {
+      int x;
+    };
+    }  // namespace ns
+    namespace ns {
+    void Foo(S* s);
+    }  // namespace ns
+    template <typename T>
+    struct Template {
+      T t;
+    };
+    using Instantiation = Template<int>;
+    struct {
+      int y;
+    } anonymous;
+  )cc";
+  const std::vector<std::string> extra_rs_srcs = {"extra.rs"};
+  ASSERT_OK_AND_ASSIGN(IR ir1,
+                       IrFromCc({.extra_source_code_for_testing = kSource,
+                                 .extra_rs_srcs = extra_rs_srcs}));
+  ASSERT_OK_AND_ASSIGN(IR ir2,
+                       IrFromCc({.extra_source_code_for_testing = kSource,
+                                 .extra_rs_srcs = extra_rs_srcs}));
+  EXPECT_EQ(IrToBinary(ir1), IrToBinary(ir2));
+
+  // ItemIds don't depend on where the AST is allocated, so adding a decl
+  // doesn't change the ItemIds of the others.
+  ASSERT_OK_AND_ASSIGN(IR ir3,
+                       IrFromCc({absl::StrCat(kSource, "struct Other {};")}));
+  std::optional<ItemId> s_id = DeclIdForRecord(ir1, "S");
+  ASSERT_TRUE(s_id.has_value());
+  EXPECT_EQ(DeclIdForRecord(ir3, "S"), s_id);
+}
+
+TEST(ImporterTest, ReproducibleCrubitFeatures) {
+  // Hash maps iterate in an order that depends on the process and on how they
+  // were built, so build the same features in different orders and sizes.
+  absl::flat_hash_map<BazelLabel, absl::flat_hash_set<std::string>> forward;
+  absl::flat_hash_map<BazelLabel, absl::flat_hash_set<std::string>> backward;
+  backward.reserve(1000);
+  constexpr int kTargets = 20;
+  constexpr int kFeatures = 10;
+  for (int i = 0; i < kTargets; ++i) {
+    BazelLabel target(absl::StrCat("//t:", absl::Dec(i, absl::kZeroPad2)));
+    for (int j = 0; j < kFeatures; ++j) {
+      forward[target].insert(absl::StrCat("f", i, "_", j));
+    }
+  }
+  for (int i = kTargets - 1; i >= 0; --i) {
+    BazelLabel target(absl::StrCat("//t:", absl::Dec(i, absl::kZeroPad2)));
+    backward[target].reserve(100);
+    for (int j = kFeatures - 1; j >= 0; --j) {
+      backward[target].insert(absl::StrCat("f", i, "_", j));
+    }
+  }
+  ASSERT_OK_AND_ASSIGN(IR ir1, IrFromCc({.extra_source_code_for_testing = " ",
+                                         .crubit_features = forward}));
+  ASSERT_OK_AND_ASSIGN(IR ir2, IrFromCc({.extra_source_code_for_testing = " ",
+                                         .crubit_features = backward}));
+  EXPECT_EQ(IrToBinary(ir1), IrToBinary(ir2));
+
+  // The targets and their features are written in sorted order, independent
+  // of the hash seed of the process.
+  std::string json = IrToJson(ir1);
+  size_t previous = 0;
+  for (int i = 0; i < kTargets; ++i) {
+    size_t target = json.find(
+        absl::StrCat("\"//t:", absl::Dec(i, absl::kZeroPad2), "\""));
+    ASSERT_NE(target, std::string::npos);
+    EXPECT_GT(target, previous);
+    previous = target;
+    for (int j = 0; j < kFeatures; ++j) {
+      size_t feature = json.find(absl::StrCat("\"f", i, "_", j, "\""));
+      ASSERT_NE(feature, std::string::npos);
+      EXPECT_GT(feature, previous);
+      previous = feature;
+    }
+  }
+}
+
+TEST(ImporterTest, UnnamedDeclsFromOneMacroHaveDistinctIds) {
+  // The unnamed decls of one macro expansion share their presumed location.
+  ASSERT_OK_AND_ASSIGN(IR ir, IrFromCc({R"cc(
+    #define UNNAMED_DECLS      \
+      enum { kA };             \
+      enum { kB };             \
+      struct {                 \
+        struct {               \
+          int x;               \
+        } inner;               \
+      } outer1;                \
+      struct {                 \
+        int y;                 \
+      } outer2;
+    UNNAMED_DECLS
+  )cc"}));
+  std::vector<ItemId> ids;
+  for (const IR::Item& item : ir.items) {
+    std::visit([&](const auto& item) { ids.push_back(item.id); }, item);
+  }
+  absl::flat_hash_set<ItemId> unique_ids(ids.begin(), ids.end());
+  EXPECT_EQ(unique_ids.size(), ids.size());
+}
+
 TEST(ImporterTest, NonInlineFunc) {
   ASSERT_OK_AND_ASSIGN(IR ir, IrFromCc({"void Foo() {}"}));
   EXPECT_THAT(ItemsWithoutBuiltins(ir),
@@ -403,6 +576,62 @@ TEST(ImporterTest, TestImportReferenceFunc) {
                   ReturnType(IsIntRef()), ParamsAre(ParamType(IsIntRef()))))));
 }
 
+TEST(ImporterTest, RepeatedTypesInSignatures) {
+  ASSERT_OK_AND_ASSIGN(IR ir, IrFromCc({R"cc(
+    struct S {};
+    typedef S T;
+    const S* Foo(const S* s, const T* t, const S* u);
+    S* Bar(S* s, const S* t);
+  )cc"}));
+
+  std::optional<ItemId> s_id = DeclIdForRecord(ir, "S");
+  ASSERT_TRUE(s_id.has_value());
+  std::vector<const TypeAlias*> type_aliases = ir.get_items_if<TypeAlias>();
+  ASSERT_THAT(type_aliases, SizeIs(1));
+  ItemId t_id = type_aliases[0]->id;
+
+  // The conversions of the same type are shared, but not across the types
+  // that only differ by their qualifiers or their sugar.
+  auto is_ptr_to_const_s =
+      AllOf(CcTypeIs(CcPointsTo(AllOf(DeclIdIs(*s_id), IsConst()))),
+            RsTypeIs(RsConstPointsTo(DeclIdIs(*s_id))));
+  auto is_ptr_to_const_t =
+      AllOf(CcTypeIs(CcPointsTo(AllOf(DeclIdIs(t_id), IsConst()))),
+            RsTypeIs(RsConstPointsTo(DeclIdIs(t_id))));
+  auto is_ptr_to_s = AllOf(CcTypeIs(CcPointsTo(AllOf(DeclIdIs(*s_id),
+                                                     Not(IsConst())))),
+                           RsTypeIs(RsPointsTo(DeclIdIs(*s_id))));
+  EXPECT_THAT(
+      ir.items,
+      Contains(VariantWith<Func>(AllOf(
+          IdentifierIs("Foo"), ReturnType(is_ptr_to_const_s),
+          ParamsAre(ParamType(is_ptr_to_const_s), ParamType(is_ptr_to_const_t),
+                    ParamType(is_ptr_to_const_s))))));
+  EXPECT_THAT(ir.items, Contains(VariantWith<Func>(AllOf(
+                            IdentifierIs("Bar"), ReturnType(is_ptr_to_s),
+                            ParamsAre(ParamType(is_ptr_to_s),
+                                      ParamType(is_ptr_to_const_s))))));
+}
+
+TEST(ImporterTest, IrItemIndex) {
+  absl::string_view file = R"cc(
+    struct S {};
+    void F();
+    struct T {};
+  )cc";
+  ASSERT_OK_AND_ASSIGN(IR ir, IrFromCc({file}));
+  IrItemIndex index(ir);
+
+  EXPECT_THAT(index.items_of_kind<Record>(),
+              ElementsAreArray(ir.get_items_if<Record>()));
+  EXPECT_THAT(index.items_of_kind<Func>(),
+              ElementsAreArray(ir.get_items_if<Func>()));
+  for (const Record* record : index.items_of_kind<Record>()) {
+    EXPECT_EQ(index.FindItemOfKind<Record>(record->id), record);
+    EXPECT_EQ(index.FindItemOfKind<Func>(record->id), nullptr);
+  }
+}
+
 TEST(ImporterTest, TrivialCopyConstructor) {
   absl::string_view file = R"cc(
     struct Implicit {};
@@ -826,6 +1055,56 @@ TEST(ImporterTest, TopLevelItemIds) {
           VariantWith<Comment>(TextIs("namespace top_level_namespace"))));
 }
 
+TEST(ImporterTest, TopLevelItemIdsAcrossIncludesAndMacros) {
+  const HeaderName textual_header("test/textual_header.inc");
+  ASSERT_OK_AND_ASSIGN(
+      IR ir,
+      IrFromCc({.extra_source_code_for_testing =
+                    "#define DEFINE_STRUCTS(a, b) struct a {}; struct b {};\n"
+                    "struct Before {};\n"
+                    "#include \"test/textual_header.inc\"\n"
+                    "struct After {};\n"
+                    "DEFINE_STRUCTS(First, Second)\n",
+                .virtual_headers_contents_for_testing = {
+                    {textual_header, "struct Included {};"}}}));
+
+  std::vector<IR::Item> items;
+  for (const auto& id : ir.top_level_item_ids) {
+    auto item = FindItemById(ir, id);
+    ASSERT_TRUE(item.has_value());
+    items.push_back(*item);
+  }
+  EXPECT_THAT(items, ElementsAre(VariantWith<Record>(RsNameIs("Before")),
+                                 VariantWith<Record>(RsNameIs("Included")),
+                                 VariantWith<Record>(RsNameIs("After")),
+                                 VariantWith<Record>(RsNameIs("First")),
+                                 VariantWith<Record>(RsNameIs("Second"))));
+}
+
+TEST(ImporterTest, TopLevelItemIdsWithForcedInclude) {
+  const HeaderName forced_header("test/forced_include.h");
+  std::vector<absl::string_view> clang_args = {"-include",
+                                               forced_header.IncludePath()};
+  ASSERT_OK_AND_ASSIGN(
+      IR ir,
+      IrFromCc({.extra_source_code_for_testing = "struct Main {};",
+                .virtual_headers_contents_for_testing =
+                    {{forced_header, "struct Forced {};"}},
+                .headers_to_targets = {{forced_header,
+                                        BazelLabel{"//test:testing_target"}}},
+                .clang_args = clang_args}));
+
+  std::vector<IR::Item> items;
+  for (const auto& id : ir.top_level_item_ids) {
+    auto item = FindItemById(ir, id);
+    ASSERT_TRUE(item.has_value());
+    items.push_back(*item);
+  }
+  // The `-include`d header is parsed before the main file.
+  EXPECT_THAT(items, ElementsAre(VariantWith<Record>(RsNameIs("Forced")),
+                                 VariantWith<Record>(RsNameIs("Main"))));
+}
+
 TEST(ImporterTest, RecordItemIds) {
   absl::string_view file = R"cc(
     struct TopLevelStruct {
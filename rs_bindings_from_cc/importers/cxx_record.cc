@@ -281,7 +281,7 @@ std::optional<IR::Item> CXXRecordDeclImporter::Import(
     return IncompleteRecord{
         .cc_name = std::move(cc_name),
         .rs_name = std::move(rs_name),
-        .id = GenerateItemId(record_decl),
+        .id = ictx_.GetItemId(record_decl),
         .owning_target = ictx_.GetOwningTarget(record_decl),
         .record_type = *record_type,
         .enclosing_namespace_id = GetEnclosingNamespaceId(record_decl)};
@@ -310,7 +310,7 @@ std::optional<IR::Item> CXXRecordDeclImporter::Import(
       .rs_name = std::move(rs_name),
       .cc_name = std::move(cc_name),
       .mangled_cc_name = ictx_.GetMangledName(record_decl),
-      .id = GenerateItemId(record_decl),
+      .id = ictx_.GetItemId(record_decl),
       .owning_target = ictx_.GetOwningTarget(record_decl),
       .defining_target = std::move(defining_target),
       .doc_comment = std::move(doc_comment),
@@ -414,9 +414,9 @@ std::vector<Field> CXXRecordDeclImporter::ImportFields(
     if (field_record) {
       // If it is a record as a direct member, its item must be already
       // imported.
-      auto item = ictx_.GetImportedItem(field_record);
-      if (item.has_value()) {
-        if (const auto* record = std::get_if<Record>(&item.value())) {
+      const IR::Item* item = ictx_.GetImportedItem(field_record);
+      if (item != nullptr) {
+        if (const auto* record = std::get_if<Record>(item)) {
           is_inheritable = record->is_inheritable;
         }
       }
@@ -509,7 +509,7 @@ std::vector<BaseClass> CXXRecordDeclImporter::GetUnambiguousPublicBases(
       CHECK((!offset.has_value() || *offset >= 0) &&
             "Concrete base classes should have non-negative offsets.");
       bases.push_back(
-          BaseClass{.base_record_id = GenerateItemId(base_record_decl),
+          BaseClass{.base_record_id = ictx_.GetItemId(base_record_decl),
                     .offset = offset});
       break;
     }
@@ -264,7 +264,7 @@ std::optional<IR::Item> FunctionDeclImporter::Import(
     }
 
     member_func_metadata = MemberFuncMetadata{
-        .record_id = GenerateItemId(method_decl->getParent()),
+        .record_id = ictx_.GetItemId(method_decl->getParent()),
         .instance_method_metadata = instance_metadata};
   }
 
@@ -317,7 +317,7 @@ std::optional<IR::Item> FunctionDeclImporter::Import(
       .is_member_or_descendant_of_class_template =
           is_member_or_descendant_of_class_template,
       .source_loc = ictx_.ConvertSourceLocation(function_decl->getBeginLoc()),
-      .id = GenerateItemId(function_decl),
+      .id = ictx_.GetItemId(function_decl),
       .enclosing_namespace_id = GetEnclosingNamespaceId(function_decl),
   };
 }
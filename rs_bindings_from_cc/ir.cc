@@ -4,79 +4,264 @@
 
 #include "rs_bindings_from_cc/ir.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <limits>
 #include <optional>
 #include <ostream>
 #include <string>
+#include <type_traits>
 #include <utility>
 #include <variant>
 #include <vector>
 
+#include "absl/container/flat_hash_set.h"
 #include "absl/log/check.h"
+#include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "common/string_type.h"
 #include "common/strong_int.h"
+#include "rs_bindings_from_cc/ir_writer.h"
+#include "clang/AST/Decl.h"
+#include "clang/AST/DeclBase.h"
+#include "clang/AST/RawCommentList.h"
 #include "clang/AST/Type.h"
+#include "clang/Basic/SourceLocation.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Index/USRGeneration.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
 #include "llvm/Support/JSON.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/raw_ostream.h"
 
 namespace crubit {
 
-template <class T>
-llvm::json::Value toJSON(const T& t) {
-  return t.ToJson();
+namespace {
+
+// `WriteValue` overloads serialize the building blocks of the IR, in the shape
+// that the `serde::Deserialize` impls in `ir.rs` expect. They are all declared
+// upfront so that the templates below can see each other.
+template <typename T>
+void WriteValue(IrWriter& writer, const T& value);
+template <typename T>
+void WriteValue(IrWriter& writer, const std::optional<T>& value);
+template <typename T>
+void WriteValue(IrWriter& writer, const std::vector<T>& values);
+template <typename T>
+void WriteValue(IrWriter& writer, const absl::StatusOr<T>& value);
+template <typename TTag, typename TInt>
+void WriteValue(IrWriter& writer, const crubit::StrongInt<TTag, TInt>& value);
+template <typename TTag>
+void WriteValue(IrWriter& writer, const crubit::StringType<TTag>& value);
+void WriteValue(IrWriter& writer, const std::string& value);
+void WriteValue(IrWriter& writer, const UnqualifiedIdentifier& value);
+void WriteValue(IrWriter& writer, const SpecialMemberFunc& value);
+
+// Writes bools and integers directly, and everything else using its `Write`
+// method.
+template <typename T>
+void WriteValue(IrWriter& writer, const T& value) {
+  if constexpr (std::is_same_v<T, bool>) {
+    writer.Bool(value);
+  } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+    writer.Int(value);
+  } else if constexpr (std::is_integral_v<T>) {
+    writer.Uint(value);
+  } else {
+    value.Write(writer);
+  }
+}
+
+template <typename T>
+void WriteValue(IrWriter& writer, const std::optional<T>& value) {
+  if (value.has_value()) {
+    WriteValue(writer, *value);
+  } else {
+    writer.Null();
+  }
+}
+
+template <typename T>
+void WriteValue(IrWriter& writer, const std::vector<T>& values) {
+  writer.ArrayBegin();
+  for (const T& value : values) {
+    WriteValue(writer, value);
+  }
+  writer.ArrayEnd();
+}
+
+template <typename T>
+void WriteValue(IrWriter& writer, const absl::StatusOr<T>& value) {
+  writer.ObjectBegin();
+  if (value.ok()) {
+    writer.Key("Ok");
+    WriteValue(writer, *value);
+  } else {
+    writer.Key("Err");
+    writer.String(value.status().message());
+  }
+  writer.ObjectEnd();
 }
 
 template <typename TTag, typename TInt>
-llvm::json::Value toJSON(const crubit::StrongInt<TTag, TInt> strong_int) {
-  return llvm::json::Value(strong_int.value());
+void WriteValue(IrWriter& writer, const crubit::StrongInt<TTag, TInt>& value) {
+  WriteValue(writer, value.value());
 }
 
 template <typename TTag>
-llvm::json::Value toJSON(const crubit::StringType<TTag> string_type) {
-  return llvm::json::Value(string_type.value());
+void WriteValue(IrWriter& writer, const crubit::StringType<TTag>& value) {
+  writer.String(value.value());
 }
 
-template <class T>
-llvm::json::Value toJSON(const absl::StatusOr<T>& t) {
-  if (t.ok()) {
-    return llvm::json::Object{{"Ok", *t}};
+void WriteValue(IrWriter& writer, const std::string& value) {
+  writer.String(value);
+}
+
+// Writes an object member.
+template <typename T>
+void WriteField(IrWriter& writer, absl::string_view key, const T& value) {
+  writer.Key(key);
+  WriteValue(writer, value);
+}
+
+// Items are externally tagged, i.e. written as `{"<kind>": {<fields>}}`.
+void BeginItem(IrWriter& writer, absl::string_view kind) {
+  writer.ObjectBegin();
+  writer.Key(kind);
+  writer.ObjectBegin();
+}
+
+void EndItem(IrWriter& writer) {
+  writer.ObjectEnd();
+  writer.ObjectEnd();
+}
+
+// Returns the presumed location of `loc`, which (unlike `loc` itself) is the
+// same in every run.
+std::string StableLocation(const clang::SourceManager& source_manager,
+                           clang::SourceLocation loc) {
+  clang::PresumedLoc presumed_loc = source_manager.getPresumedLoc(loc);
+  if (presumed_loc.isInvalid()) {
+    return "<invalid>";
   }
-  return llvm::json::Object{{"Err", std::string(t.status().message())}};
+  return absl::StrCat(presumed_loc.getFilename(), ":", presumed_loc.getLine(),
+                      ":", presumed_loc.getColumn());
 }
 
-llvm::json::Value HeaderName::ToJson() const {
-  return llvm::json::Object{
-      {"name", name_},
-  };
+}  // namespace
+
+ItemId GenerateItemIdFromKey(absl::string_view key) {
+  uint64_t hash = llvm::MD5Hash(llvm::StringRef(key.data(), key.size()));
+  return ItemId(static_cast<uintptr_t>(hash) &
+                (std::numeric_limits<uintptr_t>::max() >> 1));
+}
+
+ItemId GenerateItemId(const clang::Decl* decl) {
+  if (!clang::isa<clang::NamespaceDecl>(decl)) {
+    decl = decl->getCanonicalDecl();
+  }
+  llvm::SmallString<128> key;
+  bool has_usr = !clang::index::generateUSRForDecl(decl, key);
+  if (!has_usr) {
+    key.clear();
+  }
+  auto named_decl = clang::dyn_cast<clang::NamedDecl>(decl);
+  bool is_unnamed = named_decl == nullptr || named_decl->getDeclName().isEmpty();
+  if (!has_usr || is_unnamed || clang::isa<clang::NamespaceDecl>(decl)) {
+    const clang::SourceManager& source_manager =
+        decl->getASTContext().getSourceManager();
+    clang::SourceLocation loc = decl->getLocation();
+    key += "@";
+    key += decl->getDeclKindName();
+    key += "@";
+    key += StableLocation(source_manager, loc);
+    // The decls that come from one macro expansion (or that have no location)
+    // share their presumed location, so they are told apart by where they are
+    // spelled, by their parent, and by their index among the decls of the
+    // parent with the same kind and location.
+    if (loc.isMacroID() || loc.isInvalid()) {
+      key += "@";
+      key += StableLocation(source_manager, source_manager.getSpellingLoc(loc));
+      const clang::DeclContext* parent = decl->getLexicalDeclContext();
+      if (!parent->isTranslationUnit()) {
+        key += "@";
+        key += std::to_string(
+            GenerateItemId(clang::cast<clang::Decl>(parent)).value());
+      }
+      int index = 0;
+      for (const clang::Decl* sibling : parent->decls()) {
+        if (sibling == decl) break;
+        if (sibling->getKind() == decl->getKind() &&
+            sibling->getLocation() == loc) {
+          ++index;
+        }
+      }
+      key += "#";
+      key += std::to_string(index);
+    }
+  }
+  return GenerateItemIdFromKey(absl::string_view(key.data(), key.size()));
+}
+
+ItemId GenerateItemId(const clang::RawComment* comment,
+                      const clang::SourceManager& source_manager) {
+  return GenerateItemIdFromKey(absl::StrCat(
+      "comment@", StableLocation(source_manager, comment->getBeginLoc())));
+}
+
+void HeaderName::Write(IrWriter& writer) const {
+  writer.ObjectBegin();
+  WriteField(writer, "name", name_);
+  writer.ObjectEnd();
+}
+
+llvm::json::Value HeaderName::ToJson() const { return WriteToJsonValue(*this); }
+
+void LifetimeName::Write(IrWriter& writer) const {
+  writer.ObjectBegin();
+  WriteField(writer, "name", name);
+  WriteField(writer, "id", id);
+  writer.ObjectEnd();
 }
 
 llvm::json::Value LifetimeName::ToJson() const {
-  return llvm::json::Object{
-      {"name", name},
-      {"id", id},
-  };
+  return WriteToJsonValue(*this);
 }
 
-llvm::json::Value RsType::ToJson() const {
-  return llvm::json::Object{
-      {"name", decl_id.has_value() ? llvm::json::Value(nullptr)
-                                   : llvm::json::Value(name)},
-      {"lifetime_args", lifetime_args},
-      {"type_args", type_args},
-      {"decl_id", decl_id},
-  };
+void RsType::Write(IrWriter& writer) const {
+  writer.ObjectBegin();
+  writer.Key("name");
+  if (decl_id.has_value()) {
+    writer.Null();
+  } else {
+    writer.String(name);
+  }
+  WriteField(writer, "lifetime_args", lifetime_args);
+  WriteField(writer, "type_args", type_args);
+  WriteField(writer, "decl_id", decl_id);
+  writer.ObjectEnd();
 }
 
-llvm::json::Value CcType::ToJson() const {
-  return llvm::json::Object{
-      {"name", decl_id.has_value() ? llvm::json::Value(nullptr)
-                                   : llvm::json::Value(name)},
-      {"is_const", is_const},
-      {"type_args", type_args},
-      {"decl_id", decl_id},
-  };
+llvm::json::Value RsType::ToJson() const { return WriteToJsonValue(*this); }
+
+void CcType::Write(IrWriter& writer) const {
+  writer.ObjectBegin();
+  writer.Key("name");
+  if (decl_id.has_value()) {
+    writer.Null();
+  } else {
+    writer.String(name);
+  }
+  WriteField(writer, "is_const", is_const);
+  WriteField(writer, "type_args", type_args);
+  WriteField(writer, "decl_id", decl_id);
+  writer.ObjectEnd();
 }
 
+llvm::json::Value CcType::ToJson() const { return WriteToJsonValue(*this); }
+
 namespace {
 enum class ValueCategory { kLvalue, kRvalue };
 
@@ -202,32 +387,45 @@ MappedType MappedType::FuncRef(absl::string_view cc_call_conv,
   };
 }
 
-llvm::json::Value MappedType::ToJson() const {
-  return llvm::json::Object{
-      {"rs_type", rs_type},
-      {"cc_type", cc_type},
-  };
+void MappedType::Write(IrWriter& writer) const {
+  // The same types appear in many signatures and fields.
+  writer.SharedValue([&] {
+    writer.ObjectBegin();
+    WriteField(writer, "rs_type", rs_type);
+    WriteField(writer, "cc_type", cc_type);
+    writer.ObjectEnd();
+  });
 }
 
-llvm::json::Value Identifier::ToJson() const {
-  return llvm::json::Object{
-      {"identifier", identifier_},
-  };
+llvm::json::Value MappedType::ToJson() const { return WriteToJsonValue(*this); }
+
+void Identifier::Write(IrWriter& writer) const {
+  writer.ObjectBegin();
+  WriteField(writer, "identifier", identifier_);
+  writer.ObjectEnd();
+}
+
+llvm::json::Value Identifier::ToJson() const { return WriteToJsonValue(*this); }
+
+void IntegerConstant::Write(IrWriter& writer) const {
+  writer.ObjectBegin();
+  WriteField(writer, "is_negative", is_negative_);
+  WriteField(writer, "wrapped_value", wrapped_value_);
+  writer.ObjectEnd();
 }
 
 llvm::json::Value IntegerConstant::ToJson() const {
-  return llvm::json::Object{
-      {"is_negative", is_negative_},
-      {"wrapped_value", wrapped_value_},
-  };
+  return WriteToJsonValue(*this);
 }
 
-llvm::json::Value Operator::ToJson() const {
-  return llvm::json::Object{
-      {"name", name_},
-  };
+void Operator::Write(IrWriter& writer) const {
+  writer.ObjectBegin();
+  WriteField(writer, "name", name_);
+  writer.ObjectEnd();
 }
 
+llvm::json::Value Operator::ToJson() const { return WriteToJsonValue(*this); }
+
 static std::string SpecialNameToString(SpecialName special_name) {
   switch (special_name) {
     case SpecialName::kDestructor:
@@ -237,35 +435,44 @@ static std::string SpecialNameToString(SpecialName special_name) {
   }
 }
 
-llvm::json::Value toJSON(const UnqualifiedIdentifier& unqualified_identifier) {
+namespace {
+void WriteValue(IrWriter& writer,
+                const UnqualifiedIdentifier& unqualified_identifier) {
+  writer.ObjectBegin();
   if (auto* id = std::get_if<Identifier>(&unqualified_identifier)) {
-    return llvm::json::Object{
-        {"Identifier", *id},
-    };
+    WriteField(writer, "Identifier", *id);
   } else if (auto* op = std::get_if<Operator>(&unqualified_identifier)) {
-    return llvm::json::Object{
-        {"Operator", *op},
-    };
+    WriteField(writer, "Operator", *op);
   } else {
     SpecialName special_name = std::get<SpecialName>(unqualified_identifier);
-    return llvm::json::Object{
-        {SpecialNameToString(special_name), nullptr},
-    };
+    writer.Key(SpecialNameToString(special_name));
+    writer.Null();
   }
+  writer.ObjectEnd();
 }
+}  // namespace
 
-llvm::json::Value FuncParam::ToJson() const {
-  return llvm::json::Object{
-      {"type", type},
-      {"identifier", identifier},
-  };
+llvm::json::Value toJSON(const UnqualifiedIdentifier& unqualified_identifier) {
+  JsonValueIrWriter writer;
+  WriteValue(writer, unqualified_identifier);
+  return std::move(writer).Finish();
 }
 
+void FuncParam::Write(IrWriter& writer) const {
+  writer.ObjectBegin();
+  WriteField(writer, "type", type);
+  WriteField(writer, "identifier", identifier);
+  writer.ObjectEnd();
+}
+
+llvm::json::Value FuncParam::ToJson() const { return WriteToJsonValue(*this); }
+
 std::ostream& operator<<(std::ostream& o, const SpecialName& special_name) {
   return o << SpecialNameToString(special_name);
 }
 
-llvm::json::Value MemberFuncMetadata::InstanceMethodMetadata::ToJson() const {
+void MemberFuncMetadata::InstanceMethodMetadata::Write(
+    IrWriter& writer) const {
   const char* reference_str = nullptr;
   switch (reference) {
     case MemberFuncMetadata::kLValue:
@@ -279,74 +486,79 @@ llvm::json::Value MemberFuncMetadata::InstanceMethodMetadata::ToJson() const {
       break;
   }
 
-  return llvm::json::Object{
-      {"reference", reference_str},
-      {"is_const", is_const},
-      {"is_virtual", is_virtual},
-  };
+  writer.ObjectBegin();
+  writer.Key("reference");
+  writer.String(reference_str);
+  WriteField(writer, "is_const", is_const);
+  WriteField(writer, "is_virtual", is_virtual);
+  writer.ObjectEnd();
 }
 
-llvm::json::Value MemberFuncMetadata::ToJson() const {
-  return llvm::json::Object{
-      {"record_id", record_id},
-      {"instance_method_metadata", instance_method_metadata},
-  };
+llvm::json::Value MemberFuncMetadata::InstanceMethodMetadata::ToJson() const {
+  return WriteToJsonValue(*this);
 }
 
-llvm::json::Value TypeMapOverride::ToJson() const {
-  llvm::json::Object override{
-      {"rs_name", rs_name},
-      {"cc_name", cc_name},
-      {"owning_target", owning_target},
-      {"is_same_abi", is_same_abi},
-      {"id", id},
-  };
-  if (size_align.has_value()) {
-    override.insert({"size_align", size_align->ToJson()});
-  }
-
-  return llvm::json::Object{
-      {"TypeMapOverride", std::move(override)},
-  };
+void MemberFuncMetadata::Write(IrWriter& writer) const {
+  writer.ObjectBegin();
+  WriteField(writer, "record_id", record_id);
+  WriteField(writer, "instance_method_metadata", instance_method_metadata);
+  writer.ObjectEnd();
 }
 
-llvm::json::Value UseMod::ToJson() const {
-  llvm::json::Object use_mod{
-      {"path", path},
-      {"mod_name", mod_name},
-      {"id", id},
-  };
-
-  return llvm::json::Object{
-      {"UseMod", std::move(use_mod)},
-  };
+llvm::json::Value MemberFuncMetadata::ToJson() const {
+  return WriteToJsonValue(*this);
 }
 
-llvm::json::Value Func::ToJson() const {
-  llvm::json::Object func{
-      {"name", name},
-      {"owning_target", owning_target},
-      {"doc_comment", doc_comment},
-      {"mangled_name", mangled_name},
-      {"return_type", return_type},
-      {"params", params},
-      {"lifetime_params", lifetime_params},
-      {"is_inline", is_inline},
-      {"member_func_metadata", member_func_metadata},
-      {"has_c_calling_convention", has_c_calling_convention},
-      {"is_member_or_descendant_of_class_template",
-       is_member_or_descendant_of_class_template},
-      {"source_loc", source_loc},
-      {"id", id},
-      {"enclosing_namespace_id", enclosing_namespace_id},
-      {"adl_enclosing_record", adl_enclosing_record},
-  };
-
-  return llvm::json::Object{
-      {"Func", std::move(func)},
-  };
+void TypeMapOverride::Write(IrWriter& writer) const {
+  BeginItem(writer, "TypeMapOverride");
+  WriteField(writer, "rs_name", rs_name);
+  WriteField(writer, "cc_name", cc_name);
+  WriteField(writer, "owning_target", owning_target);
+  WriteField(writer, "is_same_abi", is_same_abi);
+  WriteField(writer, "id", id);
+  if (size_align.has_value()) {
+    WriteField(writer, "size_align", *size_align);
+  }
+  EndItem(writer);
 }
 
+llvm::json::Value TypeMapOverride::ToJson() const {
+  return WriteToJsonValue(*this);
+}
+
+void UseMod::Write(IrWriter& writer) const {
+  BeginItem(writer, "UseMod");
+  WriteField(writer, "path", path);
+  WriteField(writer, "mod_name", mod_name);
+  WriteField(writer, "id", id);
+  EndItem(writer);
+}
+
+llvm::json::Value UseMod::ToJson() const { return WriteToJsonValue(*this); }
+
+void Func::Write(IrWriter& writer) const {
+  BeginItem(writer, "Func");
+  WriteField(writer, "name", name);
+  WriteField(writer, "owning_target", owning_target);
+  WriteField(writer, "doc_comment", doc_comment);
+  WriteField(writer, "mangled_name", mangled_name);
+  WriteField(writer, "return_type", return_type);
+  WriteField(writer, "params", params);
+  WriteField(writer, "lifetime_params", lifetime_params);
+  WriteField(writer, "is_inline", is_inline);
+  WriteField(writer, "member_func_metadata", member_func_metadata);
+  WriteField(writer, "has_c_calling_convention", has_c_calling_convention);
+  WriteField(writer, "is_member_or_descendant_of_class_template",
+             is_member_or_descendant_of_class_template);
+  WriteField(writer, "source_loc", source_loc);
+  WriteField(writer, "id", id);
+  WriteField(writer, "enclosing_namespace_id", enclosing_namespace_id);
+  WriteField(writer, "adl_enclosing_record", adl_enclosing_record);
+  EndItem(writer);
+}
+
+llvm::json::Value Func::ToJson() const { return WriteToJsonValue(*this); }
+
 static std::string AccessToString(AccessSpecifier access) {
   switch (access) {
     case kPublic:
@@ -362,40 +574,56 @@ std::ostream& operator<<(std::ostream& o, const AccessSpecifier& access) {
   return o << AccessToString(access);
 }
 
-llvm::json::Value Field::ToJson() const {
-  return llvm::json::Object{
-      {"identifier", identifier},
-      {"doc_comment", doc_comment},
-      {"type", type},
-      {"access", AccessToString(access)},
-      {"offset", offset},
-      {"size", size},
-      {"is_no_unique_address", is_no_unique_address},
-      {"is_bitfield", is_bitfield},
-      {"is_inheritable", is_inheritable},
-  };
+void Field::Write(IrWriter& writer) const {
+  writer.ObjectBegin();
+  WriteField(writer, "identifier", identifier);
+  WriteField(writer, "doc_comment", doc_comment);
+  WriteField(writer, "type", type);
+  WriteField(writer, "access", AccessToString(access));
+  WriteField(writer, "offset", offset);
+  WriteField(writer, "size", size);
+  WriteField(writer, "is_no_unique_address", is_no_unique_address);
+  WriteField(writer, "is_bitfield", is_bitfield);
+  WriteField(writer, "is_inheritable", is_inheritable);
+  writer.ObjectEnd();
 }
 
-llvm::json::Value toJSON(const SpecialMemberFunc& f) {
+llvm::json::Value Field::ToJson() const { return WriteToJsonValue(*this); }
+
+namespace {
+void WriteValue(IrWriter& writer, const SpecialMemberFunc& f) {
   switch (f) {
     case SpecialMemberFunc::kTrivial:
-      return "Trivial";
+      writer.String("Trivial");
+      return;
     case SpecialMemberFunc::kNontrivialMembers:
-      return "NontrivialMembers";
+      writer.String("NontrivialMembers");
+      return;
     case SpecialMemberFunc::kNontrivialUserDefined:
-      return "NontrivialUserDefined";
+      writer.String("NontrivialUserDefined");
+      return;
     case SpecialMemberFunc::kUnavailable:
-      return "Unavailable";
+      writer.String("Unavailable");
+      return;
   }
 }
+}  // namespace
 
-llvm::json::Value BaseClass::ToJson() const {
-  return llvm::json::Object{
-      {"base_record_id", base_record_id},
-      {"offset", offset},
-  };
+llvm::json::Value toJSON(const SpecialMemberFunc& f) {
+  JsonValueIrWriter writer;
+  WriteValue(writer, f);
+  return std::move(writer).Finish();
+}
+
+void BaseClass::Write(IrWriter& writer) const {
+  writer.ObjectBegin();
+  WriteField(writer, "base_record_id", base_record_id);
+  WriteField(writer, "offset", offset);
+  writer.ObjectEnd();
 }
 
+llvm::json::Value BaseClass::ToJson() const { return WriteToJsonValue(*this); }
+
 static std::string RecordTypeToString(RecordType record_type) {
   switch (record_type) {
     case kStruct:
@@ -411,188 +639,206 @@ std::ostream& operator<<(std::ostream& o, const RecordType& record_type) {
   return o << RecordTypeToString(record_type);
 }
 
-llvm::json::Value IncompleteRecord::ToJson() const {
-  llvm::json::Object record{
-      {"cc_name", cc_name},
-      {"rs_name", rs_name},
-      {"id", id},
-      {"owning_target", owning_target},
-      {"record_type", RecordTypeToString(record_type)},
-      {"enclosing_namespace_id", enclosing_namespace_id},
-  };
-
-  return llvm::json::Object{
-      {"IncompleteRecord", std::move(record)},
-  };
-}
-
-llvm::json::Value SizeAlign::ToJson() const {
-  return llvm::json::Object{
-      {"size", size},
-      {"alignment", alignment},
-  };
+void IncompleteRecord::Write(IrWriter& writer) const {
+  BeginItem(writer, "IncompleteRecord");
+  WriteField(writer, "cc_name", cc_name);
+  WriteField(writer, "rs_name", rs_name);
+  WriteField(writer, "id", id);
+  WriteField(writer, "owning_target", owning_target);
+  WriteField(writer, "record_type", RecordTypeToString(record_type));
+  WriteField(writer, "enclosing_namespace_id", enclosing_namespace_id);
+  EndItem(writer);
 }
 
-llvm::json::Value Record::ToJson() const {
-  std::vector<llvm::json::Value> json_item_ids;
-  json_item_ids.reserve(child_item_ids.size());
-  for (const auto& id : child_item_ids) {
-    json_item_ids.push_back(id.value());
-  }
-
-  llvm::json::Object record{
-      {"rs_name", rs_name},
-      {"cc_name", cc_name},
-      {"mangled_cc_name", mangled_cc_name},
-      {"id", id},
-      {"owning_target", owning_target},
-      {"defining_target", defining_target},
-      {"doc_comment", doc_comment},
-      {"source_loc", source_loc},
-      {"unambiguous_public_bases", unambiguous_public_bases},
-      {"fields", fields},
-      {"lifetime_params", lifetime_params},
-      {"size_align", size_align.ToJson()},
-      {"is_derived_class", is_derived_class},
-      {"override_alignment", override_alignment},
-      {"copy_constructor", copy_constructor},
-      {"move_constructor", move_constructor},
-      {"destructor", destructor},
-      {"is_trivial_abi", is_trivial_abi},
-      {"is_inheritable", is_inheritable},
-      {"is_abstract", is_abstract},
-      {"record_type", RecordTypeToString(record_type)},
-      {"is_aggregate", is_aggregate},
-      {"is_anon_record_with_typedef", is_anon_record_with_typedef},
-      {"child_item_ids", std::move(json_item_ids)},
-      {"enclosing_namespace_id", enclosing_namespace_id},
-  };
-
-  return llvm::json::Object{
-      {"Record", std::move(record)},
-  };
+llvm::json::Value IncompleteRecord::ToJson() const {
+  return WriteToJsonValue(*this);
+}
+
+void SizeAlign::Write(IrWriter& writer) const {
+  writer.ObjectBegin();
+  WriteField(writer, "size", size);
+  WriteField(writer, "alignment", alignment);
+  writer.ObjectEnd();
+}
+
+llvm::json::Value SizeAlign::ToJson() const { return WriteToJsonValue(*this); }
+
+void Record::Write(IrWriter& writer) const {
+  BeginItem(writer, "Record");
+  WriteField(writer, "rs_name", rs_name);
+  WriteField(writer, "cc_name", cc_name);
+  WriteField(writer, "mangled_cc_name", mangled_cc_name);
+  WriteField(writer, "id", id);
+  WriteField(writer, "owning_target", owning_target);
+  WriteField(writer, "defining_target", defining_target);
+  WriteField(writer, "doc_comment", doc_comment);
+  WriteField(writer, "source_loc", source_loc);
+  WriteField(writer, "unambiguous_public_bases", unambiguous_public_bases);
+  WriteField(writer, "fields", fields);
+  WriteField(writer, "lifetime_params", lifetime_params);
+  WriteField(writer, "size_align", size_align);
+  WriteField(writer, "is_derived_class", is_derived_class);
+  WriteField(writer, "override_alignment", override_alignment);
+  WriteField(writer, "copy_constructor", copy_constructor);
+  WriteField(writer, "move_constructor", move_constructor);
+  WriteField(writer, "destructor", destructor);
+  WriteField(writer, "is_trivial_abi", is_trivial_abi);
+  WriteField(writer, "is_inheritable", is_inheritable);
+  WriteField(writer, "is_abstract", is_abstract);
+  WriteField(writer, "record_type", RecordTypeToString(record_type));
+  WriteField(writer, "is_aggregate", is_aggregate);
+  WriteField(writer, "is_anon_record_with_typedef",
+             is_anon_record_with_typedef);
+  WriteField(writer, "child_item_ids", child_item_ids);
+  WriteField(writer, "enclosing_namespace_id", enclosing_namespace_id);
+  EndItem(writer);
+}
+
+llvm::json::Value Record::ToJson() const { return WriteToJsonValue(*this); }
+
+void Enumerator::Write(IrWriter& writer) const {
+  writer.ObjectBegin();
+  WriteField(writer, "identifier", identifier);
+  WriteField(writer, "value", value);
+  writer.ObjectEnd();
+}
+
+llvm::json::Value Enumerator::ToJson() const { return WriteToJsonValue(*this); }
+
+void Enum::Write(IrWriter& writer) const {
+  BeginItem(writer, "Enum");
+  WriteField(writer, "identifier", identifier);
+  WriteField(writer, "id", id);
+  WriteField(writer, "owning_target", owning_target);
+  WriteField(writer, "source_loc", source_loc);
+  WriteField(writer, "underlying_type", underlying_type);
+  WriteField(writer, "enumerators", enumerators);
+  WriteField(writer, "enclosing_namespace_id", enclosing_namespace_id);
+  EndItem(writer);
+}
+
+llvm::json::Value Enum::ToJson() const { return WriteToJsonValue(*this); }
+
+void TypeAlias::Write(IrWriter& writer) const {
+  BeginItem(writer, "TypeAlias");
+  WriteField(writer, "identifier", identifier);
+  WriteField(writer, "id", id);
+  WriteField(writer, "owning_target", owning_target);
+  WriteField(writer, "doc_comment", doc_comment);
+  WriteField(writer, "underlying_type", underlying_type);
+  WriteField(writer, "source_loc", source_loc);
+  WriteField(writer, "enclosing_record_id", enclosing_record_id);
+  WriteField(writer, "enclosing_namespace_id", enclosing_namespace_id);
+  EndItem(writer);
+}
+
+llvm::json::Value TypeAlias::ToJson() const { return WriteToJsonValue(*this); }
+
+void UnsupportedItem::Write(IrWriter& writer) const {
+  BeginItem(writer, "UnsupportedItem");
+  WriteField(writer, "name", name);
+  WriteField(writer, "message", message);
+  WriteField(writer, "source_loc", source_loc);
+  WriteField(writer, "id", id);
+  EndItem(writer);
 }
 
-llvm::json::Value Enumerator::ToJson() const {
-  return llvm::json::Object{
-      {"identifier", identifier},
-      {"value", value},
-  };
+llvm::json::Value UnsupportedItem::ToJson() const {
+  return WriteToJsonValue(*this);
 }
 
-llvm::json::Value Enum::ToJson() const {
-  llvm::json::Object enum_ir{
-      {"identifier", identifier},
-      {"id", id},
-      {"owning_target", owning_target},
-      {"source_loc", source_loc},
-      {"underlying_type", underlying_type},
-      {"enumerators", enumerators},
-      {"enclosing_namespace_id", enclosing_namespace_id},
-  };
-
-  return llvm::json::Object{
-      {"Enum", std::move(enum_ir)},
-  };
+void Comment::Write(IrWriter& writer) const {
+  BeginItem(writer, "Comment");
+  WriteField(writer, "text", text);
+  WriteField(writer, "id", id);
+  EndItem(writer);
 }
 
-llvm::json::Value TypeAlias::ToJson() const {
-  llvm::json::Object type_alias{
-      {"identifier", identifier},
-      {"id", id},
-      {"owning_target", owning_target},
-      {"doc_comment", doc_comment},
-      {"underlying_type", underlying_type},
-      {"source_loc", source_loc},
-      {"enclosing_record_id", enclosing_record_id},
-      {"enclosing_namespace_id", enclosing_namespace_id},
-  };
+llvm::json::Value Comment::ToJson() const { return WriteToJsonValue(*this); }
 
-  return llvm::json::Object{
-      {"TypeAlias", std::move(type_alias)},
-  };
+void Namespace::Write(IrWriter& writer) const {
+  BeginItem(writer, "Namespace");
+  WriteField(writer, "name", name);
+  WriteField(writer, "id", id);
+  WriteField(writer, "canonical_namespace_id", canonical_namespace_id);
+  WriteField(writer, "owning_target", owning_target);
+  WriteField(writer, "child_item_ids", child_item_ids);
+  WriteField(writer, "enclosing_namespace_id", enclosing_namespace_id);
+  WriteField(writer, "is_inline", is_inline);
+  EndItem(writer);
 }
 
-llvm::json::Value UnsupportedItem::ToJson() const {
-  llvm::json::Object unsupported{
-      {"name", name},
-      {"message", message},
-      {"source_loc", source_loc},
-      {"id", id},
-  };
+llvm::json::Value Namespace::ToJson() const { return WriteToJsonValue(*this); }
 
-  return llvm::json::Object{
-      {"UnsupportedItem", std::move(unsupported)},
-  };
-}
+void IR::Write(IrWriter& writer) const {
+  writer.ObjectBegin();
+  WriteField(writer, "public_headers", public_headers);
+  WriteField(writer, "current_target", current_target);
 
-llvm::json::Value Comment::ToJson() const {
-  llvm::json::Object comment{
-      {"text", text},
-      {"id", id},
-  };
-  comment["id"] = id.value();
-  return llvm::json::Object{
-      {"Comment", std::move(comment)},
-  };
-}
-
-llvm::json::Value Namespace::ToJson() const {
-  std::vector<llvm::json::Value> json_item_ids;
-  json_item_ids.reserve(child_item_ids.size());
-  for (const auto& id : child_item_ids) {
-    json_item_ids.push_back(id.value());
-  }
-
-  llvm::json::Object ns{
-      {"name", name},
-      {"id", id},
-      {"canonical_namespace_id", canonical_namespace_id},
-      {"owning_target", owning_target},
-      {"child_item_ids", std::move(json_item_ids)},
-      {"enclosing_namespace_id", enclosing_namespace_id},
-      {"is_inline", is_inline},
-  };
-
-  return llvm::json::Object{
-      {"Namespace", std::move(ns)},
-  };
-}
-
-llvm::json::Value IR::ToJson() const {
-  std::vector<llvm::json::Value> json_items;
-  json_items.reserve(items.size());
+  writer.Key("items");
+  writer.ArrayBegin();
   for (const auto& item : items) {
-    std::visit([&](auto&& item) { json_items.push_back(item.ToJson()); }, item);
+    std::visit([&](auto&& item) { item.Write(writer); }, item);
   }
-  CHECK_EQ(json_items.size(), items.size());
+  writer.ArrayEnd();
 
-  std::vector<llvm::json::Value> top_level_ids;
-  top_level_ids.reserve(top_level_item_ids.size());
-  for (const auto& id : top_level_item_ids) {
-    top_level_ids.push_back(id.value());
-  }
+  WriteField(writer, "top_level_item_ids", top_level_item_ids);
 
-  llvm::json::Object features_json;
+  // Hash maps iterate in an order that varies between processes, so the
+  // targets and features are sorted to keep the IR reproducible.
+  std::vector<const BazelLabel*> targets;
+  targets.reserve(crubit_features.size());
   for (const auto& [target, features] : crubit_features) {
-    std::vector<llvm::json::Value> feature_array;
-    for (const std::string& feature : features) {
-      feature_array.push_back(feature);
+    targets.push_back(&target);
+  }
+  std::sort(targets.begin(), targets.end(),
+            [](const BazelLabel* a, const BazelLabel* b) { return *a < *b; });
+  writer.Key("crubit_features");
+  writer.ObjectBegin();
+  for (const BazelLabel* target : targets) {
+    const absl::flat_hash_set<std::string>& features =
+        crubit_features.at(*target);
+    std::vector<absl::string_view> sorted_features(features.begin(),
+                                                   features.end());
+    std::sort(sorted_features.begin(), sorted_features.end());
+    writer.Key(target->value());
+    writer.ArrayBegin();
+    for (absl::string_view feature : sorted_features) {
+      writer.String(feature);
     }
-    features_json[target.value()] = std::move(feature_array);
+    writer.ArrayEnd();
   }
+  writer.ObjectEnd();
 
-  llvm::json::Object result{
-      {"public_headers", public_headers},
-      {"current_target", current_target},
-      {"items", std::move(json_items)},
-      {"top_level_item_ids", std::move(top_level_ids)},
-      {"crubit_features", std::move(features_json)},
-  };
   if (!crate_root_path.empty()) {
-    result["crate_root_path"] = crate_root_path;
+    WriteField(writer, "crate_root_path", crate_root_path);
+  }
+  writer.ObjectEnd();
+}
+
+llvm::json::Value IR::ToJson() const { return WriteToJsonValue(*this); }
+
+std::string IrToJson(const IR& ir) {
+  std::string json;
+  llvm::raw_string_ostream os(json);
+  JsonIrWriter writer(os, internal::kJsonIndent);
+  ir.Write(writer);
+  os.flush();
+  return json;
+}
+
+IrItemIndex::IrItemIndex(const IR& ir) {
+  items_by_id_.reserve(ir.items.size());
+  for (const IR::Item& item : ir.items) {
+    std::visit(
+        [&](const auto& item_of_kind) {
+          using Kind = std::decay_t<decltype(item_of_kind)>;
+          std::get<std::vector<const Kind*>>(items_by_kind_)
+              .push_back(&item_of_kind);
+          items_by_id_.insert({item_of_kind.id, &item});
+        },
+        item);
   }
-  return std::move(result);
 }
 
 std::string ItemToString(const IR::Item& item) {
@@ -17,6 +17,7 @@
 #include <optional>
 #include <ostream>
 #include <string>
+#include <tuple>
 #include <utility>
 #include <variant>
 #include <vector>
@@ -26,14 +27,17 @@
 #include "absl/log/check.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "common/strong_int.h"
 #include "rs_bindings_from_cc/bazel_types.h"
+#include "rs_bindings_from_cc/ir_writer.h"
 #include "clang/AST/Decl.h"
 #include "clang/AST/DeclBase.h"
 #include "clang/AST/DeclTemplate.h"
 #include "clang/AST/RawCommentList.h"
 #include "clang/AST/Type.h"
 #include "clang/Basic/LLVM.h"
+#include "clang/Basic/SourceManager.h"
 #include "llvm/ADT/APSInt.h"
 #include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/JSON.h"
@@ -72,6 +76,7 @@ class HeaderName {
   absl::string_view IncludePath() const { return name_; }
 
   llvm::json::Value ToJson() const;
+  void Write(IrWriter& writer) const;
 
   template <typename H>
   friend H AbslHashValue(H h, const HeaderName& header_name) {
@@ -97,18 +102,31 @@ inline std::ostream& operator<<(std::ostream& o, const HeaderName& h) {
 // edges that don't follow the JSON tree structure (for example between types
 // and records), as well as location of comments and items we don't yet support.
 //  We use ItemIds for this.
+//
+// ItemIds are hashes of stable keys (see `GenerateItemIdFromKey`), so that two
+// runs over the same inputs produce the same IR.
 CRUBIT_DEFINE_STRONG_INT_TYPE(ItemId, uintptr_t);
 
-inline ItemId GenerateItemId(const clang::Decl* decl) {
-  if (auto namespace_decl = clang::dyn_cast<clang::NamespaceDecl>(decl)) {
-    return ItemId(reinterpret_cast<uintptr_t>(namespace_decl));
-  }
-  return ItemId(reinterpret_cast<uintptr_t>(decl->getCanonicalDecl()));
-}
+// Returns the ItemId for `key`. The result doesn't depend on anything but
+// `key`, and has the most significant bit cleared, so that it is also a valid
+// JSON integer.
+ItemId GenerateItemIdFromKey(absl::string_view key);
 
-inline ItemId GenerateItemId(const clang::RawComment* comment) {
-  return ItemId(reinterpret_cast<uintptr_t>(comment));
-}
+// Returns the ItemId of the canonical declaration of `decl`, derived from its
+// USR. Declarations without a USR (and unnamed ones, whose USRs are not
+// necessarily unique) are identified by their kind and presumed location, and
+// those in macro expansions also by their parent and their index in it.
+//
+// Generating a USR isn't cheap, so the importers use the memoized
+// `ImportContext::GetItemId` instead.
+//
+// Namespaces are not merged with their redeclarations: each `namespace` block
+// gets its own ItemId.
+ItemId GenerateItemId(const clang::Decl* decl);
+
+// Returns the ItemId of `comment`, derived from its presumed location.
+ItemId GenerateItemId(const clang::RawComment* comment,
+                      const clang::SourceManager& source_manager);
 
 // Returns the ID of the parent namespace, if such exists, and `std::nullopt`
 // for top level decls. We use this function to assign a parent namespace to all
@@ -133,6 +151,7 @@ CRUBIT_DEFINE_STRONG_INT_TYPE(LifetimeId, int);
 // A lifetime.
 struct LifetimeName {
   llvm::json::Value ToJson() const;
+  void Write(IrWriter& writer) const;
 
   // Lifetime name. Unlike syn::Lifetime, this does not include the apostrophe.
   //
@@ -152,6 +171,7 @@ inline std::ostream& operator<<(std::ostream& o, const LifetimeName& l) {
 // is spelled in C++.
 struct CcType {
   llvm::json::Value ToJson() const;
+  void Write(IrWriter& writer) const;
 
   // The name of the type. Examples:
   // - "int32_t", "std::ptrdiff_t", "long long", "bool"
@@ -186,6 +206,7 @@ struct CcType {
 // is spelled in Rust.
 struct RsType {
   llvm::json::Value ToJson() const;
+  void Write(IrWriter& writer) const;
 
   // The name of the type. Examples:
   // - "i32" or "bool" or "::core::ffi::c_int"
@@ -232,6 +253,9 @@ inline std::ostream& operator<<(std::ostream& o, const RsType& type) {
 // For example: a C++ pointer may be a usize in Rust, rather than a pointer, but
 // should almost certainly not be a u8, because u8 and pointers are sized and
 // aligned differently.
+//
+// MappedTypes are values: each item owns copies of its types. The repetitions
+// of a type are only shared in the binary IR (see `IrWriter::SharedValue`).
 struct MappedType {
   static MappedType Void() { return Simple("()", "void"); }
 
@@ -276,6 +300,7 @@ struct MappedType {
   bool IsVoid() const { return rs_type.name == "()"; }
 
   llvm::json::Value ToJson() const;
+  void Write(IrWriter& writer) const;
 
   RsType rs_type;
   CcType cc_type;
@@ -309,6 +334,7 @@ class Identifier {
   absl::string_view Ident() const { return identifier_; }
 
   llvm::json::Value ToJson() const;
+  void Write(IrWriter& writer) const;
 
  private:
   std::string identifier_;
@@ -337,6 +363,7 @@ class IntegerConstant {
   IntegerConstant& operator=(const IntegerConstant& other) = default;
 
   llvm::json::Value ToJson() const;
+  void Write(IrWriter& writer) const;
 
  private:
   // value < 0
@@ -355,6 +382,7 @@ class Operator {
   absl::string_view Name() const { return name_; }
 
   llvm::json::Value ToJson() const;
+  void Write(IrWriter& writer) const;
 
  private:
   std::string name_;
@@ -374,6 +402,7 @@ inline std::ostream& operator<<(std::ostream& stream, const Operator& op) {
 //    `FuncParam{.type=Type{"i32", "int32_t"}, .identifier=Identifier("foo"))`.
 struct FuncParam {
   llvm::json::Value ToJson() const;
+  void Write(IrWriter& writer) const;
 
   MappedType type;
   Identifier identifier;
@@ -411,6 +440,7 @@ struct MemberFuncMetadata {
   // constructors.
   struct InstanceMethodMetadata {
     llvm::json::Value ToJson() const;
+    void Write(IrWriter& writer) const;
 
     ReferenceQualification reference = kUnqualified;
     bool is_const = false;
@@ -418,6 +448,7 @@ struct MemberFuncMetadata {
   };
 
   llvm::json::Value ToJson() const;
+  void Write(IrWriter& writer) const;
 
   // The type that this is a member function for.
   ItemId record_id;
@@ -431,6 +462,7 @@ struct MemberFuncMetadata {
 // A function involved in the bindings.
 struct Func {
   llvm::json::Value ToJson() const;
+  void Write(IrWriter& writer) const;
 
   UnqualifiedIdentifier name;
   BazelLabel owning_target;
@@ -472,6 +504,7 @@ std::ostream& operator<<(std::ostream& o, const AccessSpecifier& access);
 // A field (non-static member variable) of a record.
 struct Field {
   llvm::json::Value ToJson() const;
+  void Write(IrWriter& writer) const;
 
   // Name of the field.  This may be missing for "unnamed members" - see:
   // - https://en.cppreference.com/w/c/language/struct
@@ -524,6 +557,7 @@ inline std::ostream& operator<<(std::ostream& o, const SpecialMemberFunc& f) {
 // A base class subobject of a struct or class.
 struct BaseClass {
   llvm::json::Value ToJson() const;
+  void Write(IrWriter& writer) const;
   ItemId base_record_id;
 
   // The offset the base class subobject is located at. This is always nonempty
@@ -549,6 +583,7 @@ std::ostream& operator<<(std::ostream& o, const RecordType& record_type);
 
 struct SizeAlign {
   llvm::json::Value ToJson() const;
+  void Write(IrWriter& writer) const;
 
   int64_t size;
   int64_t alignment;
@@ -557,6 +592,7 @@ struct SizeAlign {
 // A record (struct, class, union).
 struct Record {
   llvm::json::Value ToJson() const;
+  void Write(IrWriter& writer) const;
 
   // `rs_name` and `cc_name` are typically equal, but they may be different for
   // template instantiations (when `cc_name` is similar to `MyStruct<int>` and
@@ -639,6 +675,7 @@ struct Record {
 // A forward-declared record (e.g. `struct Foo;`)
 struct IncompleteRecord {
   llvm::json::Value ToJson() const;
+  void Write(IrWriter& writer) const;
   std::string cc_name;
   std::string rs_name;
   ItemId id;
@@ -649,6 +686,7 @@ struct IncompleteRecord {
 
 struct Enumerator {
   llvm::json::Value ToJson() const;
+  void Write(IrWriter& writer) const;
 
   Identifier identifier;
   IntegerConstant value;
@@ -656,6 +694,7 @@ struct Enumerator {
 
 struct Enum {
   llvm::json::Value ToJson() const;
+  void Write(IrWriter& writer) const;
 
   Identifier identifier;
   ItemId id;
@@ -673,6 +712,7 @@ inline std::ostream& operator<<(std::ostream& o, const Record& r) {
 // A type alias (defined either using `typedef` or `using`).
 struct TypeAlias {
   llvm::json::Value ToJson() const;
+  void Write(IrWriter& writer) const;
 
   Identifier identifier;
   ItemId id;
@@ -691,6 +731,7 @@ inline std::ostream& operator<<(std::ostream& o, const TypeAlias& t) {
 // A placeholder for an item that we can't generate bindings for (yet)
 struct UnsupportedItem {
   llvm::json::Value ToJson() const;
+  void Write(IrWriter& writer) const;
 
   // TODO(forster): We could show the original declaration in the generated
   // message (potentially also for successfully imported items).
@@ -711,6 +752,7 @@ inline std::ostream& operator<<(std::ostream& o, const UnsupportedItem& r) {
 
 struct Comment {
   llvm::json::Value ToJson() const;
+  void Write(IrWriter& writer) const;
 
   std::string text;
   ItemId id;
@@ -722,6 +764,7 @@ inline std::ostream& operator<<(std::ostream& o, const Comment& r) {
 
 struct Namespace {
   llvm::json::Value ToJson() const;
+  void Write(IrWriter& writer) const;
 
   Identifier name;
   ItemId id;
@@ -741,6 +784,7 @@ inline std::ostream& operator<<(std::ostream& o, const Namespace& n) {
 // This is used to support extra Rust source files.
 struct UseMod {
   llvm::json::Value ToJson() const;
+  void Write(IrWriter& writer) const;
 
   std::string path;
   Identifier mod_name;
@@ -755,6 +799,7 @@ inline std::ostream& operator<<(std::ostream& o, const UseMod& use_mod) {
 // rust type.
 struct TypeMapOverride {
   llvm::json::Value ToJson() const;
+  void Write(IrWriter& writer) const;
 
   std::string rs_name;
   std::string cc_name;
@@ -777,6 +822,9 @@ inline std::ostream& operator<<(std::ostream& o,
 // declarations of a single C++ library.
 struct IR {
   llvm::json::Value ToJson() const;
+  // Streams the IR into `writer`. Items are written one at a time, so no
+  // intermediate representation of the whole IR is built.
+  void Write(IrWriter& writer) const;
 
   template <typename T>
   std::vector<const T*> get_items_if() const {
@@ -821,9 +869,52 @@ struct IR {
       crubit_features;
 };
 
-inline std::string IrToJson(const IR& ir) {
-  return std::string(llvm::formatv("{0:2}", ir.ToJson()));
-}
+// Indexes the items of an `IR` by kind and by `ItemId`, in a single pass over
+// `IR::items`. Unlike `IR::get_items_if`, lookups don't rescan the items.
+//
+// The index points into `ir.items`, so it must not outlive `ir`, and it doesn't
+// see items added to `ir` after it was built.
+class IrItemIndex {
+ public:
+  explicit IrItemIndex(const IR& ir);
+
+  IrItemIndex(const IrItemIndex&) = delete;
+  IrItemIndex& operator=(const IrItemIndex&) = delete;
+
+  // Returns the items of type `T`, in the order of `IR::items`.
+  template <typename T>
+  absl::Span<const T* const> items_of_kind() const {
+    return std::get<std::vector<const T*>>(items_by_kind_);
+  }
+
+  // Returns the (first) item with the given `id`, or nullptr if there is none.
+  const IR::Item* FindItem(ItemId id) const {
+    auto it = items_by_id_.find(id);
+    return it == items_by_id_.end() ? nullptr : it->second;
+  }
+
+  // Returns the item with the given `id` if it is a `T`, or nullptr otherwise.
+  template <typename T>
+  const T* FindItemOfKind(ItemId id) const {
+    const IR::Item* item = FindItem(id);
+    return item == nullptr ? nullptr : std::get_if<T>(item);
+  }
+
+ private:
+  template <typename Variant>
+  struct ItemsByKind;
+  template <typename... Kinds>
+  struct ItemsByKind<std::variant<Kinds...>> {
+    using type = std::tuple<std::vector<const Kinds*>...>;
+  };
+
+  typename ItemsByKind<IR::Item>::type items_by_kind_;
+  absl::flat_hash_map<ItemId, const IR::Item*> items_by_id_;
+};
+
+// Serializes `ir` into pretty-printed JSON text. Unlike `IR::ToJson`, this
+// doesn't build an `llvm::json::Value` tree first.
+std::string IrToJson(const IR& ir);
 
 inline std::ostream& operator<<(std::ostream& o, const IR& ir) {
   return o << IrToJson(ir);
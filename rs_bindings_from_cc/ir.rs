@@ -51,6 +51,13 @@ pub fn deserialize_ir<R: Read>(reader: R) -> Result<IR> {
     Ok(make_ir(flat_ir))
 }
 
+/// Deserialize `IR` from the binary wire format produced by `IrToBinary` (see
+/// `ir_binary.h`).
+pub fn deserialize_ir_binary(bytes: &[u8]) -> Result<IR> {
+    let flat_ir = ir_binary::from_slice(bytes)?;
+    Ok(make_ir(flat_ir))
+}
+
 /// Create a testing `IR` instance from given parts. This function does not use
 /// any mock values.
 pub fn make_ir_from_parts<CrubitFeatures>(
@@ -0,0 +1,149 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#include "rs_bindings_from_cc/ir_binary.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include "absl/functional/function_ref.h"
+#include "absl/strings/string_view.h"
+#include "rs_bindings_from_cc/ir.h"
+#include "rs_bindings_from_cc/ir_writer.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/JSON.h"
+
+namespace crubit {
+
+BinaryIrWriter::BinaryIrWriter() {
+  buffer_.append(kIrBinaryMagic.data(), kIrBinaryMagic.size());
+  WriteVarint(kIrBinaryFormatVersion);
+}
+
+void BinaryIrWriter::WriteVarint(uint64_t value) {
+  while (value >= 0x80) {
+    buffer_.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  buffer_.push_back(static_cast<char>(value));
+}
+
+void BinaryIrWriter::WriteFixed64(uint64_t value) {
+  for (int i = 0; i < 8; ++i) {
+    buffer_.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+uint64_t BinaryIrWriter::InternString(absl::string_view value) {
+  auto [it, inserted] =
+      string_indices_.try_emplace(std::string(value), strings_.size());
+  if (inserted) {
+    strings_.push_back(&it->first);
+  }
+  return it->second;
+}
+
+void BinaryIrWriter::Null() { WriteTag(kNull); }
+
+void BinaryIrWriter::Bool(bool value) { WriteTag(value ? kTrue : kFalse); }
+
+void BinaryIrWriter::Int(int64_t value) {
+  if (value >= 0) {
+    Uint(static_cast<uint64_t>(value));
+    return;
+  }
+  WriteTag(kNegInt);
+  // -(value + 1) can't overflow, even for INT64_MIN.
+  WriteVarint(static_cast<uint64_t>(-(value + 1)));
+}
+
+void BinaryIrWriter::Uint(uint64_t value) {
+  WriteTag(kUint);
+  WriteVarint(value);
+}
+
+void BinaryIrWriter::Double(double value) {
+  WriteTag(kDouble);
+  uint64_t bits;
+  static_assert(sizeof(bits) == sizeof(value));
+  std::memcpy(&bits, &value, sizeof(bits));
+  WriteFixed64(bits);
+}
+
+void BinaryIrWriter::String(absl::string_view value) {
+  WriteTag(kString);
+  // The Rust side requires valid UTF-8, so invalid sequences (e.g. in doc
+  // comments) are replaced the same way `llvm::json::Value` does it.
+  llvm::StringRef string_ref(value.data(), value.size());
+  if (!llvm::json::isUTF8(string_ref)) {
+    WriteVarint(InternString(llvm::json::fixUTF8(string_ref)));
+    return;
+  }
+  WriteVarint(InternString(value));
+}
+
+void BinaryIrWriter::ArrayBegin() { WriteTag(kArray); }
+
+void BinaryIrWriter::ArrayEnd() { WriteTag(kEnd); }
+
+void BinaryIrWriter::ObjectBegin() { WriteTag(kObject); }
+
+void BinaryIrWriter::Key(absl::string_view key) {
+  WriteVarint(InternString(key) + 1);
+}
+
+void BinaryIrWriter::ObjectEnd() { WriteVarint(0); }
+
+// Returns the size of `value` as a varint.
+static size_t VarintSize(uint64_t value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    ++size;
+  }
+  return size;
+}
+
+void BinaryIrWriter::SharedValue(absl::FunctionRef<void()> write) {
+  // The offsets of the values nested in a shared value would be invalidated if
+  // it was replaced by a reference.
+  if (in_shared_value_) {
+    write();
+    return;
+  }
+  in_shared_value_ = true;
+  size_t start = buffer_.size();
+  write();
+  in_shared_value_ = false;
+
+  auto [it, inserted] =
+      shared_value_offsets_.try_emplace(buffer_.substr(start), start);
+  if (!inserted && 1 + VarintSize(it->second) < buffer_.size() - start) {
+    buffer_.resize(start);
+    WriteTag(kRef);
+    WriteVarint(it->second);
+  }
+}
+
+std::string BinaryIrWriter::Finish() && {
+  uint64_t string_table_offset = buffer_.size();
+  WriteVarint(strings_.size());
+  for (const std::string* s : strings_) {
+    WriteVarint(s->size());
+    buffer_.append(*s);
+  }
+  WriteFixed64(string_table_offset);
+  return std::move(buffer_);
+}
+
+std::string IrToBinary(const IR& ir) {
+  BinaryIrWriter writer;
+  ir.Write(writer);
+  return std::move(writer).Finish();
+}
+
+}  // namespace crubit
@@ -0,0 +1,123 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+// This file defines the binary wire format used to hand the `IR` from the C++
+// importer over to the Rust code generator (see `ir_binary.rs` for the
+// reading side).
+//
+// The format is a compact, self-describing encoding of the same value tree that
+// `IR::Write` emits for JSON, which means that the `serde::Deserialize` impls in
+// `ir.rs` can consume it unchanged. Compared to JSON it avoids printing and
+// re-parsing numbers, and every distinct string (field names, target labels,
+// type names, ...) is stored only once, in a string table. Likewise, the
+// repetitions of a shared value (see `IrWriter::SharedValue`, used for the
+// types) are references to its first occurrence.
+//
+// Layout:
+//
+//   header:       `kIrBinaryMagic`, varint `kIrBinaryFormatVersion`
+//   root value:   a single value (see below)
+//   string table: varint count, then for each string: varint size + bytes
+//   footer:       offset of the string table, as 8 little-endian bytes
+//
+// A value starts with a one byte tag (`BinaryIrWriter::Tag`):
+//
+//   kNull, kFalse, kTrue: no payload
+//   kUint:   varint
+//   kNegInt: varint holding `-(value + 1)`
+//   kDouble: 8 little-endian bytes of the IEEE 754 representation
+//   kString: varint index into the string table
+//   kArray:  values, terminated by a `kEnd` tag
+//   kObject: (varint key index + 1, value) pairs, terminated by a varint 0
+//   kRef:    varint offset (from the start of the buffer) of an earlier value,
+//            which is read in place of the reference
+//
+// Varints are unsigned LEB128. Arrays and objects are terminated rather than
+// length-prefixed so that they can be written without knowing their size
+// upfront.
+#ifndef CRUBIT_RS_BINDINGS_FROM_CC_IR_BINARY_H_
+#define CRUBIT_RS_BINDINGS_FROM_CC_IR_BINARY_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/node_hash_map.h"
+#include "absl/functional/function_ref.h"
+#include "absl/strings/string_view.h"
+#include "rs_bindings_from_cc/ir.h"
+#include "rs_bindings_from_cc/ir_writer.h"
+
+namespace crubit {
+
+// LINT.IfChange
+inline constexpr absl::string_view kIrBinaryMagic = "CRUBITIR";
+inline constexpr uint64_t kIrBinaryFormatVersion = 2;
+// LINT.ThenChange(//depot/rs_bindings_from_cc/ir_binary.rs)
+
+// Incrementally builds a buffer in the binary IR wire format.
+class BinaryIrWriter : public IrWriter {
+ public:
+  // LINT.IfChange
+  enum Tag : uint8_t {
+    kNull = 0,
+    kFalse = 1,
+    kTrue = 2,
+    kUint = 3,
+    kNegInt = 4,
+    kDouble = 5,
+    kString = 6,
+    kArray = 7,
+    kObject = 8,
+    kEnd = 9,
+    kRef = 10,
+  };
+  // LINT.ThenChange(//depot/rs_bindings_from_cc/ir_binary.rs)
+
+  BinaryIrWriter();
+
+  BinaryIrWriter(const BinaryIrWriter&) = delete;
+  BinaryIrWriter& operator=(const BinaryIrWriter&) = delete;
+
+  void Null() override;
+  void Bool(bool value) override;
+  void Int(int64_t value) override;
+  void Uint(uint64_t value) override;
+  void Double(double value);
+  void String(absl::string_view value) override;
+
+  void ArrayBegin() override;
+  void ArrayEnd() override;
+
+  void ObjectBegin() override;
+  void Key(absl::string_view key) override;
+  void ObjectEnd() override;
+
+  void SharedValue(absl::FunctionRef<void()> write) override;
+
+  // Appends the string table and the footer, and returns the finished buffer.
+  std::string Finish() &&;
+
+ private:
+  void WriteTag(Tag tag) { buffer_.push_back(static_cast<char>(tag)); }
+  void WriteVarint(uint64_t value);
+  void WriteFixed64(uint64_t value);
+  uint64_t InternString(absl::string_view value);
+
+  std::string buffer_;
+  absl::node_hash_map<std::string, uint64_t> string_indices_;
+  std::vector<const std::string*> strings_;
+  // The offsets of the encodings of the shared values written so far. Since
+  // strings are written as indices, equal values have equal encodings.
+  absl::flat_hash_map<std::string, uint64_t> shared_value_offsets_;
+  bool in_shared_value_ = false;
+};
+
+// Serializes `ir` into the binary IR wire format.
+std::string IrToBinary(const IR& ir);
+
+}  // namespace crubit
+
+#endif  // CRUBIT_RS_BINDINGS_FROM_CC_IR_BINARY_H_
@@ -0,0 +1,636 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+//! A `serde` deserializer for the binary IR wire format written by
+//! `BinaryIrWriter` in `rs_bindings_from_cc/ir_binary.cc`. See `ir_binary.h`
+//! for a description of the format.
+//!
+//! The format is self-describing, so any type implementing
+//! `serde::Deserialize` can be read from it, exactly like from JSON. Strings
+//! are borrowed from the input buffer, and no intermediate value tree is
+//! built. References to shared values are followed transparently, so the
+//! value they refer to is deserialized at each of its uses.
+
+use serde::de::{self, DeserializeSeed, IntoDeserializer, Visitor};
+use std::fmt::{self, Display};
+
+// LINT.IfChange
+pub const MAGIC: &[u8] = b"CRUBITIR";
+pub const FORMAT_VERSION: u64 = 2;
+
+const TAG_NULL: u8 = 0;
+const TAG_FALSE: u8 = 1;
+const TAG_TRUE: u8 = 2;
+const TAG_UINT: u8 = 3;
+const TAG_NEG_INT: u8 = 4;
+const TAG_DOUBLE: u8 = 5;
+const TAG_STRING: u8 = 6;
+const TAG_ARRAY: u8 = 7;
+const TAG_OBJECT: u8 = 8;
+const TAG_END: u8 = 9;
+const TAG_REF: u8 = 10;
+// LINT.ThenChange(//depot/rs_bindings_from_cc/ir_binary.h)
+
+/// Size of the footer holding the offset of the string table.
+const FOOTER_SIZE: usize = 8;
+
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct Error(String);
+
+impl Display for Error {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.write_str(&self.0)
+    }
+}
+
+impl std::error::Error for Error {}
+
+impl de::Error for Error {
+    fn custom<T: Display>(msg: T) -> Self {
+        Error(msg.to_string())
+    }
+}
+
+pub type Result<T> = std::result::Result<T, Error>;
+
+/// Returns true if `bytes` start with the binary IR magic number.
+pub fn is_binary_ir(bytes: &[u8]) -> bool {
+    bytes.starts_with(MAGIC)
+}
+
+/// Deserializes an instance of `T` from `bytes` in the binary IR wire format.
+pub fn from_slice<'de, T: de::Deserialize<'de>>(bytes: &'de [u8]) -> Result<T> {
+    let mut deserializer = Deserializer::new(bytes)?;
+    let value = T::deserialize(&mut deserializer)?;
+    if deserializer.pos != deserializer.end {
+        return Err(deserializer.error("trailing bytes after the root value"));
+    }
+    Ok(value)
+}
+
+pub struct Deserializer<'de> {
+    input: &'de [u8],
+    pos: usize,
+    /// Start of the root value.
+    start: usize,
+    /// End of the root value (i.e. the start of the string table).
+    end: usize,
+    strings: Vec<&'de str>,
+}
+
+impl<'de> Deserializer<'de> {
+    pub fn new(input: &'de [u8]) -> Result<Self> {
+        if !is_binary_ir(input) || input.len() < MAGIC.len() + FOOTER_SIZE {
+            return Err(Error("input is not in the binary IR format".to_string()));
+        }
+        let footer_start = input.len() - FOOTER_SIZE;
+        let mut footer = [0u8; FOOTER_SIZE];
+        footer.copy_from_slice(&input[footer_start..]);
+        let string_table_offset = u64::from_le_bytes(footer) as usize;
+        if string_table_offset < MAGIC.len() || string_table_offset > footer_start {
+            return Err(Error(format!("invalid string table offset {string_table_offset}")));
+        }
+
+        let mut deserializer =
+            Deserializer { input, pos: MAGIC.len(), start: 0, end: footer_start, strings: vec![] };
+        let version = deserializer.read_varint()?;
+        if version != FORMAT_VERSION {
+            return Err(Error(format!(
+                "unsupported binary IR version {version} (expected {FORMAT_VERSION})"
+            )));
+        }
+        let root_start = deserializer.pos;
+
+        deserializer.pos = string_table_offset;
+        let count = deserializer.read_varint()? as usize;
+        let mut strings = Vec::with_capacity(count.min(footer_start - string_table_offset));
+        for _ in 0..count {
+            let size = deserializer.read_varint()? as usize;
+            let bytes = deserializer.read_bytes(size)?;
+            strings.push(
+                std::str::from_utf8(bytes).map_err(|e| deserializer.error(e.to_string()))?,
+            );
+        }
+        if deserializer.pos != footer_start {
+            return Err(deserializer.error("trailing bytes after the string table"));
+        }
+
+        deserializer.strings = strings;
+        deserializer.pos = root_start;
+        deserializer.start = root_start;
+        deserializer.end = string_table_offset;
+        Ok(deserializer)
+    }
+
+    fn error(&self, msg: impl Display) -> Error {
+        Error(format!("{msg} (at byte offset {})", self.pos))
+    }
+
+    fn read_bytes(&mut self, size: usize) -> Result<&'de [u8]> {
+        if size > self.end - self.pos {
+            return Err(self.error("unexpected end of input"));
+        }
+        let bytes = &self.input[self.pos..self.pos + size];
+        self.pos += size;
+        Ok(bytes)
+    }
+
+    fn peek_u8(&self) -> Result<u8> {
+        if self.pos >= self.end {
+            return Err(self.error("unexpected end of input"));
+        }
+        Ok(self.input[self.pos])
+    }
+
+    fn read_u8(&mut self) -> Result<u8> {
+        let byte = self.peek_u8()?;
+        self.pos += 1;
+        Ok(byte)
+    }
+
+    fn read_varint(&mut self) -> Result<u64> {
+        let mut value = 0u64;
+        for shift in (0..64).step_by(7) {
+            let byte = self.read_u8()?;
+            value |= u64::from(byte & 0x7f) << shift;
+            if byte & 0x80 == 0 {
+                return Ok(value);
+            }
+        }
+        Err(self.error("varint is too long"))
+    }
+
+    fn read_string(&mut self) -> Result<&'de str> {
+        let index = self.read_varint()? as usize;
+        match self.strings.get(index) {
+            Some(s) => Ok(s),
+            None => Err(self.error(format!("invalid string index {index}"))),
+        }
+    }
+
+    /// Reads an object key, or returns `None` at the end of the object.
+    fn read_key(&mut self) -> Result<Option<&'de str>> {
+        let index = self.read_varint()? as usize;
+        if index == 0 {
+            return Ok(None);
+        }
+        match self.strings.get(index - 1) {
+            Some(s) => Ok(Some(s)),
+            None => Err(self.error(format!("invalid key index {index}"))),
+        }
+    }
+
+    fn read_neg_int(&mut self) -> Result<i64> {
+        let magnitude = self.read_varint()?;
+        if magnitude > i64::MAX as u64 {
+            return Err(self.error("negative integer out of range"));
+        }
+        Ok(-1 - magnitude as i64)
+    }
+
+    fn read_double(&mut self) -> Result<f64> {
+        let mut bytes = [0u8; 8];
+        bytes.copy_from_slice(self.read_bytes(8)?);
+        Ok(f64::from_le_bytes(bytes))
+    }
+
+    /// If the next value is a reference to a shared value, moves to the value
+    /// it refers to, and returns the position right after the reference (where
+    /// to resume once the value is read).
+    fn enter_ref(&mut self) -> Result<Option<usize>> {
+        if self.peek_u8()? != TAG_REF {
+            return Ok(None);
+        }
+        let ref_pos = self.pos;
+        self.pos += 1;
+        let target = self.read_varint()? as usize;
+        // Only backward references are valid, so following them terminates.
+        if target < self.start || target >= ref_pos {
+            self.pos = ref_pos;
+            return Err(self.error(format!("invalid reference to offset {target}")));
+        }
+        let resume = self.pos;
+        self.pos = target;
+        Ok(Some(resume))
+    }
+
+    /// Skips over the next value without interpreting it.
+    fn skip_value(&mut self) -> Result<()> {
+        match self.read_u8()? {
+            TAG_NULL | TAG_FALSE | TAG_TRUE => {}
+            TAG_UINT | TAG_NEG_INT | TAG_STRING | TAG_REF => {
+                self.read_varint()?;
+            }
+            TAG_DOUBLE => {
+                self.read_bytes(8)?;
+            }
+            TAG_ARRAY => {
+                while self.peek_u8()? != TAG_END {
+                    self.skip_value()?;
+                }
+                self.pos += 1;
+            }
+            TAG_OBJECT => {
+                while self.read_key()?.is_some() {
+                    self.skip_value()?;
+                }
+            }
+            tag => return Err(self.error(format!("unexpected tag {tag}"))),
+        }
+        Ok(())
+    }
+}
+
+impl<'de, 'a> de::Deserializer<'de> for &'a mut Deserializer<'de> {
+    type Error = Error;
+
+    fn deserialize_any<V: Visitor<'de>>(self, visitor: V) -> Result<V::Value> {
+        if let Some(resume) = self.enter_ref()? {
+            let value = de::Deserializer::deserialize_any(&mut *self, visitor)?;
+            self.pos = resume;
+            return Ok(value);
+        }
+        match self.read_u8()? {
+            TAG_NULL => visitor.visit_unit(),
+            TAG_FALSE => visitor.visit_bool(false),
+            TAG_TRUE => visitor.visit_bool(true),
+            TAG_UINT => visitor.visit_u64(self.read_varint()?),
+            TAG_NEG_INT => visitor.visit_i64(self.read_neg_int()?),
+            TAG_DOUBLE => visitor.visit_f64(self.read_double()?),
+            TAG_STRING => visitor.visit_borrowed_str(self.read_string()?),
+            TAG_ARRAY => {
+                let mut seq = SeqReader { de: self, done: false };
+                let value = visitor.visit_seq(&mut seq)?;
+                if !seq.done {
+                    return Err(seq.de.error("trailing array elements"));
+                }
+                Ok(value)
+            }
+            TAG_OBJECT => {
+                let mut map = MapReader { de: self, done: false };
+                let value = visitor.visit_map(&mut map)?;
+                if !map.done {
+                    return Err(map.de.error("trailing object members"));
+                }
+                Ok(value)
+            }
+            tag => Err(self.error(format!("unexpected tag {tag}"))),
+        }
+    }
+
+    fn deserialize_option<V: Visitor<'de>>(self, visitor: V) -> Result<V::Value> {
+        if let Some(resume) = self.enter_ref()? {
+            let value = de::Deserializer::deserialize_option(&mut *self, visitor)?;
+            self.pos = resume;
+            return Ok(value);
+        }
+        if self.peek_u8()? == TAG_NULL {
+            self.pos += 1;
+            visitor.visit_none()
+        } else {
+            visitor.visit_some(self)
+        }
+    }
+
+    fn deserialize_enum<V: Visitor<'de>>(
+        self,
+        _name: &'static str,
+        _variants: &'static [&'static str],
+        visitor: V,
+    ) -> Result<V::Value> {
+        if let Some(resume) = self.enter_ref()? {
+            let value = de::Deserializer::deserialize_enum(&mut *self, _name, _variants, visitor)?;
+            self.pos = resume;
+            return Ok(value);
+        }
+        // Enums use the same external tagging as `serde_json`: unit variants are
+        // plain strings, and all other variants are single-member objects.
+        match self.read_u8()? {
+            TAG_STRING => visitor.visit_enum(self.read_string()?.into_deserializer()),
+            TAG_OBJECT => {
+                let variant = match self.read_key()? {
+                    Some(variant) => variant,
+                    None => return Err(self.error("expected an enum variant, found `{}`")),
+                };
+                let value = visitor.visit_enum(VariantReader { de: self, variant })?;
+                if self.read_key()?.is_some() {
+                    return Err(self.error("expected a single enum variant"));
+                }
+                Ok(value)
+            }
+            tag => Err(self.error(format!("expected an enum, found tag {tag}"))),
+        }
+    }
+
+    fn deserialize_ignored_any<V: Visitor<'de>>(self, visitor: V) -> Result<V::Value> {
+        self.skip_value()?;
+        visitor.visit_unit()
+    }
+
+    serde::forward_to_deserialize_any! {
+        bool i8 i16 i32 i64 i128 u8 u16 u32 u64 u128 f32 f64 char str string
+        bytes byte_buf unit unit_struct newtype_struct seq tuple
+        tuple_struct map struct identifier
+    }
+}
+
+struct SeqReader<'a, 'de> {
+    de: &'a mut Deserializer<'de>,
+    done: bool,
+}
+
+impl<'de, 'a> de::SeqAccess<'de> for SeqReader<'a, 'de> {
+    type Error = Error;
+
+    fn next_element_seed<T: DeserializeSeed<'de>>(&mut self, seed: T) -> Result<Option<T::Value>> {
+        if self.done {
+            return Ok(None);
+        }
+        if self.de.peek_u8()? == TAG_END {
+            self.de.pos += 1;
+            self.done = true;
+            return Ok(None);
+        }
+        seed.deserialize(&mut *self.de).map(Some)
+    }
+}
+
+struct MapReader<'a, 'de> {
+    de: &'a mut Deserializer<'de>,
+    done: bool,
+}
+
+impl<'de, 'a> de::MapAccess<'de> for MapReader<'a, 'de> {
+    type Error = Error;
+
+    fn next_key_seed<K: DeserializeSeed<'de>>(&mut self, seed: K) -> Result<Option<K::Value>> {
+        if self.done {
+            return Ok(None);
+        }
+        match self.de.read_key()? {
+            None => {
+                self.done = true;
+                Ok(None)
+            }
+            Some(key) => {
+                seed.deserialize(de::value::BorrowedStrDeserializer::new(key)).map(Some)
+            }
+        }
+    }
+
+    fn next_value_seed<V: DeserializeSeed<'de>>(&mut self, seed: V) -> Result<V::Value> {
+        seed.deserialize(&mut *self.de)
+    }
+}
+
+struct VariantReader<'a, 'de> {
+    de: &'a mut Deserializer<'de>,
+    variant: &'de str,
+}
+
+impl<'de, 'a> de::EnumAccess<'de> for VariantReader<'a, 'de> {
+    type Error = Error;
+    type Variant = Self;
+
+    fn variant_seed<V: DeserializeSeed<'de>>(self, seed: V) -> Result<(V::Value, Self)> {
+        let variant =
+            seed.deserialize(de::value::BorrowedStrDeserializer::<Error>::new(self.variant))?;
+        Ok((variant, self))
+    }
+}
+
+impl<'de, 'a> de::VariantAccess<'de> for VariantReader<'a, 'de> {
+    type Error = Error;
+
+    fn unit_variant(self) -> Result<()> {
+        // `{"Variant": null}`, as emitted for e.g. `SpecialName`.
+        de::Deserialize::deserialize(self.de)
+    }
+
+    fn newtype_variant_seed<T: DeserializeSeed<'de>>(self, seed: T) -> Result<T::Value> {
+        seed.deserialize(self.de)
+    }
+
+    fn tuple_variant<V: Visitor<'de>>(self, _len: usize, visitor: V) -> Result<V::Value> {
+        de::Deserializer::deserialize_seq(self.de, visitor)
+    }
+
+    fn struct_variant<V: Visitor<'de>>(
+        self,
+        _fields: &'static [&'static str],
+        visitor: V,
+    ) -> Result<V::Value> {
+        de::Deserializer::deserialize_map(self.de, visitor)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use serde::Deserialize;
+    use std::collections::HashMap;
+
+    /// A minimal Rust port of `BinaryIrWriter`, for building test inputs.
+    #[derive(Default)]
+    struct Writer {
+        body: Vec<u8>,
+        strings: Vec<String>,
+    }
+
+    impl Writer {
+        fn new() -> Self {
+            let mut writer = Writer::default();
+            writer.body.extend_from_slice(MAGIC);
+            writer.varint(FORMAT_VERSION);
+            writer
+        }
+        fn varint(&mut self, mut value: u64) {
+            while value >= 0x80 {
+                self.body.push((value as u8 & 0x7f) | 0x80);
+                value >>= 7;
+            }
+            self.body.push(value as u8);
+        }
+        fn intern(&mut self, s: &str) -> u64 {
+            match self.strings.iter().position(|existing| existing == s) {
+                Some(index) => index as u64,
+                None => {
+                    self.strings.push(s.to_string());
+                    self.strings.len() as u64 - 1
+                }
+            }
+        }
+        fn tag(&mut self, tag: u8) -> &mut Self {
+            self.body.push(tag);
+            self
+        }
+        fn uint(&mut self, value: u64) -> &mut Self {
+            self.tag(TAG_UINT).varint(value);
+            self
+        }
+        fn string(&mut self, s: &str) -> &mut Self {
+            let index = self.intern(s);
+            self.tag(TAG_STRING).varint(index);
+            self
+        }
+        fn key(&mut self, key: &str) -> &mut Self {
+            let index = self.intern(key);
+            self.varint(index + 1);
+            self
+        }
+        fn object_end(&mut self) -> &mut Self {
+            self.varint(0);
+            self
+        }
+        fn pos(&self) -> u64 {
+            self.body.len() as u64
+        }
+        fn reference(&mut self, offset: u64) -> &mut Self {
+            self.tag(TAG_REF).varint(offset);
+            self
+        }
+        fn finish(&mut self) -> Vec<u8> {
+            let mut result = std::mem::take(&mut self.body);
+            let string_table_offset = result.len() as u64;
+            self.body.clear();
+            self.varint(self.strings.len() as u64);
+            for s in std::mem::take(&mut self.strings) {
+                self.varint(s.len() as u64);
+                self.body.extend_from_slice(s.as_bytes());
+            }
+            result.append(&mut self.body);
+            result.extend_from_slice(&string_table_offset.to_le_bytes());
+            result
+        }
+    }
+
+    #[derive(Debug, PartialEq, Deserialize)]
+    #[serde(deny_unknown_fields)]
+    struct Inner {
+        name: String,
+        value: Option<i64>,
+    }
+
+    #[derive(Debug, PartialEq, Deserialize)]
+    enum Kind {
+        Unit,
+        Special,
+        Newtype(Inner),
+    }
+
+    #[derive(Debug, PartialEq, Deserialize)]
+    #[serde(deny_unknown_fields)]
+    struct Outer {
+        ids: Vec<u64>,
+        kinds: Vec<Kind>,
+        features: HashMap<String, Vec<String>>,
+        #[serde(default)]
+        missing: Option<bool>,
+    }
+
+    #[test]
+    fn test_round_trip() {
+        let mut w = Writer::new();
+        w.tag(TAG_OBJECT);
+        w.key("ids").tag(TAG_ARRAY).uint(1).uint(300).uint(u64::MAX).tag(TAG_END);
+        w.key("kinds").tag(TAG_ARRAY);
+        w.string("Unit");
+        w.tag(TAG_OBJECT).key("Special").tag(TAG_NULL).object_end();
+        w.tag(TAG_OBJECT).key("Newtype").tag(TAG_OBJECT);
+        w.key("name").string("Unit");
+        w.key("value").tag(TAG_NEG_INT).varint(41);
+        w.object_end().object_end();
+        w.tag(TAG_END);
+        w.key("features").tag(TAG_OBJECT);
+        w.key("//foo:bar").tag(TAG_ARRAY).string("supported").tag(TAG_END);
+        w.object_end();
+        w.object_end();
+        let bytes = w.finish();
+
+        let outer: Outer = from_slice(&bytes).unwrap();
+        assert_eq!(
+            outer,
+            Outer {
+                ids: vec![1, 300, u64::MAX],
+                kinds: vec![
+                    Kind::Unit,
+                    Kind::Special,
+                    Kind::Newtype(Inner { name: "Unit".to_string(), value: Some(-42) }),
+                ],
+                features: HashMap::from([(
+                    "//foo:bar".to_string(),
+                    vec!["supported".to_string()]
+                )]),
+                missing: None,
+            }
+        );
+    }
+
+    #[test]
+    fn test_null_option() {
+        let mut w = Writer::new();
+        w.tag(TAG_OBJECT).key("name").string("x").key("value").tag(TAG_NULL).object_end();
+        let inner: Inner = from_slice(&w.finish()).unwrap();
+        assert_eq!(inner, Inner { name: "x".to_string(), value: None });
+    }
+
+    #[test]
+    fn test_unknown_field() {
+        let mut w = Writer::new();
+        w.tag(TAG_OBJECT).key("name").string("x").key("bogus").tag(TAG_TRUE).object_end();
+        let err = from_slice::<Inner>(&w.finish()).unwrap_err();
+        assert!(err.to_string().contains("unknown field `bogus`"), "{err}");
+    }
+
+    #[test]
+    fn test_shared_values() {
+        let mut w = Writer::new();
+        w.tag(TAG_ARRAY);
+        let first = w.pos();
+        w.tag(TAG_OBJECT).key("name").string("x").key("value").uint(1).object_end();
+        w.reference(first);
+        w.tag(TAG_OBJECT).key("name").string("y").key("value").tag(TAG_NULL).object_end();
+        w.reference(first);
+        w.tag(TAG_END);
+        let inners: Vec<Inner> = from_slice(&w.finish()).unwrap();
+        let x = || Inner { name: "x".to_string(), value: Some(1) };
+        let y = Inner { name: "y".to_string(), value: None };
+        assert_eq!(inners, vec![x(), x(), y, x()]);
+    }
+
+    #[test]
+    fn test_forward_reference() {
+        let mut w = Writer::new();
+        let first = w.pos();
+        w.tag(TAG_ARRAY).reference(first + 4).uint(1).tag(TAG_END);
+        let err = from_slice::<Vec<u64>>(&w.finish()).unwrap_err();
+        assert!(err.to_string().contains("invalid reference"), "{err}");
+    }
+
+    #[test]
+    fn test_bad_magic() {
+        let err = from_slice::<u64>(b"{\"current_target\": \"//foo:bar\"}").unwrap_err();
+        assert_eq!(err.to_string(), "input is not in the binary IR format");
+    }
+
+    #[test]
+    fn test_bad_version() {
+        let mut bytes = MAGIC.to_vec();
+        bytes.push(FORMAT_VERSION as u8 + 1);
+        bytes.push(TAG_NULL);
+        let string_table_offset = bytes.len() as u64;
+        bytes.push(0);
+        bytes.extend_from_slice(&string_table_offset.to_le_bytes());
+        let err = from_slice::<()>(&bytes).unwrap_err();
+        assert!(err.to_string().contains("unsupported binary IR version"), "{err}");
+    }
+
+    #[test]
+    fn test_truncated() {
+        let mut w = Writer::new();
+        w.tag(TAG_ARRAY).uint(1);
+        let err = from_slice::<Vec<u64>>(&w.finish()).unwrap_err();
+        assert!(err.to_string().contains("unexpected end of input"), "{err}");
+    }
+}
@@ -0,0 +1,231 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#include "rs_bindings_from_cc/ir_binary.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "rs_bindings_from_cc/bazel_types.h"
+#include "rs_bindings_from_cc/ir.h"
+
+namespace crubit {
+namespace {
+
+using ::testing::ElementsAre;
+
+// The magic and the version, which fits in a single byte.
+constexpr size_t kHeaderSize = kIrBinaryMagic.size() + 1;
+
+std::string Bytes(std::initializer_list<uint8_t> bytes) {
+  return std::string(bytes.begin(), bytes.end());
+}
+
+uint64_t ReadVarint(absl::string_view& input) {
+  uint64_t value = 0;
+  for (int shift = 0; !input.empty(); shift += 7) {
+    uint8_t byte = input.front();
+    input.remove_prefix(1);
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) break;
+  }
+  return value;
+}
+
+uint64_t StringTableOffset(absl::string_view buffer) {
+  uint64_t offset = 0;
+  for (int i = 0; i < 8; ++i) {
+    offset |= static_cast<uint64_t>(
+                  static_cast<uint8_t>(buffer[buffer.size() - 8 + i]))
+              << (8 * i);
+  }
+  return offset;
+}
+
+// Returns the encoding of the root value of `buffer`.
+absl::string_view RootValue(absl::string_view buffer) {
+  return buffer.substr(kHeaderSize, StringTableOffset(buffer) - kHeaderSize);
+}
+
+std::vector<std::string> StringTable(absl::string_view buffer) {
+  absl::string_view input = buffer.substr(StringTableOffset(buffer));
+  input.remove_suffix(8);
+  std::vector<std::string> strings(ReadVarint(input));
+  for (std::string& s : strings) {
+    uint64_t size = ReadVarint(input);
+    s = std::string(input.substr(0, size));
+    input.remove_prefix(size);
+  }
+  EXPECT_TRUE(input.empty());
+  return strings;
+}
+
+TEST(BinaryIrWriterTest, Empty) {
+  BinaryIrWriter writer;
+  std::string buffer = std::move(writer).Finish();
+  EXPECT_EQ(buffer, absl::StrCat(kIrBinaryMagic,
+                                 Bytes({kIrBinaryFormatVersion,
+                                        // No strings.
+                                        0,
+                                        // The string table is at offset 9.
+                                        9, 0, 0, 0, 0, 0, 0, 0})));
+}
+
+TEST(BinaryIrWriterTest, Numbers) {
+  BinaryIrWriter writer;
+  writer.ArrayBegin();
+  writer.Uint(0);
+  writer.Uint(127);
+  writer.Uint(128);
+  writer.Int(300);
+  writer.Int(-1);
+  writer.Int(-300);
+  writer.Bool(true);
+  writer.Null();
+  writer.ArrayEnd();
+  std::string buffer = std::move(writer).Finish();
+  EXPECT_EQ(RootValue(buffer),
+            Bytes({BinaryIrWriter::kArray,
+                   BinaryIrWriter::kUint, 0,
+                   BinaryIrWriter::kUint, 0x7f,
+                   BinaryIrWriter::kUint, 0x80, 0x01,
+                   BinaryIrWriter::kUint, 0xac, 0x02,
+                   BinaryIrWriter::kNegInt, 0,
+                   BinaryIrWriter::kNegInt, 0xab, 0x02,
+                   BinaryIrWriter::kTrue,
+                   BinaryIrWriter::kNull,
+                   BinaryIrWriter::kEnd}));
+  EXPECT_THAT(StringTable(buffer), ElementsAre());
+}
+
+TEST(BinaryIrWriterTest, StringsAreStoredOnce) {
+  BinaryIrWriter writer;
+  writer.ObjectBegin();
+  writer.Key("a");
+  writer.String("b");
+  writer.Key("b");
+  writer.String("a");
+  writer.Key("c");
+  writer.String("\xff");
+  writer.ObjectEnd();
+  std::string buffer = std::move(writer).Finish();
+  // Keys are written as their index + 1, as 0 ends the object.
+  EXPECT_EQ(RootValue(buffer), Bytes({BinaryIrWriter::kObject,
+                                      1, BinaryIrWriter::kString, 1,
+                                      2, BinaryIrWriter::kString, 0,
+                                      3, BinaryIrWriter::kString, 3,
+                                      0}));
+  // Invalid UTF-8 is replaced.
+  EXPECT_THAT(StringTable(buffer), ElementsAre("a", "b", "c", "\xef\xbf\xbd"));
+}
+
+TEST(BinaryIrWriterTest, RepeatedSharedValueIsAReference) {
+  MappedType type = MappedType::Simple("::core::ffi::c_int", "int");
+  BinaryIrWriter type_writer;
+  type.Write(type_writer);
+  std::string type_buffer = std::move(type_writer).Finish();
+
+  BinaryIrWriter writer;
+  writer.ArrayBegin();
+  type.Write(writer);
+  type.Write(writer);
+  writer.ArrayEnd();
+  std::string buffer = std::move(writer).Finish();
+  // The first type is written right after the array tag, and the second one
+  // refers to it.
+  EXPECT_EQ(RootValue(buffer),
+            absl::StrCat(Bytes({BinaryIrWriter::kArray}),
+                         RootValue(type_buffer),
+                         Bytes({BinaryIrWriter::kRef, kHeaderSize + 1,
+                                BinaryIrWriter::kEnd})));
+  EXPECT_EQ(StringTable(buffer), StringTable(type_buffer));
+}
+
+TEST(BinaryIrWriterTest, SharedValuesAreOnlyReplacedIfLarger) {
+  BinaryIrWriter writer;
+  writer.ArrayBegin();
+  for (int i = 0; i < 2; ++i) {
+    writer.SharedValue([&] { writer.Uint(1); });
+  }
+  writer.ArrayEnd();
+  std::string buffer = std::move(writer).Finish();
+  EXPECT_EQ(RootValue(buffer),
+            Bytes({BinaryIrWriter::kArray,
+                   BinaryIrWriter::kUint, 1,
+                   BinaryIrWriter::kUint, 1,
+                   BinaryIrWriter::kEnd}));
+}
+
+TEST(BinaryIrWriterTest, NestedSharedValuesAreNotReferences) {
+  BinaryIrWriter writer;
+  auto write_inner = [&] {
+    writer.SharedValue([&] {
+      writer.ObjectBegin();
+      writer.Key("a");
+      writer.String("b");
+      writer.ObjectEnd();
+    });
+  };
+  auto write_outer = [&] {
+    writer.SharedValue([&] {
+      writer.ArrayBegin();
+      write_inner();
+      writer.ArrayEnd();
+    });
+  };
+  writer.ArrayBegin();
+  write_inner();
+  write_outer();
+  write_outer();
+  writer.ArrayEnd();
+  std::string buffer = std::move(writer).Finish();
+  // The inner value at offset 10 is repeated in the outer one at offset 15,
+  // whose repetition refers to it.
+  EXPECT_EQ(RootValue(buffer),
+            Bytes({BinaryIrWriter::kArray,
+                   BinaryIrWriter::kObject, 1, BinaryIrWriter::kString, 1, 0,
+                   BinaryIrWriter::kArray,
+                   BinaryIrWriter::kObject, 1, BinaryIrWriter::kString, 1, 0,
+                   BinaryIrWriter::kEnd,
+                   BinaryIrWriter::kRef, 15,
+                   BinaryIrWriter::kEnd}));
+}
+
+TEST(IrToBinaryTest, SmallIr) {
+  IR ir;
+  ir.public_headers.push_back(HeaderName("foo/bar.h"));
+  ir.current_target = BazelLabel("//foo:bar");
+  std::string buffer = IrToBinary(ir);
+
+  EXPECT_TRUE(absl::StartsWith(buffer, kIrBinaryMagic));
+  EXPECT_EQ(buffer[kIrBinaryMagic.size()], kIrBinaryFormatVersion);
+  EXPECT_TRUE(absl::StartsWith(
+      RootValue(buffer),
+      Bytes({BinaryIrWriter::kObject,
+             // "public_headers": [{"name": "foo/bar.h"}]
+             1, BinaryIrWriter::kArray,
+             BinaryIrWriter::kObject, 2, BinaryIrWriter::kString, 2, 0,
+             BinaryIrWriter::kEnd,
+             // "current_target": "//foo:bar"
+             4, BinaryIrWriter::kString, 4,
+             // "items": []
+             6, BinaryIrWriter::kArray, BinaryIrWriter::kEnd})));
+  std::vector<std::string> strings = StringTable(buffer);
+  ASSERT_GE(strings.size(), size_t{6});
+  EXPECT_THAT(std::vector<std::string>(strings.begin(), strings.begin() + 6),
+              ElementsAre("public_headers", "name", "foo/bar.h",
+                          "current_target", "//foo:bar", "items"));
+}
+
+}  // namespace
+}  // namespace crubit
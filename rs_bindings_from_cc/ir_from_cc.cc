@@ -4,7 +4,6 @@
 
 #include "rs_bindings_from_cc/ir_from_cc.h"
 
-#include <cstdint>
 #include <memory>
 #include <string>
 #include <utility>
@@ -22,8 +21,21 @@
 #include "rs_bindings_from_cc/decl_importer.h"
 #include "rs_bindings_from_cc/frontend_action.h"
 #include "rs_bindings_from_cc/ir.h"
+#include "clang/Basic/SourceLocation.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Lex/Pragma.h"
+#include "clang/Lex/Preprocessor.h"
+#include "clang/Lex/Token.h"
 #include "clang/Serialization/PCHContainerOperations.h"
 #include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SHA256.h"
+#include "llvm/Support/VirtualFileSystem.h"
 
 namespace crubit {
 
@@ -32,38 +44,182 @@ static constexpr absl::string_view kVirtualHeaderPath =
 static constexpr absl::string_view kVirtualInputPath =
     "ir_from_cc_virtual_input.cc";
 
-absl::StatusOr<IR> IrFromCc(IrFromCcOptions options) {
-  // Caller should verify that the inputs are not empty.
-  CHECK(!options.extra_source_code_for_testing.empty() ||
-        !options.public_headers.empty() ||
-        !options.extra_instantiations.empty());
+static constexpr absl::string_view kVirtualPchInputPath =
+    "ir_from_cc_virtual_pch_input.h";
+
+static constexpr absl::string_view kVirtualHashInputPath =
+    "ir_from_cc_virtual_hash_input.cc";
+
+namespace {
 
+// The parts of a Clang invocation that are shared by `IrFromCc` and
+// `PrecompileHeaders`.
+struct ToolInput {
+  // `public_headers`, plus the header with `extra_source_code_for_testing`.
+  std::vector<HeaderName> public_headers;
+  // `#include`s of all the `public_headers`.
+  std::string virtual_input_file_content;
   clang::tooling::FileContentMappings file_contents;
+  std::vector<std::string> args;
+};
+
+ToolInput MakeToolInput(IrFromCcOptions& options) {
+  ToolInput input;
 
   for (auto const& name_and_content :
        options.virtual_headers_contents_for_testing) {
-    file_contents.push_back({std::string(name_and_content.first.IncludePath()),
-                             name_and_content.second});
+    input.file_contents.push_back(
+        {std::string(name_and_content.first.IncludePath()),
+         name_and_content.second});
   }
 
   // Tests may inject `extra_source_code_for_testing` - it needs to be appended
   // to `public_headers` and exposed via `file_contents` virtual file system.
-  std::vector<HeaderName> augmented_public_headers(
-      options.public_headers.begin(), options.public_headers.end());
+  input.public_headers.assign(options.public_headers.begin(),
+                              options.public_headers.end());
   if (!options.extra_source_code_for_testing.empty()) {
-    file_contents.push_back(
+    input.file_contents.push_back(
         {std::string(kVirtualHeaderPath),
          std::string(options.extra_source_code_for_testing)});
     HeaderName header_name = HeaderName(std::string(kVirtualHeaderPath));
-    augmented_public_headers.push_back(header_name);
+    input.public_headers.push_back(header_name);
     options.headers_to_targets.insert({header_name, options.current_target});
   }
 
-  std::string virtual_input_file_content;
-  for (const HeaderName& header_name : augmented_public_headers) {
-    absl::SubstituteAndAppend(&virtual_input_file_content, "#include \"$0\"\n",
-                              header_name.IncludePath());
+  for (const HeaderName& header_name : input.public_headers) {
+    absl::SubstituteAndAppend(&input.virtual_input_file_content,
+                              "#include \"$0\"\n", header_name.IncludePath());
+  }
+
+  input.args = {"-std=gnu++17",
+                // Parse non-doc comments that are used as documentation
+                "-fparse-all-comments"};
+  input.args.insert(input.args.end(), options.clang_args.begin(),
+                    options.clang_args.end());
+  return input;
+}
+
+// Runs `action` on `code` (named `file_name`) like
+// `clang::tooling::runToolOnCodeWithArgs`, except that the files that aren't in
+// `input.file_contents` are read from `file_system` (or from the real file
+// system, if it is null).
+bool RunTool(std::unique_ptr<clang::FrontendAction> action,
+             const std::string& code, const ToolInput& input,
+             absl::string_view file_name,
+             llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> file_system) {
+  if (file_system == nullptr) {
+    file_system = llvm::vfs::getRealFileSystem();
+  }
+  auto overlay_file_system =
+      llvm::makeIntrusiveRefCnt<llvm::vfs::OverlayFileSystem>(file_system);
+  auto in_memory_file_system =
+      llvm::makeIntrusiveRefCnt<llvm::vfs::InMemoryFileSystem>();
+  overlay_file_system->pushOverlay(in_memory_file_system);
+  in_memory_file_system->addFile(file_name, 0,
+                                 llvm::MemoryBuffer::getMemBuffer(code));
+  for (const auto& [name, contents] : input.file_contents) {
+    in_memory_file_system->addFile(name, 0,
+                                   llvm::MemoryBuffer::getMemBuffer(contents));
+  }
+  return clang::tooling::runToolOnCodeWithArgs(
+      std::move(action), code, overlay_file_system, input.args, file_name,
+      "rs_bindings_from_cc", std::make_shared<clang::PCHContainerOperations>());
+}
+
+// Writes the AST of the input as a precompiled header to `output_path`.
+class PrecompileHeadersAction : public clang::GeneratePCHAction {
+ public:
+  explicit PrecompileHeadersAction(absl::string_view output_path)
+      : output_path_(output_path) {}
+
+ protected:
+  bool BeginInvocation(clang::CompilerInstance& ci) override {
+    ci.getFrontendOpts().OutputFile = output_path_;
+    // Keep the output deterministic, and independent of file timestamps in the
+    // build sandbox.
+    ci.getFrontendOpts().IncludeTimestamps = false;
+    return clang::GeneratePCHAction::BeginInvocation(ci);
+  }
+
+ private:
+  std::string output_path_;
+};
+
+// Feeds the pragmas that the preprocessor doesn't know about (and would
+// otherwise drop) to `hasher`.
+class HashPragmaHandler : public clang::PragmaHandler {
+ public:
+  explicit HashPragmaHandler(llvm::SHA256& hasher) : hasher_(hasher) {}
+
+  void HandlePragma(clang::Preprocessor& preprocessor,
+                    clang::PragmaIntroducer introducer,
+                    clang::Token& first_token) override {
+    hasher_.update("\n#pragma");
+    for (clang::Token token = first_token; token.isNot(clang::tok::eod);
+         preprocessor.Lex(token)) {
+      hasher_.update(" ");
+      hasher_.update(preprocessor.getSpelling(token));
+    }
+  }
+
+ private:
+  llvm::SHA256& hasher_;
+};
+
+// Feeds the preprocessed token stream of the input to `hasher`.
+class HashTokensAction : public clang::PreprocessorFrontendAction {
+ public:
+  explicit HashTokensAction(llvm::SHA256& hasher) : hasher_(hasher) {}
+
+ protected:
+  void ExecuteAction() override {
+    clang::Preprocessor& preprocessor = getCompilerInstance().getPreprocessor();
+    const clang::SourceManager& source_manager =
+        getCompilerInstance().getSourceManager();
+    // Doc comments are imported into the IR.
+    preprocessor.SetCommentRetentionState(/*KeepComments=*/true,
+                                          /*KeepMacroComments=*/true);
+    HashPragmaHandler pragma_handler(hasher_);
+    for (llvm::StringRef pragma_namespace : {"", "GCC", "clang"}) {
+      preprocessor.AddPragmaHandler(pragma_namespace, &pragma_handler);
+    }
+
+    preprocessor.EnterMainSourceFile();
+    clang::Token token;
+    for (preprocessor.Lex(token); token.isNot(clang::tok::eof);
+         preprocessor.Lex(token)) {
+      // Source locations are imported into the IR too.
+      if (token.isAtStartOfLine()) {
+        clang::PresumedLoc loc =
+            source_manager.getPresumedLoc(token.getLocation());
+        if (loc.isValid()) {
+          hasher_.update(absl::StrCat("\n", loc.getFilename(), ":",
+                                      loc.getLine(), ":"));
+        }
+      }
+      hasher_.update(" ");
+      hasher_.update(preprocessor.getSpelling(token));
+    }
+
+    for (llvm::StringRef pragma_namespace : {"", "GCC", "clang"}) {
+      preprocessor.RemovePragmaHandler(pragma_namespace, &pragma_handler);
+    }
   }
+
+ private:
+  llvm::SHA256& hasher_;
+};
+
+}  // namespace
+
+absl::StatusOr<IR> IrFromCc(IrFromCcOptions options) {
+  // Caller should verify that the inputs are not empty.
+  CHECK(!options.extra_source_code_for_testing.empty() ||
+        !options.public_headers.empty() ||
+        !options.extra_instantiations.empty());
+
+  ToolInput input = MakeToolInput(options);
+  std::string& virtual_input_file_content = input.virtual_input_file_content;
   if (!options.extra_instantiations.empty()) {
     absl::SubstituteAndAppend(&virtual_input_file_content, "namespace $0 {\n",
                               kInstantiationsNamespaceName);
@@ -78,20 +234,17 @@ absl::StatusOr<IR> IrFromCc(IrFromCcOptions options) {
                               "}  // namespace $0\n",
                               kInstantiationsNamespaceName);
   }
-  std::vector<std::string> args_as_strings = {
-      "-std=gnu++17",
-      // Parse non-doc comments that are used as documentation
-      "-fparse-all-comments"};
-  args_as_strings.insert(args_as_strings.end(), options.clang_args.begin(),
-                         options.clang_args.end());
-
-  Invocation invocation(options.current_target, augmented_public_headers,
-                        options.headers_to_targets);
-  if (!clang::tooling::runToolOnCodeWithArgs(
-          std::make_unique<FrontendAction>(invocation),
-          virtual_input_file_content, args_as_strings, kVirtualInputPath,
-          "rs_bindings_from_cc",
-          std::make_shared<clang::PCHContainerOperations>(), file_contents)) {
+  if (!options.precompiled_header.empty()) {
+    input.args.push_back("-include-pch");
+    input.args.push_back(std::string(options.precompiled_header));
+  }
+
+  Invocation invocation(options.current_target, input.public_headers,
+                        options.headers_to_targets, options.lazy_import,
+                        options.memoize_owning_targets_for_testing);
+  if (!RunTool(std::make_unique<FrontendAction>(invocation),
+               virtual_input_file_content, input, kVirtualInputPath,
+               options.file_system)) {
     return absl::Status(absl::StatusCode::kInvalidArgument,
                         "Could not compile header contents");
   }
@@ -103,7 +256,7 @@ absl::StatusOr<IR> IrFromCc(IrFromCcOptions options) {
     // TODO(jeanpierreda): It'd be nice to give these human-readable names, e.g. the
     // name of the file without the `.rs`, but it's also annoying to handle name
     // collisions.
-    ItemId id(reinterpret_cast<uintptr_t>(&extra_source));
+    ItemId id = GenerateItemIdFromKey(absl::StrCat("extra_rs_src@", i));
     invocation.ir_.items.push_back(UseMod{
         .path = extra_source,
         .mod_name = Identifier(absl::StrCat("__crubit_mod_", i)),
@@ -113,7 +266,40 @@ absl::StatusOr<IR> IrFromCc(IrFromCcOptions options) {
     ++i;
   }
   invocation.ir_.crubit_features = std::move(options.crubit_features);
-  return invocation.ir_;
+  return std::move(invocation.ir_);
+}
+
+absl::Status PrecompileHeaders(IrFromCcOptions options,
+                               absl::string_view output_path) {
+  // Caller should verify that the inputs are not empty.
+  CHECK(!options.extra_source_code_for_testing.empty() ||
+        !options.public_headers.empty());
+  CHECK(!output_path.empty());
+
+  ToolInput input = MakeToolInput(options);
+  input.args.push_back("-x");
+  input.args.push_back("c++-header");
+  if (!RunTool(std::make_unique<PrecompileHeadersAction>(output_path),
+               input.virtual_input_file_content, input, kVirtualPchInputPath,
+               options.file_system)) {
+    return absl::InvalidArgumentError("Could not precompile header contents");
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::string> HashPreprocessedHeaders(IrFromCcOptions options) {
+  // Caller should verify that the inputs are not empty.
+  CHECK(!options.extra_source_code_for_testing.empty() ||
+        !options.public_headers.empty());
+
+  ToolInput input = MakeToolInput(options);
+  llvm::SHA256 hasher;
+  if (!RunTool(std::make_unique<HashTokensAction>(hasher),
+               input.virtual_input_file_content, input, kVirtualHashInputPath,
+               options.file_system)) {
+    return absl::InvalidArgumentError("Could not preprocess header contents");
+  }
+  return llvm::toHex(hasher.final(), /*LowerCase=*/true);
 }
 
 }  // namespace crubit
@@ -10,11 +10,14 @@
 
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/span.h"
 #include "rs_bindings_from_cc/bazel_types.h"
 #include "rs_bindings_from_cc/ir.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/Support/VirtualFileSystem.h"
 
 namespace crubit {
 
@@ -40,6 +43,10 @@ struct IrFromCcOptions final {
   absl::Span<const std::string> extra_instantiations = {};
   absl::flat_hash_map<BazelLabel, absl::flat_hash_set<std::string>>
       crubit_features = {};
+  absl::string_view precompiled_header = "";
+  bool lazy_import = false;
+  bool memoize_owning_targets_for_testing = true;
+  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> file_system = nullptr;
 
   // Not an argument, just here to prevent the options struct from being
   // copied/moved with nontrivial lifetime implications.
@@ -72,9 +79,41 @@ static_assert(std::is_aggregate_v<IrFromCcOptions>);
 // * `extra_instantiations`: names of full C++ class template specializations
 //   to instantiate and generate bindings from.
 // * `crubit_features`: The set of Crubit features to enable for each target.
+// * `precompiled_header`: path to a precompiled header produced by
+//   `PrecompileHeaders` (with the same `clang_args`). Declarations from the
+//   headers it contains are deserialized from it instead of being parsed again.
+// * `lazy_import`: if true, only the declarations of `current_target` are
+//   walked, and declarations of other targets are imported only if they are
+//   referenced (e.g. by the signature of a function of `current_target`).
+//   Otherwise, all declarations of the translation unit are imported.
+// * `memoize_owning_targets_for_testing`: if false, the owning target of the
+//   file of each declaration is looked up again for every declaration. Only
+//   useful as a baseline for benchmarks.
+// * `file_system`: the file system from which Clang reads the headers. If not
+//   specified, the real file system is used.
 //
 absl::StatusOr<IR> IrFromCc(IrFromCcOptions options);
 
+// Parses `public_headers` (and `extra_source_code_for_testing`, if any) like
+// `IrFromCc` does, and writes the resulting AST as a precompiled header to
+// `output_path`. The output can be passed as `precompiled_header` when
+// generating bindings for targets that include these headers, so that they are
+// parsed only once.
+//
+// The options that only affect the IR (`current_target`, `headers_to_targets`,
+// `extra_rs_srcs`, `extra_instantiations`, `crubit_features`) are ignored.
+absl::Status PrecompileHeaders(IrFromCcOptions options,
+                               absl::string_view output_path);
+
+// Preprocesses `public_headers` (and `extra_source_code_for_testing`, if any)
+// like `IrFromCc` does, and returns a hex-encoded SHA-256 digest of the
+// resulting token stream. Comments, unknown pragmas and the presumed location
+// of each line are part of the digest, since they end up in the IR.
+//
+// The options that are ignored by `PrecompileHeaders` are ignored here too. So
+// is `precompiled_header`: the headers in it are preprocessed from source.
+absl::StatusOr<std::string> HashPreprocessedHeaders(IrFromCcOptions options);
+
 }  // namespace crubit
 
 #endif  // CRUBIT_RS_BINDINGS_FROM_CC_IR_FROM_CC_H_
@@ -4028,3 +4028,22 @@ fn test_source_location_class_template_specialization() {
         }
     );
 }
+
+#[test]
+fn test_binary_ir_with_repeated_types() {
+    // The binary IR stores the repetitions of a type as references to the
+    // first one, and the Rust reader resolves them to the same `IR` as JSON.
+    let header = r#"
+        struct S {
+          S* next;
+          S* prev;
+          const int* x;
+          const int* y;
+        };
+        S* f(S* a, S* b, const S& c, const int* d);
+        const int* g(const S& a, const S& b, const int* c);
+    "#;
+    let binary_ir =
+        ir_testing::ir_from_cc_binary(multiplatform_testing::test_platform(), header).unwrap();
+    assert_eq!(binary_ir, ir_from_cc(header).unwrap());
+}
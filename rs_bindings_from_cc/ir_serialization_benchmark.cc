@@ -0,0 +1,156 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+// Measures the throughput and the peak memory overhead of the IR serializers
+// on a synthetic IR.
+//
+// Every run measures a single `--mode`, because the peak RSS of a process never
+// goes down:
+//
+//   bazel run -c opt //rs_bindings_from_cc:ir_serialization_benchmark -- \
+//       --mode=json_value --items=100000
+//   bazel run -c opt //rs_bindings_from_cc:ir_serialization_benchmark -- \
+//       --mode=json_stream --items=100000
+//   bazel run -c opt //rs_bindings_from_cc:ir_serialization_benchmark -- \
+//       --mode=binary --items=100000
+//
+// Numbers depend on the machine, so none are recorded here; quote the output
+// of these runs (and the command line) when comparing serializers.
+//
+// `json_value` is the old path that builds an `llvm::json::Value` tree for the
+// whole IR before printing it.
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "rs_bindings_from_cc/bazel_types.h"
+#include "rs_bindings_from_cc/ir.h"
+#include "rs_bindings_from_cc/ir_binary.h"
+#include "rs_bindings_from_cc/time_trace.h"
+#include "llvm/Support/FormatVariadic.h"
+
+ABSL_FLAG(std::string, mode, "json_stream",
+          "serializer to measure: json_value, json_stream or binary");
+ABSL_FLAG(int, items, 100000, "number of records (and as many functions)");
+ABSL_FLAG(int, iterations, 5, "number of times to serialize the IR");
+
+namespace crubit {
+namespace {
+
+// Returns an IR with `count` records, each with a couple of fields and a
+// method taking the record by pointer.
+IR MakeSyntheticIr(int count) {
+  IR ir;
+  ir.current_target = BazelLabel("//benchmark:synthetic");
+  ir.public_headers.push_back(HeaderName("benchmark/synthetic.h"));
+  for (int i = 0; i < count; ++i) {
+    ItemId record_id(2 * i + 1);
+    ItemId func_id(2 * i + 2);
+    std::string name = absl::StrCat("Struct", i);
+
+    Record record{
+        .rs_name = name,
+        .cc_name = name,
+        .mangled_cc_name = absl::StrCat(name.size(), name),
+        .id = record_id,
+        .owning_target = ir.current_target,
+        .doc_comment = absl::StrCat("Doc comment of ", name, "."),
+        .source_loc = absl::StrCat("benchmark/synthetic.h;l=", i),
+        .size_align = {.size = 8, .alignment = 4},
+        .is_derived_class = false,
+        .record_type = kStruct,
+        .child_item_ids = {func_id},
+    };
+    for (absl::string_view field_name : {"x", "y"}) {
+      record.fields.push_back(Field{
+          .identifier = Identifier(std::string(field_name)),
+          .type = MappedType::Simple("::core::ffi::c_int", "int"),
+          .access = kPublic,
+          .offset = field_name == "x" ? 0u : 32u,
+          .size = 32,
+          .is_no_unique_address = false,
+          .is_bitfield = false,
+          .is_inheritable = false,
+      });
+    }
+    ir.top_level_item_ids.push_back(record_id);
+    ir.items.push_back(std::move(record));
+
+    ir.items.push_back(Func{
+        .name = Identifier("Method"),
+        .owning_target = ir.current_target,
+        .mangled_name = absl::StrCat("_ZN", name.size(), name, "6MethodEv"),
+        .return_type = MappedType::Void(),
+        .params = {FuncParam{
+            .type = MappedType::PointerTo(MappedType::WithDeclId(record_id),
+                                          /*lifetime=*/std::nullopt,
+                                          /*ref_qualifier_kind=*/std::nullopt),
+            .identifier = Identifier("__this")}},
+        .is_inline = true,
+        .member_func_metadata =
+            MemberFuncMetadata{
+                .record_id = record_id,
+                .instance_method_metadata =
+                    MemberFuncMetadata::InstanceMethodMetadata{}},
+        .source_loc = absl::StrCat("benchmark/synthetic.h;l=", i),
+        .id = func_id,
+    });
+  }
+  return ir;
+}
+
+std::string Serialize(const IR& ir, absl::string_view mode) {
+  if (mode == "json_value") {
+    return llvm::formatv("{0:2}", ir.ToJson());
+  }
+  if (mode == "json_stream") {
+    return IrToJson(ir);
+  }
+  return IrToBinary(ir);
+}
+
+int Main() {
+  std::string mode = absl::GetFlag(FLAGS_mode);
+  if (mode != "json_value" && mode != "json_stream" && mode != "binary") {
+    std::cerr << "Unknown --mode: " << mode << "\n";
+    return 1;
+  }
+  int iterations = absl::GetFlag(FLAGS_iterations);
+  IR ir = MakeSyntheticIr(absl::GetFlag(FLAGS_items));
+
+  int64_t rss_before_kb = PeakRssKb();
+  size_t bytes = 0;
+  absl::Time start = absl::Now();
+  for (int i = 0; i < iterations; ++i) {
+    bytes += Serialize(ir, mode).size();
+  }
+  absl::Duration elapsed = absl::Now() - start;
+  int64_t rss_after_kb = PeakRssKb();
+
+  double seconds = absl::ToDoubleSeconds(elapsed);
+  std::cout << "mode:                 " << mode << "\n"
+            << "output size:          " << bytes / iterations << " bytes\n"
+            << "time per iteration:   " << elapsed / iterations << "\n"
+            << "throughput:           " << bytes / seconds / (1 << 20)
+            << " MiB/s\n"
+            << "peak RSS overhead:    " << rss_after_kb - rss_before_kb
+            << " KiB\n";
+  return 0;
+}
+
+}  // namespace
+}  // namespace crubit
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+  return crubit::Main();
+}
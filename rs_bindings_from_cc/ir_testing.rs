@@ -65,43 +65,81 @@ pub fn make_ir_from_items(items: impl IntoIterator<Item = Item>) -> IR {
 /// Needs to be kept in sync with `kDependencyTarget` in `json_from_cc.cc`.
 pub const DEPENDENCY_TARGET: &str = "//test:dependency";
 
-/// Generates `IR` from a header that depends on another header.
-///
-/// `header_source` of the header will be updated to contain the `#include` line
-/// for the header with `dependency_header_source`. The name of the dependency
-/// target is exposed as `DEPENDENCY_TARGET`.
-pub fn ir_from_cc_dependency(
+const DEPENDENCY_HEADER_NAME: &str = "test/dependency_header.h";
+
+extern "C" {
+    fn json_from_cc_dependency(
+        target_triple: FfiU8Slice,
+        header_source: FfiU8Slice,
+        dependency_header_source: FfiU8Slice,
+    ) -> FfiU8SliceBox;
+    fn binary_ir_from_cc_dependency(
+        target_triple: FfiU8Slice,
+        header_source: FfiU8Slice,
+        dependency_header_source: FfiU8Slice,
+    ) -> FfiU8SliceBox;
+}
+
+/// Serializes the `IR` of a header that includes the dependency header, using
+/// `from_cc` (one of the functions defined in `json_from_cc.cc`).
+fn serialized_ir_from_cc_dependency(
+    from_cc: unsafe extern "C" fn(FfiU8Slice, FfiU8Slice, FfiU8Slice) -> FfiU8SliceBox,
     platform: multiplatform_testing::Platform,
     header_source: &str,
     dependency_header_source: &str,
-) -> Result<IR> {
-    const DEPENDENCY_HEADER_NAME: &str = "test/dependency_header.h";
-
-    extern "C" {
-        fn json_from_cc_dependency(
-            target_triple: FfiU8Slice,
-            header_source: FfiU8Slice,
-            dependency_header_source: FfiU8Slice,
-        ) -> FfiU8SliceBox;
-    }
-
+) -> Box<[u8]> {
     let header_source_with_include =
         format!("#include \"{}\"\n\n{}", DEPENDENCY_HEADER_NAME, header_source);
     let header_source_with_include_u8 = header_source_with_include.as_bytes();
     let dependency_header_source_u8 = dependency_header_source.as_bytes();
-    let json_utf8 = unsafe {
-        json_from_cc_dependency(
+    unsafe {
+        from_cc(
             FfiU8Slice::from_slice(platform.target_triple().as_ref()),
             FfiU8Slice::from_slice(header_source_with_include_u8),
             FfiU8Slice::from_slice(dependency_header_source_u8),
         )
         .into_boxed_slice()
-    };
+    }
+}
+
+/// Generates `IR` from a header that depends on another header.
+///
+/// `header_source` of the header will be updated to contain the `#include` line
+/// for the header with `dependency_header_source`. The name of the dependency
+/// target is exposed as `DEPENDENCY_TARGET`.
+pub fn ir_from_cc_dependency(
+    platform: multiplatform_testing::Platform,
+    header_source: &str,
+    dependency_header_source: &str,
+) -> Result<IR> {
+    let json_utf8 = serialized_ir_from_cc_dependency(
+        json_from_cc_dependency,
+        platform,
+        header_source,
+        dependency_header_source,
+    );
     let mut ir = ir::deserialize_ir(&*json_utf8)?;
     update_test_ir(&mut ir);
     Ok(ir)
 }
 
+/// Like `ir_from_cc`, but passes the `IR` from C++ to Rust in the binary wire
+/// format (see `ir_binary.h`) instead of JSON.
+pub fn ir_from_cc_binary(
+    platform: multiplatform_testing::Platform,
+    header_source: &str,
+) -> Result<IR> {
+    let bytes = serialized_ir_from_cc_dependency(
+        binary_ir_from_cc_dependency,
+        platform,
+        header_source,
+        "// empty header",
+    );
+    let mut ir = ir::deserialize_ir_binary(&bytes)?;
+    update_test_ir(&mut ir);
+    Ok(ir)
+}
+
 /// Creates an identifier
 pub fn ir_id(name: &str) -> Identifier {
     Identifier { identifier: name.into() }
@@ -0,0 +1,146 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#include "rs_bindings_from_cc/ir_writer.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#include "absl/log/check.h"
+#include "absl/strings/string_view.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/JSON.h"
+
+namespace crubit {
+
+namespace {
+llvm::StringRef ToStringRef(absl::string_view s) {
+  return llvm::StringRef(s.data(), s.size());
+}
+}  // namespace
+
+void JsonIrWriter::EndValue() {
+  if (!in_object_.empty() && in_object_.back()) {
+    stream_.attributeEnd();
+  }
+}
+
+void JsonIrWriter::Null() {
+  stream_.value(nullptr);
+  EndValue();
+}
+
+void JsonIrWriter::Bool(bool value) {
+  stream_.value(value);
+  EndValue();
+}
+
+void JsonIrWriter::Int(int64_t value) {
+  stream_.value(value);
+  EndValue();
+}
+
+void JsonIrWriter::Uint(uint64_t value) {
+  stream_.value(value);
+  EndValue();
+}
+
+void JsonIrWriter::String(absl::string_view value) {
+  llvm::StringRef string_ref = ToStringRef(value);
+  if (llvm::json::isUTF8(string_ref)) {
+    // `llvm::json::Value` only borrows the `StringRef`, so this doesn't copy.
+    stream_.value(string_ref);
+  } else {
+    stream_.value(llvm::json::fixUTF8(string_ref));
+  }
+  EndValue();
+}
+
+void JsonIrWriter::ArrayBegin() {
+  stream_.arrayBegin();
+  in_object_.push_back(false);
+}
+
+void JsonIrWriter::ArrayEnd() {
+  CHECK(!in_object_.empty() && !in_object_.back());
+  in_object_.pop_back();
+  stream_.arrayEnd();
+  EndValue();
+}
+
+void JsonIrWriter::ObjectBegin() {
+  stream_.objectBegin();
+  in_object_.push_back(true);
+}
+
+void JsonIrWriter::Key(absl::string_view key) {
+  stream_.attributeBegin(ToStringRef(key));
+}
+
+void JsonIrWriter::ObjectEnd() {
+  CHECK(!in_object_.empty() && in_object_.back());
+  in_object_.pop_back();
+  stream_.objectEnd();
+  EndValue();
+}
+
+void JsonValueIrWriter::AddValue(llvm::json::Value value) {
+  if (stack_.empty()) {
+    result_ = std::move(value);
+    return;
+  }
+  Container& container = stack_.back();
+  if (container.is_object) {
+    container.object[std::move(container.key)] = std::move(value);
+  } else {
+    container.array.push_back(std::move(value));
+  }
+}
+
+void JsonValueIrWriter::Null() { AddValue(nullptr); }
+
+void JsonValueIrWriter::Bool(bool value) { AddValue(value); }
+
+void JsonValueIrWriter::Int(int64_t value) { AddValue(value); }
+
+void JsonValueIrWriter::Uint(uint64_t value) { AddValue(value); }
+
+void JsonValueIrWriter::String(absl::string_view value) {
+  llvm::StringRef string_ref = ToStringRef(value);
+  if (llvm::json::isUTF8(string_ref)) {
+    AddValue(string_ref.str());
+  } else {
+    AddValue(llvm::json::fixUTF8(string_ref));
+  }
+}
+
+void JsonValueIrWriter::ArrayBegin() {
+  stack_.push_back(Container{.is_object = false});
+}
+
+void JsonValueIrWriter::ArrayEnd() {
+  CHECK(!stack_.empty() && !stack_.back().is_object);
+  llvm::json::Array array = std::move(stack_.back().array);
+  stack_.pop_back();
+  AddValue(std::move(array));
+}
+
+void JsonValueIrWriter::ObjectBegin() {
+  stack_.push_back(Container{.is_object = true});
+}
+
+void JsonValueIrWriter::Key(absl::string_view key) {
+  CHECK(!stack_.empty() && stack_.back().is_object);
+  stack_.back().key = std::string(key);
+}
+
+void JsonValueIrWriter::ObjectEnd() {
+  CHECK(!stack_.empty() && stack_.back().is_object);
+  llvm::json::Object object = std::move(stack_.back().object);
+  stack_.pop_back();
+  AddValue(std::move(object));
+}
+
+}  // namespace crubit
@@ -0,0 +1,127 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+// This file defines the streaming interface used to serialize the IR (see the
+// `Write` methods in `ir.h`), and the JSON implementations of it.
+//
+// IR types describe themselves as a sequence of events (scalars, and the
+// beginning and end of arrays and objects), and the writer turns those events
+// into the output format directly, without building an intermediate value tree.
+#ifndef CRUBIT_RS_BINDINGS_FROM_CC_IR_WRITER_H_
+#define CRUBIT_RS_BINDINGS_FROM_CC_IR_WRITER_H_
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/functional/function_ref.h"
+#include "absl/strings/string_view.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace crubit {
+
+// Receives the serialization events of a single value tree.
+//
+// The caller is responsible for emitting a well-formed value tree (exactly one
+// root value, balanced `ArrayBegin`/`ArrayEnd` and `ObjectBegin`/`ObjectEnd`,
+// and a `Key` before every value inside of an object).
+class IrWriter {
+ public:
+  virtual ~IrWriter() = default;
+
+  virtual void Null() = 0;
+  virtual void Bool(bool value) = 0;
+  virtual void Int(int64_t value) = 0;
+  virtual void Uint(uint64_t value) = 0;
+  virtual void String(absl::string_view value) = 0;
+
+  virtual void ArrayBegin() = 0;
+  virtual void ArrayEnd() = 0;
+
+  virtual void ObjectBegin() = 0;
+  // Starts an object member. Must be followed by exactly one value.
+  virtual void Key(absl::string_view key) = 0;
+  virtual void ObjectEnd() = 0;
+
+  // Writes a value by calling `write`, which must emit exactly one value. The
+  // value is likely to be repeated many times in the IR (e.g. a type), so the
+  // writer may store its repetitions as references to its first occurrence.
+  virtual void SharedValue(absl::FunctionRef<void()> write) { write(); }
+};
+
+// Prints JSON text to an `llvm::raw_ostream` as the events come in.
+class JsonIrWriter : public IrWriter {
+ public:
+  explicit JsonIrWriter(llvm::raw_ostream& os, unsigned indent_size = 0)
+      : stream_(os, indent_size) {}
+
+  void Null() override;
+  void Bool(bool value) override;
+  void Int(int64_t value) override;
+  void Uint(uint64_t value) override;
+  void String(absl::string_view value) override;
+
+  void ArrayBegin() override;
+  void ArrayEnd() override;
+
+  void ObjectBegin() override;
+  void Key(absl::string_view key) override;
+  void ObjectEnd() override;
+
+ private:
+  // Must be called after every complete value.
+  void EndValue();
+
+  llvm::json::OStream stream_;
+  // For each open array or object: whether it is an object.
+  std::vector<bool> in_object_;
+};
+
+// Builds an `llvm::json::Value`. This is only meant for debugging output and
+// tests: writing the IR out through this writer has the same memory overhead
+// that `JsonIrWriter` and `BinaryIrWriter` avoid.
+class JsonValueIrWriter : public IrWriter {
+ public:
+  void Null() override;
+  void Bool(bool value) override;
+  void Int(int64_t value) override;
+  void Uint(uint64_t value) override;
+  void String(absl::string_view value) override;
+
+  void ArrayBegin() override;
+  void ArrayEnd() override;
+
+  void ObjectBegin() override;
+  void Key(absl::string_view key) override;
+  void ObjectEnd() override;
+
+  llvm::json::Value Finish() && { return std::move(result_); }
+
+ private:
+  struct Container {
+    bool is_object;
+    llvm::json::Array array;
+    llvm::json::Object object;
+    std::string key;
+  };
+
+  void AddValue(llvm::json::Value value);
+
+  std::vector<Container> stack_;
+  llvm::json::Value result_ = nullptr;
+};
+
+// Returns the JSON value of anything with a `Write(IrWriter&)` method.
+template <typename T>
+llvm::json::Value WriteToJsonValue(const T& t) {
+  JsonValueIrWriter writer;
+  t.Write(writer);
+  return std::move(writer).Finish();
+}
+
+}  // namespace crubit
+
+#endif  // CRUBIT_RS_BINDINGS_FROM_CC_IR_WRITER_H_
@@ -0,0 +1,263 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#include "rs_bindings_from_cc/output_cache.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "common/ffi_types.h"
+#include "common/file_io.h"
+#include "common/status_macros.h"
+#include "rs_bindings_from_cc/bazel_types.h"
+#include "rs_bindings_from_cc/cmdline.h"
+#include "rs_bindings_from_cc/ir_from_cc.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/SHA256.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+namespace crubit {
+
+namespace {
+
+// Has to be changed whenever the format of the cache entries changes. Changes
+// to the generated bindings don't need a new version, as the key covers the
+// binary of the tool (see `GeneratorStamp`).
+constexpr absl::string_view kOutputCacheVersion = "1";
+
+// Feeds length-prefixed strings to a SHA-256 hasher, so that the boundaries
+// between them are part of the digest.
+class KeyHasher {
+ public:
+  void Add(absl::string_view s) {
+    hasher_.update(absl::StrCat(s.size(), ":"));
+    hasher_.update(llvm::StringRef(s.data(), s.size()));
+  }
+
+  void AddBool(bool b) { Add(b ? "1" : "0"); }
+
+  std::string HexDigest() {
+    return llvm::toHex(hasher_.final(), /*LowerCase=*/true);
+  }
+
+ private:
+  llvm::SHA256 hasher_;
+};
+
+// Returns a stamp of the running binary, so that the entries that were
+// generated by an older version of the tool (which may have generated different
+// bindings for the same inputs) are never reused. The binary is too large to
+// hash for every action, so the stamp is its identity on disk: its size,
+// modification time and file ID (but not its path, which changes with the
+// sandbox of each action). Computed once per process.
+absl::StatusOr<std::string> GeneratorStamp() {
+  static const absl::StatusOr<std::string>* const kStamp =
+      new absl::StatusOr<std::string>([]() -> absl::StatusOr<std::string> {
+        std::string path = llvm::sys::fs::getMainExecutable(
+            nullptr, reinterpret_cast<void*>(&GeneratorStamp));
+        if (path.empty()) {
+          return absl::InternalError("Couldn't find the path of the binary");
+        }
+        llvm::sys::fs::file_status status;
+        if (std::error_code error = llvm::sys::fs::status(path, status)) {
+          return absl::InternalError(
+              absl::StrCat("Couldn't stat ", path, ": ", error.message()));
+        }
+        llvm::sys::fs::UniqueID id = status.getUniqueID();
+        return absl::StrCat(
+            status.getSize(), ":",
+            status.getLastModificationTime().time_since_epoch().count(), ":",
+            id.getDevice(), ":", id.getFile());
+      }());
+  return *kStamp;
+}
+
+std::string EntryPath(absl::string_view cache_dir, absl::string_view key) {
+  return absl::StrCat(cache_dir, "/", key);
+}
+
+// Appends `s` to `entry`, prefixed by its length.
+void AppendSection(std::string& entry, absl::string_view s) {
+  absl::StrAppend(&entry, s.size(), "\n", s);
+}
+
+// Consumes a section appended by `AppendSection` from the front of `entry`.
+std::optional<std::string> ConsumeSection(absl::string_view& entry) {
+  size_t newline = entry.find('\n');
+  size_t size;
+  if (newline == absl::string_view::npos ||
+      !absl::SimpleAtoi(entry.substr(0, newline), &size) ||
+      entry.size() - newline - 1 < size) {
+    return std::nullopt;
+  }
+  std::string section(entry.substr(newline + 1, size));
+  entry.remove_prefix(newline + 1 + size);
+  return section;
+}
+
+}  // namespace
+
+absl::StatusOr<std::string> ComputeOutputCacheKey(
+    const Cmdline& cmdline, absl::Span<const std::string> clang_args,
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> file_system) {
+  KeyHasher hasher;
+  hasher.Add(kOutputCacheVersion);
+  CRUBIT_ASSIGN_OR_RETURN(std::string generator_stamp, GeneratorStamp());
+  hasher.Add(generator_stamp);
+
+  hasher.Add(cmdline.current_target().value());
+  for (const HeaderName& header : cmdline.public_headers()) {
+    hasher.Add(header.IncludePath());
+  }
+
+  std::vector<std::pair<absl::string_view, absl::string_view>>
+      headers_to_targets;
+  for (const auto& [header, target] : cmdline.headers_to_targets()) {
+    headers_to_targets.push_back({header.IncludePath(), target.value()});
+  }
+  std::sort(headers_to_targets.begin(), headers_to_targets.end());
+  for (const auto& [header, target] : headers_to_targets) {
+    hasher.Add(header);
+    hasher.Add(target);
+  }
+
+  std::vector<std::pair<absl::string_view, std::vector<absl::string_view>>>
+      target_to_features;
+  for (const auto& [target, features] : cmdline.target_to_features()) {
+    std::vector<absl::string_view> sorted_features(features.begin(),
+                                                   features.end());
+    std::sort(sorted_features.begin(), sorted_features.end());
+    target_to_features.push_back({target.value(), std::move(sorted_features)});
+  }
+  std::sort(target_to_features.begin(), target_to_features.end());
+  for (const auto& [target, features] : target_to_features) {
+    hasher.Add(target);
+    for (absl::string_view feature : features) {
+      hasher.Add(feature);
+    }
+  }
+
+  for (const std::string& extra_rs_src : cmdline.extra_rs_srcs()) {
+    hasher.Add(extra_rs_src);
+  }
+  for (const std::string& src : cmdline.srcs_to_scan_for_instantiations()) {
+    hasher.Add(src);
+    CRUBIT_ASSIGN_OR_RETURN(std::string contents, GetFileContents(src));
+    hasher.Add(contents);
+  }
+  hasher.AddBool(!cmdline.instantiations_out().empty());
+  hasher.AddBool(!cmdline.error_report_out().empty());
+
+  hasher.Add(cmdline.crubit_support_path());
+  hasher.Add(cmdline.clang_format_exe_path());
+  hasher.Add(cmdline.rustfmt_exe_path());
+  hasher.Add(cmdline.rustfmt_config_path());
+  if (!cmdline.rustfmt_config_path().empty()) {
+    CRUBIT_ASSIGN_OR_RETURN(std::string contents,
+                            GetFileContents(cmdline.rustfmt_config_path()));
+    hasher.Add(contents);
+  }
+  hasher.AddBool(cmdline.generate_source_location_in_doc_comment() ==
+                 SourceLocationDocComment::Enabled);
+  hasher.AddBool(cmdline.rust_formatting() == RustFormatting::Rustfmt);
+  hasher.AddBool(cmdline.lazy_import());
+
+  std::vector<absl::string_view> clang_args_view(clang_args.begin(),
+                                                 clang_args.end());
+  for (absl::string_view arg : clang_args_view) {
+    hasher.Add(arg);
+  }
+  CRUBIT_ASSIGN_OR_RETURN(
+      std::string headers_digest,
+      HashPreprocessedHeaders({.public_headers = cmdline.public_headers(),
+                               .clang_args = clang_args_view,
+                               .file_system = std::move(file_system)}));
+  hasher.Add(headers_digest);
+
+  return hasher.HexDigest();
+}
+
+std::optional<CachedOutputs> LookUpCachedOutputs(absl::string_view cache_dir,
+                                                 absl::string_view key) {
+  absl::StatusOr<std::string> entry_or =
+      GetFileContents(EntryPath(cache_dir, key));
+  if (!entry_or.ok()) {
+    return std::nullopt;
+  }
+  absl::string_view entry = *entry_or;
+  std::optional<std::string> version = ConsumeSection(entry);
+  if (!version.has_value() || *version != kOutputCacheVersion) {
+    return std::nullopt;
+  }
+
+  CachedOutputs outputs;
+  for (FfiString* section :
+       {&outputs.rs_api, &outputs.rs_api_impl, &outputs.namespaces_json,
+        &outputs.instantiations_json, &outputs.error_report}) {
+    std::optional<std::string> value = ConsumeSection(entry);
+    if (!value.has_value()) {
+      return std::nullopt;
+    }
+    *section = FfiString(*std::move(value));
+  }
+  if (!entry.empty()) {
+    return std::nullopt;
+  }
+  return outputs;
+}
+
+absl::Status StoreCachedOutputs(absl::string_view cache_dir,
+                                absl::string_view key,
+                                const CachedOutputs& outputs) {
+  if (std::error_code error = llvm::sys::fs::create_directories(cache_dir)) {
+    return absl::InternalError(error.message());
+  }
+
+  std::string entry;
+  AppendSection(entry, kOutputCacheVersion);
+  for (const FfiString* section :
+       {&outputs.rs_api, &outputs.rs_api_impl, &outputs.namespaces_json,
+        &outputs.instantiations_json, &outputs.error_report}) {
+    AppendSection(entry, section->view());
+  }
+
+  // Write to a temporary file first, so that readers never see a partially
+  // written entry.
+  llvm::SmallString<128> temp_path;
+  if (std::error_code error = llvm::sys::fs::createUniqueFile(
+          absl::StrCat(EntryPath(cache_dir, key), ".tmp-%%%%%%%%"),
+          temp_path)) {
+    return absl::InternalError(error.message());
+  }
+  absl::Status status =
+      SetFileContents(absl::string_view(temp_path.data(), temp_path.size()),
+                      entry);
+  if (status.ok()) {
+    if (std::error_code error =
+            llvm::sys::fs::rename(temp_path, EntryPath(cache_dir, key))) {
+      status = absl::InternalError(error.message());
+    }
+  }
+  if (!status.ok()) {
+    llvm::sys::fs::remove(temp_path);
+  }
+  return status;
+}
+
+}  // namespace crubit
@@ -0,0 +1,59 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#ifndef CRUBIT_RS_BINDINGS_FROM_CC_OUTPUT_CACHE_H_
+#define CRUBIT_RS_BINDINGS_FROM_CC_OUTPUT_CACHE_H_
+
+#include <optional>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "common/ffi_types.h"
+#include "rs_bindings_from_cc/cmdline.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+namespace crubit {
+
+// The outputs of the tool that are stored in the output cache (everything but
+// the IR).
+struct CachedOutputs {
+  FfiString rs_api;
+  FfiString rs_api_impl;
+  FfiString namespaces_json;
+  FfiString instantiations_json;
+  FfiString error_report;
+};
+
+// Returns the key under which the outputs for `cmdline` and `clang_args` are
+// cached.
+//
+// The key is a hex-encoded SHA-256 digest of the preprocessed public headers
+// (see `HashPreprocessedHeaders`), of the contents of the
+// `srcs_to_scan_for_instantiations` and of the `rustfmt_config_path`, of all
+// the other arguments that affect the outputs, and of the size, modification
+// time and file ID of the running binary (so that a new version of the tool
+// doesn't reuse outputs it would generate differently). The headers are read
+// from `file_system` (see `IrFromCcOptions`).
+absl::StatusOr<std::string> ComputeOutputCacheKey(
+    const Cmdline& cmdline, absl::Span<const std::string> clang_args,
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> file_system = nullptr);
+
+// Returns the outputs stored in `cache_dir` under `key`, or `std::nullopt` if
+// there are none (or if they can't be read).
+std::optional<CachedOutputs> LookUpCachedOutputs(absl::string_view cache_dir,
+                                                 absl::string_view key);
+
+// Stores `outputs` in `cache_dir` under `key`. The entry is written atomically,
+// so that concurrent runs of the tool can share the same `cache_dir`.
+absl::Status StoreCachedOutputs(absl::string_view cache_dir,
+                                absl::string_view key,
+                                const CachedOutputs& outputs);
+
+}  // namespace crubit
+
+#endif  // CRUBIT_RS_BINDINGS_FROM_CC_OUTPUT_CACHE_H_
@@ -0,0 +1,98 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#include "rs_bindings_from_cc/output_cache.h"
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "common/ffi_types.h"
+#include "common/status_test_matchers.h"
+#include "common/test_utils.h"
+#include "rs_bindings_from_cc/cmdline.h"
+
+namespace crubit {
+namespace {
+
+using ::testing::Eq;
+using ::testing::Ne;
+
+absl::StatusOr<Cmdline> TestCmdline(bool lazy_import = false) {
+  constexpr absl::string_view kTargetsAndHeaders = R"([
+    {"t": "//:target", "h": ["a.h"]}
+  ])";
+  return Cmdline::CreateForTesting(
+      "//:target", "cc_out", "rs_out", /* ir_out= */ "", "namespaces_out",
+      "crubit_support_path", "clang_format_exe_path", "rustfmt_exe_path",
+      /* rustfmt_config_path= */ "",
+      /* do_nothing= */ false, {"a.h"}, std::string(kTargetsAndHeaders),
+      /* extra_rs_srcs= */ {},
+      /* srcs_to_scan_for_instantiations= */ {},
+      /* instantiations_out= */ "", /* error_report_out= */ "",
+      SourceLocationDocComment::Enabled, /* precompiled_header= */ "",
+      /* precompiled_header_out= */ "", lazy_import);
+}
+
+// Returns the cache key of `TestCmdline(lazy_import)` with the given contents
+// of the public header.
+absl::StatusOr<std::string> KeyForHeader(absl::string_view header_contents,
+                                         bool lazy_import = false) {
+  WriteFileForCurrentTest("a.h", header_contents);
+  CRUBIT_ASSIGN_OR_RETURN(Cmdline cmdline, TestCmdline(lazy_import));
+  return ComputeOutputCacheKey(cmdline, DefaultClangArgs());
+}
+
+TEST(OutputCacheTest, KeyDependsOnTheTokensOfTheHeaders) {
+  ASSERT_OK_AND_ASSIGN(std::string key, KeyForHeader("struct S { int x; };"));
+  EXPECT_THAT(KeyForHeader("struct S { int x; };"), IsOkAndHolds(Eq(key)));
+  EXPECT_THAT(KeyForHeader("struct S {  int  x;  };"), IsOkAndHolds(Eq(key)));
+
+  EXPECT_THAT(KeyForHeader("struct S { long x; };"), IsOkAndHolds(Ne(key)));
+  // Comments, pragmas and line numbers end up in the bindings.
+  EXPECT_THAT(KeyForHeader("struct S { int x; };  // Doc."),
+              IsOkAndHolds(Ne(key)));
+  ASSERT_OK_AND_ASSIGN(std::string second_line_key,
+                       KeyForHeader("\nstruct S { int x; };"));
+  EXPECT_NE(second_line_key, key);
+  EXPECT_THAT(KeyForHeader("#pragma clang lifetime_elision\n"
+                           "struct S { int x; };"),
+              IsOkAndHolds(Ne(second_line_key)));
+}
+
+TEST(OutputCacheTest, KeyDependsOnTheCmdline) {
+  ASSERT_OK_AND_ASSIGN(std::string key, KeyForHeader("struct S {};"));
+  EXPECT_THAT(KeyForHeader("struct S {};", /* lazy_import= */ true),
+              IsOkAndHolds(Ne(key)));
+}
+
+TEST(OutputCacheTest, StoreAndLookUp) {
+  std::string cache_dir = absl::StrCat(testing::TempDir(), "/output_cache");
+  EXPECT_EQ(LookUpCachedOutputs(cache_dir, "key"), std::nullopt);
+
+  ASSERT_OK(StoreCachedOutputs(cache_dir, "key",
+                               {.rs_api = FfiString("rs_api\n"),
+                                .rs_api_impl = FfiString(""),
+                                .namespaces_json = FfiString("[]"),
+                                .instantiations_json = FfiString("{}"),
+                                .error_report = FfiString("12\nnot a size")}));
+  std::optional<CachedOutputs> outputs =
+      LookUpCachedOutputs(cache_dir, "key");
+  ASSERT_TRUE(outputs.has_value());
+  EXPECT_EQ(outputs->rs_api.view(), "rs_api\n");
+  EXPECT_EQ(outputs->rs_api_impl.view(), "");
+  EXPECT_EQ(outputs->namespaces_json.view(), "[]");
+  EXPECT_EQ(outputs->instantiations_json.view(), "{}");
+  EXPECT_EQ(outputs->error_report.view(), "12\nnot a size");
+
+  EXPECT_EQ(LookUpCachedOutputs(cache_dir, "other_key"), std::nullopt);
+}
+
+}  // namespace
+}  // namespace crubit
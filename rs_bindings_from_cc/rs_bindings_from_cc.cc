@@ -5,13 +5,25 @@
 // Parses C++ headers and generates:
 // * a Rust source file with bindings for the C++ API
 // * a C++ source file with the implementation of the bindings
+//
+// With `--persistent_worker`, generates the bindings for a stream of targets,
+// as a Bazel persistent worker (see `RunPersistentWorker`).
 
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
 #include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "absl/flags/parse.h"
+#include "absl/flags/reflection.h"
+#include "absl/log/log.h"
 #include "absl/status/status.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/span.h"
@@ -21,8 +33,14 @@
 #include "rs_bindings_from_cc/collect_namespaces.h"
 #include "rs_bindings_from_cc/generate_bindings_and_metadata.h"
 #include "rs_bindings_from_cc/ir.h"
+#include "rs_bindings_from_cc/ir_from_cc.h"
+#include "rs_bindings_from_cc/output_cache.h"
+#include "rs_bindings_from_cc/time_trace.h"
+#include "rs_bindings_from_cc/worker.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
 #include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/JSON.h"
+#include "llvm/Support/VirtualFileSystem.h"
 #include "llvm/Support/raw_ostream.h"
 
 namespace crubit {
@@ -36,9 +54,31 @@ std::string InstantiationsAsJson(
   return std::string(llvm::formatv("{0:2}", llvm::json::Value(std::move(obj))));
 }
 
-absl::Status Main(absl::Span<char* const> args) {
-  CRUBIT_ASSIGN_OR_RETURN(Cmdline cmdline, Cmdline::Create());
+// Writes the outputs requested on the command line (except for the IR).
+absl::Status WriteOutputs(const Cmdline& cmdline,
+                          const CachedOutputs& outputs) {
+  std::vector<FileContents> files = {
+      {cmdline.rs_out(), outputs.rs_api.view()},
+      {cmdline.cc_out(), outputs.rs_api_impl.view()},
+  };
+  if (!cmdline.instantiations_out().empty()) {
+    files.push_back(
+        {cmdline.instantiations_out(), outputs.instantiations_json.view()});
+  }
+  if (!cmdline.namespaces_out().empty()) {
+    files.push_back({cmdline.namespaces_out(), outputs.namespaces_json.view()});
+  }
+  if (!cmdline.error_report_out().empty()) {
+    files.push_back({cmdline.error_report_out(), outputs.error_report.view()});
+  }
+  return SetFilesContents(files);
+}
 
+// Generates the bindings requested by `cmdline`. `clang_args` are passed to
+// Clang, which reads the headers from `file_system` (see `IrFromCcOptions`).
+absl::Status GenerateOutputs(
+    Cmdline& cmdline, std::vector<std::string> clang_args,
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> file_system) {
   if (cmdline.do_nothing()) {
     CRUBIT_RETURN_IF_ERROR(SetFileContents(
         cmdline.rs_out(),
@@ -56,46 +96,151 @@ absl::Status Main(absl::Span<char* const> args) {
     return absl::OkStatus();
   }
 
-  std::vector<std::string> clang_args;
-  clang_args.insert(clang_args.end(), args.begin(), args.end());
+  if (!cmdline.precompiled_header_out().empty()) {
+    TracePhase phase("PrecompileHeaders");
+    std::vector<absl::string_view> clang_args_view(clang_args.begin(),
+                                                   clang_args.end());
+    CRUBIT_RETURN_IF_ERROR(
+        PrecompileHeaders({.public_headers = cmdline.public_headers(),
+                           .clang_args = clang_args_view,
+                           .file_system = file_system},
+                          cmdline.precompiled_header_out()));
+  }
+
+  // The IR is not cached, so the cache can't be used when it is requested.
+  std::string cache_key;
+  if (!cmdline.output_cache_dir().empty() && cmdline.ir_out().empty()) {
+    std::optional<CachedOutputs> cached_outputs;
+    {
+      TracePhase phase("LookUpCachedOutputs");
+      CRUBIT_ASSIGN_OR_RETURN(
+          cache_key, ComputeOutputCacheKey(cmdline, clang_args, file_system));
+      cached_outputs =
+          LookUpCachedOutputs(cmdline.output_cache_dir(), cache_key);
+      phase.AddCount("hits", cached_outputs.has_value() ? 1 : 0);
+    }
+    if (cached_outputs.has_value()) {
+      TracePhase phase("WriteOutputs");
+      return WriteOutputs(cmdline, *cached_outputs);
+    }
+  }
 
   CRUBIT_ASSIGN_OR_RETURN(
       BindingsAndMetadata bindings_and_metadata,
-      GenerateBindingsAndMetadata(cmdline, std::move(clang_args)));
+      GenerateBindingsAndMetadata(cmdline, std::move(clang_args),
+                                  /*virtual_headers_contents_for_testing=*/{},
+                                  file_system));
 
   if (!cmdline.ir_out().empty()) {
+    TracePhase phase("IrToJson");
     CRUBIT_RETURN_IF_ERROR(
         SetFileContents(cmdline.ir_out(), IrToJson(bindings_and_metadata.ir)));
   }
 
-  CRUBIT_RETURN_IF_ERROR(
-      SetFileContents(cmdline.rs_out(), bindings_and_metadata.rs_api));
-  CRUBIT_RETURN_IF_ERROR(
-      SetFileContents(cmdline.cc_out(), bindings_and_metadata.rs_api_impl));
-
-  if (!cmdline.instantiations_out().empty()) {
-    CRUBIT_RETURN_IF_ERROR(
-        SetFileContents(cmdline.instantiations_out(),
-                        InstantiationsAsJson(bindings_and_metadata)));
+  TracePhase write_outputs_phase("WriteOutputs");
+  CachedOutputs outputs{
+      .rs_api = std::move(bindings_and_metadata.rs_api),
+      .rs_api_impl = std::move(bindings_and_metadata.rs_api_impl),
+      .namespaces_json = FfiString(
+          crubit::NamespacesAsJson(bindings_and_metadata.namespaces)),
+      .instantiations_json =
+          FfiString(InstantiationsAsJson(bindings_and_metadata)),
+      .error_report = std::move(bindings_and_metadata.error_report),
+  };
+  CRUBIT_RETURN_IF_ERROR(WriteOutputs(cmdline, outputs));
+
+  if (!cache_key.empty()) {
+    // A failure to populate the cache only makes later runs slower.
+    absl::Status status =
+        StoreCachedOutputs(cmdline.output_cache_dir(), cache_key, outputs);
+    if (!status.ok()) {
+      LOG(WARNING) << "Failed to store the outputs in --output_cache_dir: "
+                   << status;
+    }
   }
+  return absl::OkStatus();
+}
 
-  if (!cmdline.namespaces_out().empty()) {
-    CRUBIT_RETURN_IF_ERROR(SetFileContents(
-        cmdline.namespaces_out(),
-        crubit::NamespacesAsJson(bindings_and_metadata.namespaces)));
+// Generates the bindings requested by the flags. `args` are the arguments left
+// after parsing the flags, and are passed to Clang. Clang reads the headers
+// from `file_system` (see `IrFromCcOptions`).
+absl::Status Main(
+    absl::Span<char* const> args,
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> file_system = nullptr) {
+  CRUBIT_ASSIGN_OR_RETURN(Cmdline cmdline, Cmdline::Create());
+  std::vector<std::string> clang_args(args.begin(), args.end());
+  if (cmdline.time_trace_out().empty()) {
+    return GenerateOutputs(cmdline, std::move(clang_args), file_system);
   }
 
-  if (!cmdline.error_report_out().empty()) {
-    CRUBIT_RETURN_IF_ERROR(SetFileContents(cmdline.error_report_out(),
-                                           bindings_and_metadata.error_report));
+  StartTimeTrace();
+  absl::Status status;
+  {
+    TracePhase phase("rs_bindings_from_cc");
+    status = GenerateOutputs(cmdline, std::move(clang_args), file_system);
   }
+  // The trace is also written when the bindings could not be generated.
+  absl::Status trace_status = FinishTimeTrace(cmdline.time_trace_out());
+  CRUBIT_RETURN_IF_ERROR(status);
+  return trace_status;
+}
 
-  return absl::OkStatus();
+// Handles the requests of a Bazel persistent worker. The arguments of each
+// request are appended to `startup_args`, and parsed as if they were the
+// arguments of a separate run of the tool (but invalid flags only fail the
+// request). The diagnostics printed while handling a request are its output.
+// All the requests share a cache of the file system lookups made by Clang.
+int PersistentWorkerMain(std::vector<char*> startup_args) {
+  // Stdout carries the responses, so everything else is sent to stderr.
+  int responses_fd = dup(STDOUT_FILENO);
+  if (responses_fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+    llvm::errs() << "Failed to redirect stdout: " << std::strerror(errno)
+                 << "\n";
+    return -1;
+  }
+  llvm::raw_fd_ostream responses(responses_fd, /*shouldClose=*/true);
+  auto file_system = llvm::makeIntrusiveRefCnt<StatCachingFileSystem>(
+      llvm::vfs::getRealFileSystem());
+
+  absl::Status status = RunPersistentWorker(
+      std::cin, responses, *file_system,
+      [&](const WorkRequest& request, std::string& output) {
+        std::vector<std::string> arguments(request.arguments);
+        std::vector<char*> argv(startup_args);
+        for (std::string& argument : arguments) {
+          argv.push_back(argument.data());
+        }
+        // Restores the default values of the flags once the request is
+        // handled.
+        absl::FlagSaver flag_saver;
+        return CaptureOutput(
+            [&]() -> absl::Status {
+              CRUBIT_ASSIGN_OR_RETURN(std::vector<char*> args,
+                                      ParseFlags(argv));
+              return Main(args, file_system);
+            },
+            output);
+      });
+  if (!status.ok()) {
+    llvm::errs() << status.message() << "\n";
+    return -1;
+  }
+  return 0;
 }
 
 }  // namespace crubit
 
 int main(int argc, char* argv[]) {
+  std::vector<char*> startup_args(argv, argv + argc);
+  auto persistent_worker =
+      std::find_if(startup_args.begin(), startup_args.end(), [](char* arg) {
+        return absl::string_view(arg) == "--persistent_worker";
+      });
+  if (persistent_worker != startup_args.end()) {
+    startup_args.erase(persistent_worker);
+    return crubit::PersistentWorkerMain(std::move(startup_args));
+  }
+
   auto args = absl::ParseCommandLine(argc, argv);
   absl::Status status = crubit::Main(args);
   if (!status.ok()) {
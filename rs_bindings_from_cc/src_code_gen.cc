@@ -4,14 +4,26 @@
 
 #include "rs_bindings_from_cc/src_code_gen.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "common/ffi_types.h"
 #include "common/status_macros.h"
 #include "rs_bindings_from_cc/ir.h"
-#include "llvm/Support/FormatVariadic.h"
+#include "rs_bindings_from_cc/ir_binary.h"
+#include "rs_bindings_from_cc/time_trace.h"
+#include "clang/Format/Format.h"
+#include "clang/Tooling/Core/Replacement.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
 
 namespace crubit {
 
@@ -22,49 +34,89 @@ struct FfiBindings {
   FfiU8SliceBox error_report;
 };
 
+// FFI equivalent of `TracePhaseCallback`.
+using TracePhaseCallback = void (*)(FfiU8Slice name, bool begin);
+
 // This function is implemented in Rust.
 extern "C" FfiBindings GenerateBindingsImpl(
-    FfiU8Slice json, FfiU8Slice crubit_support_path,
+    FfiU8Slice ir, FfiU8Slice crubit_support_path,
     FfiU8Slice clang_format_exe_path, FfiU8Slice rustfmt_exe_path,
     FfiU8Slice rustfmt_config_path, bool generate_error_report,
-    SourceLocationDocComment generate_source_location_in_doc_comment);
-
-// Creates `Bindings` instance from copied data from `ffi_bindings`.
-static absl::StatusOr<Bindings> MakeBindingsFromFfiBindings(
-    const FfiBindings& ffi_bindings) {
-  Bindings bindings;
+    SourceLocationDocComment generate_source_location_in_doc_comment,
+    size_t codegen_threads, RustFormatting rust_formatting,
+    TracePhaseCallback trace_phase);
 
-  const FfiU8SliceBox& rs_api = ffi_bindings.rs_api;
-  const FfiU8SliceBox& rs_api_impl = ffi_bindings.rs_api_impl;
-  const FfiU8SliceBox& error_report = ffi_bindings.error_report;
+// Begins (if `begin`) or ends the `TracePhase` of a phase of
+// `GenerateBindingsImpl`. The phases of a thread are nested.
+static void TraceRustPhase(FfiU8Slice name, bool begin) {
+  thread_local std::vector<std::unique_ptr<TracePhase>> phases;
+  if (begin) {
+    phases.push_back(
+        std::make_unique<TracePhase>(StringViewFromFfiU8Slice(name)));
+  } else if (!phases.empty()) {
+    phases.pop_back();
+  }
+}
 
-  bindings.rs_api = std::string(rs_api.ptr, rs_api.size);
-  bindings.rs_api_impl = std::string(rs_api_impl.ptr, rs_api_impl.size);
-  bindings.error_report = std::string(error_report.ptr, error_report.size);
-  return bindings;
+// Creates `Bindings` instance that takes ownership of the buffers of
+// `ffi_bindings`.
+static Bindings MakeBindingsFromFfiBindings(FfiBindings ffi_bindings) {
+  return Bindings{
+      .rs_api = FfiString(ffi_bindings.rs_api),
+      .rs_api_impl = FfiString(ffi_bindings.rs_api_impl),
+      .error_report = FfiString(ffi_bindings.error_report),
+  };
 }
 
-// Deallocates given `ffi_bindings` instance that was created in Rust.
-static void FreeFfiBindings(FfiBindings ffi_bindings) {
-  FreeFfiU8SliceBox(ffi_bindings.rs_api);
-  FreeFfiU8SliceBox(ffi_bindings.rs_api_impl);
-  FreeFfiU8SliceBox(ffi_bindings.error_report);
+// Formats the generated C++ source code in-process, like
+// `clang-format --style=google` would.
+static absl::StatusOr<std::string> FormatCcSource(
+    absl::string_view cc_source) {
+  llvm::StringRef code(cc_source.data(), cc_source.size());
+  clang::format::FormatStyle style =
+      clang::format::getGoogleStyle(clang::format::FormatStyle::LK_Cpp);
+  clang::tooling::Replacements replacements = clang::format::reformat(
+      style, code, {clang::tooling::Range(0, code.size())});
+  llvm::Expected<std::string> formatted =
+      clang::tooling::applyAllReplacements(code, replacements);
+  if (!formatted) {
+    return absl::InternalError(
+        absl::StrCat("Failed to format the generated C++ source code: ",
+                     llvm::toString(formatted.takeError())));
+  }
+  return *std::move(formatted);
 }
 
 absl::StatusOr<Bindings> GenerateBindings(
     const IR& ir, absl::string_view crubit_support_path,
     absl::string_view clang_format_exe_path, absl::string_view rustfmt_exe_path,
     absl::string_view rustfmt_config_path, bool generate_error_report,
-    SourceLocationDocComment generate_source_location_in_doc_comment) {
-  std::string json = llvm::formatv("{0}", ir.ToJson());
-  FfiBindings ffi_bindings = GenerateBindingsImpl(
-      MakeFfiU8Slice(json), MakeFfiU8Slice(crubit_support_path),
-      MakeFfiU8Slice(clang_format_exe_path), MakeFfiU8Slice(rustfmt_exe_path),
-      MakeFfiU8Slice(rustfmt_config_path), generate_error_report,
-      generate_source_location_in_doc_comment);
-  CRUBIT_ASSIGN_OR_RETURN(Bindings bindings,
-                          MakeBindingsFromFfiBindings(ffi_bindings));
-  FreeFfiBindings(ffi_bindings);
+    SourceLocationDocComment generate_source_location_in_doc_comment,
+    int codegen_threads, RustFormatting rust_formatting) {
+  std::string ir_binary;
+  {
+    TracePhase phase("IrToBinary");
+    ir_binary = IrToBinary(ir);
+    phase.AddCount("ir_bytes", ir_binary.size());
+  }
+  FfiBindings ffi_bindings;
+  {
+    TracePhase phase("GenerateBindingsImpl");
+    ffi_bindings = GenerateBindingsImpl(
+        MakeFfiU8Slice(ir_binary), MakeFfiU8Slice(crubit_support_path),
+        MakeFfiU8Slice(clang_format_exe_path), MakeFfiU8Slice(rustfmt_exe_path),
+        MakeFfiU8Slice(rustfmt_config_path), generate_error_report,
+        generate_source_location_in_doc_comment,
+        static_cast<size_t>(std::max(codegen_threads, 1)), rust_formatting,
+        TimeTraceEnabled() ? &TraceRustPhase : nullptr);
+  }
+  Bindings bindings = MakeBindingsFromFfiBindings(ffi_bindings);
+  if (clang_format_exe_path.empty()) {
+    TracePhase phase("FormatCcSource");
+    CRUBIT_ASSIGN_OR_RETURN(std::string formatted_rs_api_impl,
+                            FormatCcSource(bindings.rs_api_impl.view()));
+    bindings.rs_api_impl = FfiString(std::move(formatted_rs_api_impl));
+  }
   return bindings;
 }
 
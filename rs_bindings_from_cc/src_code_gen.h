@@ -14,22 +14,34 @@
 
 namespace crubit {
 
-// Source code for generated bindings.
+// Source code for generated bindings. The strings are usually the buffers
+// allocated by the Rust code generator, which are not copied.
 struct Bindings {
   // Rust source code.
-  std::string rs_api;
+  FfiString rs_api;
   // C++ source code.
-  std::string rs_api_impl;
+  FfiString rs_api_impl;
   // Optional JSON error report.
-  std::string error_report;
+  FfiString error_report;
 };
 
 // Generates bindings from the given `IR`.
+//
+// With `codegen_threads` > 1, the bindings of the top-level items are generated
+// on that many threads. The output is the same for any number of threads.
+//
+// If `clang_format_exe_path` is empty, the C++ source code is formatted
+// in-process with clang's Format library instead of with the `clang-format`
+// executable. `rust_formatting` selects how the Rust source code is formatted;
+// `rustfmt_exe_path` and `rustfmt_config_path` are only used with
+// `RustFormatting::Rustfmt`.
 absl::StatusOr<Bindings> GenerateBindings(
     const IR& ir, absl::string_view crubit_support_path,
     absl::string_view clang_format_exe_path, absl::string_view rustfmt_exe_path,
     absl::string_view rustfmt_config_path, bool generate_error_report,
-    SourceLocationDocComment generate_source_location_in_doc_comment);
+    SourceLocationDocComment generate_source_location_in_doc_comment,
+    int codegen_threads = 1,
+    RustFormatting rust_formatting = RustFormatting::Rustfmt);
 
 }  // namespace crubit
 
@@ -12,18 +12,23 @@ use itertools::Itertools;
 use once_cell::sync::Lazy;
 use proc_macro2::{Ident, Literal, TokenStream};
 use quote::{format_ident, quote, ToTokens};
+use std::cell::RefCell;
 use std::collections::{BTreeSet, HashMap, HashSet};
 use std::ffi::{OsStr, OsString};
 use std::fmt::Write as _;
+use std::hash::Hash;
 use std::iter::{self, Iterator};
+use std::ops::Range;
 use std::panic::catch_unwind;
 use std::path::Path;
 use std::process;
 use std::ptr;
 use std::rc::Rc;
+use std::sync::mpsc;
+use std::thread;
 use token_stream_printer::{
-    cc_tokens_to_formatted_string, rs_tokens_to_formatted_string, write_unformatted_tokens,
-    RustfmtConfig,
+    cc_tokens_to_formatted_string, rs_tokens_to_formatted_string, rs_tokens_to_laid_out_string,
+    write_unformatted_tokens, RustfmtConfig,
 };
 
 /// FFI equivalent of `Bindings`.
@@ -34,14 +39,15 @@ pub struct FfiBindings {
     error_report: FfiU8SliceBox,
 }
 
-/// Deserializes IR from `json` and generates bindings source code.
+/// Deserializes IR from `ir` (in the binary format written by `IrToBinary`) and
+/// generates bindings source code, using up to `codegen_threads` threads.
 ///
 /// This function panics on error.
 ///
 /// # Safety
 ///
 /// Expectations:
-///    * `json` should be a FfiU8Slice for a valid array of bytes with the given
+///    * `ir` should be a FfiU8Slice for a valid array of bytes with the given
 ///      size.
 ///    * `crubit_support_path` should be a FfiU8Slice for a valid array of bytes
 ///      representing an UTF8-encoded string
@@ -49,25 +55,32 @@ pub struct FfiBindings {
 ///      FfiU8Slice for a valid array of bytes representing an UTF8-encoded
 ///      string (without the UTF-8 requirement, it seems that Rust doesn't offer
 ///      a way to convert to OsString on Windows)
-///    * `json`, `crubit_support_path`, `rustfmt_exe_path`, and
+///    * `clang_format_exe_path` may be empty, in which case `rs_api_impl` is
+///      returned unformatted (and the caller is expected to format it).
+///    * `ir`, `crubit_support_path`, `rustfmt_exe_path`, and
 ///      `rustfmt_config_path` shouldn't change during the call.
+///    * `trace_phase` should be `None`, or a function that can be called
+///      during the call (see `TracePhaseCallback`).
 ///
 /// Ownership:
 ///    * function doesn't take ownership of (in other words it borrows) the
-///      input params: `json`, `crubit_support_path`, `rustfmt_exe_path`, and
+///      input params: `ir`, `crubit_support_path`, `rustfmt_exe_path`, and
 ///      `rustfmt_config_path`
 ///    * function passes ownership of the returned value to the caller
 #[no_mangle]
 pub unsafe extern "C" fn GenerateBindingsImpl(
-    json: FfiU8Slice,
+    ir: FfiU8Slice,
     crubit_support_path: FfiU8Slice,
     clang_format_exe_path: FfiU8Slice,
     rustfmt_exe_path: FfiU8Slice,
     rustfmt_config_path: FfiU8Slice,
     generate_error_report: bool,
     generate_source_loc_doc_comment: SourceLocationDocComment,
+    codegen_threads: usize,
+    rust_formatting: RustFormatting,
+    trace_phase: TracePhaseCallback,
 ) -> FfiBindings {
-    let json: &[u8] = json.as_slice();
+    let ir: &[u8] = ir.as_slice();
     let crubit_support_path: &str = std::str::from_utf8(crubit_support_path.as_slice()).unwrap();
     let clang_format_exe_path: OsString =
         std::str::from_utf8(clang_format_exe_path.as_slice()).unwrap().into();
@@ -80,13 +93,16 @@ pub unsafe extern "C" fn GenerateBindingsImpl(
         let errors: Rc<dyn ErrorReporting> =
             if generate_error_report { Rc::new(ErrorReport::new()) } else { Rc::new(IgnoreErrors) };
         let Bindings { rs_api, rs_api_impl } = generate_bindings(
-            json,
+            ir,
             crubit_support_path,
             &clang_format_exe_path,
             &rustfmt_exe_path,
             &rustfmt_config_path,
             errors.clone(),
             generate_source_loc_doc_comment,
+            codegen_threads,
+            rust_formatting,
+            trace_phase,
         )
         .unwrap();
         FfiBindings {
@@ -115,6 +131,9 @@ trait BindingsGenerator {
 
     fn generate_func(&self, func: Rc<Func>) -> Result<Option<(Rc<GeneratedItem>, Rc<FunctionId>)>>;
 
+    /// Functions having overloads that we can't import (yet).  Set by
+    /// `generate_bindings_tokens` before any item is generated.
+    #[salsa::input]
     fn overloaded_funcs(&self) -> Rc<HashSet<Rc<FunctionId>>>;
 
     fn is_record_clonable(&self, record: Rc<Record>) -> bool;
@@ -142,6 +161,38 @@ struct Bindings {
     rs_api_impl: String,
 }
 
+/// FFI callback that begins (if `begin` is true) or ends a phase of the time
+/// trace requested with `--time_trace_out`. The phases of a thread are nested,
+/// and `name` is only borrowed for the duration of the call. `None` if no trace
+/// is being recorded.
+pub type TracePhaseCallback = Option<unsafe extern "C" fn(name: FfiU8Slice, begin: bool)>;
+
+/// Records a phase of `generate_bindings` in the time trace, until it is
+/// dropped.
+struct TracePhase {
+    trace_phase: TracePhaseCallback,
+}
+
+impl TracePhase {
+    fn new(trace_phase: TracePhaseCallback, name: &str) -> Self {
+        if let Some(trace_phase) = trace_phase {
+            // SAFETY: The caller of `GenerateBindingsImpl` guarantees that the
+            // callback can be called, and `name` outlives the call.
+            unsafe { trace_phase(FfiU8Slice::from_slice(name.as_bytes()), true) };
+        }
+        TracePhase { trace_phase }
+    }
+}
+
+impl Drop for TracePhase {
+    fn drop(&mut self) {
+        if let Some(trace_phase) = self.trace_phase {
+            // SAFETY: See `TracePhase::new`.
+            unsafe { trace_phase(FfiU8Slice::from_slice(&[]), false) };
+        }
+    }
+}
+
 /// Source code for generated bindings, as tokens.
 struct BindingsTokens {
     // Rust source code.
@@ -151,33 +202,68 @@ struct BindingsTokens {
 }
 
 fn generate_bindings(
-    json: &[u8],
+    ir: &[u8],
     crubit_support_path: &str,
     clang_format_exe_path: &OsStr,
     rustfmt_exe_path: &OsStr,
     rustfmt_config_path: &OsStr,
     errors: Rc<dyn ErrorReporting>,
     generate_source_loc_doc_comment: SourceLocationDocComment,
+    codegen_threads: usize,
+    rust_formatting: RustFormatting,
+    trace_phase: TracePhaseCallback,
 ) -> Result<Bindings> {
-    let ir = Rc::new(deserialize_ir(json)?);
+    let ir_bytes = ir;
+    let ir = {
+        let _phase = TracePhase::new(trace_phase, "DeserializeIr");
+        Rc::new(deserialize_ir_binary(ir_bytes)?)
+    };
 
-    let BindingsTokens { rs_api, rs_api_impl } = generate_bindings_tokens(
-        ir.clone(),
-        crubit_support_path,
-        errors,
-        generate_source_loc_doc_comment,
-    )?;
-    let rs_api = {
-        let rustfmt_exe_path = Path::new(rustfmt_exe_path);
-        let rustfmt_config_path = if rustfmt_config_path.is_empty() {
-            None
-        } else {
-            Some(Path::new(rustfmt_config_path))
-        };
-        let rustfmt_config = RustfmtConfig::new(rustfmt_exe_path, rustfmt_config_path);
-        rs_tokens_to_formatted_string(rs_api, &rustfmt_config)?
+    let generate_tokens_phase = TracePhase::new(trace_phase, "GenerateBindingsTokens");
+    let BindingsTokens { rs_api, rs_api_impl } = if codegen_threads > 1 {
+        generate_bindings_tokens_in_parallel(
+            ir.clone(),
+            &|| deserialize_ir_binary(ir_bytes),
+            crubit_support_path,
+            errors,
+            generate_source_loc_doc_comment,
+            codegen_threads,
+        )?
+    } else {
+        generate_bindings_tokens(
+            ir.clone(),
+            crubit_support_path,
+            errors,
+            generate_source_loc_doc_comment,
+        )?
+    };
+    drop(generate_tokens_phase);
+
+    let format_rs_phase = TracePhase::new(trace_phase, "FormatRsSource");
+    let rs_api = match rust_formatting {
+        RustFormatting::Rustfmt => {
+            let rustfmt_exe_path = Path::new(rustfmt_exe_path);
+            let rustfmt_config_path = if rustfmt_config_path.is_empty() {
+                None
+            } else {
+                Some(Path::new(rustfmt_config_path))
+            };
+            let rustfmt_config = RustfmtConfig::new(rustfmt_exe_path, rustfmt_config_path);
+            rs_tokens_to_formatted_string(rs_api, &rustfmt_config)?
+        }
+        RustFormatting::BuiltinLayout => rs_tokens_to_laid_out_string(rs_api)?,
+    };
+    drop(format_rs_phase);
+
+    let rs_api_impl = if clang_format_exe_path.is_empty() {
+        // Formatted in-process by the C++ caller.
+        let mut unformatted = String::new();
+        write_unformatted_tokens(&mut unformatted, rs_api_impl)?;
+        unformatted
+    } else {
+        let _phase = TracePhase::new(trace_phase, "FormatCcSource");
+        cc_tokens_to_formatted_string(rs_api_impl, Path::new(clang_format_exe_path))?
     };
-    let rs_api_impl = cc_tokens_to_formatted_string(rs_api_impl, Path::new(clang_format_exe_path))?;
 
     // Add top-level comments that help identify where the generated bindings came
     // from.
@@ -2913,21 +2999,41 @@ fn crubit_features_for_item(item: &Item) -> flagset::FlagSet<ir::CrubitFeature>
     }
 }
 
-/// Identifies all functions having overloads that we can't import (yet).
+/// Returns the id of the Rust function generated for `func`, if any.
+fn generated_function_id(db: &Database, func: &Rc<Func>) -> Option<Rc<FunctionId>> {
+    match db.generate_func(func.clone()) {
+        Ok(Some((_, function_id))) => Some(function_id),
+        _ => None,
+    }
+}
+
+/// Identifies all functions having overloads that we can't import (yet), given
+/// the ids of all the generated functions.
 ///
 /// TODO(b/213280424): Implement support for overloaded functions.
-fn overloaded_funcs(db: &dyn BindingsGenerator) -> Rc<HashSet<Rc<FunctionId>>> {
+fn find_overloaded_funcs<T: Clone + Eq + Hash>(
+    function_ids: impl IntoIterator<Item = T>,
+) -> HashSet<T> {
     let mut seen_funcs = HashSet::new();
     let mut overloaded_funcs = HashSet::new();
-    for func in db.ir().functions() {
-        if let Ok(Some(f)) = db.generate_func(func.clone()) {
-            let (.., function_id) = &f;
-            if !seen_funcs.insert(function_id.clone()) {
-                overloaded_funcs.insert(function_id.clone());
-            }
+    for function_id in function_ids {
+        if !seen_funcs.insert(function_id.clone()) {
+            overloaded_funcs.insert(function_id);
         }
     }
-    Rc::new(overloaded_funcs)
+    overloaded_funcs
+}
+
+fn new_database(
+    ir: Rc<IR>,
+    generate_source_loc_doc_comment: SourceLocationDocComment,
+    errors: Rc<dyn ErrorReporting>,
+) -> Database {
+    let mut db = Database::default();
+    db.set_ir(ir);
+    db.set_generate_source_loc_doc_comment(generate_source_loc_doc_comment);
+    db.set_errors(errors);
+    db
 }
 
 // Returns the Rust code implementing bindings, plus any auxiliary C++ code
@@ -2938,14 +3044,298 @@ fn generate_bindings_tokens(
     errors: Rc<dyn ErrorReporting>,
     generate_source_loc_doc_comment: SourceLocationDocComment,
 ) -> Result<BindingsTokens> {
-    let mut db = Database::default();
-    db.set_ir(ir.clone());
-    db.set_generate_source_loc_doc_comment(generate_source_loc_doc_comment);
-    db.set_errors(errors);
+    let mut db = new_database(ir.clone(), generate_source_loc_doc_comment, errors);
+    let function_ids =
+        ir.functions().filter_map(|func| generated_function_id(&db, func)).collect_vec();
+    db.set_overloaded_funcs(Rc::new(find_overloaded_funcs(function_ids)));
+
+    let mut generated_items = vec![];
+    for top_level_item_id in ir.top_level_item_ids() {
+        let item =
+            ir.find_decl(*top_level_item_id).context("Failed to look up ir.top_level_item_ids")?;
+        generated_items.push(generate_item(&db, item)?);
+    }
+    bindings_tokens_from_generated_items(&mut db, crubit_support_path, generated_items)
+}
+
+/// Like `generate_bindings_tokens`, but generates the top-level items on up to
+/// `threads` threads.
+///
+/// `IR` and `Database` are built on `Rc`, and `TokenStream`s are `!Send`, so
+/// every thread loads its own copy of the IR with `load_ir`, and sends the
+/// items it generated back as strings.  Each thread first generates the
+/// functions nested in its share of the top-level items, so that overloaded
+/// functions can be identified across all the threads, and then generates its
+/// items.  The items are concatenated in the order of `ir.top_level_item_ids()`,
+/// so the output doesn't depend on the number of threads.
+fn generate_bindings_tokens_in_parallel(
+    ir: Rc<IR>,
+    load_ir: &(dyn Fn() -> Result<IR> + Sync),
+    crubit_support_path: &str,
+    errors: Rc<dyn ErrorReporting>,
+    generate_source_loc_doc_comment: SourceLocationDocComment,
+    threads: usize,
+) -> Result<BindingsTokens> {
+    let shares = split_top_level_items(&ir, threads);
+    if shares.len() <= 1 {
+        return generate_bindings_tokens(
+            ir,
+            crubit_support_path,
+            errors,
+            generate_source_loc_doc_comment,
+        );
+    }
+
+    let (function_ids_sender, function_ids_receiver) = mpsc::channel();
+    let results = thread::scope(|scope| {
+        let mut overloaded_funcs_senders = vec![];
+        let handles = shares
+            .iter()
+            .map(|share| {
+                let function_ids_sender = function_ids_sender.clone();
+                let (overloaded_funcs_sender, overloaded_funcs_receiver) = mpsc::channel();
+                overloaded_funcs_senders.push(overloaded_funcs_sender);
+                scope.spawn(move || {
+                    generate_share_of_items(
+                        load_ir,
+                        share,
+                        generate_source_loc_doc_comment,
+                        function_ids_sender,
+                        overloaded_funcs_receiver,
+                    )
+                })
+            })
+            .collect_vec();
+        drop(function_ids_sender);
+
+        // The receiver yields the function ids of all the threads (or of all the threads that
+        // didn't fail), in an arbitrary order, which doesn't matter for finding overloads.
+        let overloaded_funcs =
+            find_overloaded_funcs(function_ids_receiver.iter().flatten()).into_iter().collect_vec();
+        for sender in overloaded_funcs_senders {
+            // This only fails if the thread has already failed, which `join` reports below.
+            let _ = sender.send(overloaded_funcs.clone());
+        }
+        handles
+            .into_iter()
+            .map(|handle| handle.join().unwrap_or_else(|panic| std::panic::resume_unwind(panic)))
+            .collect_vec()
+    });
+
+    let mut generated_items = vec![];
+    for result in results {
+        let (items, share_errors) = result?;
+        for error in &share_errors {
+            errors.insert(error);
+        }
+        for item in items {
+            generated_items.push(item.into_generated_item()?);
+        }
+    }
+    let mut db = new_database(ir, generate_source_loc_doc_comment, errors);
+    bindings_tokens_from_generated_items(&mut db, crubit_support_path, generated_items)
+}
+
+/// The part of the work of `generate_bindings_tokens_in_parallel` done by one
+/// thread.
+struct ShareOfItems {
+    /// Indices into `ir.top_level_item_ids()`.
+    top_level_items: Range<usize>,
+    /// Indices into `ir.functions()` of the functions nested in these items.
+    functions: Vec<usize>,
+}
+
+/// Splits the top-level items into up to `threads` contiguous ranges with
+/// roughly the same number of (nested) items.
+fn split_top_level_items(ir: &IR, threads: usize) -> Vec<ShareOfItems> {
+    fn collect_nested_item_ids(ir: &IR, item_id: ItemId, item_ids: &mut Vec<ItemId>) {
+        item_ids.push(item_id);
+        let child_item_ids: &[ItemId] = match ir.find_decl::<Item>(item_id) {
+            Ok(Item::Namespace(namespace)) => &namespace.child_item_ids,
+            Ok(Item::Record(record)) => &record.child_item_ids,
+            _ => &[],
+        };
+        for child_item_id in child_item_ids {
+            collect_nested_item_ids(ir, *child_item_id, item_ids);
+        }
+    }
+
+    let nested_item_ids = ir
+        .top_level_item_ids()
+        .map(|item_id| {
+            let mut item_ids = vec![];
+            collect_nested_item_ids(ir, *item_id, &mut item_ids);
+            item_ids
+        })
+        .collect_vec();
+    let function_indices: HashMap<ItemId, usize> =
+        ir.functions().enumerate().map(|(index, func)| (func.id, index)).collect();
+    let total_items: usize = nested_item_ids.iter().map(Vec::len).sum();
+    let threads = threads.max(1);
+    let items_per_share = (total_items + threads - 1) / threads;
+
+    let mut shares = vec![];
+    let mut start = 0;
+    let mut items_in_share = 0;
+    let mut functions = vec![];
+    for (index, item_ids) in nested_item_ids.iter().enumerate() {
+        functions.extend(item_ids.iter().filter_map(|item_id| function_indices.get(item_id)));
+        items_in_share += item_ids.len();
+        if items_in_share >= items_per_share || index + 1 == nested_item_ids.len() {
+            shares.push(ShareOfItems {
+                top_level_items: start..index + 1,
+                functions: std::mem::take(&mut functions),
+            });
+            start = index + 1;
+            items_in_share = 0;
+        }
+    }
+
+    // Functions that aren't nested in any top-level item are still needed to find overloads.
+    if !shares.is_empty() {
+        let assigned: HashSet<usize> =
+            shares.iter().flat_map(|share| share.functions.iter().copied()).collect();
+        let share_count = shares.len();
+        for index in (0..function_indices.len()).filter(|index| !assigned.contains(index)) {
+            shares[index % share_count].functions.push(index);
+        }
+    }
+    shares
+}
+
+/// Generates the items of `share` on the current thread.  Returns the generated
+/// items and the errors reported while generating them.
+fn generate_share_of_items(
+    load_ir: &(dyn Fn() -> Result<IR> + Sync),
+    share: &ShareOfItems,
+    generate_source_loc_doc_comment: SourceLocationDocComment,
+    function_ids_sender: mpsc::Sender<Vec<FunctionIdSource>>,
+    overloaded_funcs_receiver: mpsc::Receiver<Vec<FunctionIdSource>>,
+) -> Result<(Vec<GeneratedItemSource>, Vec<Error>)> {
+    let ir = Rc::new(load_ir()?);
+    let errors = Rc::new(CollectErrors::default());
+    let mut db = new_database(ir.clone(), generate_source_loc_doc_comment, errors.clone());
+
+    let functions = ir.functions().collect_vec();
+    let function_ids = share
+        .functions
+        .iter()
+        .filter_map(|index| generated_function_id(&db, functions[*index]))
+        .map(|function_id| FunctionIdSource::new(&function_id))
+        .collect_vec();
+    // This only fails if the receiving thread has already failed.
+    let _ = function_ids_sender.send(function_ids);
+    drop(function_ids_sender);
+
+    let overloaded_funcs = overloaded_funcs_receiver
+        .recv()
+        .map_err(|_| anyhow!("Failed to receive the overloaded functions"))?;
+    let overloaded_funcs = overloaded_funcs
+        .iter()
+        .map(|function_id| Ok(Rc::new(function_id.to_function_id()?)))
+        .collect::<Result<HashSet<_>>>()?;
+    db.set_overloaded_funcs(Rc::new(overloaded_funcs));
+
+    let mut generated_items = vec![];
+    for top_level_item_id in
+        ir.top_level_item_ids().skip(share.top_level_items.start).take(share.top_level_items.len())
+    {
+        let item =
+            ir.find_decl(*top_level_item_id).context("Failed to look up ir.top_level_item_ids")?;
+        generated_items.push(GeneratedItemSource::new(&generate_item(&db, item)?));
+    }
+    drop(db);
+    Ok((generated_items, errors.errors.take()))
+}
+
+/// A `FunctionId` that can be sent to another thread.
+#[derive(Clone, PartialEq, Eq, Hash)]
+struct FunctionIdSource {
+    self_type: Option<String>,
+    function_path: String,
+}
+
+impl FunctionIdSource {
+    fn new(function_id: &FunctionId) -> Self {
+        FunctionIdSource {
+            self_type: function_id
+                .self_type
+                .as_ref()
+                .map(|path| path.to_token_stream().to_string()),
+            function_path: function_id.function_path.to_token_stream().to_string(),
+        }
+    }
+
+    fn to_function_id(&self) -> Result<FunctionId> {
+        Ok(FunctionId {
+            self_type: self.self_type.as_deref().map(syn::parse_str).transpose()?,
+            function_path: syn::parse_str(&self.function_path)?,
+        })
+    }
+}
+
+/// A `GeneratedItem` that can be sent to another thread.
+struct GeneratedItemSource {
+    item: String,
+    thunks: String,
+    thunk_impls: String,
+    assertions: String,
+    features: Vec<String>,
+}
+
+impl GeneratedItemSource {
+    fn new(generated: &GeneratedItem) -> Self {
+        GeneratedItemSource {
+            item: generated.item.to_string(),
+            thunks: generated.thunks.to_string(),
+            thunk_impls: generated.thunk_impls.to_string(),
+            assertions: generated.assertions.to_string(),
+            features: generated.features.iter().map(Ident::to_string).collect(),
+        }
+    }
+
+    fn into_generated_item(self) -> Result<GeneratedItem> {
+        let parse = |source: &str| -> Result<TokenStream> {
+            source.parse().map_err(|err| anyhow!("Failed to parse generated tokens: {err}"))
+        };
+        Ok(GeneratedItem {
+            item: parse(&self.item)?,
+            thunks: parse(&self.thunks)?,
+            thunk_impls: parse(&self.thunk_impls)?,
+            assertions: parse(&self.assertions)?,
+            features: self.features.iter().map(|feature| make_rs_ident(feature)).collect(),
+        })
+    }
+}
+
+/// An [`ErrorReporting`] that keeps the errors, so that they can be sent to the
+/// thread that owns the actual error report.
+#[derive(Debug, Default)]
+struct CollectErrors {
+    errors: RefCell<Vec<Error>>,
+}
+
+impl ErrorReporting for CollectErrors {
+    fn insert(&self, error: &Error) {
+        self.errors.borrow_mut().push(error.clone());
+    }
+
+    fn serialize_to_vec(&self) -> anyhow::Result<Vec<u8>> {
+        unreachable!("CollectErrors is never serialized")
+    }
+}
+
+/// Assembles the output of `generate_bindings_tokens` from the generated
+/// top-level items, in order.
+fn bindings_tokens_from_generated_items(
+    db: &mut Database,
+    crubit_support_path: &str,
+    generated_items: Vec<GeneratedItem>,
+) -> Result<BindingsTokens> {
     let mut items = vec![];
     let mut thunks = vec![];
     let mut thunk_impls = vec![
-        generate_rs_api_impl_includes(&mut db, crubit_support_path)?,
+        generate_rs_api_impl_includes(db, crubit_support_path)?,
         quote! {
             __HASH_TOKEN__ pragma clang diagnostic push __NEWLINE__
             // Disable Clang thread-safety-analysis warnings that would otherwise
@@ -2969,10 +3359,7 @@ fn generate_bindings_tokens(
     // For #![rustfmt::skip].
     features.insert(make_rs_ident("custom_inner_attributes"));
 
-    for top_level_item_id in ir.top_level_item_ids() {
-        let item =
-            ir.find_decl(*top_level_item_id).context("Failed to look up ir.top_level_item_ids")?;
-        let generated = generate_item(&db, item)?;
+    for generated in generated_items {
         items.push(generated.item);
         if !generated.thunks.is_empty() {
             thunks.push(generated.thunks);
@@ -4322,6 +4709,41 @@ mod tests {
         Ok(db)
     }
 
+    #[test]
+    fn test_generate_bindings_tokens_in_parallel() -> Result<()> {
+        const CC_SRC: &str = r#"
+            struct SomeStruct final {
+                int field;
+                void Method();
+            };
+            void Overloaded(int x);
+            void Overloaded(SomeStruct* s);
+            namespace some_namespace {
+                inline void InNamespace(SomeStruct& s) {}
+                struct OtherStruct final {};
+            }
+            enum Enum { kA, kB };
+            inline int Last() { return 0; }
+        "#;
+        let sequential = generate_bindings_tokens(ir_from_cc(CC_SRC)?)?;
+        // Only one thread at a time runs Clang.
+        let lock = std::sync::Mutex::new(());
+        let parallel = super::generate_bindings_tokens_in_parallel(
+            Rc::new(ir_from_cc(CC_SRC)?),
+            &|| {
+                let _guard = lock.lock().unwrap();
+                ir_from_cc(CC_SRC)
+            },
+            "crubit/rs_bindings_support",
+            Rc::new(IgnoreErrors),
+            SourceLocationDocComment::Enabled,
+            /* threads= */ 3,
+        )?;
+        assert_eq!(parallel.rs_api.to_string(), sequential.rs_api.to_string());
+        assert_eq!(parallel.rs_api_impl.to_string(), sequential.rs_api_impl.to_string());
+        Ok(())
+    }
+
     #[test]
     fn test_disable_thread_safety_warnings() -> Result<()> {
         let ir = ir_from_cc("inline void foo() {}")?;
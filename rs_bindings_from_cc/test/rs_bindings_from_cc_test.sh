@@ -39,15 +39,6 @@ function test::cmd_line_api() {
       grep 'please specify --crubit_support_path' > /dev/null" \
     "generator should show help message for --crubit_support_path"
 
-  EXPECT_SUCCEED \
-    "\"${RS_BINDINGS_FROM_CC}\" \
-      --target=//:target \
-      --rs_out=\"${rs_out}\" \
-      --cc_out=\"${cc_out}\" 2>&1 \
-      --crubit_support_path=test/crubit/support/path | \
-      grep 'please specify --clang_format_exe_path' > /dev/null" \
-    "generator should show help message for --clang_format_exe_path"
-
   EXPECT_SUCCEED \
     "\"${RS_BINDINGS_FROM_CC}\" \
       --target=//:target \
@@ -103,6 +94,23 @@ EOT
 
   EXPECT_FILE_NOT_EMPTY "${rs_out}"
   EXPECT_FILE_NOT_EMPTY "${cc_out}"
+
+  # Without --clang_format_exe_path, `cc_out` is formatted in-process.
+  local in_process_cc_out="${TEST_TMPDIR}/rs_api_impl_in_process.cc"
+  EXPECT_SUCCEED \
+    "\"${RS_BINDINGS_FROM_CC}\" \
+      --target=//:target \
+      --rs_out=\"${rs_out}\" \
+      --cc_out=\"${in_process_cc_out}\" \
+      --crubit_support_path=test/crubit/support/path \
+      --rustfmt_exe_path=\"${DEFAULT_RUSTFMT_EXE_PATH}\" \
+      --public_headers=\"${hdr}\" \
+      --target_args=\"$(echo "${json}" | quote_escape)\"" \
+    "generator should not require --clang_format_exe_path"
+  EXPECT_FILE_NOT_EMPTY "${in_process_cc_out}"
+  EXPECT_SUCCEED \
+    "grep 'hello_world.h' \"${in_process_cc_out}\" > /dev/null" \
+    "cc_out should include the public header"
 }
 
 function test::do_nothing() {
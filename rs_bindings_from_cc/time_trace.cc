@@ -0,0 +1,200 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#include "rs_bindings_from_cc/time_trace.h"
+
+#include <sys/resource.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "common/file_io.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace crubit {
+
+namespace {
+
+// Events shorter than this are not recorded by LLVM's profiler.
+constexpr unsigned kTimeTraceGranularityUs = 500;
+
+struct PhaseEvent {
+  std::string name;
+  uint64_t thread_id;
+  std::chrono::microseconds start;
+  std::chrono::microseconds duration;
+  std::chrono::microseconds cpu_time;
+  int64_t peak_rss_kb;
+  std::vector<std::pair<std::string, int64_t>> counts;
+};
+
+struct TimeTrace {
+  std::mutex mutex;
+  // Guarded by `mutex`.
+  std::chrono::steady_clock::time_point start;
+  std::vector<PhaseEvent> events;
+};
+
+std::atomic<bool> time_trace_enabled = false;
+
+TimeTrace& GetTimeTrace() {
+  static TimeTrace* time_trace = new TimeTrace();
+  return *time_trace;
+}
+
+std::chrono::microseconds ProcessCpuTime() {
+  llvm::sys::TimePoint<> elapsed;
+  std::chrono::nanoseconds user_time;
+  std::chrono::nanoseconds system_time;
+  llvm::sys::Process::GetTimeUsage(elapsed, user_time, system_time);
+  return std::chrono::duration_cast<std::chrono::microseconds>(user_time +
+                                                               system_time);
+}
+
+llvm::json::Value PhaseEventToJson(const PhaseEvent& event, int64_t pid) {
+  llvm::json::Object args{
+      {"cpu_ms", static_cast<double>(event.cpu_time.count()) / 1000},
+      {"peak_rss_kb", event.peak_rss_kb},
+  };
+  for (const auto& count : event.counts) {
+    args[count.first] = count.second;
+  }
+  return llvm::json::Object{
+      {"name", event.name},
+      {"cat", "rs_bindings_from_cc"},
+      {"ph", "X"},
+      {"pid", pid},
+      {"tid", static_cast<int64_t>(event.thread_id)},
+      {"ts", static_cast<int64_t>(event.start.count())},
+      {"dur", static_cast<int64_t>(event.duration.count())},
+      {"args", std::move(args)},
+  };
+}
+
+// Returns a counter event, which Chrome trace viewers plot as a graph of the
+// peak RSS over time.
+llvm::json::Value PeakRssToJson(const PhaseEvent& event, int64_t pid) {
+  return llvm::json::Object{
+      {"name", "Peak RSS"},
+      {"ph", "C"},
+      {"pid", pid},
+      {"ts", static_cast<int64_t>((event.start + event.duration).count())},
+      {"args", llvm::json::Object{{"kb", event.peak_rss_kb}}},
+  };
+}
+
+}  // namespace
+
+int64_t PeakRssKb() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+  // On Linux, `ru_maxrss` is in kilobytes.
+  return usage.ru_maxrss;
+}
+
+void StartTimeTrace() {
+  llvm::timeTraceProfilerInitialize(kTimeTraceGranularityUs,
+                                    "rs_bindings_from_cc");
+  TimeTrace& time_trace = GetTimeTrace();
+  std::lock_guard<std::mutex> lock(time_trace.mutex);
+  time_trace.start = std::chrono::steady_clock::now();
+  time_trace.events.clear();
+  time_trace_enabled = true;
+}
+
+bool TimeTraceEnabled() { return time_trace_enabled; }
+
+absl::Status FinishTimeTrace(absl::string_view path) {
+  time_trace_enabled = false;
+  llvm::SmallString<0> llvm_trace;
+  llvm::raw_svector_ostream llvm_trace_stream(llvm_trace);
+  llvm::timeTraceProfilerWrite(llvm_trace_stream);
+  llvm::timeTraceProfilerCleanup();
+
+  llvm::Expected<llvm::json::Value> trace = llvm::json::parse(llvm_trace);
+  if (!trace) {
+    return absl::InternalError(absl::StrCat("Failed to parse the time trace: ",
+                                            llvm::toString(trace.takeError())));
+  }
+  llvm::json::Object* trace_object = trace->getAsObject();
+  llvm::json::Array* trace_events =
+      trace_object ? trace_object->getArray("traceEvents") : nullptr;
+  if (trace_events == nullptr) {
+    return absl::InternalError("The time trace has no traceEvents");
+  }
+  int64_t pid = 0;
+  for (const llvm::json::Value& trace_event : *trace_events) {
+    if (const llvm::json::Object* object = trace_event.getAsObject()) {
+      pid = object->getInteger("pid").value_or(0);
+      break;
+    }
+  }
+
+  TimeTrace& time_trace = GetTimeTrace();
+  std::lock_guard<std::mutex> lock(time_trace.mutex);
+  for (const PhaseEvent& event : time_trace.events) {
+    trace_events->push_back(PhaseEventToJson(event, pid));
+    trace_events->push_back(PeakRssToJson(event, pid));
+  }
+  time_trace.events.clear();
+  return SetFileContents(path, std::string(llvm::formatv("{0}", *trace)));
+}
+
+TracePhase::TracePhase(absl::string_view name)
+    : enabled_(TimeTraceEnabled()) {
+  if (!enabled_) {
+    return;
+  }
+  name_ = std::string(name);
+  start_ = std::chrono::steady_clock::now();
+  start_cpu_time_ = ProcessCpuTime();
+}
+
+TracePhase::~TracePhase() {
+  if (!enabled_ || !TimeTraceEnabled()) {
+    return;
+  }
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  PhaseEvent event{
+      .name = std::move(name_),
+      .thread_id = llvm::get_threadid(),
+      .duration =
+          std::chrono::duration_cast<std::chrono::microseconds>(end - start_),
+      .cpu_time = ProcessCpuTime() - start_cpu_time_,
+      .peak_rss_kb = PeakRssKb(),
+      .counts = std::move(counts_),
+  };
+  TimeTrace& time_trace = GetTimeTrace();
+  std::lock_guard<std::mutex> lock(time_trace.mutex);
+  event.start = std::chrono::duration_cast<std::chrono::microseconds>(
+      start_ - time_trace.start);
+  time_trace.events.push_back(std::move(event));
+}
+
+void TracePhase::AddCount(absl::string_view name, int64_t count) {
+  if (enabled_) {
+    counts_.emplace_back(std::string(name), count);
+  }
+}
+
+}  // namespace crubit
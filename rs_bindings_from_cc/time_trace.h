@@ -0,0 +1,67 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#ifndef CRUBIT_RS_BINDINGS_FROM_CC_TIME_TRACE_H_
+#define CRUBIT_RS_BINDINGS_FROM_CC_TIME_TRACE_H_
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+
+namespace crubit {
+
+// Returns the peak resident set size of the process so far, in KiB, or 0 if it
+// is unknown. It never goes down, so measuring the memory of a step only works
+// if the process hasn't used more memory before.
+int64_t PeakRssKb();
+
+// Starts recording a trace of the phases of the tool (see `TracePhase`).
+//
+// Clang runs in-process, on the thread that started the trace, so its own
+// `-ftime-trace` events (parsing, template instantiation, ...) are recorded
+// along with the phases, as are the `llvm::TimeTraceScope`s of the importers.
+void StartTimeTrace();
+
+// Returns true if a trace is being recorded.
+bool TimeTraceEnabled();
+
+// Stops recording the trace, and writes it to `path` in the Chrome trace event
+// format, like `clang -ftime-trace` does (it can be opened in Perfetto or
+// chrome://tracing).
+absl::Status FinishTimeTrace(absl::string_view path);
+
+// Records the wall time, the CPU time and the peak RSS of the process during a
+// phase of the tool (from the construction to the destruction of the
+// `TracePhase`), as well as the number of items it handled. Does nothing if no
+// trace is being recorded.
+//
+// The CPU time is that of the whole process, so it includes the time of the
+// threads started by the phase.
+class TracePhase {
+ public:
+  explicit TracePhase(absl::string_view name);
+  ~TracePhase();
+
+  TracePhase(const TracePhase&) = delete;
+  TracePhase& operator=(const TracePhase&) = delete;
+
+  // Records that the phase handled `count` items of the given kind.
+  void AddCount(absl::string_view name, int64_t count);
+
+ private:
+  bool enabled_;
+  std::string name_;
+  std::chrono::steady_clock::time_point start_;
+  std::chrono::microseconds start_cpu_time_;
+  std::vector<std::pair<std::string, int64_t>> counts_;
+};
+
+}  // namespace crubit
+
+#endif  // CRUBIT_RS_BINDINGS_FROM_CC_TIME_TRACE_H_
@@ -0,0 +1,81 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#include "rs_bindings_from_cc/time_trace.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "absl/strings/str_cat.h"
+#include "common/file_io.h"
+#include "common/status_test_matchers.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/TimeProfiler.h"
+
+namespace crubit {
+namespace {
+
+// Returns the first event named `name` in the trace, or nullptr.
+const llvm::json::Object* FindEvent(const llvm::json::Value& trace,
+                                    llvm::StringRef name) {
+  for (const llvm::json::Value& event :
+       *trace.getAsObject()->getArray("traceEvents")) {
+    const llvm::json::Object* object = event.getAsObject();
+    if (object->getString("name") == name) {
+      return object;
+    }
+  }
+  return nullptr;
+}
+
+TEST(TimeTraceTest, PhasesAreNotRecordedByDefault) {
+  EXPECT_FALSE(TimeTraceEnabled());
+  TracePhase phase("Phase");
+  phase.AddCount("items", 1);
+}
+
+TEST(TimeTraceTest, RecordsPhases) {
+  std::string path = absl::StrCat(testing::TempDir(), "/trace.json");
+  StartTimeTrace();
+  EXPECT_TRUE(TimeTraceEnabled());
+  {
+    TracePhase outer("Outer");
+    outer.AddCount("items", 12);
+    {
+      TracePhase inner("Inner");
+      // An event of LLVM's profiler, like those of Clang. It is too short to
+      // be recorded on its own, but it is part of the totals.
+      llvm::timeTraceProfilerBegin("LlvmEvent", "");
+      llvm::timeTraceProfilerEnd();
+    }
+  }
+  ASSERT_OK(FinishTimeTrace(path));
+  EXPECT_FALSE(TimeTraceEnabled());
+
+  ASSERT_OK_AND_ASSIGN(std::string contents, GetFileContents(path));
+  llvm::Expected<llvm::json::Value> trace = llvm::json::parse(contents);
+  ASSERT_TRUE(static_cast<bool>(trace)) << llvm::toString(trace.takeError());
+
+  const llvm::json::Object* outer = FindEvent(*trace, "Outer");
+  ASSERT_NE(outer, nullptr);
+  EXPECT_EQ(outer->getString("ph"), "X");
+  const llvm::json::Object* args = outer->getObject("args");
+  ASSERT_NE(args, nullptr);
+  EXPECT_EQ(args->getInteger("items"), 12);
+  EXPECT_TRUE(args->getNumber("cpu_ms").has_value());
+  EXPECT_GT(args->getInteger("peak_rss_kb").value_or(0), 0);
+
+  const llvm::json::Object* inner = FindEvent(*trace, "Inner");
+  ASSERT_NE(inner, nullptr);
+  EXPECT_GE(*inner->getInteger("ts"), *outer->getInteger("ts"));
+  EXPECT_LE(*inner->getInteger("dur"), *outer->getInteger("dur"));
+
+  EXPECT_NE(FindEvent(*trace, "Peak RSS"), nullptr);
+  EXPECT_NE(FindEvent(*trace, "Total LlvmEvent"), nullptr);
+}
+
+}  // namespace
+}  // namespace crubit
@@ -0,0 +1,310 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#include "rs_bindings_from_cc/worker.h"
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/flags/commandlineflag.h"
+#include "absl/flags/reflection.h"
+#include "absl/functional/function_ref.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+#include "absl/types/span.h"
+#include "common/status_macros.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/ErrorOr.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace crubit {
+
+std::string StatCachingFileSystem::CacheKey(const llvm::Twine& path) {
+  llvm::SmallString<256> key;
+  path.toVector(key);
+  // If the path can't be made absolute, it is still a fine key, as long as the
+  // working directory doesn't change.
+  (void)makeAbsolute(key);
+  llvm::sys::path::remove_dots(key, /*remove_dot_dot=*/false);
+  return std::string(key);
+}
+
+llvm::ErrorOr<llvm::vfs::Status> StatCachingFileSystem::status(
+    const llvm::Twine& path) {
+  std::string key = CacheKey(path);
+  auto it = statuses_.find(key);
+  const llvm::ErrorOr<llvm::vfs::Status>& status =
+      it != statuses_.end()
+          ? it->second
+          : Remember(key, ProxyFileSystem::status(key));
+  if (!status) {
+    return status.getError();
+  }
+  return llvm::vfs::Status::copyWithNewName(*status, path);
+}
+
+llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+StatCachingFileSystem::openFileForRead(const llvm::Twine& path) {
+  std::string key = CacheKey(path);
+  auto it = statuses_.find(key);
+  if (it != statuses_.end() && !it->second) {
+    return it->second.getError();
+  }
+  llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> file =
+      ProxyFileSystem::openFileForRead(path);
+  if (it == statuses_.end()) {
+    if (!file) {
+      Remember(std::move(key), file.getError());
+    } else if (llvm::ErrorOr<llvm::vfs::Status> status = (*file)->status()) {
+      Remember(std::move(key), *status);
+    }
+  }
+  return file;
+}
+
+void StatCachingFileSystem::Invalidate(const llvm::Twine& path) {
+  statuses_.erase(CacheKey(path));
+}
+
+void StatCachingFileSystem::ForgetMissingFiles() {
+  absl::erase_if(statuses_, [](const auto& entry) { return !entry.second; });
+}
+
+llvm::ErrorOr<llvm::vfs::Status>& StatCachingFileSystem::Remember(
+    std::string key, llvm::ErrorOr<llvm::vfs::Status> status) {
+  if (statuses_.size() >= max_entries_) {
+    statuses_.clear();
+  }
+  return statuses_.insert_or_assign(std::move(key), std::move(status))
+      .first->second;
+}
+
+absl::StatusOr<WorkRequest> ParseWorkRequest(absl::string_view json) {
+  llvm::Expected<llvm::json::Value> value =
+      llvm::json::parse(llvm::StringRef(json.data(), json.size()));
+  if (!value) {
+    return absl::InvalidArgumentError(llvm::toString(value.takeError()));
+  }
+  const llvm::json::Object* object = value->getAsObject();
+  if (object == nullptr) {
+    return absl::InvalidArgumentError("WorkRequest is not a JSON object");
+  }
+
+  WorkRequest request;
+  if (const llvm::json::Array* arguments = object->getArray("arguments")) {
+    for (const llvm::json::Value& argument : *arguments) {
+      auto argument_string = argument.getAsString();
+      if (!argument_string) {
+        return absl::InvalidArgumentError(
+            "WorkRequest arguments must be strings");
+      }
+      request.arguments.emplace_back(*argument_string);
+    }
+  }
+  if (const llvm::json::Array* inputs = object->getArray("inputs")) {
+    for (const llvm::json::Value& input : *inputs) {
+      const llvm::json::Object* input_object = input.getAsObject();
+      if (input_object == nullptr || !input_object->getString("path")) {
+        return absl::InvalidArgumentError(
+            "WorkRequest inputs must be objects with a path");
+      }
+      request.inputs.push_back(
+          {std::string(*input_object->getString("path")),
+           std::string(input_object->getString("digest").value_or(""))});
+    }
+  }
+  request.request_id = object->getInteger("requestId").value_or(0);
+  return request;
+}
+
+std::string WorkResponseToJson(int exit_code, absl::string_view output,
+                               int64_t request_id) {
+  llvm::StringRef output_ref(output.data(), output.size());
+  return llvm::formatv(
+      "{0}", llvm::json::Value(llvm::json::Object{
+                 {"exitCode", exit_code},
+                 {"output", llvm::json::isUTF8(output_ref)
+                                ? output_ref.str()
+                                : llvm::json::fixUTF8(output_ref)},
+                 {"requestId", request_id},
+             }));
+}
+
+absl::StatusOr<std::vector<char*>> ParseFlags(absl::Span<char* const> argv) {
+  std::vector<char*> positional_args;
+  if (argv.empty()) {
+    return positional_args;
+  }
+  positional_args.push_back(argv[0]);
+  for (size_t i = 1; i < argv.size(); ++i) {
+    absl::string_view arg = argv[i];
+    if (arg == "--") {
+      positional_args.insert(positional_args.end(), argv.begin() + i + 1,
+                             argv.end());
+      break;
+    }
+    if (arg.size() < 2 || arg[0] != '-') {
+      positional_args.push_back(argv[i]);
+      continue;
+    }
+    arg.remove_prefix(arg[1] == '-' ? 2 : 1);
+    absl::string_view name = arg;
+    std::optional<absl::string_view> value;
+    if (size_t equals = arg.find('='); equals != absl::string_view::npos) {
+      name = arg.substr(0, equals);
+      value = arg.substr(equals + 1);
+    }
+
+    absl::CommandLineFlag* flag = absl::FindCommandLineFlag(name);
+    // `--nofoo` sets the bool flag `foo` to false.
+    absl::string_view negated_name = name;
+    if (flag == nullptr && !value.has_value() &&
+        absl::ConsumePrefix(&negated_name, "no")) {
+      flag = absl::FindCommandLineFlag(negated_name);
+      if (flag != nullptr && flag->IsOfType<bool>()) {
+        name = negated_name;
+        value = "false";
+      } else {
+        flag = nullptr;
+      }
+    }
+    if (flag == nullptr) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Unknown command line flag '", name, "'"));
+    }
+    if (!value.has_value()) {
+      if (flag->IsOfType<bool>()) {
+        value = "true";
+      } else if (i + 1 < argv.size()) {
+        value = argv[++i];
+      } else {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Missing the value of flag '", name, "'"));
+      }
+    }
+    std::string error;
+    if (!flag->ParseFrom(*value, &error)) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Illegal value '", *value, "' specified for flag '",
+                       name, "': ", error));
+    }
+  }
+  return positional_args;
+}
+
+absl::Status CaptureOutput(absl::FunctionRef<absl::Status()> f,
+                           std::string& output) {
+  int capture_fd;
+  llvm::SmallString<128> capture_path;
+  if (std::error_code error = llvm::sys::fs::createTemporaryFile(
+          "rs_bindings_from_cc", "out", capture_fd, capture_path)) {
+    return absl::InternalError(error.message());
+  }
+  llvm::FileRemover remover(capture_path);
+
+  llvm::outs().flush();
+  llvm::errs().flush();
+  std::fflush(stdout);
+  std::fflush(stderr);
+  int saved_stdout = dup(STDOUT_FILENO);
+  int saved_stderr = dup(STDERR_FILENO);
+  bool redirected = saved_stdout >= 0 && saved_stderr >= 0 &&
+                    dup2(capture_fd, STDOUT_FILENO) >= 0 &&
+                    dup2(capture_fd, STDERR_FILENO) >= 0;
+  close(capture_fd);
+  absl::Status status =
+      redirected ? f()
+                 : absl::InternalError(absl::StrCat(
+                       "Failed to redirect the output: ", std::strerror(errno)));
+
+  llvm::outs().flush();
+  llvm::errs().flush();
+  std::fflush(stdout);
+  std::fflush(stderr);
+  if (saved_stdout >= 0) {
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+  }
+  if (saved_stderr >= 0) {
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stderr);
+  }
+
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> captured =
+      llvm::MemoryBuffer::getFile(capture_path, /*IsText=*/true);
+  if (captured) {
+    output.append((*captured)->getBufferStart(), (*captured)->getBufferSize());
+  }
+  return status;
+}
+
+absl::Status RunPersistentWorker(
+    std::istream& requests, llvm::raw_ostream& responses,
+    StatCachingFileSystem& file_system,
+    absl::FunctionRef<absl::Status(const WorkRequest&, std::string& output)>
+        handle_request) {
+  // The digests of the inputs of the requests seen so far.
+  absl::flat_hash_map<std::string, std::string> input_digests;
+  std::string line;
+  while (std::getline(requests, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    CRUBIT_ASSIGN_OR_RETURN(WorkRequest request, ParseWorkRequest(line));
+    // Files that were missing may have been created since the previous
+    // request, e.g. in a new include directory.
+    file_system.ForgetMissingFiles();
+    for (const auto& [path, digest] : request.inputs) {
+      // An input seen for the first time may have been looked up (and found
+      // missing) before it was created.
+      auto [it, inserted] = input_digests.insert({path, digest});
+      if (inserted || it->second != digest) {
+        it->second = digest;
+        file_system.Invalidate(path);
+      }
+    }
+
+    std::string output;
+    absl::Status status = handle_request(request, output);
+    if (!status.ok()) {
+      if (!output.empty() && output.back() != '\n') {
+        output += "\n";
+      }
+      absl::StrAppend(&output, status.message());
+    }
+    responses << WorkResponseToJson(status.ok() ? 0 : 1, output,
+                                    request.request_id)
+              << "\n";
+    responses.flush();
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace crubit
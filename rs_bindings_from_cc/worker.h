@@ -0,0 +1,112 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#ifndef CRUBIT_RS_BINDINGS_FROM_CC_WORKER_H_
+#define CRUBIT_RS_BINDINGS_FROM_CC_WORKER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/functional/function_ref.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/ErrorOr.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace crubit {
+
+// A file system that remembers the result of looking up each path in the
+// underlying file system, including the lookups that failed. Header search
+// stats the same (mostly missing) paths under every include directory, for
+// every target, so a persistent worker answers most of them from memory.
+//
+// The contents of the files are not cached. At most `max_entries` lookups are
+// remembered: the cache is cleared when it is full. Not thread-safe.
+class StatCachingFileSystem : public llvm::vfs::ProxyFileSystem {
+ public:
+  explicit StatCachingFileSystem(
+      llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> file_system,
+      size_t max_entries = 1 << 20)
+      : ProxyFileSystem(std::move(file_system)), max_entries_(max_entries) {}
+
+  llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine& path) override;
+  llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> openFileForRead(
+      const llvm::Twine& path) override;
+
+  // Forgets what is known about `path`, e.g. because the file has changed.
+  void Invalidate(const llvm::Twine& path);
+
+  // Forgets the lookups that failed, as the files (or the directories they
+  // were looked up in) may have been created since.
+  void ForgetMissingFiles();
+
+ private:
+  // Returns the key under which the status of `path` is cached.
+  std::string CacheKey(const llvm::Twine& path);
+
+  // Remembers `status` as the result of looking up `key`, and returns where it
+  // is stored.
+  llvm::ErrorOr<llvm::vfs::Status>& Remember(
+      std::string key, llvm::ErrorOr<llvm::vfs::Status> status);
+
+  size_t max_entries_;
+
+  absl::flat_hash_map<std::string, llvm::ErrorOr<llvm::vfs::Status>> statuses_;
+};
+
+// A request of Bazel's persistent worker protocol, in its JSON form
+// (https://bazel.build/remote/persistent).
+struct WorkRequest {
+  std::vector<std::string> arguments;
+  // The paths and digests of the inputs of the action.
+  std::vector<std::pair<std::string, std::string>> inputs;
+  int64_t request_id = 0;
+};
+
+absl::StatusOr<WorkRequest> ParseWorkRequest(absl::string_view json);
+
+// Returns the JSON form of a `WorkResponse`.
+std::string WorkResponseToJson(int exit_code, absl::string_view output,
+                               int64_t request_id);
+
+// Parses the flags in `argv` like `absl::ParseCommandLine`, and returns the
+// positional arguments (with the name of the program first). Unlike
+// `absl::ParseCommandLine`, returns an error instead of exiting the process if a
+// flag is unknown or has an invalid value, so that a persistent worker can
+// fail a single request.
+absl::StatusOr<std::vector<char*>> ParseFlags(absl::Span<char* const> argv);
+
+// Calls `f` with the standard output and error of the process (where Clang
+// writes its diagnostics) redirected to `output`.
+absl::Status CaptureOutput(absl::FunctionRef<absl::Status()> f,
+                           std::string& output);
+
+// Reads `WorkRequest`s (one per line) from `requests` until it ends, and writes
+// a `WorkResponse` (one per line) to `responses` for each of them.
+//
+// Before each request is handled, the inputs whose digest changed since the
+// previous requests are invalidated in `file_system`, and so are all the
+// lookups that failed. The output of a request
+// is what `handle_request` writes to its `output`. The request fails if
+// `handle_request` returns an error, whose message is appended to the output.
+absl::Status RunPersistentWorker(
+    std::istream& requests, llvm::raw_ostream& responses,
+    StatCachingFileSystem& file_system,
+    absl::FunctionRef<absl::Status(const WorkRequest&, std::string& output)>
+        handle_request);
+
+}  // namespace crubit
+
+#endif  // CRUBIT_RS_BINDINGS_FROM_CC_WORKER_H_
@@ -0,0 +1,267 @@
+// Part of the Crubit project, under the Apache License v2.0 with LLVM
+// Exceptions. See /LICENSE for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#include "rs_bindings_from_cc/worker.h"
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/reflection.h"
+#include "absl/status/status.h"
+#include "common/status_test_matchers.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/ErrorOr.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+ABSL_FLAG(std::string, test_string_flag, "", "");
+ABSL_FLAG(bool, test_bool_flag, false, "");
+ABSL_FLAG(int, test_int_flag, 0, "");
+
+namespace crubit {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::HasSubstr;
+using ::testing::Pair;
+using ::testing::StrEq;
+
+// Counts the lookups that reach the underlying in-memory file system.
+class CountingFileSystem : public llvm::vfs::ProxyFileSystem {
+ public:
+  explicit CountingFileSystem(
+      llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> file_system)
+      : ProxyFileSystem(std::move(file_system)) {}
+
+  llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine& path) override {
+    ++lookups;
+    return ProxyFileSystem::status(path);
+  }
+
+  llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> openFileForRead(
+      const llvm::Twine& path) override {
+    ++lookups;
+    return ProxyFileSystem::openFileForRead(path);
+  }
+
+  int lookups = 0;
+};
+
+struct TestFileSystems {
+  TestFileSystems()
+      : in_memory(llvm::makeIntrusiveRefCnt<llvm::vfs::InMemoryFileSystem>()),
+        counting(llvm::makeIntrusiveRefCnt<CountingFileSystem>(in_memory)),
+        caching(llvm::makeIntrusiveRefCnt<StatCachingFileSystem>(counting)) {
+    in_memory->setCurrentWorkingDirectory("/");
+    in_memory->addFile("/dir/a.h", 0, llvm::MemoryBuffer::getMemBuffer("a"));
+  }
+
+  llvm::IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem> in_memory;
+  llvm::IntrusiveRefCntPtr<CountingFileSystem> counting;
+  llvm::IntrusiveRefCntPtr<StatCachingFileSystem> caching;
+};
+
+TEST(StatCachingFileSystemTest, CachesLookups) {
+  TestFileSystems fs;
+  ASSERT_TRUE(fs.caching->status("/dir/a.h"));
+  EXPECT_EQ(fs.counting->lookups, 1);
+
+  llvm::ErrorOr<llvm::vfs::Status> status = fs.caching->status("/dir/./a.h");
+  ASSERT_TRUE(status);
+  EXPECT_EQ(status->getName(), "/dir/./a.h");
+  EXPECT_EQ(status->getSize(), 1u);
+  EXPECT_EQ(fs.counting->lookups, 1);
+
+  EXPECT_FALSE(fs.caching->status("/dir/missing.h"));
+  EXPECT_FALSE(fs.caching->status("/dir/missing.h"));
+  EXPECT_FALSE(fs.caching->openFileForRead("/dir/missing.h"));
+  EXPECT_EQ(fs.counting->lookups, 2);
+}
+
+TEST(StatCachingFileSystemTest, OpenedFilesArePartOfTheCache) {
+  TestFileSystems fs;
+  ASSERT_TRUE(fs.caching->openFileForRead("/dir/a.h"));
+  ASSERT_TRUE(fs.caching->status("/dir/a.h"));
+  EXPECT_EQ(fs.counting->lookups, 1);
+
+  // The contents of the files are not cached.
+  ASSERT_TRUE(fs.caching->openFileForRead("/dir/a.h"));
+  EXPECT_EQ(fs.counting->lookups, 2);
+}
+
+TEST(StatCachingFileSystemTest, Invalidate) {
+  TestFileSystems fs;
+  EXPECT_FALSE(fs.caching->status("/dir/b.h"));
+  fs.in_memory->addFile("/dir/b.h", 0, llvm::MemoryBuffer::getMemBuffer("b"));
+  EXPECT_FALSE(fs.caching->status("/dir/b.h"));
+
+  fs.caching->Invalidate("/dir/b.h");
+  EXPECT_TRUE(fs.caching->status("/dir/b.h"));
+}
+
+TEST(StatCachingFileSystemTest, ForgetMissingFiles) {
+  TestFileSystems fs;
+  ASSERT_TRUE(fs.caching->status("/dir/a.h"));
+  EXPECT_FALSE(fs.caching->status("/dir/b.h"));
+  fs.in_memory->addFile("/dir/b.h", 0, llvm::MemoryBuffer::getMemBuffer("b"));
+  EXPECT_EQ(fs.counting->lookups, 2);
+
+  fs.caching->ForgetMissingFiles();
+  EXPECT_TRUE(fs.caching->status("/dir/b.h"));
+  // The files that were found are still cached.
+  EXPECT_TRUE(fs.caching->status("/dir/a.h"));
+  EXPECT_EQ(fs.counting->lookups, 3);
+}
+
+TEST(StatCachingFileSystemTest, ClearedWhenFull) {
+  TestFileSystems fs;
+  auto caching =
+      llvm::makeIntrusiveRefCnt<StatCachingFileSystem>(fs.counting, 2);
+  EXPECT_FALSE(caching->status("/dir/1.h"));
+  EXPECT_FALSE(caching->status("/dir/2.h"));
+  EXPECT_FALSE(caching->status("/dir/1.h"));
+  EXPECT_EQ(fs.counting->lookups, 2);
+
+  // The third entry doesn't fit, so the first two are forgotten.
+  EXPECT_FALSE(caching->status("/dir/3.h"));
+  EXPECT_FALSE(caching->status("/dir/1.h"));
+  EXPECT_EQ(fs.counting->lookups, 4);
+}
+
+TEST(WorkerTest, ParseWorkRequest) {
+  ASSERT_OK_AND_ASSIGN(
+      WorkRequest request,
+      ParseWorkRequest(R"({"arguments": ["--target=//:a", "-x"],)"
+                       R"( "inputs": [{"path": "a.h", "digest": "AAE="}],)"
+                       R"( "requestId": 12})"));
+  EXPECT_THAT(request.arguments, ElementsAre("--target=//:a", "-x"));
+  EXPECT_THAT(request.inputs, ElementsAre(Pair("a.h", "AAE=")));
+  EXPECT_EQ(request.request_id, 12);
+
+  // Fields with default values are omitted from the JSON.
+  ASSERT_OK_AND_ASSIGN(request, ParseWorkRequest("{}"));
+  EXPECT_EQ(request.request_id, 0);
+
+  EXPECT_THAT(ParseWorkRequest("[]"),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(ParseWorkRequest(R"({"arguments": [1]})"),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+TEST(WorkerTest, WorkResponseToJson) {
+  EXPECT_EQ(WorkResponseToJson(1, "error", 12),
+            R"({"exitCode":1,"output":"error","requestId":12})");
+}
+
+TEST(WorkerTest, RunPersistentWorker) {
+  TestFileSystems fs;
+  std::istringstream requests(
+      R"({"arguments": ["a"], "inputs": [{"path": "/dir/b.h", "digest": "1"}]})"
+      "\n"
+      R"({"arguments": ["b"], "inputs": [{"path": "/dir/b.h", "digest": "1"}],)"
+      R"( "requestId": 1})"
+      "\n"
+      R"({"arguments": ["c"], "inputs": [{"path": "/dir/b.h", "digest": "2"}],)"
+      R"( "requestId": 2})"
+      "\n");
+  std::string responses;
+  llvm::raw_string_ostream responses_stream(responses);
+  std::vector<bool> b_h_exists;
+
+  ASSERT_OK(RunPersistentWorker(
+      requests, responses_stream, *fs.caching,
+      [&](const WorkRequest& request, std::string& output) -> absl::Status {
+        b_h_exists.push_back(static_cast<bool>(fs.caching->status("/dir/b.h")));
+        EXPECT_TRUE(fs.caching->status("/dir/a.h"));
+        output = request.arguments[0];
+        if (request.arguments[0] == "a") {
+          fs.in_memory->addFile("/dir/b.h", 0,
+                                llvm::MemoryBuffer::getMemBuffer("b"));
+        }
+        if (request.arguments[0] == "b") {
+          return absl::InvalidArgumentError("failed");
+        }
+        return absl::OkStatus();
+      }));
+
+  // The failed lookup of `b.h` is forgotten before the next request. Then `b.h`
+  // is only looked up again once its digest changes, and `a.h` (which isn't an
+  // input) only once.
+  EXPECT_THAT(b_h_exists, ElementsAre(false, true, true));
+  EXPECT_EQ(fs.counting->lookups, 4);
+  EXPECT_EQ(responses,
+            "{\"exitCode\":0,\"output\":\"a\",\"requestId\":0}\n"
+            "{\"exitCode\":1,\"output\":\"b\\nfailed\",\"requestId\":1}\n"
+            "{\"exitCode\":0,\"output\":\"c\",\"requestId\":2}\n");
+}
+
+TEST(WorkerTest, ParseFlags) {
+  absl::FlagSaver flag_saver;
+  std::vector<std::string> arguments = {"tool",
+                                        "--test_string_flag=a",
+                                        "--notest_bool_flag",
+                                        "x.h",
+                                        "--test_int_flag",
+                                        "3",
+                                        "--",
+                                        "-I",
+                                        "--test_int_flag=4"};
+  std::vector<char*> argv;
+  for (std::string& argument : arguments) {
+    argv.push_back(argument.data());
+  }
+  absl::SetFlag(&FLAGS_test_bool_flag, true);
+
+  ASSERT_OK_AND_ASSIGN(std::vector<char*> positional_args, ParseFlags(argv));
+  EXPECT_THAT(positional_args,
+              ElementsAre(StrEq("tool"), StrEq("x.h"), StrEq("-I"),
+                          StrEq("--test_int_flag=4")));
+  EXPECT_EQ(absl::GetFlag(FLAGS_test_string_flag), "a");
+  EXPECT_FALSE(absl::GetFlag(FLAGS_test_bool_flag));
+  EXPECT_EQ(absl::GetFlag(FLAGS_test_int_flag), 3);
+}
+
+TEST(WorkerTest, ParseFlagsReturnsErrorsInsteadOfExiting) {
+  absl::FlagSaver flag_saver;
+  auto parse = [](std::vector<std::string> arguments) {
+    std::vector<char*> argv;
+    for (std::string& argument : arguments) {
+      argv.push_back(argument.data());
+    }
+    return ParseFlags(argv).status();
+  };
+  EXPECT_THAT(parse({"tool", "--no_such_flag"}),
+              StatusIs(absl::StatusCode::kInvalidArgument,
+                       HasSubstr("no_such_flag")));
+  EXPECT_THAT(parse({"tool", "--test_int_flag=x"}),
+              StatusIs(absl::StatusCode::kInvalidArgument,
+                       HasSubstr("test_int_flag")));
+  EXPECT_THAT(parse({"tool", "--test_int_flag"}),
+              StatusIs(absl::StatusCode::kInvalidArgument,
+                       HasSubstr("test_int_flag")));
+}
+
+TEST(WorkerTest, CaptureOutput) {
+  std::string output = "before\n";
+  EXPECT_THAT(CaptureOutput(
+                  [] {
+                    llvm::errs() << "warning: diagnostic\n";
+                    llvm::outs() << "printed\n";
+                    return absl::InvalidArgumentError("failed");
+                  },
+                  output),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_EQ(output, "before\nwarning: diagnostic\nprinted\n");
+}
+
+}  // namespace
+}  // namespace crubit
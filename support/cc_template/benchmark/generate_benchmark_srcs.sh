@@ -0,0 +1,58 @@
+#!/bin/bash
+# Part of the Crubit project, under the Apache License v2.0 with LLVM
+# Exceptions. See /LICENSE for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+# Usage: generate_benchmark_srcs.sh <number of instantiations> <output dir>
+#
+# Writes the sources of two crates using the same `<number of instantiations>`
+# structs: `with_cc_template.rs` names them through `cc_template!`, and
+# `without_cc_template.rs` names them directly. Both crates include the structs
+# from `__cc_template_instantiations_rs_api.rs`, and the `cc_template!` macro
+# reads their names from `__cc_template_instantiations.json`.
+
+set -euo pipefail
+
+readonly INSTANTIATIONS="$1"
+readonly OUT="$2"
+
+readonly HEADER="// Generated by generate_benchmark_srcs.sh. Do not edit."
+
+{
+  echo "${HEADER}"
+  for ((i = 0; i < INSTANTIATIONS; i++)); do
+    echo "pub struct __CcTemplateInst_benchmark_Template_Arg${i};"
+  done
+} > "${OUT}/__cc_template_instantiations_rs_api.rs"
+
+{
+  echo "{"
+  for ((i = 0; i < INSTANTIATIONS; i++)); do
+    separator=","
+    if ((i == INSTANTIATIONS - 1)); then
+      separator=""
+    fi
+    echo "  \"benchmark :: Template < Arg${i} >\":" \
+         "\"__CcTemplateInst_benchmark_Template_Arg${i}\"${separator}"
+  done
+  echo "}"
+} > "${OUT}/__cc_template_instantiations.json"
+
+for variant in with without; do
+  {
+    echo "${HEADER}"
+    echo "#[allow(non_camel_case_types)]"
+    echo "mod __cc_template_instantiations_rs_api;"
+    if [[ "${variant}" == "with" ]]; then
+      echo "use cc_template::cc_template;"
+    fi
+    for ((i = 0; i < INSTANTIATIONS; i++)); do
+      if [[ "${variant}" == "with" ]]; then
+        type="cc_template!(benchmark::Template<Arg${i}>)"
+      else
+        type="__cc_template_instantiations_rs_api::__CcTemplateInst_benchmark_Template_Arg${i}"
+      fi
+      echo "pub fn use_${i}(_: &${type}) {}"
+    done
+  } > "${OUT}/${variant}_cc_template.rs"
+done
@@ -2,17 +2,23 @@
 // Exceptions. See /LICENSE for license information.
 // SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
 
+use once_cell::sync::Lazy;
 use proc_macro2::{Span, TokenStream};
 use quote::quote;
 use std::collections::HashMap;
 use std::env;
-use std::fs::File;
-use std::io::BufReader;
+use std::fs;
+use std::sync::{Arc, Mutex};
+use std::time::SystemTime;
+
+/// Maps the (normalized) arguments of `cc_template!` to the names of the
+/// structs generated for the instantiations.
+type InstantiationsMap = HashMap<String, String>;
 
 pub fn to_private_struct_path(input: TokenStream) -> Result<TokenStream, syn::Error> {
     validate_user_input(&input)?;
     let instantiations = read_instantiations_map()?;
-    get_instantiation_struct_name(input, instantiations)
+    get_instantiation_struct_name(input, &instantiations)
 }
 
 fn validate_user_input(_input: &TokenStream) -> Result<(), syn::Error> {
@@ -21,21 +27,79 @@ fn validate_user_input(_input: &TokenStream) -> Result<(), syn::Error> {
     Ok(())
 }
 
-fn read_instantiations_map() -> Result<HashMap<String, String>, syn::Error> {
+/// The last instantiations map read by `read_instantiations_map`.
+struct LoadedInstantiationsMap {
+    path: String,
+    modified: SystemTime,
+    len: u64,
+    instantiations: Arc<InstantiationsMap>,
+}
+
+/// A proc macro is loaded once per rustc process, so this lets all the
+/// expansions of `cc_template!` in a crate share a single read of the file.
+static LOADED_INSTANTIATIONS_MAP: Lazy<Mutex<Option<LoadedInstantiationsMap>>> =
+    Lazy::new(Default::default);
+
+/// Returns the instantiations map from `CRUBIT_INSTANTIATIONS_FILE`. The file
+/// is only read again if its path, modification time or size changed since the
+/// previous call.
+fn read_instantiations_map() -> Result<Arc<InstantiationsMap>, syn::Error> {
     let path = env::var("CRUBIT_INSTANTIATIONS_FILE").map_err(|err| {
         make_syn_error(format!("Couldn't read 'CRUBIT_INSTANTIATIONS_FILE': {}.", err))
     })?;
-    let file = File::open(&path).map_err(|err| {
-        make_syn_error(format!("Couldn't read C++ instantiations from '{}': {}", path, err))
+    load_instantiations_map(path, &LOADED_INSTANTIATIONS_MAP)
+}
+
+/// Returns the instantiations map from the file at `path`, unless `loaded`
+/// already holds the map read from the same version of that file.
+fn load_instantiations_map(
+    path: String,
+    loaded: &Mutex<Option<LoadedInstantiationsMap>>,
+) -> Result<Arc<InstantiationsMap>, syn::Error> {
+    let read_error =
+        |err| make_syn_error(format!("Couldn't read C++ instantiations from '{}': {}", path, err));
+    let metadata = fs::metadata(&path).map_err(read_error)?;
+    let modified = metadata.modified().map_err(read_error)?;
+
+    let mut loaded = loaded.lock().unwrap();
+    if let Some(loaded) = &*loaded {
+        if loaded.path == path && loaded.modified == modified && loaded.len == metadata.len() {
+            return Ok(loaded.instantiations.clone());
+        }
+    }
+    let contents = fs::read(&path).map_err(read_error)?;
+    let instantiations: InstantiationsMap = serde_json::from_slice(&contents).map_err(|err| {
+        make_syn_error(format!("Couldn't deserialize JSON from {}: {}", path, err))
     })?;
-    let reader = BufReader::new(file);
-    serde_json::from_reader(reader)
-        .map_err(|err| make_syn_error(format!("Couldn't deserialize JSON from {}: {}", path, err)))
+    let instantiations: Arc<InstantiationsMap> = Arc::new(
+        instantiations
+            .into_iter()
+            .map(|(instantiation, struct_name)| {
+                (normalize_instantiation(instantiation), struct_name)
+            })
+            .collect(),
+    );
+    *loaded = Some(LoadedInstantiationsMap {
+        path,
+        modified,
+        len: metadata.len(),
+        instantiations: instantiations.clone(),
+    });
+    Ok(instantiations)
+}
+
+/// Returns `instantiation` printed the same way as the `TokenStream` passed to
+/// the macro, so that keys that only differ in whitespace still match.
+fn normalize_instantiation(instantiation: String) -> String {
+    match instantiation.parse::<TokenStream>() {
+        Ok(tokens) => tokens.to_string(),
+        Err(_) => instantiation,
+    }
 }
 
 fn get_instantiation_struct_name(
     input: TokenStream,
-    instantiations: HashMap<String, String>,
+    instantiations: &InstantiationsMap,
 ) -> Result<TokenStream, syn::Error> {
     // In theory `TokenStream` -> `instantiation_name` translation could go through
     // `token_stream_printer::tokens_to_string`.  This route is not used because:
@@ -75,14 +139,23 @@ mod tests {
     use maplit::hashmap;
     use std::path::Path;
 
-    fn get_error_from_read_instantiations_map(no_error_happened_msg: &str) -> String {
-        read_instantiations_map().expect_err(no_error_happened_msg).to_string()
+    // The tests load the map through their own cache, and pass the path
+    // directly, so that they don't share the process-wide
+    // `CRUBIT_INSTANTIATIONS_FILE` and `LOADED_INSTANTIATIONS_MAP` while they run
+    // in parallel.
+    fn load(path: impl AsRef<Path>) -> Result<Arc<InstantiationsMap>, syn::Error> {
+        load_instantiations_map(path.as_ref().to_str().unwrap().to_string(), &Default::default())
+    }
+
+    fn get_error_from_load(path: impl AsRef<Path>, no_error_happened_msg: &str) -> String {
+        load(path).expect_err(no_error_happened_msg).to_string()
     }
 
     #[test]
     fn test_env_var_not_set() {
+        // No test sets the env var.
         let err_message =
-            get_error_from_read_instantiations_map("The env var was unexpectedly set.");
+            read_instantiations_map().expect_err("The env var was unexpectedly set.").to_string();
 
         assert_eq!(
             err_message,
@@ -92,10 +165,8 @@ mod tests {
 
     #[test]
     fn test_instantiations_file_not_found() {
-        env::set_var("CRUBIT_INSTANTIATIONS_FILE", "path/does/not/exist");
-
         let err_message =
-            get_error_from_read_instantiations_map("The file was unexpectedly found.");
+            get_error_from_load("path/does/not/exist", "The file was unexpectedly found.");
 
         assert_eq!(
             err_message,
@@ -107,9 +178,9 @@ mod tests {
     fn test_instantiations_file_deserialization_error() {
         let path = Path::join(Path::new(&env::var("TEST_TMPDIR").unwrap()), "my_file.not_json");
         std::fs::write(&path, "definitely not json").unwrap();
-        env::set_var("CRUBIT_INSTANTIATIONS_FILE", &path);
 
-        let err_message = get_error_from_read_instantiations_map(
+        let err_message = get_error_from_load(
+            &path,
             "The file was unexpectedly deserialized successfully.",
         );
 
@@ -128,19 +199,41 @@ mod tests {
         let key = "std::string<bool>";
         let value = "__CcTemplateInst_std_string_bool";
         std::fs::write(&path, serde_json::to_string(&hashmap! {key => value}).unwrap()).unwrap();
-        env::set_var("CRUBIT_INSTANTIATIONS_FILE", &path);
 
-        let deserialized_map =
-            read_instantiations_map().expect("Expected successful deserialization.");
+        let deserialized_map = load(&path).expect("Expected successful deserialization.");
 
-        assert_eq!(deserialized_map, hashmap! { key.to_string() => value.to_string() });
+        assert_eq!(
+            *deserialized_map,
+            hashmap! { quote!{ std::string<bool> }.to_string() => value.to_string() }
+        );
+    }
+
+    #[test]
+    fn test_instantiations_map_is_read_once() {
+        let path = Path::join(Path::new(&env::var("TEST_TMPDIR").unwrap()), "read_once.json");
+        std::fs::write(&path, r#"{"std::vector<int>": "__CcTemplateInst_vector_int"}"#).unwrap();
+        let path = path.to_str().unwrap().to_string();
+        let loaded = Mutex::default();
+
+        let first = load_instantiations_map(path.clone(), &loaded).unwrap();
+        let second = load_instantiations_map(path.clone(), &loaded).unwrap();
+        assert!(Arc::ptr_eq(&first, &second));
+
+        std::fs::write(&path, r#"{"std::vector<bool>": "__CcTemplateInst_vector_bool"}"#).unwrap();
+        let third = load_instantiations_map(path, &loaded).unwrap();
+        assert_eq!(
+            *third,
+            hashmap! {
+                quote!{ std::vector<bool> }.to_string() => "__CcTemplateInst_vector_bool".to_string(),
+            }
+        );
     }
 
     #[test]
     fn test_successful_expansion() {
         let expanded = get_instantiation_struct_name(
-            quote!{ std::vector<bool> },
-            hashmap! {
+            quote! { std::vector<bool> },
+            &hashmap! {
                 quote!{ std::vector<bool> }.to_string() => "__std_vector__bool__".to_string(),
             },
         )